@@ -23,9 +23,11 @@
 #include <trace.h>
 #include <vm/fault.h>
 #include <vm/vm.h>
+#include <vm/vm_aspace.h>
 
 #include <lib/counters.h>
 #include <lib/crashlog.h>
+#include <lib/profiler.h>
 
 #include <zircon/syscalls/exception.h>
 #include <zircon/types.h>
@@ -33,6 +35,7 @@
 #define LOCAL_TRACE 0
 
 #define DFSC_ALIGNMENT_FAULT 0b100001
+#define FSC_ACCESS_FLAG_FAULT 0b001000 // levels 0-3 in the low two bits
 
 static void dump_iframe(const struct arm64_iframe_long* iframe) {
     printf("iframe %p:\n", iframe);
@@ -155,6 +158,16 @@ static void arm64_fpu_handler(struct arm64_iframe_long* iframe, uint exception_f
     arm64_fpu_exception(iframe, exception_flags);
 }
 
+// The access flag is only ever clear on pages whose accesses are being
+// sampled for reclaim, so an access flag fault is resolved by setting it.
+static bool arm64_handle_access_flag_fault(uint32_t iss, uint64_t far) {
+    if ((iss & 0b111100) != FSC_ACCESS_FLAG_FAULT) {
+        return false;
+    }
+    VmAspace* aspace = VmAspace::vaddr_to_aspace(far);
+    return aspace && aspace->arch_aspace().MarkAccessed(far) == ZX_OK;
+}
+
 static void arm64_instruction_abort_handler(struct arm64_iframe_long* iframe, uint exception_flags,
                                             uint32_t esr) {
     /* read the FAR register */
@@ -177,7 +190,10 @@ static void arm64_instruction_abort_handler(struct arm64_iframe_long* iframe, ui
     arch_enable_ints();
     kcounter_add(exceptions_page, 1);
     CPU_STATS_INC(page_faults);
-    zx_status_t err = vmm_page_fault_handler(far, pf_flags);
+    zx_status_t err = ZX_OK;
+    if (!arm64_handle_access_flag_fault(iss, far)) {
+        err = vmm_page_fault_handler(far, pf_flags);
+    }
     arch_disable_ints();
     if (err >= 0)
         return;
@@ -222,7 +238,10 @@ static void arm64_data_abort_handler(struct arm64_iframe_long* iframe, uint exce
     if (likely(dfsc != DFSC_ALIGNMENT_FAULT)) {
         arch_enable_ints();
         kcounter_add(exceptions_page, 1);
-        zx_status_t err = vmm_page_fault_handler(far, pf_flags);
+        zx_status_t err = ZX_OK;
+        if (!arm64_handle_access_flag_fault(iss, far)) {
+            err = vmm_page_fault_handler(far, pf_flags);
+        }
         arch_disable_ints();
         if (err >= 0) {
             return;
@@ -351,6 +370,10 @@ extern "C" uint32_t arm64_irq(struct arm64_iframe_short* iframe, uint exception_
 
     LTRACEF("iframe %p, flags 0x%x\n", iframe, exception_flags);
 
+    // record what was interrupted for the sampling profiler
+    profiler_set_irq_context(iframe->elr, iframe->fp,
+                             exception_flags & ARM64_EXCEPTION_FLAG_LOWER_EL);
+
     int_handler_saved_state_t state;
     int_handler_start(&state);
 
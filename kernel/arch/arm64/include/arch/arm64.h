@@ -78,8 +78,10 @@ struct arm64_iframe_long {
 
 struct arm64_iframe_short {
     uint64_t r[20];
-    // pad the short frame out so that it has the same general shape and size as a long
-    uint64_t pad[10];
+    // pad the short frame out so that it has the same general shape and size as a long;
+    // of x20 through x29 only the frame pointer is saved, for the sampling profiler
+    uint64_t pad[9];
+    uint64_t fp;
     uint64_t lr;
     uint64_t usp;
     uint64_t elr;
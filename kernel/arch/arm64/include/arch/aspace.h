@@ -34,6 +34,12 @@ public:
     zx_status_t Protect(vaddr_t vaddr, size_t count, uint mmu_flags) override;
 
     zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) override;
+    zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                                HarvestAccessedCallback callback, void* context) override;
+
+    // Set the access flag of the page mapping |vaddr|, after HarvestAccessed
+    // cleared it and an access took an access flag fault.
+    zx_status_t MarkAccessed(vaddr_t vaddr);
 
     vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags,
                      vaddr_t end, uint next_region_mmu_flags,
@@ -67,6 +73,9 @@ private:
                            uint index_shift, uint page_size_shift,
                            volatile pte_t* page_table) TA_REQ(lock_);
 
+    zx_status_t SplitBlock(vaddr_t vaddr, vaddr_t index, uint index_shift,
+                           uint page_size_shift, volatile pte_t* page_table) TA_REQ(lock_);
+
     int ProtectPageTable(vaddr_t vaddr_in, vaddr_t vaddr_rel_in, size_t size_in,
                          pte_t attrs, uint index_shift, uint page_size_shift,
                          volatile pte_t* page_table) TA_REQ(lock_);
@@ -87,6 +96,7 @@ private:
                              vaddr_t vaddr_base, uint top_size_shift,
                              uint top_index_shift, uint page_size_shift) TA_REQ(lock_);
     zx_status_t QueryLocked(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) TA_REQ(lock_);
+    volatile pte_t* GetTerminalPteLocked(vaddr_t vaddr, uint* block_shift) TA_REQ(lock_);
 
     void FlushTLBEntry(vaddr_t vaddr, bool terminal) TA_REQ(lock_);
 
@@ -20,6 +20,7 @@
 #include <fbl/auto_lock.h>
 #include <inttypes.h>
 #include <kernel/mutex.h>
+#include <lib/counters.h>
 #include <lib/heap.h>
 #include <lib/ktrace.h>
 #include <rand.h>
@@ -49,6 +50,8 @@
 #define LOCAL_KTRACE64(probe, x)
 #endif
 
+KCOUNTER(large_page_split, "kernel.mmu.large_page.split");
+
 static_assert(((long)KERNEL_BASE >> MMU_KERNEL_SIZE_SHIFT) == -1, "");
 static_assert(((long)KERNEL_ASPACE_BASE >> MMU_KERNEL_SIZE_SHIFT) == -1, "");
 static_assert(MMU_KERNEL_SIZE_SHIFT <= 48, "");
@@ -297,6 +300,118 @@ zx_status_t ArmArchVmAspace::Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flag
     return QueryLocked(vaddr, paddr, mmu_flags);
 }
 
+// Returns the page or block entry mapping |vaddr| in a user aspace, or nullptr
+// if nothing is mapped there. |block_shift| is set to log2 of the size of the
+// range the entry maps.
+volatile pte_t* ArmArchVmAspace::GetTerminalPteLocked(vaddr_t vaddr, uint* block_shift) {
+    DEBUG_ASSERT(!(flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST)));
+
+    uint index_shift = MMU_USER_TOP_SHIFT;
+    const uint page_size_shift = MMU_USER_PAGE_SIZE_SHIFT;
+    vaddr_t vaddr_rem = vaddr;
+    volatile pte_t* page_table = tt_virt_;
+
+    while (true) {
+        const ulong index = vaddr_rem >> index_shift;
+        vaddr_rem -= (vaddr_t)index << index_shift;
+        const pte_t pte = page_table[index];
+        const uint descriptor_type = pte & MMU_PTE_DESCRIPTOR_MASK;
+
+        if (descriptor_type == MMU_PTE_DESCRIPTOR_INVALID)
+            return nullptr;
+
+        if (descriptor_type == ((index_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK : MMU_PTE_L3_DESCRIPTOR_PAGE)) {
+            *block_shift = index_shift;
+            return &page_table[index];
+        }
+
+        if (index_shift <= page_size_shift ||
+            descriptor_type != MMU_PTE_L012_DESCRIPTOR_TABLE) {
+            PANIC_UNIMPLEMENTED;
+        }
+
+        page_table = static_cast<volatile pte_t*>(
+            paddr_to_physmap(pte & MMU_PTE_OUTPUT_ADDR_MASK));
+        index_shift -= page_size_shift - 3;
+    }
+}
+
+// Every mapping is created with the access flag set, so it is only clear on
+// pages harvested here, and the next access to one of them takes an access
+// flag fault that MarkAccessed resolves. Only user aspaces are harvested: the
+// kernel can access its own mappings where the fault couldn't take the aspace
+// lock, and guest accesses fault into the hypervisor instead.
+zx_status_t ArmArchVmAspace::HarvestAccessed(vaddr_t vaddr, size_t count,
+                                             HarvestAccessedCallback callback, void* context) {
+    canary_.Assert();
+
+    if (flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    if (!IsValidVaddr(vaddr) || !IsValidVaddr(vaddr + count * PAGE_SIZE - 1))
+        return ZX_ERR_OUT_OF_RANGE;
+
+    fbl::AutoLock a(&lock_);
+
+    const vaddr_t end = vaddr + count * PAGE_SIZE;
+    bool flushed = false;
+    while (vaddr < end) {
+        uint block_shift;
+        volatile pte_t* ptep = GetTerminalPteLocked(vaddr, &block_shift);
+        if (!ptep) {
+            vaddr += PAGE_SIZE;
+            continue;
+        }
+
+        // A block has a single flag for all of the pages it maps.
+        const vaddr_t block_base = vaddr & ~((1UL << block_shift) - 1);
+        const vaddr_t next = MIN(end, block_base + (1UL << block_shift));
+
+        // The hardware doesn't manage the flag, so nothing else writes the
+        // entry while the lock is held.
+        const pte_t pte = *ptep;
+        if (pte & MMU_PTE_ATTR_AF) {
+            *ptep = pte & ~MMU_PTE_ATTR_AF;
+            __dmb(ARM_MB_ISHST);
+            FlushTLBEntry(block_base, true);
+            flushed = true;
+                callback(vaddr, (next - vaddr) / PAGE_SIZE, context);
+        }
+        vaddr = next;
+    }
+
+    // Wait for all of the invalidations at once.
+    if (flushed)
+        __dsb(ARM_MB_ISH);
+
+    return ZX_OK;
+}
+
+zx_status_t ArmArchVmAspace::MarkAccessed(vaddr_t vaddr) {
+    canary_.Assert();
+
+    if (flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    if (!IsValidVaddr(vaddr))
+        return ZX_ERR_OUT_OF_RANGE;
+
+    fbl::AutoLock a(&lock_);
+
+    uint block_shift;
+    volatile pte_t* ptep = GetTerminalPteLocked(vaddr, &block_shift);
+    if (!ptep)
+        return ZX_ERR_NOT_FOUND;
+
+    // Entries that cause access flag faults are never cached in the TLB, so
+    // there is nothing to invalidate. If the flag is already set another
+    // thread got here first and the access can simply be retried.
+    *ptep |= MMU_PTE_ATTR_AF;
+    __dsb(ARM_MB_ISHST);
+    __isb(ARM_MB_SY);
+    return ZX_OK;
+}
+
 zx_status_t ArmArchVmAspace::QueryLocked(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) {
     ulong index;
     uint index_shift;
@@ -511,6 +626,49 @@ void ArmArchVmAspace::FlushTLBEntry(vaddr_t vaddr, bool terminal) {
     }
 }
 
+// Replace the block entry at page_table[index] with a page table of next level
+// entries covering the same range with the same attributes, so that part of
+// the block can be unmapped or protected on its own.
+zx_status_t ArmArchVmAspace::SplitBlock(vaddr_t vaddr, vaddr_t index, uint index_shift,
+                                        uint page_size_shift, volatile pte_t* page_table) {
+    const pte_t pte = page_table[index];
+    DEBUG_ASSERT(index_shift > page_size_shift);
+    DEBUG_ASSERT((pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK);
+
+    paddr_t paddr;
+    zx_status_t status = AllocPageTable(&paddr, page_size_shift);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    const uint next_index_shift = index_shift - (page_size_shift - 3);
+    const pte_t desc = (next_index_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK
+                                                            : MMU_PTE_L3_DESCRIPTOR_PAGE;
+    const pte_t attrs = pte & ~(MMU_PTE_OUTPUT_ADDR_MASK | MMU_PTE_DESCRIPTOR_MASK);
+    const paddr_t block_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+    const size_t count = 1U << (page_size_shift - 3);
+
+    volatile pte_t* next_page_table = static_cast<volatile pte_t*>(paddr_to_physmap(paddr));
+    for (size_t i = 0; i < count; i++) {
+        next_page_table[i] = (block_paddr + (i << next_index_shift)) | attrs | desc;
+    }
+
+    // break before make: the block has to be gone from the TLBs before the
+    // table that replaces it becomes visible
+    page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+    __dmb(ARM_MB_ISHST);
+    FlushTLBEntry(vaddr, true);
+    __dsb(ARM_MB_ISH);
+
+    page_table[index] = paddr | MMU_PTE_L012_DESCRIPTOR_TABLE;
+    __dmb(ARM_MB_ISHST);
+
+    LTRACEF("split block pte %p[%#" PRIxPTR "] into table %#" PRIxPTR "\n",
+            page_table, index, paddr);
+    kcounter_add(large_page_split, 1);
+    return ZX_OK;
+}
+
 // NOTE: caller must DSB afterwards to ensure TLB entries are flushed
 ssize_t ArmArchVmAspace::UnmapPageTable(vaddr_t vaddr, vaddr_t vaddr_rel,
                                         size_t size, uint index_shift,
@@ -539,6 +697,14 @@ ssize_t ArmArchVmAspace::UnmapPageTable(vaddr_t vaddr, vaddr_t vaddr_rel,
 
         pte = page_table[index];
 
+        // only part of a block is going away; if the split fails the whole
+        // block is unmapped below and faulted back in later
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK &&
+            SplitBlock(vaddr, index, index_shift, page_size_shift, page_table) == ZX_OK) {
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -703,6 +869,15 @@ int ArmArchVmAspace::ProtectPageTable(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
         index = vaddr_rel >> index_shift;
         pte = page_table[index];
 
+        // changing part of a block would change all of it, so split it first
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            if (SplitBlock(vaddr, index, index_shift, page_size_shift, page_table) != ZX_OK) {
+                goto err;
+            }
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -32,6 +32,7 @@
 
 #include <lib/counters.h>
 #include <lib/ktrace.h>
+#include <lib/profiler.h>
 
 #include <zircon/syscalls/exception.h>
 #include <zircon/types.h>
@@ -465,6 +466,12 @@ void x86_exception_handler(x86_iframe_t* frame) {
     // did we come from user or kernel space?
     bool from_user = is_from_user(frame);
 
+    // record what was interrupted for the sampling profiler; an nmi may arrive
+    // while a sample is being taken, so leave the record alone for those
+    if (frame->vector != X86_INT_NMI) {
+        profiler_set_irq_context(frame->ip, frame->rbp, from_user);
+    }
+
     // deliver the interrupt
     ktrace_tiny(TAG_IRQ_ENTER, ((uint32_t)frame->vector << 8) | arch_curr_cpu_num());
 
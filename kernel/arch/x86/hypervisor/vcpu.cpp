@@ -776,6 +776,9 @@ zx_status_t Vcpu::Resume(zx_port_packet_t* packet) {
         if (status != ZX_OK) {
             return status;
         }
+        // Our address space may have been given a new PCID since the last
+        // entry, and VM exit must not come back to the old one.
+        vmcs.Write(VmcsFieldXX::HOST_CR3, x86_get_cr3());
         if (x86_feature_test(X86_FEATURE_XSAVE)) {
             // Save the host XCR0, and load the guest XCR0.
             vmx_state_.host_state.xcr0 = x86_xgetbv(0);
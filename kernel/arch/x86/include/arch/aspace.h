@@ -43,6 +43,7 @@ private:
     PtFlags split_flags(PageTableLevel level, PtFlags flags) final;
     void TlbInvalidate(PendingTlbInvalidation* pending) final;
     uint pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level) final;
+    PtFlags accessed_flag() final;
     bool needs_cache_flushes() final { return false; }
 
     // If true, all mappings will have the global bit set.
@@ -65,6 +66,7 @@ private:
     PtFlags split_flags(PageTableLevel level, PtFlags flags) final;
     void TlbInvalidate(PendingTlbInvalidation* pending) final;
     uint pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level) final;
+    PtFlags accessed_flag() final;
     bool needs_cache_flushes() final { return false; }
 };
 
@@ -85,6 +87,8 @@ public:
     zx_status_t Unmap(vaddr_t vaddr, size_t count, size_t* unmapped) override;
     zx_status_t Protect(vaddr_t vaddr, size_t count, uint mmu_flags) override;
     zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) override;
+    zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                                HarvestAccessedCallback callback, void* context) override;
 
     vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags,
                      vaddr_t end, uint next_region_mmu_flags,
@@ -100,6 +104,11 @@ public:
 
     static void ContextSwitch(X86ArchVmAspace* from, X86ArchVmAspace* to);
 
+    // Called before a non-global TLB shootdown of this aspace.  CPUs that are
+    // not running in it keep its entries tagged with its PCID, so every CPU
+    // that has run in it has to flush them the next time it switches in.
+    void MarkTlbStale() { tlb_stale_cpus_.fetch_or(tlb_cpus_.load()); }
+
 private:
     // Test the vaddr against the address space's range.
     bool IsValidVaddr(vaddr_t vaddr) {
@@ -129,6 +138,24 @@ private:
     // CPUs that are currently executing in this aspace.
     // Actually an mp_cpu_mask_t, but header dependencies.
     fbl::atomic_int active_cpus_{0};
+
+    // Returns the value to load into CR3 to switch to this aspace on |cpu|.
+    // Sets |flush_all| if every PCID has to be flushed after loading it.
+    ulong SwitchCr3(uint cpu, bool* flush_all);
+
+    // Generation and PCID assigned to this aspace, packed as
+    // (generation << 12) | pcid.  Stale generations get a new PCID on the
+    // next switch.
+    fbl::atomic_uint64_t pcid_state_{0};
+
+    // CPUs that have run in this aspace, and so may hold TLB entries tagged
+    // with its PCID.  Set before |active_cpus_| and never cleared.
+    // Actually an mp_cpu_mask_t, but header dependencies.
+    fbl::atomic_int tlb_cpus_{0};
+
+    // CPUs that may hold stale TLB entries for this aspace's PCID.
+    // Actually an mp_cpu_mask_t, but header dependencies.
+    fbl::atomic_int tlb_stale_cpus_{0};
 };
 
 using ArchVmAspace = X86ArchVmAspace;
@@ -17,6 +17,8 @@
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
 #include <kernel/mp.h>
+#include <kernel/spinlock.h>
+#include <lib/counters.h>
 #include <new>
 #include <vm/arch_vm_aspace.h>
 #include <vm/physmap.h>
@@ -34,6 +36,27 @@ uint8_t g_paddr_width = 32;
 /* True if the system supports 1GB pages */
 static bool supports_huge_pages = false;
 
+/* True if CR4.PCIDE is set and user aspaces get tagged TLB entries */
+static bool pcid_enabled = false;
+
+/* True if the INVPCID instruction is available */
+static bool invpcid_supported = false;
+
+// PCIDs are handed out from a global counter and recycled a generation at a
+// time.  PCID 0 is left for the kernel aspace.  When the counter runs out a
+// new generation starts, and each CPU flushes its whole TLB the first time it
+// switches after that, before any PCID of the new generation can be used there.
+static constexpr uint kPcidBits = 12;
+static constexpr uint64_t kMaxPcid = (1u << kPcidBits) - 1;
+static SpinLock pcid_lock;
+static fbl::atomic_uint64_t pcid_generation{1};
+static uint64_t pcid_next = 1; // guarded by pcid_lock
+static uint64_t cpu_pcid_generation[SMP_MAX_CPUS];
+
+KCOUNTER(pcid_rollover, "kernel.x86.pcid.rollover");
+KCOUNTER(pcid_tlb_flush, "kernel.x86.pcid.tlb_flush");
+KCOUNTER(pcid_tlb_keep, "kernel.x86.pcid.tlb_keep");
+
 /* top level kernel page tables, initialized in start.S */
 volatile pt_entry_t pml4[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 volatile pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE); /* temporary */
@@ -117,9 +140,19 @@ bool x86_mmu_check_paddr(paddr_t paddr) {
 }
 
 /**
- * @brief  invalidate all TLB entries, including global entries
+ * @brief  invalidate all TLB entries, including global entries, for every PCID
  */
 static void x86_tlb_global_invalidate() {
+    if (invpcid_supported) {
+        /* Type 2: all contexts, including global translations */
+        struct {
+            uint64_t pcid;
+            uint64_t addr;
+        } desc = {0, 0};
+        __asm__ volatile("invpcid %0, %1" ::"m"(desc), "r"(2ul) : "memory");
+        return;
+    }
+
     /* See Intel 3A section 4.10.4.1 */
     ulong cr4 = x86_get_cr4();
     if (likely(cr4 & X86_CR4_PGE)) {
@@ -141,17 +174,26 @@ static void x86_tlb_nonglobal_invalidate() {
 struct TlbInvalidatePage_context {
     ulong target_cr3;
     const PendingTlbInvalidation* pending;
+    // The invalidation applies to every aspace, whatever CR3 is loaded.
+    bool all_aspaces;
+    // INVLPG isn't enough; see x86_tlb_invalidate_page().
+    bool flush_all_pcids;
 };
 static void TlbInvalidatePage_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
     TlbInvalidatePage_context* context = (TlbInvalidatePage_context*)raw_context;
 
-    ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->pending->contains_global) {
+    ulong cr3 = x86_get_cr3() & X86_CR3_BASE_MASK;
+    if (context->target_cr3 != cr3 && !context->all_aspaces) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
+    if (context->flush_all_pcids) {
+        x86_tlb_global_invalidate();
+        return;
+    }
+
     if (context->pending->full_shootdown) {
         if (context->pending->contains_global) {
             x86_tlb_global_invalidate();
@@ -186,9 +228,43 @@ static void x86_tlb_invalidate_page(const X86PageTableBase* pt, PendingTlbInvali
         return;
     }
 
-    ulong cr3 = pt ? pt->phys() : x86_get_cr3();
+    // Kernel mappings are shared by every aspace, so they may be cached under
+    // any PCID, not just the one of the aspace being switched to.
+    const bool kernel = pt == nullptr || pt->phys() == kernel_pt_phys;
+    const bool all_aspaces = kernel || pending->contains_global;
+
+    // With PCIDs, CPUs that have left the aspace still hold its entries.
+    // This has to happen before active_cpus() is read below so that a CPU
+    // switching in either sees the mark or is sent the IPI.
+    if (pcid_enabled && !all_aspaces) {
+        static_cast<X86ArchVmAspace*>(pt->ctx())->MarkTlbStale();
+    }
+
+    // INVLPG drops global translations for every PCID, but non-global ones
+    // and paging-structure caches only for the current PCID.  Anything
+    // other than global leaf entries of the kernel has to be flushed from
+    // every PCID instead.
+    bool flush_all_pcids = false;
+    if (pcid_enabled && all_aspaces) {
+        for (uint i = 0; i < pending->count; ++i) {
+            const auto& item = pending->item[i];
+            if (!item.is_global() || !item.is_terminal()) {
+                flush_all_pcids = true;
+                break;
+            }
+        }
+        // A full shootdown may cover more than the queued items.
+        if (pending->full_shootdown) {
+            flush_all_pcids = true;
+        }
+    }
+
+    ulong cr3 = pt ? pt->phys() : (x86_get_cr3() & X86_CR3_BASE_MASK);
     struct TlbInvalidatePage_context task_context = {
-        .target_cr3 = cr3, .pending = pending,
+        .target_cr3 = cr3,
+        .pending = pending,
+        .all_aspaces = all_aspaces,
+        .flush_all_pcids = flush_all_pcids,
     };
 
     /* Target only CPUs this aspace is active on.  It may be the case that some
@@ -198,7 +274,7 @@ static void x86_tlb_invalidate_page(const X86PageTableBase* pt, PendingTlbInvali
      * case, it will get a spurious request to flush. */
     mp_ipi_target_t target;
     cpu_mask_t target_mask = 0;
-    if (pending->contains_global || pt == nullptr) {
+    if (all_aspaces) {
         target = MP_IPI_TARGET_ALL;
     } else {
         target = MP_IPI_TARGET_MASK;
@@ -431,6 +507,10 @@ X86PageTableBase::PtFlags X86PageTableEpt::split_flags(PageTableLevel level,
 }
 
 
+X86PageTableBase::PtFlags X86PageTableMmu::accessed_flag() {
+    return X86_MMU_PG_A;
+}
+
 void X86PageTableEpt::TlbInvalidate(PendingTlbInvalidation* pending) {
     // TODO(ZX-981): Implement this.
     pending->clear();
@@ -466,6 +546,11 @@ uint X86PageTableEpt::pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level)
     return mmu_flags;
 }
 
+// EPT accessed and dirty flags are not enabled.
+X86PageTableBase::PtFlags X86PageTableEpt::accessed_flag() {
+    return 0;
+}
+
 void x86_mmu_early_init() {
     x86_mmu_percpu_init();
 
@@ -482,6 +567,8 @@ void x86_mmu_early_init() {
     uint8_t paddr_width = x86_physical_address_width();
 
     supports_huge_pages = x86_feature_test(X86_FEATURE_HUGE_PAGE);
+    pcid_enabled = x86_feature_test(X86_FEATURE_PCID);
+    invpcid_supported = x86_feature_test(X86_FEATURE_INVPCID);
 
     /* if we got something meaningful, override the defaults.
      * some combinations of cpu on certain emulators seems to return
@@ -641,21 +728,81 @@ zx_status_t X86ArchVmAspace::Protect(vaddr_t vaddr, size_t count, uint mmu_flags
     return pt_->ProtectPages(vaddr, count, mmu_flags);
 }
 
+ulong X86ArchVmAspace::SwitchCr3(uint cpu, bool* flush_all) {
+    DEBUG_ASSERT(arch_ints_disabled());
+    *flush_all = false;
+
+    paddr_t phys = pt_phys();
+    if (!pcid_enabled) {
+        return phys;
+    }
+
+    uint64_t state = pcid_state_.load();
+    if ((state >> kPcidBits) != pcid_generation.load()) {
+        AutoSpinLock guard(&pcid_lock);
+
+        // another CPU may have assigned one while we waited
+        const uint64_t generation = pcid_generation.load();
+        state = pcid_state_.load();
+        if ((state >> kPcidBits) != generation) {
+            if (pcid_next > kMaxPcid) {
+                pcid_generation.store(generation + 1);
+                pcid_next = 1;
+                kcounter_add(pcid_rollover, 1);
+            }
+            state = (pcid_generation.load() << kPcidBits) | pcid_next++;
+            pcid_state_.store(state);
+        }
+    }
+
+    const uint64_t generation = state >> kPcidBits;
+    const ulong cr3 = phys | (state & X86_CR3_PCID_MASK);
+    const int cpu_bit = static_cast<int>(cpu_num_to_mask(cpu));
+    const bool stale = tlb_stale_cpus_.fetch_and(~cpu_bit) & cpu_bit;
+
+    if (cpu_pcid_generation[cpu] != generation) {
+        // Entries from the last generation may be tagged with any PCID,
+        // including this one, so the caller has to clear them all.
+        cpu_pcid_generation[cpu] = generation;
+        *flush_all = true;
+        kcounter_add(pcid_tlb_flush, 1);
+        return cr3 | X86_CR3_NOFLUSH;
+    }
+
+    if (stale) {
+        kcounter_add(pcid_tlb_flush, 1);
+        return cr3;
+    }
+
+    kcounter_add(pcid_tlb_keep, 1);
+    return cr3 | X86_CR3_NOFLUSH;
+}
+
 void X86ArchVmAspace::ContextSwitch(X86ArchVmAspace* old_aspace, X86ArchVmAspace* aspace) {
-    cpu_mask_t cpu_bit = cpu_num_to_mask(arch_curr_cpu_num());
+    const uint cpu = arch_curr_cpu_num();
+    cpu_mask_t cpu_bit = cpu_num_to_mask(cpu);
     if (aspace != nullptr) {
         aspace->canary_.Assert();
-        paddr_t phys = aspace->pt_phys();
-        LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, phys);
-        x86_set_cr3(phys);
+        LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, aspace->pt_phys());
 
-        if (old_aspace != nullptr) {
+        // Become active before looking for stale entries in SwitchCr3(); see
+        // x86_tlb_invalidate_page().
+        aspace->tlb_cpus_.fetch_or(cpu_bit);
+        aspace->active_cpus_.fetch_or(cpu_bit);
+        bool flush_all;
+        x86_set_cr3(aspace->SwitchCr3(cpu, &flush_all));
+        if (flush_all) {
+            x86_tlb_global_invalidate();
+        }
+
+        if (old_aspace != nullptr && old_aspace != aspace) {
             old_aspace->active_cpus_.fetch_and(~cpu_bit);
         }
-        aspace->active_cpus_.fetch_or(cpu_bit);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
-        x86_set_cr3(kernel_pt_phys);
+        // The kernel aspace only has global mappings, so nothing tagged with
+        // PCID 0 needs flushing.
+        x86_set_cr3(pcid_enabled ? (kernel_pt_phys | X86_CR3_NOFLUSH) : kernel_pt_phys);
         if (old_aspace != nullptr) {
             old_aspace->active_cpus_.fetch_and(~cpu_bit);
         }
@@ -677,6 +824,14 @@ zx_status_t X86ArchVmAspace::Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flag
     return pt_->QueryVaddr(vaddr, paddr, mmu_flags);
 }
 
+zx_status_t X86ArchVmAspace::HarvestAccessed(vaddr_t vaddr, size_t count,
+                                             HarvestAccessedCallback callback, void* context) {
+    if (!IsValidVaddr(vaddr))
+        return ZX_ERR_INVALID_ARGS;
+
+    return pt_->HarvestAccessed(vaddr, count, callback, context);
+}
+
 void x86_mmu_percpu_init(void) {
     ulong cr0 = x86_get_cr0();
     /* Set write protect bit in CR0*/
@@ -691,6 +846,12 @@ void x86_mmu_percpu_init(void) {
         cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP))
         cr4 |= X86_CR4_SMAP;
+    // PCIDE may only be set while CR3 selects PCID 0, which is the case
+    // here since nothing has switched to a user aspace yet.
+    if (x86_feature_test(X86_FEATURE_PCID)) {
+        DEBUG_ASSERT((x86_get_cr3() & X86_CR3_PCID_MASK) == 0);
+        cr4 |= X86_CR4_PCIDE;
+    }
     x86_set_cr4(cr4);
 
     // Set NXE bit in X86_MSR_IA32_EFER.
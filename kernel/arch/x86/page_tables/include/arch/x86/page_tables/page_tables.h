@@ -91,6 +91,11 @@ public:
 
     zx_status_t QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags);
 
+    // Clear the accessed flags of the entries mapping the range, calling
+    // |callback| with the pages whose flags were set.
+    zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                                HarvestAccessedCallback callback, void* context);
+
 protected:
     // Initialize an empty page table, assigning this given context to it.
     zx_status_t Init(void* ctx);
@@ -121,6 +126,9 @@ protected:
 
     // Convert PtFlags to ARCH_MMU_* flags.
     virtual uint pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level) = 0;
+    // Return the flag the hardware sets in terminal entries on access, or 0
+    // if accesses aren't tracked.
+    virtual PtFlags accessed_flag() = 0;
     // Returns true if a cache flush is necessary for pagetable changes to be
     // visible.
     virtual bool needs_cache_flushes() = 0;
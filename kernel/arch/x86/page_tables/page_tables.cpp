@@ -12,12 +12,15 @@
 #include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
 #include <fbl/auto_lock.h>
+#include <lib/counters.h>
 #include <trace.h>
 #include <vm/physmap.h>
 #include <vm/pmm.h>
 
 #define LOCAL_TRACE 0
 
+KCOUNTER(large_page_split, "kernel.mmu.large_page.split");
+
 namespace {
 
 // Return the page size for this level
@@ -346,6 +349,7 @@ zx_status_t X86PageTableBase::SplitLargePage(PageTableLevel level, vaddr_t vaddr
     flags = intermediate_flags();
     UpdateEntry(cm, level, vaddr, pte, X86_VIRT_TO_PHYS(m), flags, true /* was_terminal */);
     pages_++;
+    kcounter_add(large_page_split, 1);
     return ZX_OK;
 }
 
@@ -972,6 +976,56 @@ zx_status_t X86PageTableBase::ProtectPages(vaddr_t vaddr, size_t count, uint mmu
     return ZX_OK;
 }
 
+zx_status_t X86PageTableBase::HarvestAccessed(vaddr_t vaddr, size_t count,
+                                              HarvestAccessedCallback callback,
+                                              void* context) {
+    canary_.Assert();
+
+    const PtFlags flag = accessed_flag();
+    if (flag == 0) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    const vaddr_t end = vaddr + count * PAGE_SIZE;
+    ConsistencyManager cm(this);
+    {
+        fbl::AutoLock a(&lock_);
+
+        while (vaddr < end) {
+            PageTableLevel level;
+            volatile pt_entry_t* pte;
+            zx_status_t status = GetMapping(virt_, vaddr, top_level(), &level, &pte);
+            if (status != ZX_OK) {
+                vaddr += PAGE_SIZE;
+                continue;
+            }
+
+            // A large page has a single flag for all of the pages it maps.
+            const size_t ps = page_size(level);
+            const vaddr_t entry_base = vaddr & ~(ps - 1);
+            const vaddr_t next = fbl::min(end, entry_base + ps);
+
+            // The cpu may set the dirty flag concurrently, so clear atomically.
+            pt_entry_t old = __atomic_fetch_and(const_cast<pt_entry_t*>(pte), ~flag,
+                                                __ATOMIC_RELAXED);
+
+            // The cpu only sets the flag when it loads the entry into the TLB,
+            // so drop any cached copy for the next access to be seen.
+            if (old & flag) {
+                cm.cache_line_flusher()->FlushPtEntry(pte);
+                // TODO(teisenbe): the is_kernel_address should be a check for
+                // the global bit
+                cm.pending_tlb()->enqueue(entry_base, level, is_kernel_address(entry_base),
+                                          true);
+                callback(vaddr, (next - vaddr) / PAGE_SIZE, context);
+            }
+            vaddr = next;
+        }
+        cm.Finish();
+    }
+    return ZX_OK;
+}
+
 zx_status_t X86PageTableBase::QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) {
     canary_.Assert();
 
@@ -19,7 +19,7 @@ __BEGIN_CDECLS
 
 struct percpu {
     // per cpu timer queue
-    struct list_node timer_queue;
+    TimerQueue timer_queue;
 
     // per cpu preemption timer; ZX_TIME_INFINITE means not set
     zx_time_t preempt_timer_deadline;
@@ -31,6 +31,14 @@ struct percpu {
     struct list_node run_queue[NUM_PRIORITIES];
     uint32_t run_queue_bitmap;
 
+    // deadline threads that are ready to run, ordered by absolute deadline,
+    // and those waiting for their next period after using up their capacity
+    struct list_node deadline_run_queue;
+    struct list_node deadline_throttled;
+    // bandwidth reserved by the deadline threads homed on this cpu, as a
+    // fraction of the cpu in 44.20 fixed point
+    uint64_t deadline_utilization;
+
 #if WITH_LOCK_DEP
     // state for runtime lock validation when in irq context
     lockdep_state_t lock_state;
@@ -39,6 +47,12 @@ struct percpu {
     // thread/cpu level statistics
     struct cpu_stats stats;
 
+    // pc and frame pointer of the context the current irq interrupted and
+    // whether it was running in user mode; recorded by the sampling profiler
+    vaddr_t irq_pc;
+    vaddr_t irq_fp;
+    bool irq_from_user;
+
     // per cpu idle thread
     thread_t idle_thread;
 
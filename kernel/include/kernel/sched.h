@@ -34,6 +34,14 @@ void sched_inherit_priority(thread_t* t, int pri, bool* local_resched) TA_REQ(th
 // pri should be 0 <= to <= MAX_PRIORITY.
 void sched_change_priority(thread_t* t, int pri) TA_REQ(thread_lock);
 
+// move the thread into the deadline scheduling class, or back into the priority class if
+// |capacity| is 0. deadline threads run before all others, earliest absolute deadline first,
+// and get |capacity| of every |period| within |deadline| of the start of the period. their
+// bandwidth is reserved on one cpu, and ZX_ERR_NO_RESOURCES is returned if no cpu the thread
+// may run on has enough of it left. This function might reschedule.
+zx_status_t sched_set_deadline(thread_t* t, zx_duration_t capacity, zx_duration_t deadline,
+                               zx_duration_t period) TA_REQ(thread_lock);
+
 // return true if the thread was placed on the current cpu's run queue
 // this usually means the caller should locally reschedule soon
 bool sched_unblock(thread_t* t) __WARN_UNUSED_RESULT TA_REQ(thread_lock);
@@ -61,6 +61,7 @@ typedef void (*thread_tls_callback_t)(void* tls_value);
 #define THREAD_SIGNAL_KILL                   (1 << 0)
 #define THREAD_SIGNAL_SUSPEND                (1 << 1)
 #define THREAD_SIGNAL_POLICY_EXCEPTION       (1 << 2)
+#define THREAD_SIGNAL_SAMPLE                 (1 << 3)
 // clang-format on
 
 #define THREAD_MAGIC (0x74687264) // 'thrd'
@@ -115,6 +116,25 @@ typedef struct thread {
     int priority_boost;
     int inherited_priority;
 
+    // deadline scheduling class: every deadline_period the thread gets
+    // deadline_capacity of cpu time within deadline_relative of the start of
+    // the period. deadline_capacity is 0 for threads in the priority class.
+    // deadline_abs and deadline_remaining are the absolute deadline of the
+    // current period and the capacity left in it, deadline_release is when
+    // the next period starts and deadline_cpu is the cpu the thread's
+    // bandwidth is reserved on. see sched_set_deadline().
+    zx_duration_t deadline_capacity;
+    zx_duration_t deadline_relative;
+    zx_duration_t deadline_period;
+    zx_time_t deadline_abs;
+    zx_duration_t deadline_remaining;
+    zx_time_t deadline_release;
+    cpu_num_t deadline_cpu;
+    // waiting for its next period after using up its capacity
+    bool deadline_throttled;
+    // the current period's deadline was missed and has been counted
+    bool deadline_missed;
+
     // current cpu the thread is either running on or in the ready queue, undefined otherwise
     cpu_num_t curr_cpu;
     cpu_num_t last_cpu;      // last cpu the thread ran on, INVALID_CPU if it's never run
@@ -148,6 +168,11 @@ typedef struct thread {
     uint64_t user_tid;
     uint64_t user_pid;
 
+    // user pc and frame pointer the sampling profiler interrupted; the user
+    // backtrace is recorded on the way back to user mode (THREAD_SIGNAL_SAMPLE)
+    vaddr_t profile_user_pc;
+    vaddr_t profile_user_fp;
+
     // callback for user thread state changes; do not invoke directly, use invoke_user_callback
     // helper function instead
     thread_user_callback_t user_callback;
@@ -240,6 +265,8 @@ void thread_construct_first(thread_t* t, const char* name);
 thread_t* thread_create_idle_thread(uint cpu_num);
 void thread_set_name(const char* name);
 void thread_set_priority(thread_t* t, int priority);
+zx_status_t thread_set_deadline(thread_t* t, zx_duration_t capacity,
+                                zx_duration_t relative_deadline, zx_duration_t period);
 void thread_set_user_callback(thread_t* t, thread_user_callback_t cb);
 thread_t* thread_create(const char* name, thread_start_routine entry, void* arg, int priority);
 thread_t* thread_create_etc(thread_t* t, const char* name, thread_start_routine entry, void* arg,
@@ -359,6 +386,10 @@ static inline bool thread_is_real_time_or_idle(thread_t* t) {
     return !!(t->flags & (THREAD_FLAG_REAL_TIME | THREAD_FLAG_IDLE));
 }
 
+static inline bool thread_is_deadline(const thread_t* t) {
+    return t->deadline_capacity > 0;
+}
+
 // the current thread
 #include <arch/current_thread.h>
 thread_t* get_current_thread(void);
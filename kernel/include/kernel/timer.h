@@ -9,6 +9,7 @@
 
 #include <kernel/deadline.h>
 #include <kernel/spinlock.h>
+#include <fbl/intrusive_wavl_tree.h>
 #include <list.h>
 #include <sys/types.h>
 #include <zircon/compiler.h>
@@ -25,7 +26,9 @@ typedef void (*timer_callback)(struct timer*, zx_time_t now, void* arg);
 
 typedef struct timer {
     int magic;
-    struct list_node node;
+    fbl::WAVLTreeNodeState<struct timer*> node; // Linkage in a per-cpu TimerQueue.
+    uint64_t queue_seq; // Orders timers with equal scheduled_time, see TimerQueueKey.
+    uint queue_cpu;     // Cpu whose queue |node| is in, if any.
 
     zx_time_t scheduled_time;
     zx_duration_t slack; // Stores the applied slack adjustment from
@@ -40,7 +43,9 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t)              \
     {                                       \
         .magic = TIMER_MAGIC,               \
-        .node = LIST_INITIAL_CLEARED_VALUE, \
+        .node = {},                         \
+        .queue_seq = 0,                     \
+        .queue_cpu = 0,                     \
         .scheduled_time = 0,                \
         .slack = 0,                         \
         .callback = NULL,                   \
@@ -127,3 +132,35 @@ void timer_thaw_percpu(void);
 zx_status_t timer_trylock_or_cancel(timer_t* t, spin_lock_t* lock) TA_TRY_ACQ(false, lock);
 
 __END_CDECLS
+
+// Per-cpu queue of pending timers, ordered by scheduled_time.  Timers with
+// the same scheduled_time (e.g. coalesced by slack) are ordered by when they
+// were queued, so they fire in FIFO order.  Insertion and removal are
+// O(log n), and finding the timers on either side of a deadline for slack
+// coalescing is O(log n) as well.
+struct TimerQueueKey {
+    zx_time_t scheduled_time;
+    uint64_t seq;
+};
+
+struct TimerQueueKeyTraits {
+    static TimerQueueKey GetKey(const timer_t& timer) {
+        return {timer.scheduled_time, timer.queue_seq};
+    }
+    static bool LessThan(const TimerQueueKey& a, const TimerQueueKey& b) {
+        return a.scheduled_time < b.scheduled_time ||
+               (a.scheduled_time == b.scheduled_time && a.seq < b.seq);
+    }
+    static bool EqualTo(const TimerQueueKey& a, const TimerQueueKey& b) {
+        return a.scheduled_time == b.scheduled_time && a.seq == b.seq;
+    }
+};
+
+struct TimerQueueNodeTraits {
+    static fbl::WAVLTreeNodeState<timer_t*>& node_state(timer_t& timer) {
+        return timer.node;
+    }
+};
+
+using TimerQueue = fbl::WAVLTree<TimerQueueKey, timer_t*, TimerQueueKeyTraits,
+                                 TimerQueueNodeTraits>;
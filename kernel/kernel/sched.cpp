@@ -10,10 +10,14 @@
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/mp.h>
 #include <kernel/percpu.h>
 #include <kernel/thread.h>
+#include <kernel/thread_lock.h>
+#include <lib/counters.h>
 #include <lib/ktrace.h>
+#include <lk/init.h>
 #include <list.h>
 #include <platform.h>
 #include <printf.h>
@@ -53,10 +57,34 @@
 // threads get 10ms to run before they use up their time slice and the scheduler is invoked
 #define THREAD_INITIAL_TIME_SLICE ZX_MSEC(10)
 
+KCOUNTER(sched_steal_counter, "kernel.sched.steal");
+KCOUNTER(sched_deadline_admitted_counter, "kernel.sched.deadline.admitted");
+KCOUNTER(sched_deadline_rejected_counter, "kernel.sched.deadline.rejected");
+KCOUNTER(sched_deadline_throttled_counter, "kernel.sched.deadline.throttled");
+KCOUNTER(sched_deadline_miss_counter, "kernel.sched.deadline.miss");
+
+// whether cpus about to go idle take ready threads from other cpus' run queues.
+// off unless asked for, since the pass scans every active cpu's run queues with
+// thread_lock held each time a cpu runs out of work.
+static bool sched_steal_enabled = false;
+
+// deadline bandwidth is kept as a fraction of a cpu in 44.20 fixed point
+static constexpr uint64_t kDeadlineScale = 1u << 20;
+
+// the share of each cpu deadline threads may reserve, leaving the rest to the priority class
+static uint64_t sched_deadline_limit = kDeadlineScale * 80 / 100;
+
 static bool local_migrate_if_needed(thread_t* curr_thread);
 
 // compute the effective priority of a thread
 static void compute_effec_priority(thread_t* t) {
+    // deadline threads run before all priority threads, so they wait and lend
+    // their priority like the highest priority ones
+    if (thread_is_deadline(t)) {
+        t->effec_priority = HIGHEST_PRIORITY;
+        return;
+    }
+
     int ep = t->base_priority + t->priority_boost;
     if (t->inherited_priority > ep) {
         ep = t->inherited_priority;
@@ -73,7 +101,7 @@ static void boost_thread(thread_t* t) {
         return;
     }
 
-    if (unlikely(thread_is_real_time_or_idle(t))) {
+    if (unlikely(thread_is_real_time_or_idle(t) || thread_is_deadline(t))) {
         return;
     }
 
@@ -92,7 +120,7 @@ static void deboost_thread(thread_t* t, bool quantum_expiration) {
         return;
     }
 
-    if (unlikely(thread_is_real_time_or_idle(t))) {
+    if (unlikely(thread_is_real_time_or_idle(t) || thread_is_deadline(t))) {
         return;
     }
 
@@ -152,8 +180,82 @@ static cpu_mask_t rand_cpu(cpu_mask_t mask) {
     }
 }
 
+// the share of a cpu a deadline thread reserves
+static uint64_t deadline_bandwidth(const thread_t* t) {
+    return static_cast<uint64_t>(t->deadline_capacity) * kDeadlineScale /
+           static_cast<uint64_t>(t->deadline_relative);
+}
+
+// pick the active cpu out of the passed in mask with the least deadline bandwidth reserved,
+// or INVALID_CPU if there is none
+static cpu_num_t deadline_least_loaded_cpu(cpu_mask_t mask) TA_REQ(thread_lock) {
+    mask &= mp_get_active_mask();
+
+    cpu_num_t best = INVALID_CPU;
+    for (cpu_num_t cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        if ((mask & cpu_num_to_mask(cpu)) &&
+            (best == INVALID_CPU ||
+             percpu[cpu].deadline_utilization < percpu[best].deadline_utilization)) {
+            best = cpu;
+        }
+    }
+    return best;
+}
+
+// return the cpu the bandwidth of a deadline thread is reserved on, first moving the
+// reservation if the thread may no longer run there
+static cpu_num_t deadline_home_cpu(thread_t* t) TA_REQ(thread_lock) {
+    const cpu_num_t home = t->deadline_cpu;
+    if (mp_is_cpu_active(home) && (t->cpu_affinity & cpu_num_to_mask(home))) {
+        return home;
+    }
+
+    // the cpu went offline or the affinity mask changed. the thread has to run somewhere,
+    // so move the reservation even if that overcommits the new cpu.
+    cpu_num_t cpu = deadline_least_loaded_cpu(t->cpu_affinity);
+    if (cpu == INVALID_CPU) {
+        cpu = arch_curr_cpu_num();
+    }
+    percpu[home].deadline_utilization -= deadline_bandwidth(t);
+    percpu[cpu].deadline_utilization += deadline_bandwidth(t);
+    t->deadline_cpu = cpu;
+    return cpu;
+}
+
+// start a new period of a deadline thread at |start|
+static void deadline_start_period(thread_t* t, zx_time_t start) {
+    t->deadline_abs = zx_time_add_duration(start, t->deadline_relative);
+    t->deadline_release = zx_time_add_duration(start, t->deadline_period);
+    t->deadline_remaining = t->deadline_capacity;
+    t->deadline_missed = false;
+}
+
+// a deadline thread that wakes up keeps its current period only if it can use up the capacity
+// it has left by the period's deadline without exceeding its bandwidth; otherwise it starts a
+// new period now. this keeps a thread that blocks and wakes from taking more than its share.
+static void deadline_wake(thread_t* t, zx_time_t now) {
+    if (now >= t->deadline_abs ||
+        t->deadline_remaining * t->deadline_relative >
+            zx_time_sub_time(t->deadline_abs, now) * t->deadline_capacity) {
+        deadline_start_period(t, now);
+    }
+}
+
+// count a deadline miss the first time a thread of the period runs past its deadline
+static void deadline_check_miss(thread_t* t, zx_time_t now) {
+    if (now > t->deadline_abs && !t->deadline_missed) {
+        t->deadline_missed = true;
+        kcounter_add(sched_deadline_miss_counter, 1);
+    }
+}
+
 // find a cpu to wake up
 static cpu_mask_t find_cpu_mask(thread_t* t) TA_REQ(thread_lock) {
+    // deadline threads only run on the cpu their bandwidth is reserved on
+    if (thread_is_deadline(t)) {
+        return cpu_num_to_mask(deadline_home_cpu(t));
+    }
+
     // get the last cpu the thread ran on
     cpu_mask_t last_ran_cpu_mask = cpu_num_to_mask(t->last_cpu);
 
@@ -212,8 +314,78 @@ static cpu_mask_t find_cpu_mask(thread_t* t) TA_REQ(thread_lock) {
     return mask;
 }
 
+// deadline run queue manipulation
+static void insert_in_deadline_queue(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
+    DEBUG_ASSERT(!list_in_list(&t->queue_node));
+
+    struct percpu* c = &percpu[cpu];
+
+    // a thread that used up its capacity waits for its next period
+    if (t->deadline_remaining <= 0) {
+        t->deadline_throttled = true;
+        list_add_tail(&c->deadline_throttled, &t->queue_node);
+        kcounter_add(sched_deadline_throttled_counter, 1);
+        return;
+    }
+
+    // keep the run queue ordered by absolute deadline, earliest first
+    t->deadline_throttled = false;
+    thread_t* entry;
+    list_for_every_entry (&c->deadline_run_queue, entry, thread_t, queue_node) {
+        if (entry->deadline_abs > t->deadline_abs) {
+            list_add_before(&entry->queue_node, &t->queue_node);
+            mp_set_cpu_busy(cpu);
+            return;
+        }
+    }
+    list_add_tail(&c->deadline_run_queue, &t->queue_node);
+    mp_set_cpu_busy(cpu);
+}
+
+// move the throttled deadline threads of the cpu whose next period has started to its
+// deadline run queue
+static void deadline_release_throttled(cpu_num_t cpu, zx_time_t now) TA_REQ(thread_lock) {
+    thread_t* t;
+    thread_t* temp;
+    list_for_every_entry_safe (&percpu[cpu].deadline_throttled, t, temp, thread_t, queue_node) {
+        if (t->deadline_release > now) {
+            continue;
+        }
+        list_delete(&t->queue_node);
+
+        // keep the periods in step unless the release is so late that the deadline passed
+        zx_time_t start = t->deadline_release;
+        if (zx_time_add_duration(start, t->deadline_relative) <= now) {
+            start = now;
+        }
+        deadline_start_period(t, start);
+        insert_in_deadline_queue(cpu, t);
+    }
+}
+
+// return when the next period of a throttled deadline thread of the cpu starts
+static zx_time_t deadline_next_release(cpu_num_t cpu) TA_REQ(thread_lock) {
+    zx_time_t next_release = ZX_TIME_INFINITE;
+    thread_t* t;
+    list_for_every_entry (&percpu[cpu].deadline_throttled, t, thread_t, queue_node) {
+        next_release = MIN(next_release, t->deadline_release);
+    }
+    return next_release;
+}
+
 // run queue manipulation
+//
+// All run queues are guarded by thread_lock rather than a per-cpu lock. A
+// thread's state, its wait queue and the priority inheritance chain it is on
+// change together with its run queue membership under that one lock, and
+// thread_lock is held across the context switch, so splitting the run queues
+// out needs those to be reworked first.
 static void insert_in_run_queue_head(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
+    if (thread_is_deadline(t)) {
+        insert_in_deadline_queue(cpu, t);
+        return;
+    }
+
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
     list_add_head(&percpu[cpu].run_queue[t->effec_priority], &t->queue_node);
@@ -224,6 +396,11 @@ static void insert_in_run_queue_head(cpu_num_t cpu, thread_t* t) TA_REQ(thread_l
 }
 
 static void insert_in_run_queue_tail(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
+    if (thread_is_deadline(t)) {
+        insert_in_deadline_queue(cpu, t);
+        return;
+    }
+
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
     list_add_tail(&percpu[cpu].run_queue[t->effec_priority], &t->queue_node);
@@ -240,6 +417,10 @@ static void remove_from_run_queue(thread_t* t, int prio_queue) TA_REQ(thread_loc
 
     list_delete(&t->queue_node);
 
+    if (thread_is_deadline(t)) {
+        return;
+    }
+
     // clear the old cpu's queue bitmap if that was the last entry
     struct percpu* c = &percpu[t->curr_cpu];
     if (list_is_empty(&c->run_queue[prio_queue])) {
@@ -258,6 +439,18 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
     // queued up on the passed in cpu.
 
     struct percpu* c = &percpu[cpu];
+
+    // deadline threads come first, earliest deadline first. those that used up their
+    // capacity while waiting go on to wait for their next period instead.
+    thread_t* t;
+    while ((t = list_remove_head_type(&c->deadline_run_queue, thread_t, queue_node)) != NULL) {
+        DEBUG_ASSERT(t->curr_cpu == cpu);
+        if (t->deadline_remaining > 0) {
+            return t;
+        }
+        insert_in_deadline_queue(cpu, t);
+    }
+
     if (likely(c->run_queue_bitmap)) {
         uint highest_queue = highest_run_queue(c);
 
@@ -282,10 +475,67 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
     return &c->idle_thread;
 }
 
+// Looks for a ready thread queued on another cpu that may run on |cpu| and
+// takes it off that cpu's run queue, preferring the highest priority one.
+// Threads only wait in a run queue while their cpu is running something else,
+// so this lets a cpu that would otherwise go idle take over some of a busy
+// cpu's backlog. Returns nullptr if there is nothing to take.
+static thread_t* sched_steal_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
+    if (!sched_steal_enabled || !mp_is_cpu_active(cpu)) {
+        return nullptr;
+    }
+
+    const cpu_mask_t cpu_mask = cpu_num_to_mask(cpu);
+    const cpu_mask_t active_mask = mp_get_active_mask();
+    const cpu_num_t num_cpus = arch_max_num_cpus();
+
+    thread_t* best = nullptr;
+    for (cpu_num_t i = 1; i < num_cpus; i++) {
+        // start with our neighbours so that stealing cpus spread out
+        const cpu_num_t victim = (cpu + i) % num_cpus;
+        if (!(active_mask & cpu_num_to_mask(victim))) {
+            continue;
+        }
+
+        const struct percpu* c = &percpu[victim];
+        uint32_t bitmap = c->run_queue_bitmap;
+        while (bitmap != 0) {
+            const int prio = static_cast<int>(sizeof(bitmap) * CHAR_BIT - 1) - __builtin_clz(bitmap);
+            if (best && prio <= best->effec_priority) {
+                break;
+            }
+
+            thread_t* t;
+            thread_t* found = nullptr;
+            list_for_every_entry (&c->run_queue[prio], t, thread_t, queue_node) {
+                if (t->cpu_affinity & cpu_mask) {
+                    found = t;
+                    break;
+                }
+            }
+            if (found) {
+                best = found;
+                break;
+            }
+            bitmap &= ~(1u << prio);
+        }
+    }
+
+    if (best) {
+        remove_from_run_queue(best, best->effec_priority);
+        best->curr_cpu = cpu;
+        kcounter_add(sched_steal_counter, 1);
+        LOCAL_KTRACE2("sched_steal", (uint32_t)best->user_tid, cpu);
+    }
+    return best;
+}
+
 void sched_init_thread(thread_t* t, int priority) {
     t->base_priority = priority;
     t->priority_boost = 0;
     t->inherited_priority = -1;
+    t->deadline_capacity = 0;
+    t->deadline_cpu = INVALID_CPU;
     compute_effec_priority(t);
 }
 
@@ -337,6 +587,9 @@ bool sched_unblock(thread_t* t) {
 
     // thread is being woken up, boost its priority
     boost_thread(t);
+    if (thread_is_deadline(t)) {
+        deadline_wake(t, current_time());
+    }
 
     // stuff the new thread in the run queue
     t->state = THREAD_READY;
@@ -346,7 +599,8 @@ bool sched_unblock(thread_t* t) {
     find_cpu_and_insert(t, &local_resched, &mask);
 
     if (mask) {
-        mp_reschedule(mask, 0);
+        // deadline threads preempt real time threads too
+        mp_reschedule(mask, thread_is_deadline(t) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
     }
     return local_resched;
 }
@@ -360,6 +614,7 @@ bool sched_unblock_list(struct list_node* list) {
     // pop the list of threads and shove into the scheduler
     bool local_resched = false;
     cpu_mask_t accum_cpu_mask = 0;
+    uint reschedule_flags = 0;
     thread_t* t;
     while ((t = list_remove_tail_type(list, thread_t, queue_node))) {
         DEBUG_ASSERT(t->magic == THREAD_MAGIC);
@@ -367,6 +622,10 @@ bool sched_unblock_list(struct list_node* list) {
 
         // thread is being woken up, boost its priority
         boost_thread(t);
+        if (thread_is_deadline(t)) {
+            deadline_wake(t, current_time());
+            reschedule_flags = MP_RESCHEDULE_FLAG_REALTIME;
+        }
 
         // stuff the new thread in the run queue
         t->state = THREAD_READY;
@@ -374,7 +633,7 @@ bool sched_unblock_list(struct list_node* list) {
     }
 
     if (accum_cpu_mask) {
-        mp_reschedule(accum_cpu_mask, 0);
+        mp_reschedule(accum_cpu_mask, reschedule_flags);
     }
 
     return local_resched;
@@ -404,8 +663,10 @@ void sched_yield() {
 
     LOCAL_KTRACE0("sched_yield");
 
-    // consume the rest of the time slice, deboost ourself, and go to the end of a queue
+    // consume the rest of the time slice, deboost ourself, and go to the end of a queue.
+    // a deadline thread gives up the rest of its period.
     current_thread->remaining_time_slice = 0;
+    current_thread->deadline_remaining = 0;
     deboost_thread(current_thread, false);
 
     current_thread->state = THREAD_READY;
@@ -499,7 +760,8 @@ static void migrate_current_thread(thread_t* current_thread) TA_REQ(thread_lock)
     current_thread->state = THREAD_READY;
     find_cpu_and_insert(current_thread, &local_resched, &accum_cpu_mask);
     if (accum_cpu_mask) {
-        mp_reschedule(accum_cpu_mask, 0);
+        mp_reschedule(accum_cpu_mask,
+                      thread_is_deadline(current_thread) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
     }
     sched_resched_internal();
 }
@@ -531,6 +793,17 @@ void sched_transition_off_cpu(cpu_num_t old_cpu) {
         }
     }
 
+    // Throttled deadline threads wait for their next period on another cpu.
+    while ((t = list_remove_head_type(&percpu[old_cpu].deadline_throttled,
+                                      thread_t, queue_node)) != NULL) {
+        if (t->cpu_affinity != pinned_mask) {
+            find_cpu_and_insert(t, &local_resched, &accum_cpu_mask);
+            DEBUG_ASSERT(!local_resched);
+        } else {
+            list_add_head(&pinned_threads, &t->queue_node);
+        }
+    }
+
     // Put pinned threads back on old_cpu's queue.
     while ((t = list_remove_head_type(&pinned_threads, thread_t, queue_node)) != NULL) {
         insert_in_run_queue_head(old_cpu, t);
@@ -552,6 +825,13 @@ static bool local_migrate_if_needed(thread_t* curr_thread) TA_REQ(thread_lock) {
         migrate_current_thread(curr_thread);
         return true;
     }
+
+    // deadline threads move to the cpu their bandwidth is reserved on
+    if (unlikely(thread_is_deadline(curr_thread) &&
+                 deadline_home_cpu(curr_thread) != curr_thread->curr_cpu)) {
+        migrate_current_thread(curr_thread);
+        return true;
+    }
     return false;
 }
 
@@ -732,11 +1012,142 @@ void sched_change_priority(thread_t* t, int pri) {
     }
 }
 
+zx_status_t sched_set_deadline(thread_t* t, zx_duration_t capacity, zx_duration_t deadline,
+                               zx_duration_t period) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (unlikely(t->state == THREAD_DEATH)) {
+        return ZX_ERR_BAD_STATE;
+    }
+    if (!thread_is_deadline(t) && capacity == 0) {
+        return ZX_OK;
+    }
+
+    // take the thread out of its run queue while its parameters change
+    if (t->state == THREAD_READY) {
+        DEBUG_ASSERT(list_in_list(&t->queue_node));
+        remove_from_run_queue(t, t->effec_priority);
+    }
+
+    // release the bandwidth reserved with the old parameters
+    const cpu_num_t old_cpu = t->deadline_cpu;
+    const uint64_t old_bandwidth = thread_is_deadline(t) ? deadline_bandwidth(t) : 0;
+    if (old_bandwidth) {
+        percpu[old_cpu].deadline_utilization -= old_bandwidth;
+    }
+
+    zx_status_t status = ZX_OK;
+    if (capacity > 0) {
+        DEBUG_ASSERT(capacity <= deadline && deadline <= period);
+
+        // reserve the bandwidth on the least loaded cpu the thread may run on, as long
+        // as that leaves the priority class its share
+        const uint64_t bandwidth = static_cast<uint64_t>(capacity) * kDeadlineScale /
+                                   static_cast<uint64_t>(deadline);
+        const cpu_num_t cpu = deadline_least_loaded_cpu(t->cpu_affinity);
+        if (cpu == INVALID_CPU ||
+            percpu[cpu].deadline_utilization + bandwidth > sched_deadline_limit) {
+            if (old_bandwidth) {
+                percpu[old_cpu].deadline_utilization += old_bandwidth;
+            }
+            kcounter_add(sched_deadline_rejected_counter, 1);
+            status = ZX_ERR_NO_RESOURCES;
+        } else {
+            percpu[cpu].deadline_utilization += bandwidth;
+            t->deadline_capacity = capacity;
+            t->deadline_relative = deadline;
+            t->deadline_period = period;
+            t->deadline_cpu = cpu;
+            deadline_start_period(t, current_time());
+            kcounter_add(sched_deadline_admitted_counter, 1);
+        }
+    } else {
+        t->deadline_capacity = 0;
+        t->deadline_relative = 0;
+        t->deadline_period = 0;
+        t->deadline_cpu = INVALID_CPU;
+        t->deadline_throttled = false;
+    }
+
+    int old_ep = t->effec_priority;
+    compute_effec_priority(t);
+
+    cpu_mask_t accum_cpu_mask = 0;
+    bool local_resched = false;
+
+    // put the thread back where its new class wants it
+    switch (t->state) {
+    case THREAD_READY:
+        find_cpu_and_insert(t, &local_resched, &accum_cpu_mask);
+        break;
+    case THREAD_RUNNING:
+        if (status == ZX_OK) {
+            if (t == get_current_thread()) {
+                local_resched = true;
+            } else {
+                accum_cpu_mask |= cpu_num_to_mask(t->curr_cpu);
+            }
+        }
+        break;
+    case THREAD_BLOCKED:
+    case THREAD_BLOCKED_READ_LOCK:
+        if (t->blocking_wait_queue && old_ep != t->effec_priority) {
+            wait_queue_priority_changed(t, old_ep);
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (accum_cpu_mask) {
+        mp_reschedule(accum_cpu_mask, MP_RESCHEDULE_FLAG_REALTIME);
+    }
+    if (local_resched) {
+        sched_reschedule();
+    }
+    return status;
+}
+
 // preemption timer that is set whenever a thread is scheduled
 void sched_preempt_timer_tick(zx_time_t now) {
-    // if the preemption timer went off on the idle or a real time thread, ignore it
     thread_t* current_thread = get_current_thread();
+    cpu_num_t cpu = arch_curr_cpu_num();
+
+    Guard<spin_lock_t, NoIrqSave> guard{ThreadLock::Get()};
+
+    // the timer also goes off when the period of a throttled deadline thread starts.
+    // preempt the current thread if a deadline thread should run instead.
+    deadline_release_throttled(cpu, now);
+    zx_time_t next_release = deadline_next_release(cpu);
+    thread_t* next_deadline = list_peek_head_type(&percpu[cpu].deadline_run_queue,
+                                                  thread_t, queue_node);
+    if (next_deadline && (!thread_is_deadline(current_thread) ||
+                          next_deadline->deadline_abs < current_thread->deadline_abs)) {
+        thread_preempt_set_pending();
+    }
+
+    if (thread_is_deadline(current_thread)) {
+        // did this tick use up the capacity of the current period?
+        DEBUG_ASSERT(now > current_thread->last_started_running);
+        zx_duration_t delta = zx_time_sub_time(now, current_thread->last_started_running);
+        if (delta >= current_thread->deadline_remaining) {
+            // throttle the thread until its next period
+            current_thread->deadline_remaining = 0;
+            thread_preempt_set_pending();
+        } else {
+            zx_time_t deadline = zx_time_add_duration(current_thread->last_started_running,
+                                                      current_thread->deadline_remaining);
+            timer_preempt_reset(MIN(deadline, next_release));
+        }
+        return;
+    }
+
+    // if the preemption timer went off on the idle or a real time thread, only keep
+    // it for the next deadline period
     if (unlikely(thread_is_real_time_or_idle(current_thread))) {
+        if (next_release != ZX_TIME_INFINITE) {
+            timer_preempt_reset(next_release);
+        }
         return;
     }
 
@@ -751,7 +1162,8 @@ void sched_preempt_timer_tick(zx_time_t now) {
         current_thread->remaining_time_slice = 0;
 
         // set a timer to go off on the time slice interval from now
-        timer_preempt_reset(zx_time_add_duration(now, THREAD_INITIAL_TIME_SLICE));
+        timer_preempt_reset(MIN(zx_time_add_duration(now, THREAD_INITIAL_TIME_SLICE),
+                                next_release));
 
         // Mark a reschedule as pending.  The irq handler will call back
         // into us with sched_preempt().
@@ -760,7 +1172,7 @@ void sched_preempt_timer_tick(zx_time_t now) {
         // the timer tick must have fired early, reschedule and continue
         zx_time_t deadline = zx_time_add_duration(current_thread->last_started_running,
                                                   current_thread->remaining_time_slice);
-        timer_preempt_reset(deadline);
+        timer_preempt_reset(MIN(deadline, next_release));
     }
 }
 
@@ -788,8 +1200,19 @@ void sched_resched_internal() {
 
     CPU_STATS_INC(reschedules);
 
-    // pick a new thread to run
+    zx_time_t now = current_time();
+
+    // start the periods of throttled deadline threads that are due
+    deadline_release_throttled(cpu, now);
+
+    // pick a new thread to run, taking one from a busy cpu rather than idling
     thread_t* newthread = sched_get_top_thread(cpu);
+    if (thread_is_idle(newthread)) {
+        thread_t* stolen = sched_steal_thread(cpu);
+        if (stolen) {
+            newthread = stolen;
+        }
+    }
 
     DEBUG_ASSERT(newthread);
 
@@ -810,8 +1233,6 @@ void sched_resched_internal() {
         return;
     }
 
-    zx_time_t now = current_time();
-
     // account for time used on the old thread
     DEBUG_ASSERT(now >= oldthread->last_started_running);
     zx_duration_t old_runtime = zx_time_sub_time(now, oldthread->last_started_running);
@@ -819,6 +1240,21 @@ void sched_resched_internal() {
     oldthread->remaining_time_slice = zx_duration_sub_duration(
         oldthread->remaining_time_slice, MIN(old_runtime, oldthread->remaining_time_slice));
 
+    if (thread_is_deadline(oldthread)) {
+        oldthread->deadline_remaining = zx_duration_sub_duration(
+            oldthread->deadline_remaining, MIN(old_runtime, oldthread->deadline_remaining));
+        deadline_check_miss(oldthread, now);
+
+        // a dying thread gives its bandwidth back
+        if (oldthread->state == THREAD_DEATH) {
+            percpu[oldthread->deadline_cpu].deadline_utilization -= deadline_bandwidth(oldthread);
+            oldthread->deadline_capacity = 0;
+        }
+    }
+    if (thread_is_deadline(newthread)) {
+        deadline_check_miss(newthread, now);
+    }
+
     // set up quantum for the new thread if it was consumed
     if (newthread->remaining_time_slice == 0) {
         newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
@@ -839,7 +1275,7 @@ void sched_resched_internal() {
         mp_set_cpu_idle(cpu);
     }
 
-    if (thread_is_realtime(newthread)) {
+    if (thread_is_realtime(newthread) || thread_is_deadline(newthread)) {
         mp_set_cpu_realtime(cpu);
     } else {
         mp_set_cpu_non_realtime(cpu);
@@ -860,8 +1296,21 @@ void sched_resched_internal() {
             (oldthread->effec_priority << 16) | (newthread->effec_priority << 24)),
            (uint32_t)(uintptr_t)oldthread, (uint32_t)(uintptr_t)newthread);
 
-    if (thread_is_real_time_or_idle(newthread)) {
-        if (!thread_is_real_time_or_idle(oldthread)) {
+    // the preemption timer also goes off when the next deadline period on this cpu starts
+    zx_time_t next_release = deadline_next_release(cpu);
+    if (thread_is_deadline(newthread)) {
+        // set up a one shot timer to throttle the thread once it used up its capacity
+        TRACE_CONTEXT_SWITCH("start deadline preempt, cpu %u, old %p (%s), new %p (%s)\n",
+                             cpu, oldthread, oldthread->name, newthread, newthread->name);
+
+        DEBUG_ASSERT(newthread->deadline_remaining > 0);
+
+        timer_preempt_reset(MIN(zx_time_add_duration(now, newthread->deadline_remaining),
+                                next_release));
+    } else if (thread_is_real_time_or_idle(newthread)) {
+        if (next_release != ZX_TIME_INFINITE) {
+            timer_preempt_reset(next_release);
+        } else if (!thread_is_real_time_or_idle(oldthread) || thread_is_deadline(oldthread)) {
             // if we're switching from a non real time to a real time, cancel
             // the preemption timer.
             TRACE_CONTEXT_SWITCH("stop preempt, cpu %u, old %p (%s), new %p (%s)\n",
@@ -876,7 +1325,8 @@ void sched_resched_internal() {
         // make sure the time slice is reasonable
         DEBUG_ASSERT(newthread->remaining_time_slice > 0 && newthread->remaining_time_slice < ZX_SEC(1));
 
-        timer_preempt_reset(zx_time_add_duration(now, newthread->remaining_time_slice));
+        timer_preempt_reset(MIN(zx_time_add_duration(now, newthread->remaining_time_slice),
+                                next_release));
     }
 
     // set some optional target debug leds
@@ -905,4 +1355,20 @@ void sched_init_early() {
         for (unsigned int i = 0; i < NUM_PRIORITIES; i++) {
             list_initialize(&percpu[cpu].run_queue[i]);
         }
+
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        list_initialize(&percpu[cpu].deadline_run_queue);
+        list_initialize(&percpu[cpu].deadline_throttled);
+    }
+}
+
+static void sched_init_steal(uint level) {
+    sched_steal_enabled = cmdline_get_bool("kernel.sched.steal", false);
+}
+LK_INIT_HOOK(sched_steal, &sched_init_steal, LK_INIT_LEVEL_THREADING);
+
+static void sched_init_deadline(uint level) {
+    uint64_t percent = cmdline_get_uint64("kernel.sched.deadline-utilization", 80);
+    sched_deadline_limit = kDeadlineScale * MIN(percent, 100u) / 100;
 }
+LK_INIT_HOOK(sched_deadline, &sched_init_deadline, LK_INIT_LEVEL_THREADING);
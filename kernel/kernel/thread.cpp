@@ -36,6 +36,7 @@
 #include <lib/counters.h>
 #include <lib/heap.h>
 #include <lib/ktrace.h>
+#include <lib/profiler.h>
 
 #include <list.h>
 #include <malloc.h>
@@ -721,6 +722,14 @@ void thread_process_pending_signals(void) {
         thread_exit(0);
     }
 
+    // Record the user backtrace of a sample the profiler took in irq context
+    if (current_thread->signals & THREAD_SIGNAL_SAMPLE) {
+        current_thread->signals &= ~THREAD_SIGNAL_SAMPLE;
+        guard.CallUnlocked([current_thread]() {
+            profiler_sample_user_thread(current_thread);
+        });
+    }
+
     // Report exceptions raised by syscalls
     if (current_thread->signals & THREAD_SIGNAL_POLICY_EXCEPTION) {
         current_thread->signals &= ~THREAD_SIGNAL_POLICY_EXCEPTION;
@@ -1046,9 +1055,33 @@ void thread_set_priority(thread_t* t, int priority) {
         priority = HIGHEST_PRIORITY;
     }
 
+    // a priority only means something in the priority class
+    if (thread_is_deadline(t)) {
+        sched_set_deadline(t, 0, 0, 0);
+    }
     sched_change_priority(t, priority);
 }
 
+/**
+ * @brief  Move a thread into the deadline scheduling class
+ *
+ * Every |period|, the thread is guaranteed |capacity| of cpu time within
+ * |relative_deadline| of the start of the period. A |capacity| of 0 moves
+ * the thread back into the priority class.
+ *
+ * @return ZX_ERR_NO_RESOURCES if no cpu the thread may run on has enough
+ * unreserved bandwidth left.
+ */
+zx_status_t thread_set_deadline(thread_t* t, zx_duration_t capacity,
+                                zx_duration_t relative_deadline, zx_duration_t period) {
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(capacity == 0 ||
+                 (capacity <= relative_deadline && relative_deadline <= period));
+
+    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    return sched_set_deadline(t, capacity, relative_deadline, period);
+}
+
 /**
  * @brief  Become an idle thread
  *
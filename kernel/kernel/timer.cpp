@@ -60,6 +60,10 @@ namespace {
 spin_lock_t timer_lock __CPU_ALIGN_EXCLUSIVE = SPIN_LOCK_INITIAL_VALUE;
 DECLARE_SINGLETON_LOCK_WRAPPER(TimerLock, timer_lock);
 
+// Sequence number given to the next queued timer, see TimerQueueKey.
+// Protected by timer_lock.
+uint64_t timer_queue_seq;
+
 } // anonymous namespace
 
 void timer_init(timer_t* timer) {
@@ -87,113 +91,82 @@ static void insert_timer_in_queue(uint cpu, timer_t* timer,
     DEBUG_ASSERT(arch_ints_disabled());
     LTRACEF("timer %p, cpu %u, scheduled %" PRIi64 "\n", timer, cpu, timer->scheduled_time);
 
-    // For inserting the timer we consider several cases. In general we
-    // want to coalesce with the current timer unless we can prove that
-    // either that:
-    //  1- there is no slack overlap with current timer OR
-    //  2- the next timer is a better fit.
+    TimerQueue& queue = percpu[cpu].timer_queue;
+
+    // For inserting the timer we look at the two queued timers closest to
+    // it and coalesce with whichever of them fits best, if either overlaps
+    // the new timer's slack.
     //
     // In diagrams that follow
-    // - Let |e| be the current (existing) timer deadline
     // - Let |t| be the deadline of the timer we are inserting
-    // - Let |n| be the next timer deadline if any
-    // - Let |x| be the end of the list (not a timer)
+    // - Let |p| be the last timer deadline before |t|, if any
+    // - Let |n| be the first timer deadline at or after |t|, if any
     // - Let |(| and |)| the earliest_deadline and latest_deadline.
     //
-    timer_t* entry;
-
-    list_for_every_entry (&percpu[cpu].timer_queue, entry, timer_t, node) {
-        if (entry->scheduled_time > latest_deadline) {
-            // New timer latest is earlier than the current timer.
-            // Just add upfront as is, without slack.
-            //
-            //   ---------t---)--e-------------------------------> time
-            //
-            timer->slack = 0ll;
-            list_add_before(&entry->node, &timer->node);
-            return;
-        }
-
-        if (entry->scheduled_time >= timer->scheduled_time) {
-            //  New timer slack overlaps and is to the left (or equal). We
-            //  coalesce with current by scheduling late.
-            //
-            //  --------(----t---e-)----------------------------> time
-            //
-            timer->slack = zx_time_sub_time(entry->scheduled_time, timer->scheduled_time);
-            timer->scheduled_time = entry->scheduled_time;
-            kcounter_add(timer_coalesced_counter, 1);
-            list_add_after(&entry->node, &timer->node);
-            return;
-        }
+    TimerQueue::iterator next_iter = queue.lower_bound({timer->scheduled_time, 0});
+    const timer_t* next = next_iter.IsValid() ? &*next_iter : nullptr;
+    const timer_t* prev = nullptr;
+    if (next_iter != queue.begin()) {
+        TimerQueue::iterator prev_iter = next_iter;
+        --prev_iter;
+        prev = &*prev_iter;
+    }
 
-        if (entry->scheduled_time < earliest_deadline) {
-            // new timer earliest is later than the current timer. This case
-            // is handled in a future iteration.
-            //
-            //   ----------------e--(---t-----------------------> time
-            //
-            continue;
-        }
+    // Only timers inside the slack window can be coalesced with.
+    //
+    //   ----p---(----t----)---n-------------------------> time
+    //
+    if (prev != nullptr && prev->scheduled_time < earliest_deadline) {
+        prev = nullptr;
+    }
+    if (next != nullptr && next->scheduled_time > latest_deadline) {
+        next = nullptr;
+    }
 
-        // New timer is to the right of current timer and there is overlap
-        // with the current timer, but could the next timer (if any) be
-        // a better fit?
+    const timer_t* target;
+    if (prev == nullptr) {
+        // Coalesce with the next timer by scheduling late, if it overlaps.
         //
-        //  -------------(--e---t-----?-------------------> time
+        //  --------(----t---n-)----------------------------> time
         //
-
-        const timer_t* next =
-            list_next_type(&percpu[cpu].timer_queue, &entry->node, timer_t, node);
-
-        if (next != NULL) {
-            if (next->scheduled_time <= timer->scheduled_time) {
-                // The new timer is to the right of the next timer. There is no
-                // chance the current timer is a better fit.
-                //
-                //  -------------(--e---n---t----------------------> time
-                //
-                continue;
-            }
-
-            if (next->scheduled_time < latest_deadline) {
-                // There is slack overlap with the next timer, and also with the
-                // current timer. Which coalescing is a better match?
-                //
-                //  --------------(-e---t---n-)-----------------------> time
-                //
-                zx_duration_t delta_entry =
-                    zx_time_sub_time(timer->scheduled_time, entry->scheduled_time);
-                zx_duration_t delta_next =
-                    zx_time_sub_time(next->scheduled_time, timer->scheduled_time);
-                if (delta_next < delta_entry) {
-                    // New timer is closer to the next timer, handle it in the
-                    // next iteration.
-                    continue;
-                }
-            }
-        }
-
-        // Handles the remaining cases, note that there is overlap with
-        // the current timer.
+        target = next;
+    } else if (next != nullptr && next->scheduled_time == timer->scheduled_time) {
+        // A timer with the same deadline is always the best fit, even when
+        // it sits right on latest_deadline.
+        //
+        //  --------------(-p-------n)-----------------------> time
+        //                          t
         //
-        //  1- this is the last timer (next == NULL) or
-        //  2- there is no overlap with the next timer, or
-        //  3- there is overlap with both current and next but
-        //     current is closer.
+        target = next;
+    } else if (next != nullptr && next->scheduled_time < latest_deadline &&
+               zx_time_sub_time(next->scheduled_time, timer->scheduled_time) <
+                   zx_time_sub_time(timer->scheduled_time, prev->scheduled_time)) {
+        // There is slack overlap with both timers, and the next timer is
+        // strictly closer.  A next timer right on latest_deadline loses.
         //
-        //  So we coalesce by scheduling early.
+        //  --------------(-p-----t--n-)-----------------------> time
         //
-        timer->slack = zx_time_sub_time(entry->scheduled_time, timer->scheduled_time);
-        timer->scheduled_time = entry->scheduled_time;
+        target = next;
+    } else {
+        // Otherwise coalesce with the previous timer by scheduling early.
+        //
+        //  --------------(-p---t---)-n-----------------------> time
+        //
+        target = prev;
+    }
+
+    if (target != nullptr) {
+        timer->slack = zx_time_sub_time(target->scheduled_time, timer->scheduled_time);
+        timer->scheduled_time = target->scheduled_time;
         kcounter_add(timer_coalesced_counter, 1);
-        list_add_after(&entry->node, &timer->node);
-        return;
+    } else {
+        // No overlap with any timer, add as is, without slack.
+        timer->slack = 0;
     }
 
-    // Walked off the end of the list and there was no overlap.
-    timer->slack = 0;
-    list_add_tail(&percpu[cpu].timer_queue, &timer->node);
+    timer->queue_seq = timer_queue_seq++;
+    timer->queue_cpu = cpu;
+    queue.insert(timer);
 }
 
 void timer_set(timer_t* timer, const Deadline& deadline,
@@ -207,8 +180,8 @@ void timer_set(timer_t* timer, const Deadline& deadline,
     DEBUG_ASSERT(deadline.slack().mode() <= TIMER_SLACK_EARLY);
     DEBUG_ASSERT(deadline.slack().amount() >= 0);
 
-    if (list_in_list(&timer->node)) {
-        panic("timer %p already in list\n", timer);
+    if (timer->node.InContainer()) {
+        panic("timer %p already in queue\n", timer);
     }
 
     const zx_time_t latest_deadline = deadline.latest();
@@ -240,7 +213,7 @@ void timer_set(timer_t* timer, const Deadline& deadline,
     insert_timer_in_queue(cpu, timer, earliest_deadline, latest_deadline);
     kcounter_add(timer_created_counter, 1);
 
-    if (list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node) == timer) {
+    if (&percpu[cpu].timer_queue.front() == timer) {
         // we just modified the head of the timer queue
         update_platform_timer(cpu, deadline.when());
     }
@@ -295,14 +268,16 @@ bool timer_cancel(timer_t* timer) {
     bool callback_not_running;
 
     // if the timer is in a queue, remove it and adjust hardware timers if needed
-    if (list_in_list(&timer->node)) {
+    if (timer->node.InContainer()) {
         callback_not_running = true;
 
-        // save a copy of the old head of the queue so later we can see if we modified the head
-        timer_t* oldhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+        TimerQueue& queue = percpu[timer->queue_cpu].timer_queue;
+
+        // see if we're removing the head of the queue, so later we can see if we modified the head
+        bool was_head = (&queue.front() == timer);
 
         // remove our timer from the queue
-        list_delete(&timer->node);
+        queue.erase(*timer);
         kcounter_add(timer_canceled_counter, 1);
 
         // TODO(cpu): if  after removing |timer| there is one other single timer with
@@ -311,11 +286,10 @@ bool timer_cancel(timer_t* timer) {
 
         // see if we've just modified the head of this cpu's timer queue.
         // if we modified another cpu's queue, we'll just let it fire and sort itself out
-        if (unlikely(oldhead == timer)) {
+        if (unlikely(was_head && timer->queue_cpu == cpu)) {
             // timer we're canceling was at head of queue, see if we should update platform timer
-            timer_t* newhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-            if (newhead) {
-                update_platform_timer(cpu, newhead->scheduled_time);
+            if (!queue.is_empty()) {
+                update_platform_timer(cpu, queue.front().scheduled_time);
             } else if (percpu[cpu].next_timer_deadline == ZX_TIME_INFINITE) {
                 LTRACEF("clearing old hw timer, preempt timer not set, nothing in the queue\n");
                 platform_stop_timer();
@@ -362,12 +336,13 @@ void timer_tick(zx_time_t now) {
 
     Guard<spin_lock_t, NoIrqSave> guard{TimerLock::Get()};
 
+    TimerQueue& queue = percpu[cpu].timer_queue;
     for (;;) {
         // see if there's an event to process
-        timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-        if (likely(timer == 0)) {
+        if (likely(queue.is_empty())) {
             break;
         }
+        timer = &queue.front();
         LTRACEF("next item on timer queue %p at %" PRIi64 " now %" PRIi64 " (%p, arg %p)\n",
                 timer, timer->scheduled_time, now, timer->callback, timer->arg);
         if (likely(now < timer->scheduled_time)) {
@@ -379,7 +354,7 @@ void timer_tick(zx_time_t now) {
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                          "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                          timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        queue.pop_front();
 
         // mark the timer busy
         timer->active_cpu = cpu;
@@ -407,9 +382,8 @@ void timer_tick(zx_time_t now) {
 
     // get the deadline of the event at the head of the queue (if any)
     zx_time_t deadline = ZX_TIME_INFINITE;
-    timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-    if (timer) {
-        deadline = timer->scheduled_time;
+    if (!queue.is_empty()) {
+        deadline = queue.front().scheduled_time;
 
         // has to be the case or it would have fired already
         DEBUG_ASSERT(deadline > now);
@@ -445,12 +419,13 @@ void timer_transition_off_cpu(uint old_cpu) {
     Guard<spin_lock_t, IrqSave> guard{TimerLock::Get()};
     uint cpu = arch_curr_cpu_num();
 
-    timer_t* old_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    TimerQueue& queue = percpu[cpu].timer_queue;
+    const timer_t* old_head = queue.is_empty() ? nullptr : &queue.front();
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
     // Move all timers from old_cpu to this cpu
-    list_for_every_entry_safe (&percpu[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+    TimerQueue& old_queue = percpu[old_cpu].timer_queue;
+    while (!old_queue.is_empty()) {
+        timer_t* entry = old_queue.pop_front();
         // We lost the original asymmetric slack information so when we combine them
         // with the other timer queue they are not coalesced again.
         // TODO(cpu): figure how important this case is.
@@ -460,7 +435,7 @@ void timer_transition_off_cpu(uint old_cpu) {
         // created.
     }
 
-    timer_t* new_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    const timer_t* new_head = queue.is_empty() ? nullptr : &queue.front();
     if (new_head != NULL && new_head != old_head) {
         // we just modified the head of the timer queue
         update_platform_timer(cpu, new_head->scheduled_time);
@@ -481,10 +456,10 @@ void timer_thaw_percpu(void) {
     percpu[cpu].next_timer_deadline = ZX_TIME_INFINITE;
     zx_time_t deadline = percpu[cpu].preempt_timer_deadline;
 
-    timer_t* t = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-    if (t) {
-        if (t->scheduled_time < deadline) {
-            deadline = t->scheduled_time;
+    if (!percpu[cpu].timer_queue.is_empty()) {
+        const timer_t& t = percpu[cpu].timer_queue.front();
+        if (t.scheduled_time < deadline) {
+            deadline = t.scheduled_time;
         }
     }
 
@@ -495,7 +470,6 @@ void timer_thaw_percpu(void) {
 
 void timer_queue_init(void) {
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&percpu[i].timer_queue);
         percpu[i].preempt_timer_deadline = ZX_TIME_INFINITE;
         percpu[i].next_timer_deadline = ZX_TIME_INFINITE;
     }
@@ -512,15 +486,14 @@ static void dump_timer_queues(char* buf, size_t len) {
         if (mp_is_cpu_online(i)) {
             ptr += snprintf(buf + ptr, len - ptr, "cpu %u:\n", i);
 
-            timer_t* t;
             zx_time_t last = now;
-            list_for_every_entry (&percpu[i].timer_queue, t, timer_t, node) {
-                zx_duration_t delta_now = zx_time_sub_time(t->scheduled_time, now);
-                zx_duration_t delta_last = zx_time_sub_time(t->scheduled_time, last);
+            for (const timer_t& t : percpu[i].timer_queue) {
+                zx_duration_t delta_now = zx_time_sub_time(t.scheduled_time, now);
+                zx_duration_t delta_last = zx_time_sub_time(t.scheduled_time, last);
                 ptr += snprintf(buf + ptr, len - ptr,
                                 "\ttime %" PRIi64 " delta_now %" PRIi64 " delta_last %" PRIi64 " func %p arg %p\n",
-                                t->scheduled_time, delta_now, delta_last, t->callback, t->arg);
-                last = t->scheduled_time;
+                                t.scheduled_time, delta_now, delta_last, t.callback, t.arg);
+                last = t.scheduled_time;
             }
         }
     }
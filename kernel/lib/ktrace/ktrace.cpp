@@ -11,8 +11,13 @@
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
 #include <hypervisor/ktrace.h>
+#include <kernel/align.h>
+#include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
+#include <kernel/spinlock.h>
 #include <lib/ktrace.h>
 #include <lk/init.h>
 #include <object/thread_dispatcher.h>
@@ -75,59 +80,318 @@ static void ktrace_report_probes(void) {
     }
 }
 
-typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
+// Each cpu appends records to its own ring buffer, so writers never share a
+// cache line. Positions are logical byte counts that only grow; the physical
+// offset into |buffer| is pos % size. |head| is only advanced by the owning
+// cpu with interrupts disabled, which makes every ring single-producer.
+// |tail| is advanced by the owner when it overwrites old records in circular
+// mode, and by the (single) reader in streaming mode.
+// |writing| is set while the owner is appending a record, so that resetting
+// the buffer can wait for it to finish.
+struct ktrace_cpu_buffer {
+    uint8_t* buffer;
+    uint32_t size;
+    fbl::atomic<uint64_t> head;
+    fbl::atomic<uint64_t> tail;
+    fbl::atomic<uint64_t> dropped;
+    fbl::atomic<bool> writing;
+} __CPU_ALIGN;
 
+typedef struct ktrace_state {
     // mask of groups we allow, 0 == tracing disabled
     int grpmask;
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+    // one of KTRACE_MODE_*; only changed while tracing is stopped
+    uint32_t mode;
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+    // set while the buffers are being reset; records are not written meanwhile
+    fbl::atomic<bool> resetting;
 
-    // raw trace buffer
-    uint8_t* buffer;
+    // Name and version records are rare and must survive wraparound, so they
+    // go to a separate append-only buffer shared by all cpus.
+    uint8_t* meta_buffer;
+    uint32_t meta_size;
+    fbl::atomic<uint64_t> meta_head;
+    uint64_t meta_tail;
+    fbl::atomic<uint64_t> meta_dropped;
+
+    ktrace_cpu_buffer cpu[SMP_MAX_CPUS];
+    uint32_t num_cpus;
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
 
-ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
+// Serializes writers of the metadata buffer.
+static SpinLock meta_lock;
+
+// Serializes readers and control operations that reset the buffers.
+static fbl::Mutex reader_lock;
+
+namespace {
+
+// Returns the number of bytes of whole records in the logical range
+// [from, to) of |buf| that fit in |limit| bytes.
+uint64_t ktrace_whole_records(const uint8_t* buf, uint32_t size,
+                              uint64_t from, uint64_t to, size_t limit) {
+    uint64_t pos = from;
+    while (pos < to) {
+        uint32_t tag = *reinterpret_cast<const uint32_t*>(buf + pos % size);
+        uint32_t len = KTRACE_LEN(tag);
+        if (len == 0 || (pos - from) + len > limit) {
+            break;
+        }
+        pos += len;
+    }
+    return pos - from;
+}
+
+// Copies the logical range [from, from + len) of a ring to user memory,
+// splitting the copy where the ring wraps.
+zx_status_t ktrace_copy_ring(uint8_t* ptr, const uint8_t* buf, uint32_t size,
+                             uint64_t from, size_t len) {
+    uint32_t off = static_cast<uint32_t>(from % size);
+    size_t first = fbl::min<size_t>(len, size - off);
+    if (arch_copy_to_user(ptr, buf + off, first) != ZX_OK) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (len > first && arch_copy_to_user(ptr + first, buf, len - first) != ZX_OK) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    return ZX_OK;
+}
+
+// Reserves |len| bytes at the head of |cb|. Returns nullptr and counts a
+// drop if there is no room and the buffer may not be overwritten. The record
+// is not visible to readers until ktrace_cpu_commit().
+// Must be called with interrupts disabled on the cpu that owns |cb|.
+void* ktrace_cpu_reserve(ktrace_cpu_buffer* cb, uint32_t mode, uint32_t len) {
+    uint64_t head = cb->head.load(fbl::memory_order_relaxed);
+    uint32_t off = static_cast<uint32_t>(head % cb->size);
+
+    // records never straddle the end of the ring; fill the gap instead
+    uint32_t pad = (off + len > cb->size) ? cb->size - off : 0;
+
+    uint64_t tail = cb->tail.load(fbl::memory_order_acquire);
+    if (head + pad + len - tail > cb->size) {
+        if (mode != KTRACE_MODE_CIRCULAR) {
+            cb->dropped.fetch_add(1, fbl::memory_order_relaxed);
+            return nullptr;
+        }
+        // flight recorder: throw away the oldest records
+        while (head + pad + len - tail > cb->size) {
+            uint32_t rec_len =
+                KTRACE_LEN(*reinterpret_cast<uint32_t*>(cb->buffer + tail % cb->size));
+            if (rec_len == 0) {
+                // not a record; the ring is corrupt, so start over
+                tail = head;
+                break;
+            }
+            tail += rec_len;
+        }
+        cb->tail.store(tail, fbl::memory_order_release);
+    }
+
+    if (pad) {
+        uint32_t* filler = reinterpret_cast<uint32_t*>(cb->buffer + off);
+        filler[0] = TAG_PAD | (pad >> 3);
+        filler[1] = 0;
+        head += pad;
+        cb->head.store(head, fbl::memory_order_release);
+    }
+
+    return cb->buffer + head % cb->size;
+}
+
+void ktrace_cpu_commit(ktrace_cpu_buffer* cb, uint32_t len) {
+    cb->head.store(cb->head.load(fbl::memory_order_relaxed) + len, fbl::memory_order_release);
+}
+
+// Appends a record to the current cpu's buffer. |payload| supplies the bytes
+// following the 16 byte header.
+bool ktrace_append(uint32_t tag, uint32_t tid, const void* payload, size_t payload_len) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    uint32_t len = KTRACE_LEN(tag);
+    DEBUG_ASSERT(payload_len <= len - KTRACE_HDRSIZE);
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // Announce the write before checking for a reset, so that a reset either
+    // waits for this record or is seen here and the record is not written.
+    ktrace_cpu_buffer* cb = &ks->cpu[arch_curr_cpu_num()];
+    ktrace_header_t* hdr = nullptr;
+    cb->writing.store(true);
+    if (!ks->resetting.load()) {
+        hdr = static_cast<ktrace_header_t*>(ktrace_cpu_reserve(cb, ks->mode, len));
+    }
+    if (hdr) {
+        hdr->ts = ktrace_timestamp();
+        hdr->tag = tag;
+        hdr->tid = tid;
+        if (payload_len) {
+            memcpy(hdr + 1, payload, payload_len);
+        }
+        ktrace_cpu_commit(cb, len);
+    }
+    cb->writing.store(false, fbl::memory_order_release);
 
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return hdr != nullptr;
+}
+
+// Resets every buffer to empty and rewrites the version and tick rate
+// records at the start of the metadata buffer. Writers on other cpus are
+// kept out of the per-cpu buffers, and waited for, while they are reset.
+void ktrace_reset_buffers() TA_REQ(reader_lock) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+
+    ks->resetting.store(true);
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        while (ks->cpu[i].writing.load()) {
+            arch_spinloop_pause();
         }
     }
 
+    AutoSpinLock guard(&meta_lock);
+    uint64_t n = ktrace_ticks_per_ms();
+    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->meta_buffer;
+    memset(rec, 0, KTRACE_RECSIZE * 2);
+    rec[0].tag = TAG_VERSION;
+    rec[0].a = KTRACE_VERSION;
+    rec[1].tag = TAG_TICKS_PER_MS;
+    rec[1].a = (uint32_t)n;
+    rec[1].b = (uint32_t)(n >> 32);
+
+    ks->meta_head.store(KTRACE_RECSIZE * 2);
+    ks->meta_tail = 0;
+    ks->meta_dropped.store(0);
+
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        ktrace_cpu_buffer* cb = &ks->cpu[i];
+        cb->head.store(0);
+        cb->tail.store(0);
+        cb->dropped.store(0);
+    }
+
+    ks->resetting.store(false);
+}
+
+// Streaming mode read: hands out whole records that have not been read yet
+// and frees the space they used.
+ssize_t ktrace_drain_user(uint8_t* ptr, size_t len) TA_REQ(reader_lock) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+
+    // null read is a query for the amount of unread data
+    if (ptr == nullptr) {
+        uint64_t avail = ks->meta_head.load(fbl::memory_order_acquire) - ks->meta_tail;
+        for (uint32_t i = 0; i < ks->num_cpus; i++) {
+            ktrace_cpu_buffer* cb = &ks->cpu[i];
+            avail += cb->head.load(fbl::memory_order_acquire) -
+                     cb->tail.load(fbl::memory_order_relaxed);
+        }
+        return static_cast<ssize_t>(avail);
+    }
+
+    size_t copied = 0;
+
+    uint64_t meta_head = ks->meta_head.load(fbl::memory_order_acquire);
+    uint64_t n = ktrace_whole_records(ks->meta_buffer, ks->meta_size, ks->meta_tail, meta_head,
+                                      len);
+    if (n) {
+        if (arch_copy_to_user(ptr, ks->meta_buffer + ks->meta_tail, n) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        ks->meta_tail += n;
+        copied += n;
+    }
+
+    for (uint32_t i = 0; i < ks->num_cpus && copied < len; i++) {
+        ktrace_cpu_buffer* cb = &ks->cpu[i];
+        uint64_t head = cb->head.load(fbl::memory_order_acquire);
+        uint64_t tail = cb->tail.load(fbl::memory_order_relaxed);
+        n = ktrace_whole_records(cb->buffer, cb->size, tail, head, len - copied);
+        if (n == 0) {
+            continue;
+        }
+        zx_status_t status = ktrace_copy_ring(ptr + copied, cb->buffer, cb->size, tail, n);
+        if (status != ZX_OK) {
+            return status;
+        }
+        cb->tail.store(tail + n, fbl::memory_order_release);
+        copied += n;
+    }
+
+    return static_cast<ssize_t>(copied);
+}
+
+} // namespace
+
+ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->meta_buffer == nullptr) {
+        return 0;
+    }
+
+    fbl::AutoLock lock(&reader_lock);
+
+    if (ks->mode == KTRACE_MODE_STREAMING) {
+        // streaming reads consume data, the offset is ignored
+        return ktrace_drain_user(static_cast<uint8_t*>(ptr), len);
+    }
+
+    // Otherwise the trace is presented as the metadata buffer followed by
+    // the contents of each cpu's buffer. Tracing should be stopped first.
+    uint64_t total = ks->meta_head.load();
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        total += ks->cpu[i].head.load() - ks->cpu[i].tail.load();
+    }
+
     // null read is a query for trace buffer size
     if (ptr == nullptr) {
-        return max;
+        return static_cast<ssize_t>(total);
     }
 
     // constrain read to available buffer
-    if (off >= max) {
+    if (off >= total) {
         return 0;
     }
-    if (len > (max - off)) {
-        len = max - off;
+    if (len > (total - off)) {
+        len = total - off;
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != ZX_OK) {
-        return ZX_ERR_INVALID_ARGS;
+    uint8_t* out = static_cast<uint8_t*>(ptr);
+    size_t copied = 0;
+    uint64_t pos = off;
+
+    uint64_t meta_len = ks->meta_head.load();
+    if (pos < meta_len) {
+        size_t n = fbl::min<size_t>(len, meta_len - pos);
+        if (arch_copy_to_user(out, ks->meta_buffer + pos, n) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        copied += n;
+        pos += n;
+    }
+    pos -= meta_len;
+
+    for (uint32_t i = 0; i < ks->num_cpus && copied < len; i++) {
+        ktrace_cpu_buffer* cb = &ks->cpu[i];
+        uint64_t tail = cb->tail.load();
+        uint64_t used = cb->head.load() - tail;
+        if (pos >= used) {
+            pos -= used;
+            continue;
+        }
+        size_t n = fbl::min<size_t>(len - copied, used - pos);
+        zx_status_t status = ktrace_copy_ring(out + copied, cb->buffer, cb->size, tail + pos, n);
+        if (status != ZX_OK) {
+            return status;
+        }
+        copied += n;
+        pos = 0;
     }
-    return len;
+
+    return static_cast<ssize_t>(copied);
 }
 
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
@@ -135,28 +399,22 @@ zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     switch (action) {
     case KTRACE_ACTION_START:
         options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
         atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
         ktrace_report_live_processes();
         ktrace_report_live_threads();
         break;
-    case KTRACE_ACTION_STOP: {
+    case KTRACE_ACTION_STOP:
         atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
-        }
         break;
-    }
-    case KTRACE_ACTION_REWIND:
+    case KTRACE_ACTION_REWIND: {
         // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+        fbl::AutoLock lock(&reader_lock);
+        ktrace_reset_buffers();
         ktrace_report_syscalls(kt_syscall_info);
         ktrace_report_probes();
         ktrace_report_vcpu_meta();
         break;
+    }
     case KTRACE_ACTION_NEW_PROBE: {
         fbl::AutoLock lock(&probe_list_lock);
         ktrace_probe_info_t* probe;
@@ -172,6 +430,34 @@ zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
         ktrace_add_probe(probe);
         return probe->num;
     }
+    case KTRACE_ACTION_SET_MODE: {
+        if (options > KTRACE_MODE_STREAMING) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        if (atomic_load(&ks->grpmask)) {
+            return ZX_ERR_BAD_STATE;
+        }
+        // switching modes discards whatever was recorded so far
+        fbl::AutoLock lock(&reader_lock);
+        ks->mode = options;
+        ktrace_reset_buffers();
+        ktrace_report_syscalls(kt_syscall_info);
+        ktrace_report_probes();
+        ktrace_report_vcpu_meta();
+        break;
+    }
+    case KTRACE_ACTION_GET_DROPPED: {
+        // options = number of entries in ptr; one per cpu, followed by the
+        // number of name records that did not fit in the metadata buffer
+        uint64_t* counts = static_cast<uint64_t*>(ptr);
+        for (uint32_t i = 0; i < fbl::min(options, ks->num_cpus); i++) {
+            counts[i] = ks->cpu[i].dropped.load(fbl::memory_order_relaxed);
+        }
+        if (options > ks->num_cpus) {
+            counts[ks->num_cpus] = ks->meta_dropped.load(fbl::memory_order_relaxed);
+        }
+        return static_cast<zx_status_t>(ks->num_cpus + 1);
+    }
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -185,6 +471,7 @@ void ktrace_init(unsigned level) {
 
     uint32_t mb = cmdline_get_uint32("ktrace.bufsize", KTRACE_DEFAULT_BUFSIZE);
     uint32_t grpmask = cmdline_get_uint32("ktrace.grpmask", KTRACE_DEFAULT_GRPMASK);
+    const char* mode = cmdline_get("ktrace.mode");
 
     if (mb == 0) {
         dprintf(INFO, "ktrace: disabled\n");
@@ -193,19 +480,35 @@ void ktrace_init(unsigned level) {
 
     mb *= (1024*1024);
 
+    uint8_t* buffer;
     zx_status_t status;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, VmAspace::VMM_FLAG_COMMIT,
+    if ((status = aspace->Alloc("ktrace", mb, (void**)&buffer, 0, VmAspace::VMM_FLAG_COMMIT,
                                 ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
         dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
+    // An eighth of the buffer holds names and other metadata, the rest is
+    // split evenly between the cpus.
+    ks->num_cpus = arch_max_num_cpus();
+    ks->meta_buffer = buffer;
+    ks->meta_size = mb / 8;
+    uint32_t cpu_size = ROUNDDOWN((mb - ks->meta_size) / ks->num_cpus, PAGE_SIZE);
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        ks->cpu[i].buffer = buffer + ks->meta_size + i * cpu_size;
+        ks->cpu[i].size = cpu_size;
+    }
 
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+    if (mode && !strcmp(mode, "circular")) {
+        ks->mode = KTRACE_MODE_CIRCULAR;
+    } else if (mode && !strcmp(mode, "streaming")) {
+        ks->mode = KTRACE_MODE_STREAMING;
+    } else {
+        ks->mode = KTRACE_MODE_LINEAR;
+    }
+
+    dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u per cpu)\n", buffer, mb, cpu_size);
 
     // register all static probes
     {
@@ -218,16 +521,12 @@ void ktrace_init(unsigned level) {
     }
 
     // write metadata to the first two event slots
-    uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
-    rec[0].tag = TAG_VERSION;
-    rec[0].a = KTRACE_VERSION;
-    rec[1].tag = TAG_TICKS_PER_MS;
-    rec[1].a = (uint32_t)n;
-    rec[1].b = (uint32_t)(n >> 32);
+    {
+        fbl::AutoLock lock(&reader_lock);
+        ktrace_reset_buffers();
+    }
 
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
     ktrace_report_syscalls(kt_syscall_info);
     ktrace_report_probes();
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
@@ -249,59 +548,44 @@ void ktrace_tiny(uint32_t tag, uint32_t arg) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-            hdr->ts = ktrace_timestamp();
-            hdr->tag = tag;
-            hdr->tid = arg;
-        }
+        ktrace_append(tag, arg, nullptr, 0);
     }
 }
 
-void* ktrace_open(uint32_t tag) {
+bool ktrace_write(uint32_t tag, const void* payload, size_t len) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (!(tag & atomic_load(&ks->grpmask))) {
-        return nullptr;
-    }
-
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
-        return nullptr;
+        return false;
     }
 
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-    hdr->ts = ktrace_timestamp();
-    hdr->tag = tag;
-    hdr->tid = (uint32_t)get_current_thread()->user_tid;
-    return hdr + 1;
+    return ktrace_append(tag, (uint32_t)get_current_thread()->user_tid, payload, len);
 }
 
 void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->meta_buffer == nullptr) {
+        return;
+    }
     if ((tag & atomic_load(&ks->grpmask)) || always) {
         uint32_t len = static_cast<uint32_t>(strnlen(name, ZX_MAX_NAME_LEN - 1));
 
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
-            rec->tag = tag;
-            rec->id = id;
-            rec->arg = arg;
-            memcpy(rec->name, name, len);
-            rec->name[len] = 0;
+        AutoSpinLock guard(&meta_lock);
+        uint64_t off = ks->meta_head.load(fbl::memory_order_relaxed);
+        if (off + KTRACE_LEN(tag) > ks->meta_size) {
+            ks->meta_dropped.fetch_add(1, fbl::memory_order_relaxed);
+            return;
         }
+
+        ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->meta_buffer + off);
+        rec->tag = tag;
+        rec->id = id;
+        rec->arg = arg;
+        memcpy(rec->name, name, len);
+        rec->name[len] = 0;
+        ks->meta_head.store(off + KTRACE_LEN(tag), fbl::memory_order_release);
     }
 }
 
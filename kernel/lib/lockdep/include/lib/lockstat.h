@@ -0,0 +1,37 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stddef.h>
+#include <zircon/syscalls/object.h>
+#include <zircon/types.h>
+
+// Lock statistics record, for every lock class known to lockdep, how often
+// locks of the class are acquired and contended and how long they are waited
+// for and held. They are only available in kernels built with ENABLE_LOCK_STAT
+// and are collected while enabled with the kernel.lockstat.enable command line
+// option or the 'k lockstat start' command.
+namespace lockstat {
+
+// Returns the number of lock classes statistics are kept for, or zero if the
+// kernel was built without lock statistics.
+size_t GetClassCount();
+
+// Fills |info| with the statistics of the lock class at |index|, summed across
+// all cpus. Returns ZX_ERR_OUT_OF_RANGE if |index| is not below
+// GetClassCount().
+zx_status_t GetClassInfo(size_t index, zx_info_lock_stats_t* info);
+
+// Starts or stops collecting statistics, as 'k lockstat start' and 'k lockstat
+// stop' do. Returns ZX_ERR_NOT_SUPPORTED if the kernel was built without lock
+// statistics.
+zx_status_t SetEnabled(bool enable);
+
+// Returns whether statistics are being collected.
+bool IsEnabled();
+
+} // namespace lockstat
@@ -0,0 +1,395 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/lockstat.h>
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/spinlock.h>
+#include <lib/console.h>
+#include <lib/counters.h>
+#include <lk/init.h>
+#include <platform.h>
+#include <pow2.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/atomic.h>
+#include <lockdep/lockdep.h>
+
+#if WITH_LOCK_STAT
+
+KCOUNTER(lockstat_acquisitions, "kernel.lockstat.acquisitions");
+KCOUNTER(lockstat_contentions, "kernel.lockstat.contentions");
+KCOUNTER(lockstat_wait_ns, "kernel.lockstat.wait_ns");
+KCOUNTER_MAX(lockstat_max_wait_ns, "kernel.lockstat.max_wait_ns");
+
+namespace {
+
+// Number of slots in the table that maps lock class ids to indices. At most
+// half of them are used so that lookups stay short.
+constexpr size_t kClassSlots = 1024;
+constexpr size_t kMaxClasses = kClassSlots / 2;
+static_assert(ispow2(kClassSlots), "");
+
+constexpr size_t kCallSites = ZX_LOCK_STATS_CALL_SITES;
+
+// Candidate call sites considered when merging the call sites of all cpus.
+constexpr size_t kMergedCallSites = 4 * kCallSites;
+
+struct CallSite {
+    uintptr_t caller;
+    uint64_t contentions;
+    zx_duration_t total_wait;
+};
+
+struct ClassStats {
+    uint64_t acquisitions;
+    uint64_t contentions;
+    zx_duration_t total_wait;
+    zx_duration_t max_wait;
+    zx_duration_t total_hold;
+    zx_duration_t max_hold;
+    CallSite call_sites[kCallSites];
+};
+
+struct ClassSlot {
+    lockdep::LockClassId id;
+    size_t index;
+};
+
+// The lock classes and the table mapping their ids to indices in |classes|.
+// Both are filled in at init and only read afterwards.
+ClassSlot class_slots[kClassSlots];
+lockdep::LockClassState* classes[kMaxClasses];
+size_t class_count;
+
+// Per cpu arrays of ClassStats, indexed like |classes|. Each array is only
+// written by its own cpu with interrupts disabled. Readers on other cpus see
+// a racy but word-wise consistent view, which is good enough for statistics.
+ClassStats* cpu_stats[SMP_MAX_CPUS];
+size_t cpu_count;
+
+// Whether statistics are being collected. Only set once init has completed.
+// Note: this would be fbl::atomic<bool>, except that fbl doesn't support that
+// specialization.
+fbl::atomic<int> enabled;
+
+// Acquisitions that wait at least this long count as contended.
+zx_duration_t contention_threshold;
+
+size_t HashId(lockdep::LockClassId id) {
+    // Ids are addresses of static LockClassState instances.
+    return (id / sizeof(lockdep::LockClassState)) & (kClassSlots - 1);
+}
+
+bool AddClass(lockdep::LockClassState* state) {
+    if (class_count == kMaxClasses)
+        return false;
+
+    size_t slot = HashId(state->id());
+    while (class_slots[slot].id != lockdep::kInvalidLockClassId)
+        slot = (slot + 1) & (kClassSlots - 1);
+
+    class_slots[slot] = {state->id(), class_count};
+    classes[class_count++] = state;
+    return true;
+}
+
+bool LookupClass(lockdep::LockClassId id, size_t* index) {
+    for (size_t slot = HashId(id);; slot = (slot + 1) & (kClassSlots - 1)) {
+        if (class_slots[slot].id == id) {
+            *index = class_slots[slot].index;
+            return true;
+        }
+        if (class_slots[slot].id == lockdep::kInvalidLockClassId)
+            return false;
+    }
+}
+
+// Returns the stats of the given lock class for the current cpu, or nullptr if
+// they are not kept. Interrupts must be disabled.
+ClassStats* GetLocalStats(lockdep::LockClassId id) {
+    size_t index;
+    if (!LookupClass(id, &index))
+        return nullptr;
+    const cpu_num_t cpu = arch_curr_cpu_num();
+    if (cpu >= cpu_count)
+        return nullptr;
+    return &cpu_stats[cpu][index];
+}
+
+// Charges a contended acquisition to |caller|. The call sites are an
+// approximation of the ones that waited the longest: when all entries are in
+// use, the one with the least total wait is replaced by a new caller that
+// waited at least as long.
+void RecordCallSite(CallSite* sites, size_t count, uintptr_t caller,
+                    zx_duration_t wait, uint64_t contentions) {
+    CallSite* least = &sites[0];
+    for (size_t i = 0; i < count; i++) {
+        CallSite* site = &sites[i];
+        if (site->caller == caller || site->caller == 0) {
+            site->caller = caller;
+            site->contentions += contentions;
+            site->total_wait += wait;
+            return;
+        }
+        if (site->total_wait < least->total_wait)
+            least = site;
+    }
+    if (wait >= least->total_wait)
+        *least = {caller, contentions, wait};
+}
+
+// Sums the statistics of the lock class at |index| across all cpus.
+void SumClass(size_t index, zx_info_lock_stats_t* info) {
+    *info = {};
+    strlcpy(info->name, classes[index]->name(), sizeof(info->name));
+
+    CallSite merged[kMergedCallSites] = {};
+    for (size_t cpu = 0; cpu < cpu_count; cpu++) {
+        const ClassStats& stats = cpu_stats[cpu][index];
+        info->acquisitions += stats.acquisitions;
+        info->contentions += stats.contentions;
+        info->total_wait += stats.total_wait;
+        info->max_wait = fbl::max(info->max_wait, stats.max_wait);
+        info->total_hold += stats.total_hold;
+        info->max_hold = fbl::max(info->max_hold, stats.max_hold);
+        for (const CallSite& site : stats.call_sites) {
+            if (site.caller != 0) {
+                RecordCallSite(merged, kMergedCallSites, site.caller, site.total_wait,
+                               site.contentions);
+            }
+        }
+    }
+
+    // Report the call sites that waited the longest, longest first.
+    for (auto& out : info->call_sites) {
+        CallSite* longest = &merged[0];
+        for (auto& site : merged) {
+            if (site.total_wait > longest->total_wait)
+                longest = &site;
+        }
+        if (longest->caller == 0)
+            break;
+        out = {longest->caller, longest->contentions, longest->total_wait};
+        *longest = {};
+    }
+}
+
+void ResetStats() {
+    for (size_t cpu = 0; cpu < cpu_count; cpu++)
+        memset(cpu_stats[cpu], 0, class_count * sizeof(ClassStats));
+}
+
+void LockStatInit(unsigned /*level*/) {
+    for (auto& state : lockdep::LockClassState::Iter()) {
+        if (!AddClass(&state)) {
+            printf("lockstat: too many lock classes, not tracking %s\n", state.name());
+        }
+    }
+
+    const size_t max_cpus = fbl::min<size_t>(arch_max_num_cpus(), SMP_MAX_CPUS);
+    for (size_t cpu = 0; cpu < max_cpus; cpu++) {
+        fbl::AllocChecker ac;
+        cpu_stats[cpu] = new (&ac) ClassStats[class_count]();
+        if (!ac.check()) {
+            printf("lockstat: failed to allocate statistics for cpu %zu\n", cpu);
+            return;
+        }
+    }
+    cpu_count = max_cpus;
+
+    contention_threshold = cmdline_get_uint64("kernel.lockstat.contention-threshold-ns", 1000);
+    if (cmdline_get_bool("kernel.lockstat.enable", false))
+        enabled.store(1);
+}
+
+int CommandLockStat(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc < 2) {
+        printf("Not enough arguments:\n");
+    usage:
+        printf("%s start             : start collecting lock statistics\n", argv[0].str);
+        printf("%s stop              : stop collecting lock statistics\n", argv[0].str);
+        printf("%s reset             : clear lock statistics\n", argv[0].str);
+        printf("%s dump [count]      : dump the |count| (default 20) most contended\n"
+               "                          lock classes\n", argv[0].str);
+        return -1;
+    }
+
+    if (strcmp(argv[1].str, "start") == 0) {
+        if (lockstat::SetEnabled(true) != ZX_OK) {
+            printf("lock statistics are not available\n");
+            return -1;
+        }
+    } else if (strcmp(argv[1].str, "stop") == 0) {
+        lockstat::SetEnabled(false);
+    } else if (strcmp(argv[1].str, "reset") == 0) {
+        ResetStats();
+    } else if (strcmp(argv[1].str, "dump") == 0) {
+        const size_t count = (argc > 2) ? static_cast<size_t>(argv[2].u) : 20;
+
+        fbl::AllocChecker ac;
+        auto infos = new (&ac) zx_info_lock_stats_t[class_count];
+        if (!ac.check()) {
+            printf("failed to allocate memory\n");
+            return -1;
+        }
+        for (size_t i = 0; i < class_count; i++)
+            SumClass(i, &infos[i]);
+        qsort(infos, class_count, sizeof(*infos), [](const void* a, const void* b) {
+            const auto& x = *static_cast<const zx_info_lock_stats_t*>(a);
+            const auto& y = *static_cast<const zx_info_lock_stats_t*>(b);
+            return (x.total_wait < y.total_wait) - (x.total_wait > y.total_wait);
+        });
+
+        printf("Lock statistics (%s, contention threshold %" PRId64 " ns):\n",
+               enabled.load() ? "enabled" : "disabled", contention_threshold);
+        for (size_t i = 0; i < fbl::min(count, class_count); i++) {
+            const zx_info_lock_stats_t& info = infos[i];
+            printf("  %s\n", info.name);
+            printf("    acquired %" PRIu64 " contended %" PRIu64
+                   " wait total %" PRId64 " max %" PRId64
+                   " ns hold total %" PRId64 " max %" PRId64 " ns\n",
+                   info.acquisitions, info.contentions, info.total_wait, info.max_wait,
+                   info.total_hold, info.max_hold);
+            for (const auto& site : info.call_sites) {
+                if (site.caller == 0)
+                    break;
+                printf("    caller %#" PRIx64 " contended %" PRIu64 " wait %" PRId64 " ns\n",
+                       site.caller, site.contentions, site.total_wait);
+            }
+        }
+        delete[] infos;
+    } else {
+        printf("Unrecognized subcommand: '%s'\n", argv[1].str);
+        goto usage;
+    }
+
+    return 0;
+}
+
+} // anonymous namespace
+
+STATIC_COMMAND_START
+STATIC_COMMAND("lockstat", "kernel lock contention statistics", &CommandLockStat)
+STATIC_COMMAND_END(lockstat);
+
+LK_INIT_HOOK(lockstat, LockStatInit, LK_INIT_LEVEL_THREADING);
+
+namespace lockdep {
+
+// Returns the time an acquisition started if statistics are being collected.
+uint64_t SystemLockStatBeginAcquire() {
+    if (!enabled.load(fbl::memory_order_relaxed))
+        return 0;
+    return current_time();
+}
+
+// Records the wait time of an acquisition and returns the time the lock was
+// acquired, to compute the hold time on release.
+uint64_t SystemLockStatAcquired(LockClassId id, uint64_t begin, void* caller_address) {
+    if (begin == 0)
+        return 0;
+
+    const zx_time_t now = current_time();
+    const zx_duration_t wait = zx_time_sub_time(now, begin);
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    ClassStats* stats = GetLocalStats(id);
+    if (stats != nullptr) {
+        stats->acquisitions++;
+        kcounter_add(lockstat_acquisitions, 1);
+        if (wait >= contention_threshold) {
+            stats->contentions++;
+            stats->total_wait += wait;
+            stats->max_wait = fbl::max(stats->max_wait, wait);
+            RecordCallSite(stats->call_sites, kCallSites,
+                           reinterpret_cast<uintptr_t>(caller_address), wait, 1);
+            kcounter_add(lockstat_contentions, 1);
+            kcounter_add(lockstat_wait_ns, wait);
+            kcounter_max(lockstat_max_wait_ns, wait);
+        }
+    }
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return now;
+}
+
+// Records the hold time of a lock acquired at |acquired|.
+void SystemLockStatReleased(LockClassId id, uint64_t acquired) {
+    const zx_duration_t hold = zx_time_sub_time(current_time(), acquired);
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    ClassStats* stats = GetLocalStats(id);
+    if (stats != nullptr) {
+        stats->total_hold += hold;
+        stats->max_hold = fbl::max(stats->max_hold, hold);
+    }
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+} // namespace lockdep
+
+namespace lockstat {
+
+size_t GetClassCount() {
+    return (cpu_count != 0) ? class_count : 0;
+}
+
+zx_status_t GetClassInfo(size_t index, zx_info_lock_stats_t* info) {
+    if (index >= GetClassCount())
+        return ZX_ERR_OUT_OF_RANGE;
+    SumClass(index, info);
+    return ZX_OK;
+}
+
+zx_status_t SetEnabled(bool enable) {
+    if (cpu_count == 0)
+        return ZX_ERR_NOT_SUPPORTED;
+    enabled.store(enable ? 1 : 0);
+    return ZX_OK;
+}
+
+bool IsEnabled() {
+    return enabled.load() != 0;
+}
+
+} // namespace lockstat
+
+#else // WITH_LOCK_STAT
+
+namespace lockstat {
+
+size_t GetClassCount() {
+    return 0;
+}
+
+zx_status_t GetClassInfo(size_t, zx_info_lock_stats_t*) {
+    return ZX_ERR_OUT_OF_RANGE;
+}
+
+zx_status_t SetEnabled(bool) {
+    return ZX_ERR_NOT_SUPPORTED;
+}
+
+bool IsEnabled() {
+    return false;
+}
+
+} // namespace lockstat
+
+#endif // WITH_LOCK_STAT
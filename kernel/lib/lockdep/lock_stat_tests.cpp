@@ -0,0 +1,114 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/lockstat.h>
+
+#include <kernel/event.h>
+#include <kernel/lockdep.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <lib/unittest/unittest.h>
+#include <string.h>
+
+#include <fbl/mutex.h>
+
+#if WITH_LOCK_STAT
+
+namespace {
+
+struct LockStatTestLock {
+    DECLARE_MUTEX(LockStatTestLock) lock;
+};
+
+// Finds the statistics of the lock class of LockStatTestLock::lock.
+bool GetTestLockInfo(zx_info_lock_stats_t* info) {
+    for (size_t i = 0; i < lockstat::GetClassCount(); i++) {
+        if (lockstat::GetClassInfo(i, info) == ZX_OK &&
+            strstr(info->name, "LockStatTestLock") != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct HolderArgs {
+    LockStatTestLock* test_lock;
+    event_t acquired;
+};
+
+// Holds the test lock for a while so that the test thread has to wait for it.
+int HolderThread(void* arg) {
+    auto args = static_cast<HolderArgs*>(arg);
+    Guard<fbl::Mutex> guard{&args->test_lock->lock};
+    event_signal(&args->acquired, true);
+    thread_sleep_relative(ZX_MSEC(5));
+    return 0;
+}
+
+bool acquisitions_counted() {
+    BEGIN_TEST;
+
+    const bool was_enabled = lockstat::IsEnabled();
+    ASSERT_EQ(ZX_OK, lockstat::SetEnabled(true), "");
+
+    zx_info_lock_stats_t before;
+    const bool known = GetTestLockInfo(&before);
+
+    constexpr uint64_t kAcquisitions = 100;
+    LockStatTestLock test_lock;
+    for (uint64_t i = 0; i < kAcquisitions; i++) {
+        Guard<fbl::Mutex> guard{&test_lock.lock};
+    }
+
+    zx_info_lock_stats_t after;
+    ASSERT_TRUE(known && GetTestLockInfo(&after), "test lock class not found");
+    EXPECT_GE(after.acquisitions - before.acquisitions, kAcquisitions, "");
+
+    lockstat::SetEnabled(was_enabled);
+    END_TEST;
+}
+
+bool contention_counted() {
+    BEGIN_TEST;
+
+    const bool was_enabled = lockstat::IsEnabled();
+    ASSERT_EQ(ZX_OK, lockstat::SetEnabled(true), "");
+
+    zx_info_lock_stats_t before;
+    ASSERT_TRUE(GetTestLockInfo(&before), "test lock class not found");
+
+    LockStatTestLock test_lock;
+    HolderArgs args;
+    args.test_lock = &test_lock;
+    event_init(&args.acquired, false, 0);
+    thread_t* holder = thread_create("lockstat holder", HolderThread, &args, DEFAULT_PRIORITY);
+    ASSERT_NONNULL(holder, "");
+    thread_resume(holder);
+    event_wait(&args.acquired);
+
+    { Guard<fbl::Mutex> guard{&test_lock.lock}; }
+    thread_join(holder, nullptr, ZX_TIME_INFINITE);
+    event_destroy(&args.acquired);
+
+    zx_info_lock_stats_t after;
+    ASSERT_TRUE(GetTestLockInfo(&after), "test lock class not found");
+    EXPECT_GE(after.contentions - before.contentions, 1u, "");
+    EXPECT_GE(after.max_wait, ZX_MSEC(1), "");
+    EXPECT_GE(after.max_hold, ZX_MSEC(1), "");
+    EXPECT_NE(0u, after.call_sites[0].caller, "");
+
+    lockstat::SetEnabled(was_enabled);
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(lock_stat_tests)
+UNITTEST("acquisitions counted", acquisitions_counted)
+UNITTEST("contention counted", contention_counted)
+UNITTEST_END_TESTCASE(lock_stat_tests, "lock_stat", "Lock statistics test");
+
+#endif // WITH_LOCK_STAT
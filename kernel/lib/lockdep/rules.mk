@@ -13,6 +13,12 @@ KERNEL_INCLUDES += $(LOCAL_DIR)/include \
                    $(SRC_DIR)/include
 
 MODULE_SRCS := \
-	$(LOCAL_DIR)/lock_dep.cpp
+	$(LOCAL_DIR)/lock_dep.cpp \
+	$(LOCAL_DIR)/lock_stat.cpp \
+	$(LOCAL_DIR)/lock_stat_tests.cpp
+
+MODULE_DEPS := \
+	kernel/lib/console \
+	kernel/lib/unittest
 
 include make/module.mk
@@ -12,6 +12,7 @@
 #include <lib/console.h>
 #include <platform.h>
 #include <pretty/sizes.h>
+#include <vm/page_scanner.h>
 #include <vm/pmm.h>
 #include <zircon/errors.h>
 #include <zircon/time.h>
@@ -107,7 +108,19 @@ static int oom_loop(void* arg) {
         last_free_bytes = free_bytes;
 
         if (lowmem) {
-            lowmem_callback(shortfall_bytes);
+            // Give back any pages stashed in the per-cpu caches and the zero
+            // pool so they are available to whichever cpu needs them next.
+            pmm_drain_cpu_caches();
+            pmm_drain_zero_pool();
+
+            // Dropping inactive pages of pager-backed VMOs is much cheaper
+            // than what the callback does, so only fall back to it if that
+            // doesn't cover the shortfall.
+            const uint64_t shortfall_pages = (shortfall_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+            const uint64_t reclaimed_pages = page_scanner_reclaim(shortfall_pages);
+            if (reclaimed_pages < shortfall_pages) {
+                lowmem_callback((shortfall_pages - reclaimed_pages) * PAGE_SIZE);
+            }
         }
 
         thread_sleep_relative(sleep_duration_ns);
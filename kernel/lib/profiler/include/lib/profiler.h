@@ -0,0 +1,52 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <kernel/percpu.h>
+#include <kernel/thread.h>
+#include <sys/types.h>
+#include <zircon/types.h>
+
+// The sampling profiler periodically interrupts every cpu from a per-cpu timer
+// and records the interrupted pc and a frame pointer backtrace as a
+// TAG_PROFILE_SAMPLE ktrace record in the cpu's ktrace buffer. Samples are only
+// kept while ktrace records the KTRACE_GRP_PROFILE group. The profiler is
+// started with the kernel.profiler.enable command line option or the
+// 'k profile start' command.
+
+// The shortest sample period profiler_start() accepts. Anything shorter would
+// have the cpus spend most of their time walking stacks.
+#define PROFILER_MIN_PERIOD ZX_USEC(10)
+
+// Starts sampling every cpu once every |period| nanoseconds. Returns
+// ZX_ERR_INVALID_ARGS if |period| is shorter than PROFILER_MIN_PERIOD and
+// ZX_ERR_BAD_STATE if the profiler is already running.
+zx_status_t profiler_start(zx_duration_t period);
+
+// Stops sampling. Returns once no cpu is taking a sample any more.
+void profiler_stop(void);
+
+// Returns whether the profiler is running.
+bool profiler_is_running(void);
+
+// Returns the number of samples taken since boot, whether or not ktrace kept
+// them. Samples of idle cpus aren't taken.
+uint64_t profiler_samples_taken(void);
+
+// Called on the way back to user mode by a thread the profiler interrupted in
+// user mode, to record the sample with the thread's user backtrace, which
+// can't be walked in irq context.
+void profiler_sample_user_thread(thread_t* t);
+
+// Called by the architecture's irq entry code to record the context the irq
+// interrupted, which a sample taken by the irq describes.
+static inline void profiler_set_irq_context(vaddr_t pc, vaddr_t fp, bool from_user) {
+    struct percpu* c = get_local_percpu();
+    c->irq_pc = pc;
+    c->irq_fp = fp;
+    c->irq_from_user = from_user;
+}
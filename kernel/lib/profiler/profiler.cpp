@@ -0,0 +1,274 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/profiler.h>
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/lockdep.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/thread_lock.h>
+#include <kernel/timer.h>
+#include <lib/console.h>
+#include <lib/counters.h>
+#include <lib/ktrace.h>
+#include <lib/user_copy/user_ptr.h>
+#include <lk/init.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vm/vm.h>
+#include <zircon/time.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+
+KCOUNTER(profiler_samples, "kernel.profiler.samples");
+KCOUNTER(profiler_user_samples, "kernel.profiler.user_samples");
+KCOUNTER(profiler_idle_samples, "kernel.profiler.idle_samples");
+
+namespace {
+
+constexpr zx_duration_t kDefaultPeriod = ZX_USEC(1000);
+
+// Serializes starting and stopping the profiler.
+DECLARE_SINGLETON_MUTEX(ProfilerLock);
+
+fbl::atomic<bool> running;
+fbl::atomic<uint64_t> samples_taken;
+zx_duration_t period;
+timer_t timers[SMP_MAX_CPUS];
+
+struct Sample {
+    uint32_t pid;
+    uint32_t flags;
+    uint64_t pc[KTRACE_PROFILE_MAX_FRAMES];
+};
+
+static_assert(sizeof(Sample) == sizeof(ktrace_rec_profile_t) - KTRACE_HDRSIZE, "");
+
+void WriteSample(const thread_t* t, Sample* sample, size_t frames, uint32_t flags) {
+    sample->pid = static_cast<uint32_t>(t->user_pid);
+    sample->flags = flags | (arch_curr_cpu_num() << 8);
+    ktrace_write(TAG_PROFILE_SAMPLE(frames), sample,
+                 offsetof(Sample, pc) + frames * sizeof(sample->pc[0]));
+    samples_taken.fetch_add(1);
+}
+
+// Follows the chain of frame pointers starting at |fp| through the kernel
+// stack of |t|, filling |sample| after the interrupted pc. Returns the number
+// of pcs in |sample|.
+size_t WalkKernelStack(const thread_t* t, vaddr_t fp, Sample* sample) {
+    // without frame pointers, dont even try
+    if (!WITH_FRAME_POINTERS) {
+        return 1;
+    }
+
+    const vaddr_t stack_base = t->stack.base;
+    const vaddr_t stack_top = t->stack.base + t->stack.size;
+
+    size_t n = 1;
+    while (n < KTRACE_PROFILE_MAX_FRAMES) {
+        if (fp < stack_base || fp > stack_top - 2 * sizeof(vaddr_t) ||
+            !IS_ALIGNED(fp, sizeof(vaddr_t))) {
+            break;
+        }
+        const vaddr_t* frame = reinterpret_cast<const vaddr_t*>(fp);
+        if (frame[1] == 0) {
+            break;
+        }
+        sample->pc[n++] = frame[1];
+        // Frames of callers live further up the stack; anything else is junk.
+        if (frame[0] <= fp) {
+            break;
+        }
+        fp = frame[0];
+    }
+    return n;
+}
+
+// Like WalkKernelStack(), but through the user stack of the current thread.
+// This may fault in pages, so it can't be used in irq context.
+size_t WalkUserStack(vaddr_t fp, Sample* sample) {
+    size_t n = 1;
+    while (n < KTRACE_PROFILE_MAX_FRAMES) {
+        if (fp == 0 || !is_user_address(fp) || !IS_ALIGNED(fp, sizeof(vaddr_t))) {
+            break;
+        }
+        vaddr_t frame[2];
+        auto user_frame = make_user_in_ptr(reinterpret_cast<const vaddr_t*>(fp));
+        if (user_frame.copy_array_from_user(frame, fbl::count_of(frame)) != ZX_OK ||
+            frame[1] == 0) {
+            break;
+        }
+        sample->pc[n++] = frame[1];
+        if (frame[0] <= fp) {
+            break;
+        }
+        fp = frame[0];
+    }
+    return n;
+}
+
+// Takes a sample of the context the timer interrupted on this cpu. Called in
+// irq context.
+void TakeSample() {
+    thread_t* t = get_current_thread();
+    if (thread_is_idle(t)) {
+        kcounter_add(profiler_idle_samples, 1);
+        return;
+    }
+
+    const struct percpu* c = get_local_percpu();
+    if (c->irq_from_user) {
+        // The user stack can't be touched from here, so let the thread record
+        // the sample itself on the way back to user mode.
+        t->profile_user_pc = c->irq_pc;
+        t->profile_user_fp = c->irq_fp;
+        Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+        t->signals |= THREAD_SIGNAL_SAMPLE;
+        return;
+    }
+
+    Sample sample;
+    sample.pc[0] = c->irq_pc;
+    const size_t frames = WalkKernelStack(t, c->irq_fp, &sample);
+    WriteSample(t, &sample, frames, 0);
+    kcounter_add(profiler_samples, 1);
+}
+
+void ProfilerTick(timer_t* timer, zx_time_t now, void* arg) {
+    if (!running.load()) {
+        return;
+    }
+    TakeSample();
+    timer_set_oneshot(timer, zx_time_add_duration(now, period), ProfilerTick, nullptr);
+}
+
+void StartOnCpu(void*) {
+    timer_t* timer = &timers[arch_curr_cpu_num()];
+    timer_set_oneshot(timer, zx_time_add_duration(current_time(), period),
+                      ProfilerTick, nullptr);
+}
+
+} // namespace
+
+void profiler_sample_user_thread(thread_t* t) {
+    DEBUG_ASSERT(t == get_current_thread());
+
+    // The walk may fault in user pages, which needs interrupts.
+    const bool ints_disabled = arch_ints_disabled();
+    if (ints_disabled) {
+        arch_enable_ints();
+    }
+
+    Sample sample;
+    sample.pc[0] = t->profile_user_pc;
+    const size_t frames = WalkUserStack(t->profile_user_fp, &sample);
+    WriteSample(t, &sample, frames, KTRACE_PROFILE_FLAG_USER);
+    kcounter_add(profiler_samples, 1);
+    kcounter_add(profiler_user_samples, 1);
+
+    if (ints_disabled) {
+        arch_disable_ints();
+    }
+}
+
+zx_status_t profiler_start(zx_duration_t sample_period) {
+    if (sample_period < PROFILER_MIN_PERIOD) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    Guard<fbl::Mutex> guard{ProfilerLock::Get()};
+    if (running.load()) {
+        return ZX_ERR_BAD_STATE;
+    }
+    period = sample_period;
+    running.store(true);
+    mp_sync_exec(MP_IPI_TARGET_ALL, 0, StartOnCpu, nullptr);
+    return ZX_OK;
+}
+
+void profiler_stop() {
+    Guard<fbl::Mutex> guard{ProfilerLock::Get()};
+    if (!running.load()) {
+        return;
+    }
+    running.store(false);
+    for (auto& timer : timers) {
+        timer_cancel(&timer);
+    }
+}
+
+bool profiler_is_running() {
+    return running.load();
+}
+
+uint64_t profiler_samples_taken() {
+    return samples_taken.load();
+}
+
+static void profiler_init(uint level) {
+    for (auto& timer : timers) {
+        timer_init(&timer);
+    }
+
+    if (cmdline_get_bool("kernel.profiler.enable", false)) {
+        const uint64_t period_us =
+            cmdline_get_uint64("kernel.profiler.period-us", kDefaultPeriod / ZX_USEC(1));
+        if (profiler_start(ZX_USEC(period_us)) != ZX_OK) {
+            printf("profiler: invalid sample period %" PRIu64 " us, the minimum is %" PRId64
+                   " us\n",
+                   period_us, PROFILER_MIN_PERIOD / ZX_USEC(1));
+        }
+    }
+}
+
+static int cmd_profile(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc < 2) {
+        printf("Not enough arguments:\n");
+    usage:
+        printf("%s start [period_us] : sample every cpu every |period_us| (default %" PRId64
+               ", at least %" PRId64 ") microseconds\n",
+               argv[0].str, kDefaultPeriod / ZX_USEC(1), PROFILER_MIN_PERIOD / ZX_USEC(1));
+        printf("%s stop              : stop sampling\n", argv[0].str);
+        printf("%s status            : print whether the profiler is running\n", argv[0].str);
+        printf("Samples are recorded in the ktrace buffer while ktrace records group %#x\n",
+               KTRACE_GRP_PROFILE);
+        return -1;
+    }
+
+    if (!strcmp(argv[1].str, "start")) {
+        const uint64_t period_us = argc > 2 ? argv[2].u : kDefaultPeriod / ZX_USEC(1);
+        if (ZX_USEC(period_us) < PROFILER_MIN_PERIOD) {
+            printf("the sample period must be at least %" PRId64 " us\n",
+                   PROFILER_MIN_PERIOD / ZX_USEC(1));
+            return -1;
+        }
+        zx_status_t status = profiler_start(ZX_USEC(period_us));
+        if (status != ZX_OK) {
+            printf("failed to start the profiler: %d\n", status);
+            return -1;
+        }
+    } else if (!strcmp(argv[1].str, "stop")) {
+        profiler_stop();
+    } else if (!strcmp(argv[1].str, "status")) {
+        printf("profiler %s, period %" PRId64 " us\n",
+               profiler_is_running() ? "running" : "stopped", period / ZX_USEC(1));
+    } else {
+        printf("Unrecognized subcommand: '%s'\n", argv[1].str);
+        goto usage;
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("profile", "sampling profiler", &cmd_profile)
+STATIC_COMMAND_END(profile);
+
+LK_INIT_HOOK(profiler, profiler_init, LK_INIT_LEVEL_USER);
@@ -0,0 +1,20 @@
+# Copyright 2019 The Fuchsia Authors
+#
+# Use of this source code is governed by a MIT-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/MIT
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_DEPS := \
+	kernel/lib/console \
+	kernel/lib/unittest \
+	kernel/lib/user_copy
+
+MODULE_SRCS := \
+	$(LOCAL_DIR)/profiler.cpp \
+	$(LOCAL_DIR)/profiler_tests.cpp
+
+include make/module.mk
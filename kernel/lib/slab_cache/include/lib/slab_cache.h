@@ -0,0 +1,164 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <new>
+#include <stddef.h>
+
+#include <fbl/mutex.h>
+#include <fbl/type_support.h>
+#include <kernel/align.h>
+#include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
+#include <lib/counters.h>
+#include <list.h>
+#include <zircon/types.h>
+
+// SlabCache is an allocator for kernel objects of a single, fixed size that
+// are allocated and freed at a high rate, such as port packets.
+//
+// Objects are carved out of whole pages taken from the PMM.  Free objects
+// are kept in a per-cpu magazine in front of a global depot, so in the common
+// case Alloc() and Free() only take the current cpu's magazine spinlock and
+// never touch the kernel heap lock or the depot lock.  Magazines refill from
+// and spill to the depot in batches of kMagazineBatch objects.
+//
+// Once the depot holds more than kIdlePages pages' worth of free objects, the
+// pages whose objects are all free are returned to the PMM, keeping one in
+// reserve.  How many objects a cache may hold at once can also be bounded by
+// |max_objects|.
+//
+// Alloc() and Free() may block and must be called from thread context.
+namespace slab {
+
+// The kcounters describing one cache, see SLAB_CACHE_COUNTERS.
+struct Counters {
+    const CounterSum* alloc; // Objects allocated.
+    const CounterSum* free;  // Objects freed.
+    const CounterSum* depot; // Magazine refills and spills that went to the depot.
+    const CounterSum* pages; // Pages backing the cache.
+};
+
+// Defines the kcounters kernel.slab.<name>.{alloc,free,depot,pages} and a
+// slab::Counters named |var| referring to them.
+#define SLAB_CACHE_COUNTERS(var, name)                              \
+    KCOUNTER(var##_alloc, "kernel.slab." name ".alloc");            \
+    KCOUNTER(var##_free, "kernel.slab." name ".free");              \
+    KCOUNTER(var##_depot, "kernel.slab." name ".depot");            \
+    KCOUNTER(var##_pages, "kernel.slab." name ".pages");            \
+    namespace {                                                     \
+    constexpr slab::Counters var{&var##_alloc, &var##_free,         \
+                                 &var##_depot, &var##_pages};       \
+    }
+
+class SlabCache {
+public:
+    // Number of objects a per-cpu magazine can hold.
+    static constexpr size_t kMagazineSize = 64;
+    // Number of objects moved between a magazine and the depot at a time.
+    static constexpr size_t kMagazineBatch = kMagazineSize / 2;
+    // Object sizes are rounded up to a multiple of this, which is enough
+    // alignment for any scalar type.
+    static constexpr size_t kObjectAlignment = 16;
+    // Pages' worth of free objects the depot may hold before the cache looks
+    // for pages to give back.
+    static constexpr size_t kIdlePages = 4;
+
+    // |max_objects| of zero means the cache may grow without bound.
+    SlabCache(const char* name, size_t object_size, size_t max_objects,
+              const Counters& counters);
+    // Every object must have been freed.
+    ~SlabCache();
+
+    SlabCache(const SlabCache&) = delete;
+    SlabCache& operator=(const SlabCache&) = delete;
+
+    // Returns an uninitialized object, or nullptr if out of memory or the
+    // cache is at |max_objects|.
+    void* Alloc();
+
+    // Returns |obj|, which must have come from Alloc() on this cache.
+    void Free(void* obj);
+
+    const char* name() const { return name_; }
+    size_t object_size() const { return object_size_; }
+
+    // Returns every object held in the per-cpu magazines to the depot.
+    void DrainMagazines();
+
+    // Returns the pages whose objects are all in the depot to the PMM, except
+    // for one.  Done automatically as free objects pile up in the depot.
+    void ReleaseIdlePages();
+
+    // Returns the number of objects carved out of pages so far, whether
+    // allocated or free.
+    size_t DiagnosticObjectCount() const;
+
+private:
+    // A free object.  The first word of free objects links the depot's
+    // free list.
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    struct Magazine {
+        DECLARE_SPINLOCK(Magazine) lock;
+        size_t count TA_GUARDED(lock) = 0;
+        void* objects[kMagazineSize] TA_GUARDED(lock);
+    } __CPU_ALIGN;
+
+    // Moves up to |count| objects from the depot to |objects|, growing the
+    // cache if the depot is empty.  Returns the number moved.
+    size_t DepotAlloc(void** objects, size_t count);
+    void DepotFree(void* const* objects, size_t count);
+    bool GrowLocked() TA_REQ(depot_lock_);
+    void ReleaseIdlePagesLocked() TA_REQ(depot_lock_);
+
+    const char* const name_;
+    const size_t object_size_;
+    const size_t max_objects_;
+    const Counters counters_;
+
+    Magazine magazines_[SMP_MAX_CPUS];
+
+    mutable DECLARE_MUTEX(SlabCache) depot_lock_;
+    FreeObject* depot_ TA_GUARDED(depot_lock_) = nullptr;
+    size_t depot_count_ TA_GUARDED(depot_lock_) = 0;
+    size_t object_count_ TA_GUARDED(depot_lock_) = 0;
+    // ReleaseIdlePagesLocked() runs once |depot_count_| reaches this.  It is
+    // raised after each pass, so passes that find nothing to release stay
+    // rare.
+    size_t release_at_ TA_GUARDED(depot_lock_);
+    list_node pages_ TA_GUARDED(depot_lock_) = LIST_INITIAL_VALUE(pages_);
+};
+
+// TypedSlabCache is a SlabCache that constructs and destroys objects of
+// type T.
+template <typename T>
+class TypedSlabCache {
+public:
+    TypedSlabCache(const char* name, size_t max_objects, const Counters& counters)
+        : cache_(name, sizeof(T), max_objects, counters) {}
+
+    template <typename... Args>
+    T* New(Args&&... args) {
+        void* mem = cache_.Alloc();
+        return mem ? new (mem) T(fbl::forward<Args>(args)...) : nullptr;
+    }
+
+    void Delete(T* obj) {
+        obj->~T();
+        cache_.Free(obj);
+    }
+
+    SlabCache& cache() { return cache_; }
+
+private:
+    SlabCache cache_;
+};
+
+} // namespace slab
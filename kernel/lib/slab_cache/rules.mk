@@ -0,0 +1,20 @@
+# Copyright 2019 The Fuchsia Authors
+#
+# Use of this source code is governed by a MIT-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/MIT
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_SRCS += \
+	$(LOCAL_DIR)/slab_cache.cpp \
+	$(LOCAL_DIR)/slab_cache_tests.cpp
+
+MODULE_DEPS += \
+	kernel/lib/counters \
+	kernel/lib/fbl \
+	kernel/lib/unittest
+
+include make/module.mk
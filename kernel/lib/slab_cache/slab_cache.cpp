@@ -0,0 +1,272 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/slab_cache.h>
+
+#include <arch/ops.h>
+#include <assert.h>
+#include <fbl/algorithm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+#include <vm/page.h>
+#include <vm/physmap.h>
+#include <vm/pmm.h>
+
+#define LOCAL_TRACE 0
+
+namespace slab {
+
+namespace {
+
+// The fewest free objects the depot may hold before ReleaseIdlePagesLocked()
+// runs.
+size_t idle_threshold(size_t object_size) {
+    return SlabCache::kIdlePages * (PAGE_SIZE / object_size);
+}
+
+// Returns the page |obj| was carved out of.
+vm_page_t* page_of(const void* obj) {
+    return paddr_to_vm_page(ROUNDDOWN(physmap_to_paddr(obj), PAGE_SIZE));
+}
+
+} // namespace
+
+SlabCache::SlabCache(const char* name, size_t object_size, size_t max_objects,
+                     const Counters& counters)
+    : name_(name),
+      object_size_(fbl::round_up(fbl::max(object_size, sizeof(FreeObject)),
+                                 kObjectAlignment)),
+      max_objects_(max_objects),
+      counters_(counters),
+      release_at_(idle_threshold(object_size_)) {
+    // Keep per-page waste small.
+    ASSERT(object_size_ <= PAGE_SIZE / 8);
+}
+
+SlabCache::~SlabCache() {
+    DrainMagazines();
+
+    Guard<fbl::Mutex> guard{&depot_lock_};
+    ASSERT_MSG(depot_count_ == object_count_, "slab cache %s: %zu of %zu objects leaked\n",
+               name_, object_count_ - depot_count_, object_count_);
+    kcounter_add(*counters_.pages, -static_cast<int64_t>(list_length(&pages_)));
+    pmm_free(&pages_);
+}
+
+void* SlabCache::Alloc() {
+    void* batch[kMagazineBatch];
+    for (;;) {
+        {
+            Magazine& mag = magazines_[arch_curr_cpu_num()];
+            Guard<SpinLock, IrqSave> guard{&mag.lock};
+            if (likely(mag.count > 0)) {
+                kcounter_add(*counters_.alloc, 1);
+                return mag.objects[--mag.count];
+            }
+        }
+
+        // The magazine is empty; refill it from the depot.  We may have
+        // migrated to another cpu while the depot was locked, so put the
+        // batch into whichever magazine is current once we have it.
+        size_t count = DepotAlloc(batch, kMagazineBatch);
+        if (count == 0 && max_objects_ != 0) {
+            // The cache can't grow; the free objects may all be sitting in
+            // other cpus' magazines.
+            DrainMagazines();
+            count = DepotAlloc(batch, kMagazineBatch);
+        }
+        if (count == 0) {
+            return nullptr;
+        }
+        kcounter_add(*counters_.depot, 1);
+
+        size_t stored;
+        {
+            Magazine& mag = magazines_[arch_curr_cpu_num()];
+            Guard<SpinLock, IrqSave> guard{&mag.lock};
+            stored = fbl::min(count, kMagazineSize - mag.count);
+            for (size_t i = 0; i < stored; i++) {
+                mag.objects[mag.count++] = batch[i];
+            }
+        }
+        if (stored < count) {
+            DepotFree(batch + stored, count - stored);
+        }
+    }
+}
+
+void SlabCache::Free(void* obj) {
+    DEBUG_ASSERT(obj != nullptr);
+
+    void* batch[kMagazineBatch];
+    {
+        Magazine& mag = magazines_[arch_curr_cpu_num()];
+        Guard<SpinLock, IrqSave> guard{&mag.lock};
+        kcounter_add(*counters_.free, 1);
+        if (likely(mag.count < kMagazineSize)) {
+            mag.objects[mag.count++] = obj;
+            return;
+        }
+
+        // The magazine is full; spill half of it to the depot to make room.
+        mag.count -= kMagazineBatch;
+        memcpy(batch, &mag.objects[mag.count], sizeof(batch));
+        mag.objects[mag.count++] = obj;
+    }
+
+    kcounter_add(*counters_.depot, 1);
+    DepotFree(batch, kMagazineBatch);
+}
+
+void SlabCache::DrainMagazines() {
+    void* objects[kMagazineSize];
+    for (Magazine& mag : magazines_) {
+        size_t count;
+        {
+            Guard<SpinLock, IrqSave> guard{&mag.lock};
+            count = mag.count;
+            memcpy(objects, mag.objects, count * sizeof(void*));
+            mag.count = 0;
+        }
+        if (count > 0) {
+            DepotFree(objects, count);
+        }
+    }
+}
+
+void SlabCache::ReleaseIdlePages() {
+    Guard<fbl::Mutex> guard{&depot_lock_};
+    ReleaseIdlePagesLocked();
+}
+
+size_t SlabCache::DiagnosticObjectCount() const {
+    Guard<fbl::Mutex> guard{&depot_lock_};
+    return object_count_;
+}
+
+size_t SlabCache::DepotAlloc(void** objects, size_t count) {
+    Guard<fbl::Mutex> guard{&depot_lock_};
+
+    size_t allocated = 0;
+    while (allocated < count) {
+        if (depot_ == nullptr && (allocated > 0 || !GrowLocked())) {
+            break;
+        }
+        FreeObject* obj = depot_;
+        depot_ = obj->next;
+        depot_count_--;
+        objects[allocated++] = obj;
+    }
+
+    // Follow the depot back down, so that the next pass doesn't wait for
+    // more free objects than it did last time.
+    release_at_ = fbl::max(idle_threshold(object_size_),
+                           fbl::min(release_at_, 2 * depot_count_));
+    return allocated;
+}
+
+void SlabCache::DepotFree(void* const* objects, size_t count) {
+    Guard<fbl::Mutex> guard{&depot_lock_};
+
+    for (size_t i = 0; i < count; i++) {
+        FreeObject* obj = static_cast<FreeObject*>(objects[i]);
+        obj->next = depot_;
+        depot_ = obj;
+    }
+    depot_count_ += count;
+
+    if (depot_count_ >= release_at_) {
+        ReleaseIdlePagesLocked();
+    }
+}
+
+// Carves a new page into free objects.
+bool SlabCache::GrowLocked() {
+    size_t count = PAGE_SIZE / object_size_;
+    if (max_objects_ != 0) {
+        if (object_count_ >= max_objects_) {
+            return false;
+        }
+        count = fbl::min(count, max_objects_ - object_count_);
+    }
+
+    vm_page_t* page;
+    paddr_t pa;
+    if (pmm_alloc_page(0, &page, &pa) != ZX_OK) {
+        LTRACEF("slab cache %s: out of memory\n", name_);
+        return false;
+    }
+    page->state = VM_PAGE_STATE_HEAP;
+    page->slab.object_count = static_cast<uint16_t>(count);
+    list_add_tail(&pages_, &page->queue_node);
+    kcounter_add(*counters_.pages, 1);
+
+    char* base = static_cast<char*>(paddr_to_physmap(pa));
+    for (size_t i = count; i > 0; i--) {
+        FreeObject* obj = reinterpret_cast<FreeObject*>(base + (i - 1) * object_size_);
+        obj->next = depot_;
+        depot_ = obj;
+    }
+    depot_count_ += count;
+    object_count_ += count;
+    return true;
+}
+
+// Frees the pages none of whose objects are allocated, keeping one of them.
+// Takes time linear in the number of free objects and pages, which is
+// amortized by raising |release_at_| to twice the objects left in the depot.
+void SlabCache::ReleaseIdlePagesLocked() {
+    // Count the free objects of each page.
+    vm_page_t* page;
+    list_for_every_entry (&pages_, page, vm_page_t, queue_node) {
+        page->slab.free_count = 0;
+    }
+    for (FreeObject* obj = depot_; obj != nullptr; obj = obj->next) {
+        page_of(obj)->slab.free_count++;
+    }
+
+    // Take the idle pages off the cache, marking them by clearing their
+    // object count.
+    list_node idle = LIST_INITIAL_VALUE(idle);
+    bool kept = false;
+    vm_page_t* temp;
+    list_for_every_entry_safe (&pages_, page, temp, vm_page_t, queue_node) {
+        if (page->slab.free_count != page->slab.object_count) {
+            continue;
+        }
+        if (!kept) {
+            kept = true;
+            continue;
+        }
+        list_delete(&page->queue_node);
+        list_add_tail(&idle, &page->queue_node);
+        object_count_ -= page->slab.object_count;
+        page->slab.object_count = 0;
+    }
+
+    // Unlink their objects from the depot, and give them back.
+    if (!list_is_empty(&idle)) {
+        FreeObject** link = &depot_;
+        while (*link != nullptr) {
+            if (page_of(*link)->slab.object_count == 0) {
+                *link = (*link)->next;
+                depot_count_--;
+            } else {
+                link = &(*link)->next;
+            }
+        }
+
+        const size_t released = list_length(&idle);
+        LTRACEF("slab cache %s: releasing %zu pages\n", name_, released);
+        kcounter_add(*counters_.pages, -static_cast<int64_t>(released));
+        pmm_free(&idle);
+    }
+
+    release_at_ = fbl::max(idle_threshold(object_size_), 2 * depot_count_);
+}
+
+} // namespace slab
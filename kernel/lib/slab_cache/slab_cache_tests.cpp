@@ -0,0 +1,171 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/slab_cache.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <lib/unittest/unittest.h>
+#include <string.h>
+
+SLAB_CACHE_COUNTERS(test_counters, "test");
+
+namespace {
+
+struct TestObject {
+    explicit TestObject(uint64_t v) : value(v) {}
+    uint64_t value;
+    char padding[40];
+};
+
+// SlabCaches are too big for the kernel stack.
+fbl::unique_ptr<slab::SlabCache> MakeCache(size_t object_size, size_t max_objects) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<slab::SlabCache> cache(
+        new (&ac) slab::SlabCache("test", object_size, max_objects, test_counters));
+    if (!ac.check()) {
+        return nullptr;
+    }
+    return cache;
+}
+
+} // namespace
+
+static bool alloc_free() {
+    BEGIN_TEST;
+
+    auto cache = MakeCache(sizeof(TestObject), 0);
+    ASSERT_NONNULL(cache.get(), "");
+
+    // Allocate more objects than fit in a magazine and a page, so that both
+    // the depot and cache growth are exercised.
+    constexpr size_t kCount = 3 * slab::SlabCache::kMagazineSize;
+    void* objects[kCount];
+    for (size_t i = 0; i < kCount; i++) {
+        objects[i] = cache->Alloc();
+        ASSERT_NONNULL(objects[i], "");
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(objects[i]) %
+                          slab::SlabCache::kObjectAlignment, "");
+        memset(objects[i], static_cast<int>(i), sizeof(TestObject));
+    }
+
+    // No two allocations overlap.
+    for (size_t i = 0; i < kCount; i++) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(objects[i]);
+        for (size_t j = 0; j < sizeof(TestObject); j++) {
+            ASSERT_EQ(static_cast<uint8_t>(i), bytes[j], "");
+        }
+    }
+
+    for (size_t i = 0; i < kCount; i++) {
+        cache->Free(objects[i]);
+    }
+
+    // Freed objects are reused rather than growing the cache.
+    size_t object_count = cache->DiagnosticObjectCount();
+    for (size_t i = 0; i < kCount; i++) {
+        objects[i] = cache->Alloc();
+        ASSERT_NONNULL(objects[i], "");
+    }
+    EXPECT_EQ(object_count, cache->DiagnosticObjectCount(), "");
+    for (size_t i = 0; i < kCount; i++) {
+        cache->Free(objects[i]);
+    }
+
+    END_TEST;
+}
+
+static bool max_objects() {
+    BEGIN_TEST;
+
+    constexpr size_t kMax = 10;
+    auto cache = MakeCache(sizeof(TestObject), kMax);
+    ASSERT_NONNULL(cache.get(), "");
+
+    void* objects[kMax];
+    for (size_t i = 0; i < kMax; i++) {
+        objects[i] = cache->Alloc();
+        ASSERT_NONNULL(objects[i], "");
+    }
+    EXPECT_NULL(cache->Alloc(), "");
+    EXPECT_EQ(kMax, cache->DiagnosticObjectCount(), "");
+
+    // A freed object can be allocated again, even if it went to the
+    // magazine of a cpu other than the one allocating.
+    cache->Free(objects[0]);
+    objects[0] = cache->Alloc();
+    EXPECT_NONNULL(objects[0], "");
+
+    for (size_t i = 0; i < kMax; i++) {
+        cache->Free(objects[i]);
+    }
+
+    END_TEST;
+}
+
+static bool release_idle_pages() {
+    BEGIN_TEST;
+
+    auto cache = MakeCache(sizeof(TestObject), 0);
+    ASSERT_NONNULL(cache.get(), "");
+
+    // Enough objects to fill many more pages than the cache keeps idle.
+    const size_t per_page = PAGE_SIZE / cache->object_size();
+    const size_t count = 4 * slab::SlabCache::kIdlePages * per_page;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<void*[]> objects(new (&ac) void*[count]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < count; i++) {
+        objects[i] = cache->Alloc();
+        ASSERT_NONNULL(objects[i], "");
+    }
+    EXPECT_GE(cache->DiagnosticObjectCount(), count, "");
+
+    // Freeing them gives most of the pages back on its own.
+    for (size_t i = 0; i < count; i++) {
+        cache->Free(objects[i]);
+    }
+    EXPECT_LT(cache->DiagnosticObjectCount(), count, "");
+
+    // Once every object is in the depot, all but one idle page goes.
+    cache->DrainMagazines();
+    cache->ReleaseIdlePages();
+    EXPECT_LE(cache->DiagnosticObjectCount(), per_page, "");
+
+    // The cache grows again as needed.
+    for (size_t i = 0; i < count; i++) {
+        objects[i] = cache->Alloc();
+        ASSERT_NONNULL(objects[i], "");
+    }
+    for (size_t i = 0; i < count; i++) {
+        cache->Free(objects[i]);
+    }
+
+    END_TEST;
+}
+
+static bool typed_cache() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<slab::TypedSlabCache<TestObject>> cache(
+        new (&ac) slab::TypedSlabCache<TestObject>("test", 0, test_counters));
+    ASSERT_TRUE(ac.check(), "");
+
+    TestObject* obj = cache->New(42u);
+    ASSERT_NONNULL(obj, "");
+    EXPECT_EQ(42u, obj->value, "");
+    cache->Delete(obj);
+
+    END_TEST;
+}
+
+UNITTEST_START_TESTCASE(slab_cache_tests)
+UNITTEST("alloc and free", alloc_free)
+UNITTEST("max objects", max_objects)
+UNITTEST("release idle pages", release_idle_pages)
+UNITTEST("typed cache", typed_cache)
+UNITTEST_END_TESTCASE(slab_cache_tests, "slab_cache", "Slab cache tests");
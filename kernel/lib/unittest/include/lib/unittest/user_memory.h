@@ -29,6 +29,7 @@ public:
     virtual ~UserMemory();
     void* out() { return reinterpret_cast<void*>(mapping_->base()); }
     const void* in() { return reinterpret_cast<void*>(mapping_->base()); }
+    const fbl::RefPtr<VmObject>& vmo() const { return mapping_->vmo(); }
 
 private:
     UserMemory(fbl::RefPtr<VmMapping> mapping)
@@ -23,7 +23,20 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+    for (Bucket& bucket : buckets_) {
+        Guard<fbl::Mutex> guard{&bucket.lock};
+        DEBUG_ASSERT(bucket.table.is_empty());
+    }
+}
+
+FutexContext::Bucket& FutexContext::BucketFor(uintptr_t futex_key) {
+    static_assert((kNumBuckets & (kNumBuckets - 1)) == 0, "kNumBuckets must be a power of 2");
+
+    // Futexes are ints, so the low two bits carry no information.  Fibonacci
+    // hashing spreads neighbouring futexes (e.g. an array of mutexes) over
+    // different buckets.
+    uint64_t hash = static_cast<uint64_t>(futex_key >> 2) * 0x9e3779b97f4a7c15ull;
+    return buckets_[hash >> (64 - __builtin_ctzll(kNumBuckets))];
 }
 
 zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
@@ -46,8 +59,10 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
     // Those two steps must together be atomic with respect to FutexWake().
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
-    // could miss wakeups.
-    Guard<fbl::Mutex> guard{&lock_};
+    // could miss wakeups.  Only the futex's bucket needs to be locked for
+    // that, since FutexWake() takes the same bucket lock.
+    Bucket& bucket = BucketFor(futex_key);
+    Guard<fbl::Mutex> guard{&bucket.lock};
 
     int value;
     zx_status_t result = value_ptr.copy_from_user(&value);
@@ -62,9 +77,10 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
     node.set_hash_key(futex_key);
     node.SetAsSingletonList();
 
-    QueueNodesLocked(&node);
+    QueueNodesLocked(bucket, &node);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
+    // Block current thread.  This releases the bucket lock and does not
+    // reacquire it.
     result = node.BlockThread(guard.take(), deadline);
     if (result == ZX_OK) {
         DEBUG_ASSERT(!node.IsInQueue());
@@ -78,8 +94,7 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const zx_futex_t> value_ptr,
     //
     // We need to ensure that the thread's node is removed from the wait
     // queue, because FutexWake() probably didn't do that.
-    Guard<fbl::Mutex> guard2{&lock_};
-    if (UnqueueNodeLocked(&node)) {
+    if (UnqueueNode(&node)) {
         return result;
     }
     // The current thread was not found on the wait queue.  This means
@@ -119,9 +134,10 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const zx_futex_t> value_ptr,
 
     AutoReschedDisable resched_disable; // Must come before the Guard.
     resched_disable.Disable();
-    Guard<fbl::Mutex> guard{&lock_};
+    Bucket& bucket = BucketFor(futex_key);
+    Guard<fbl::Mutex> guard{&bucket.lock};
 
-    FutexNode* node = futex_table_.erase(futex_key);
+    FutexNode* node = bucket.table.erase(futex_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return ZX_OK;
@@ -133,7 +149,7 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const zx_futex_t> value_ptr,
 
     if (remaining_waiters) {
         DEBUG_ASSERT(remaining_waiters->GetKey() == futex_key);
-        futex_table_.insert(remaining_waiters);
+        bucket.table.insert(remaining_waiters);
     }
 
     return ZX_OK;
@@ -159,8 +175,36 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const zx_futex_t> wake_ptr,
         return ZX_ERR_INVALID_ARGS;
     }
 
+    // The keys are validated by FutexRequeueLocked(), after the value check,
+    // but the buckets they hash to are needed up front to take the locks.
+    Bucket& wake_bucket = BucketFor(reinterpret_cast<uintptr_t>(wake_ptr.get()));
+    Bucket& requeue_bucket = BucketFor(reinterpret_cast<uintptr_t>(requeue_ptr.get()));
+
     AutoReschedDisable resched_disable; // Must come before the Guard.
-    Guard<fbl::Mutex> guard{&lock_};
+    if (&wake_bucket == &requeue_bucket) {
+        Guard<fbl::Mutex> guard{&wake_bucket.lock};
+        return FutexRequeueLocked(wake_bucket, requeue_bucket, &resched_disable,
+                                  wake_ptr, wake_count, current_value,
+                                  requeue_ptr, requeue_count);
+    }
+
+    // GuardMultiple takes the locks in address order, so two requeues in
+    // opposite directions between the same pair of buckets cannot deadlock.
+    GuardMultiple<2, fbl::Mutex> guard{&wake_bucket.lock, &requeue_bucket.lock};
+    return FutexRequeueLocked(wake_bucket, requeue_bucket, &resched_disable,
+                              wake_ptr, wake_count, current_value,
+                              requeue_ptr, requeue_count);
+}
+
+zx_status_t FutexContext::FutexRequeueLocked(Bucket& wake_bucket, Bucket& requeue_bucket,
+                                             AutoReschedDisable* resched_disable,
+                                             user_in_ptr<const zx_futex_t> wake_ptr,
+                                             uint32_t wake_count,
+                                             zx_futex_t current_value,
+                                             user_in_ptr<const zx_futex_t> requeue_ptr,
+                                             uint32_t requeue_count) {
+    DEBUG_ASSERT(wake_bucket.lock.lock().IsHeld());
+    DEBUG_ASSERT(requeue_bucket.lock.lock().IsHeld());
 
     int value;
     zx_status_t result = wake_ptr.copy_from_user(&value);
@@ -174,9 +218,9 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const zx_futex_t> wake_ptr,
         return ZX_ERR_INVALID_ARGS;
 
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
-    // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    // nodes below, because operations on the bucket tables look at the
+    // GetKey field of the list head nodes for wake_key and requeue_key.
+    FutexNode* node = wake_bucket.table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return ZX_OK;
@@ -184,7 +228,7 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const zx_futex_t> wake_ptr,
 
     // This must come before WakeThreads() to be useful, but we want to
     // avoid doing it before copy_from_user() in case that faults.
-    resched_disable.Disable();
+    resched_disable->Disable();
 
     if (wake_count > 0) {
         node = FutexNode::WakeThreads(node, wake_count, wake_key);
@@ -200,14 +244,14 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const zx_futex_t> wake_ptr,
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket.table.insert(node);
     }
 
     return ZX_OK;
@@ -218,8 +262,9 @@ zx_status_t FutexContext::FutexGetOwner(user_in_ptr<const zx_futex_t> wake_ptr,
     return koid.copy_to_user(ZX_KOID_INVALID);
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.lock().IsHeld());
+void FutexContext::QueueNodesLocked(Bucket& bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket.lock.lock().IsHeld());
+    DEBUG_ASSERT(&BucketFor(head->GetKey()) == &bucket);
 
     FutexNode::HashTable::iterator iter;
 
@@ -227,15 +272,15 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket.table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.lock().IsHeld());
+bool FutexContext::UnqueueNodeLocked(Bucket& bucket, FutexNode* node) {
+    DEBUG_ASSERT(bucket.lock.lock().IsHeld());
 
     if (!node->IsInQueue())
         return false;
@@ -245,11 +290,26 @@ bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
     // However, that could be out of date if the thread was requeued by
     // FutexRequeue(), so we need to re-get the hash table key here.
     uintptr_t futex_key = node->GetKey();
+    DEBUG_ASSERT(&BucketFor(futex_key) == &bucket);
 
-    FutexNode* old_head = futex_table_.erase(futex_key);
+    FutexNode* old_head = bucket.table.erase(futex_key);
     DEBUG_ASSERT(old_head);
     FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
     if (new_head)
-        futex_table_.insert(new_head);
+        bucket.table.insert(new_head);
     return true;
 }
+
+bool FutexContext::UnqueueNode(FutexNode* node) {
+    // The node's key can change under us if FutexRequeue() moves it to
+    // another futex, but only while the old and new buckets are both
+    // locked.  So once we hold the lock of the bucket the key points into,
+    // the node cannot leave that bucket until we drop the lock.
+    for (;;) {
+        Bucket& bucket = BucketFor(node->GetKey());
+        Guard<fbl::Mutex> guard{&bucket.lock};
+        if (&BucketFor(node->GetKey()) == &bucket) {
+            return UnqueueNodeLocked(bucket, node);
+        }
+    }
+}
@@ -6,11 +6,14 @@
 
 #include <object/handle.h>
 
+#include <arch/ops.h>
 #include <object/dispatcher.h>
+#include <fbl/algorithm.h>
 #include <fbl/arena.h>
 #include <fbl/mutex.h>
 #include <lib/counters.h>
 #include <pow2.h>
+#include <string.h>
 
 namespace {
 
@@ -25,6 +28,7 @@ KCOUNTER(handle_count_made, "kernel.handles.made");
 KCOUNTER(handle_count_duped, "kernel.handles.duped");
 KCOUNTER(handle_count_live, "kernel.handles.live");
 KCOUNTER_MAX(handle_count_max_live, "kernel.handles.max_live");
+KCOUNTER(handle_count_arena, "kernel.handles.arena");
 
 // Masks for building a Handle's base_value, which ProcessDispatcher
 // uses to create zx_handle_t values.
@@ -52,6 +56,7 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
 }  // namespace
 
 fbl::Arena Handle::arena_;
+Handle::SlotCache Handle::slot_caches_[SMP_MAX_CPUS];
 
 void Handle::Init() TA_NO_THREAD_SAFETY_ANALYSIS {
     arena_.Init("handles", sizeof(Handle), kMaxHandleCount);
@@ -65,7 +70,7 @@ void Handle::set_process_id(zx_koid_t pid) {
 // Returns a new |base_value| based on the value stored in the free
 // arena slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(ArenaLock::Get()) {
+uint32_t Handle::GetNewBaseValue(void* addr) {
     // Get the index of this slot within the arena.
     uint32_t handle_index = HandleToIndex(reinterpret_cast<Handle*>(addr));
     DEBUG_ASSERT((handle_index & ~kHandleIndexMask) == 0);
@@ -88,28 +93,124 @@ uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(ArenaLock::Get()) {
 // says whether this is allocation or duplication, for the error message.
 void* Handle::Alloc(const fbl::RefPtr<Dispatcher>& dispatcher,
                     const char* what, uint32_t* base_value) {
-    size_t outstanding_handles;
+    void* addr = AllocSlot();
+    if (unlikely(!addr)) {
+        printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
+               what, diagnostics::OutstandingHandles());
+        return nullptr;
+    }
+
+    dispatcher->increment_handle_count();
+    *base_value = GetNewBaseValue(addr);
+    return addr;
+}
+
+void* Handle::AllocSlot() {
+    void* batch[kSlotCacheBatch];
+    for (;;) {
+        {
+            SlotCache& cache = slot_caches_[arch_curr_cpu_num()];
+            Guard<SpinLock, IrqSave> guard{&cache.lock};
+            if (likely(cache.count > 0)) {
+                return cache.slots[--cache.count];
+            }
+        }
+
+        // The cache is empty; refill it from the arena.  Once the arena is
+        // exhausted, the only free slots left may be in other cpus' caches.
+        size_t count = ArenaAllocSlots(batch, kSlotCacheBatch);
+        if (count == 0) {
+            DrainSlotCaches();
+            count = ArenaAllocSlots(batch, kSlotCacheBatch);
+        }
+        if (count == 0) {
+            return nullptr;
+        }
+
+        // We may have migrated while the arena was locked, so fill whichever
+        // cache is current now.
+        size_t stored;
+        {
+            SlotCache& cache = slot_caches_[arch_curr_cpu_num()];
+            Guard<SpinLock, IrqSave> guard{&cache.lock};
+            stored = fbl::min(count, kSlotCacheSize - cache.count);
+            for (size_t i = 0; i < stored; i++) {
+                cache.slots[cache.count++] = batch[i];
+            }
+        }
+        if (stored < count) {
+            ArenaFreeSlots(batch + stored, count - stored);
+        }
+    }
+}
+
+void Handle::FreeSlot(void* addr) {
+    void* batch[kSlotCacheBatch];
     {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
+        SlotCache& cache = slot_caches_[arch_curr_cpu_num()];
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+        if (likely(cache.count < kSlotCacheSize)) {
+            cache.slots[cache.count++] = addr;
+            return;
+        }
+
+        // The cache is full; spill half of it to the arena to make room.
+        cache.count -= kSlotCacheBatch;
+        memcpy(batch, &cache.slots[cache.count], sizeof(batch));
+        cache.slots[cache.count++] = addr;
+    }
+
+    ArenaFreeSlots(batch, kSlotCacheBatch);
+}
+
+size_t Handle::ArenaAllocSlots(void** slots, size_t count) {
+    Guard<fbl::Mutex> guard{ArenaLock::Get()};
+
+    size_t allocated = 0;
+    while (allocated < count) {
         void* addr = arena_.Alloc();
-        outstanding_handles = arena_.DiagnosticCount();
-        if (likely(addr)) {
-            if (outstanding_handles > kHighHandleCount) {
-                // TODO: Avoid calling this for every handle after
-                // kHighHandleCount; printfs are slow and we're
-                // holding the mutex.
-                printf("WARNING: High handle count: %zu handles\n",
-                       outstanding_handles);
-            }
-            dispatcher->increment_handle_count();
-            *base_value = GetNewBaseValue(addr);
-            return addr;
+        if (!addr) {
+            break;
         }
+        slots[allocated++] = addr;
     }
 
-    printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
-           what, outstanding_handles);
-    return nullptr;
+    // Slots sitting in the caches count as outstanding here, so this can
+    // overestimate by a few batches per cpu.
+    const size_t outstanding_handles = arena_.DiagnosticCount();
+    if (allocated > 0 && outstanding_handles > kHighHandleCount) {
+        // TODO: Avoid calling this for every batch after
+        // kHighHandleCount; printfs are slow and we're
+        // holding the mutex.
+        printf("WARNING: High handle count: %zu handles\n",
+               outstanding_handles);
+    }
+    kcounter_add(handle_count_arena, 1);
+    return allocated;
+}
+
+void Handle::ArenaFreeSlots(void* const* slots, size_t count) {
+    Guard<fbl::Mutex> guard{ArenaLock::Get()};
+    for (size_t i = 0; i < count; i++) {
+        arena_.Free(slots[i]);
+    }
+    kcounter_add(handle_count_arena, 1);
+}
+
+void Handle::DrainSlotCaches() {
+    void* slots[kSlotCacheSize];
+    for (SlotCache& cache : slot_caches_) {
+        size_t count;
+        {
+            Guard<SpinLock, IrqSave> guard{&cache.lock};
+            count = cache.count;
+            memcpy(slots, cache.slots, count * sizeof(void*));
+            cache.count = 0;
+        }
+        if (count > 0) {
+            ArenaFreeSlots(slots, count);
+        }
+    }
 }
 
 HandleOwner Handle::Make(fbl::RefPtr<Dispatcher> dispatcher,
@@ -187,12 +288,8 @@ void Handle::Delete() {
 
     TearDown();
 
-    bool zero_handles = false;
-    {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
-        zero_handles = disp->decrement_handle_count();
-        arena_.Free(this);
-    }
+    bool zero_handles = disp->decrement_handle_count();
+    FreeSlot(this);
 
     if (zero_handles)
         disp->on_zero_handles();
@@ -214,14 +311,21 @@ Handle* Handle::FromU32(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
 }
 
 uint32_t Handle::Count(const fbl::RefPtr<const Dispatcher>& dispatcher) {
-    // Handle::ArenaLock also guards Dispatcher::handle_count_.
-    Guard<fbl::Mutex> guard{ArenaLock::Get()};
     return dispatcher->current_handle_count();
 }
 
 size_t Handle::diagnostics::OutstandingHandles() {
+    // Free slots held in the per-cpu caches are allocated as far as the arena
+    // is concerned.  Holding the arena lock keeps slots from moving between
+    // the caches and the arena while they are counted.
     Guard<fbl::Mutex> guard{ArenaLock::Get()};
-    return arena_.DiagnosticCount();
+    size_t cached = 0;
+    for (SlotCache& cache : slot_caches_) {
+        Guard<SpinLock, IrqSave> cache_guard{&cache.lock};
+        cached += cache.count;
+    }
+    const size_t allocated = arena_.DiagnosticCount();
+    return allocated - fbl::min(cached, allocated);
 }
 
 void Handle::diagnostics::DumpTableInfo() {
@@ -24,6 +24,11 @@
 // When the thread at the head of the futex's blocked thread list is resumed,
 // The FutexNode for the new head of the blocked thread list is set as the hash table value
 // for the futex.
+//
+// The hash table is sharded into kNumBuckets buckets, each with its own lock, so
+// that threads operating on unrelated futexes do not contend with each other.
+// A futex always lives in the bucket selected by BucketFor() on its address.
+// FutexRequeue() takes the locks of both the wake and requeue buckets.
 class FutexContext {
 public:
     FutexContext();
@@ -67,7 +72,10 @@ public:
                              OwnerAction owner_action,
                              user_in_ptr<const zx_futex_t> requeue_ptr,
                              uint32_t requeue_count,
-                             zx_handle_t new_requeue_owner);
+                             zx_handle_t new_requeue_owner)
+        // GuardMultiple is invisible to the static analysis;
+        // FutexRequeueLocked() asserts that both bucket locks are held.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
 
     // Get the KOID of the current owner of the specified futex, if any, or ZX_KOID_INVALID if there
     // is no known owner.
@@ -78,14 +86,37 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    // Must be a power of two.
+    static constexpr size_t kNumBuckets = 32;
+
+    struct Bucket {
+        // protects table
+        DECLARE_MUTEX(Bucket) lock;
+
+        // Key is futex address, value is the FutexNode for the head of futex's
+        // blocked thread list.
+        FutexNode::HashTable table TA_GUARDED(lock);
+    };
+
+    Bucket& BucketFor(uintptr_t futex_key);
+
+    void QueueNodesLocked(Bucket& bucket, FutexNode* head) TA_REQ(bucket.lock);
+
+    bool UnqueueNodeLocked(Bucket& bucket, FutexNode* node) TA_REQ(bucket.lock);
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    // Removes |node| from whichever futex wait queue it is on, taking the
+    // lock of the bucket that queue is currently in.
+    bool UnqueueNode(FutexNode* node);
 
-    // protects futex_table_
-    DECLARE_MUTEX(FutexContext) lock_;
+    // Body of FutexRequeue(), run with the locks of both buckets held (which
+    // may be the same bucket).
+    zx_status_t FutexRequeueLocked(Bucket& wake_bucket, Bucket& requeue_bucket,
+                                   AutoReschedDisable* resched_disable,
+                                   user_in_ptr<const zx_futex_t> wake_ptr, uint32_t wake_count,
+                                   zx_futex_t current_value,
+                                   user_in_ptr<const zx_futex_t> requeue_ptr,
+                                   uint32_t requeue_count)
+        TA_REQ(wake_bucket.lock) TA_REQ(requeue_bucket.lock);
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket buckets_[kNumBuckets];
 };
@@ -11,6 +11,7 @@
 #include <kernel/wait.h>
 #include <list.h>
 #include <zircon/types.h>
+#include <fbl/atomic.h>
 #include <fbl/intrusive_hash_table.h>
 #include <fbl/mutex.h>
 
@@ -18,7 +19,12 @@
 // Intended to be embedded within a ThreadDispatcher Instance
 class FutexNode : public fbl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = fbl::HashTable<uintptr_t, FutexNode*>;
+    // Each FutexContext shards its futexes across many of these tables, so
+    // keep the per-table bucket array small.
+    static constexpr size_t kNumHashBuckets = 8;
+    using HashTable = fbl::HashTable<uintptr_t, FutexNode*,
+                                     fbl::SinglyLinkedList<FutexNode*>,
+                                     size_t, kNumHashBuckets>;
 
     FutexNode();
     ~FutexNode();
@@ -47,11 +53,11 @@ public:
     zx_status_t BlockThread(Guard<fbl::Mutex>&& adopt_guard, const Deadline& deadline);
 
     void set_hash_key(uintptr_t key) {
-        hash_key_ = key;
+        hash_key_.store(key, fbl::memory_order_relaxed);
     }
 
     // Trait implementation for fbl::HashTable
-    uintptr_t GetKey() const { return hash_key_; }
+    uintptr_t GetKey() const { return hash_key_.load(fbl::memory_order_relaxed); }
     static size_t GetHash(uintptr_t key) { return (key >> 3); }
 
 private:
@@ -68,7 +74,10 @@ private:
     //  * Additionally, when this FutexNode is the head of a futex wait
     //    queue, this field is used by the HashTable (because it uses
     //    intrusive SinglyLinkedLists).
-    uintptr_t hash_key_;
+    // It is only written with the lock of the key's FutexContext bucket held,
+    // but FutexWait() reads it without a lock to find out which bucket lock
+    // to take, hence the atomic.
+    fbl::atomic<uintptr_t> hash_key_;
 
     // Used for waking the thread corresponding to the FutexNode.
     WaitQueue wait_queue_;
@@ -12,7 +12,9 @@
 #include <fbl/macros.h>
 #include <fbl/mutex.h>
 #include <fbl/ref_ptr.h>
+#include <kernel/align.h>
 #include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
 #include <stdint.h>
 #include <zircon/types.h>
 
@@ -79,8 +81,7 @@ private:
 // A Handle is how a specific process refers to a specific Dispatcher.
 class Handle final : public fbl::DoublyLinkedListable<Handle*> {
 public:
-    // The handle arena's mutex. This is public since it protects
-    // other things like |Dispatcher::handle_count_|.
+    // The handle arena's mutex.
     DECLARE_SINGLETON_MUTEX(ArenaLock);
 
     // Returns the Dispatcher to which this instance points.
@@ -150,6 +151,16 @@ private:
                        uint32_t* base_value);
     static uint32_t GetNewBaseValue(void* addr);
 
+    // Take and return free arena slots, going through the current cpu's
+    // slot cache so that the arena lock is only taken once per batch.
+    static void* AllocSlot();
+    static void FreeSlot(void* addr);
+    // Moves up to |count| slots between the arena and |slots|.
+    static size_t ArenaAllocSlots(void** slots, size_t count);
+    static void ArenaFreeSlots(void* const* slots, size_t count);
+    // Returns the slots in every cpu's cache to the arena.
+    static void DrainSlotCaches();
+
     // Handle should never be destroyed by anything other than Delete,
     // which uses TearDown to do the actual destruction.
     ~Handle() = default;
@@ -170,6 +181,17 @@ private:
     // The handle arena.
     static fbl::Arena TA_GUARDED(ArenaLock::Get()) arena_;
 
+    // Per-cpu caches of free arena slots in front of |arena_|.  Slots in a
+    // cache keep the base_value stashed by TearDown, like slots in the arena.
+    static constexpr size_t kSlotCacheSize = 32;
+    static constexpr size_t kSlotCacheBatch = kSlotCacheSize / 2;
+    struct SlotCache {
+        DECLARE_SPINLOCK(SlotCache) lock;
+        size_t count TA_GUARDED(lock) = 0;
+        void* slots[kSlotCacheSize] TA_GUARDED(lock);
+    } __CPU_ALIGN;
+    static SlotCache slot_caches_[SMP_MAX_CPUS];
+
     // NOTE! This can return an invalid address.  It must be checked
     // against the arena bounds before being cast to a Handle*.
     static uintptr_t IndexToHandle(uint32_t index) TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -47,11 +47,17 @@ public:
 
     uint32_t data_size() const { return data_size_; }
 
+    // Payloads of at least this many bytes are kept in whole pages of their own rather than
+    // in the BufferChain, so that CopyDataTo() can move those pages into the reader's address
+    // space instead of copying them when the reader's buffer is page aligned.
+    static constexpr uint32_t kPageTransferThreshold = 4 * PAGE_SIZE;
+
     // Copies the packet's |data_size()| bytes to |buf|.
     // Returns an error if |buf| points to a bad user address.
-    zx_status_t CopyDataTo(user_out_ptr<void> buf) const {
-        return buffer_chain_->CopyOut(buf, payload_offset_, data_size_);
-    }
+    //
+    // Whole pages of a large payload may be moved rather than copied, leaving the packet
+    // without them, so this must be called at most once.
+    zx_status_t CopyDataTo(user_out_ptr<void> buf);
 
     uint32_t num_handles() const { return num_handles_; }
     Handle* const* handles() const { return handles_; }
@@ -66,14 +72,12 @@ public:
             return 0;
         }
         // The first few bytes of the payload are a zx_txid_t.
-        void* payload_start = buffer_chain_->buffers()->front().data() + payload_offset_;
-        return *reinterpret_cast<zx_txid_t*>(payload_start);
+        return *reinterpret_cast<const zx_txid_t*>(payload_start());
     }
 
     void set_txid(zx_txid_t txid) {
         if (data_size_ >= sizeof(zx_txid_t)) {
-            void* payload_start = buffer_chain_->buffers()->front().data() + payload_offset_;
-            *(reinterpret_cast<zx_txid_t*>(payload_start)) = txid;
+            *(reinterpret_cast<zx_txid_t*>(payload_start())) = txid;
         }
     }
 
@@ -83,9 +87,11 @@ private:
     // when a user creates a MessagePacket, they end up with the proper
     // MessagePacket::UPtr type for managing the message packet's life cycle.
     MessagePacket(BufferChain* chain, uint32_t data_size, uint32_t payload_offset,
-                  uint16_t num_handles, Handle** handles)
+                  uint16_t num_handles, Handle** handles, list_node* payload_pages)
         : buffer_chain_(chain), handles_(handles), data_size_(data_size),
-          payload_offset_(payload_offset), num_handles_(num_handles), owns_handles_(false) {}
+          payload_offset_(payload_offset), num_handles_(num_handles), owns_handles_(false) {
+        list_move(payload_pages, &payload_pages_);
+    }
 
     // A private destructor helps to make sure that only our custom deleter is
     // ever used to destroy this object which, in turn, makes it very difficult
@@ -106,8 +112,27 @@ private:
     static zx_status_t CreateCommon(uint32_t data_size, uint32_t num_handles,
                                     MessagePacketPtr* msg);
 
+    // Fills |payload_pages_|, using |copy_fn(dst, src_offset, len)| to fetch each page.
+    template <typename CopyFn>
+    zx_status_t CopyInPages(CopyFn copy_fn);
+
+    bool is_paged() const { return data_size_ >= kPageTransferThreshold; }
+
+    char* payload_start() const {
+        if (!is_paged()) {
+            return buffer_chain_->buffers()->front().data() + payload_offset_;
+        }
+        list_node* pages = const_cast<list_node*>(&payload_pages_);
+        vm_page_t* page = list_peek_head_type(pages, vm_page_t, queue_node);
+        DEBUG_ASSERT(page != nullptr);
+        return static_cast<char*>(paddr_to_physmap(page->paddr()));
+    }
+
     BufferChain* buffer_chain_;
     Handle** const handles_;
+    // Pages holding the payload, in order, if it's at least kPageTransferThreshold bytes.
+    // Otherwise the payload follows the handles in |buffer_chain_| and this is empty.
+    list_node payload_pages_ = LIST_INITIAL_VALUE(payload_pages_);
     const uint32_t data_size_;
     const uint32_t payload_offset_;
     const uint16_t num_handles_;
@@ -14,6 +14,7 @@
 #include <zircon/syscalls/port.h>
 #include <zircon/types.h>
 
+#include <fbl/alloc_checker.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
@@ -118,6 +119,10 @@ public:
                  uint64_t key, zx_signals_t signals);
     ~PortObserver() = default;
 
+    // PortObservers are allocated from a slab cache.
+    static void* operator new(size_t size, fbl::AllocChecker* ac) noexcept;
+    static void operator delete(void* obj);
+
 private:
     PortObserver(const PortObserver&) = delete;
     PortObserver& operator=(const PortObserver&) = delete;
@@ -154,8 +159,9 @@ private:
 // |packets_| linked list and case 4 uses |interrupt_packets_| linked list.
 //
 // The threads that wish to receive notifications block on Dequeue() (which
-// maps to zx_port_wait()) and will receive packets from any of the four sources
-// depending on what kind of object the port has been 'bound' to.
+// maps to zx_port_wait()) or DequeueMany() (zx_port_wait_many()) and will
+// receive packets from any of the four sources depending on what kind of
+// object the port has been 'bound' to.
 //
 // When a packet from any of the sources arrives to the port, one waiting
 // thread unblocks and gets the packet. In all cases |sema_| is used to signal
@@ -163,7 +169,6 @@ private:
 
 class PortDispatcher final : public SoloDispatcher<PortDispatcher, ZX_DEFAULT_PORT_RIGHTS> {
 public:
-    static void Init();
     static PortAllocator* DefaultPortAllocator();
     static zx_status_t Create(uint32_t options, fbl::RefPtr<Dispatcher>* dispatcher,
                               zx_rights_t* rights);
@@ -178,6 +183,11 @@ public:
     zx_status_t QueueUser(const zx_port_packet_t& packet);
     bool QueueInterruptPacket(PortInterruptPacket* port_packet, zx_time_t timestamp);
     zx_status_t Dequeue(const Deadline& deadline, zx_port_packet_t* packet);
+    // Like Dequeue(), but once at least one packet is available takes up to
+    // |count| packets, interrupt packets first, and sets |actual| to the
+    // number taken.
+    zx_status_t DequeueMany(const Deadline& deadline, zx_port_packet_t* packets, size_t count,
+                            size_t* actual);
     bool RemoveInterruptPacket(PortInterruptPacket* port_packet);
 
     // Decides who is going to destroy the observer. If it returns the
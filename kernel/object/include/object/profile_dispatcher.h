@@ -20,6 +20,9 @@ public:
     static zx_status_t Create(const zx_profile_info_t& info,
                               fbl::RefPtr<Dispatcher>* dispatcher,
                               zx_rights_t* rights);
+    static zx_status_t Create(const zx_profile_deadline_info_t& info,
+                              fbl::RefPtr<Dispatcher>* dispatcher,
+                              zx_rights_t* rights);
 
     ~ProfileDispatcher() final;
     zx_obj_type_t get_type() const final { return ZX_OBJ_TYPE_PROFILE; }
@@ -28,7 +31,11 @@ public:
 
 private:
     explicit ProfileDispatcher(const zx_profile_info_t& info);
+    explicit ProfileDispatcher(const zx_profile_deadline_info_t& info);
 
     fbl::Canary<fbl::magic("PROF")> canary_;
-    const zx_profile_info_t info_;
+    // One of ZX_PROFILE_INFO_*, which selects the parameters that apply.
+    const uint32_t type_;
+    const zx_profile_scheduler_t scheduler_ = {};
+    const zx_profile_deadline_t deadline_ = {};
 };
@@ -12,6 +12,7 @@
 #include <object/dispatcher.h>
 #include <object/handle.h>
 #include <object/mbuf.h>
+#include <object/socket_ring.h>
 
 #include <zircon/rights.h>
 #include <zircon/types.h>
@@ -61,6 +62,17 @@ public:
 
     void GetInfo(zx_info_socket_t* info) const;
 
+    // Shared ring methods, for sockets created with ZX_SOCKET_SHARED_RING.
+    // |options| is ZX_SOCKET_RING_RX for the ring this endpoint reads from, or
+    // ZX_SOCKET_RING_TX for the one it writes to (its peer's RX ring).
+
+    // Returns the dispatcher and rights for a handle to a ring's VMO.
+    zx_status_t GetRingVmo(uint32_t options, fbl::RefPtr<Dispatcher>* vmo, zx_rights_t* rights);
+
+    // Publishes |count| bytes consumed from the RX ring or produced into the
+    // TX ring through a mapping of its VMO, and returns the ring's indices.
+    zx_status_t AdvanceRing(uint32_t options, size_t count, zx_socket_ring_state_t* state);
+
     zx_status_t CheckShareable(SocketDispatcher* to_send);
 
     struct ControlMsg {
@@ -73,19 +85,40 @@ public:
     void OnPeerZeroHandlesLocked() TA_REQ(get_lock());
 
 private:
-    // |control_msg| may be null.
+    // |control_msg| and |ring| may be null.
     SocketDispatcher(fbl::RefPtr<PeerHolder<SocketDispatcher>> holder,
                      zx_signals_t starting_signals, uint32_t flags,
-                     ktl::unique_ptr<ControlMsg> control_msg);
+                     ktl::unique_ptr<ControlMsg> control_msg,
+                     ktl::unique_ptr<SocketRing> ring);
     void Init(fbl::RefPtr<SocketDispatcher> other);
     zx_status_t WriteSelfLocked(user_in_ptr<const void> src, size_t len, size_t* nwritten) TA_REQ(get_lock());
     zx_status_t WriteControlSelfLocked(user_in_ptr<const void> src, size_t len) TA_REQ(get_lock());
     zx_status_t UserSignalSelfLocked(uint32_t clear_mask, uint32_t set_mask) TA_REQ(get_lock());
     zx_status_t ShutdownOtherLocked(uint32_t how) TA_REQ(get_lock());
     zx_status_t ShareSelfLocked(HandleOwner h) TA_REQ(get_lock());
-
-    bool is_full() const TA_REQ(get_lock()) { return data_.is_full(); }
-    bool is_empty() const TA_REQ(get_lock()) { return data_.is_empty(); }
+    zx_status_t ProduceSelfLocked(size_t count, zx_socket_ring_state_t* state) TA_REQ(get_lock());
+
+    // Update the signals of both endpoints after |count| bytes were added to
+    // or removed from this endpoint's data.
+    void DataWrittenLocked(bool was_empty, size_t count) TA_REQ(get_lock());
+    void DataReadLocked(bool was_full, size_t count) TA_REQ(get_lock());
+
+    void GetRingStateLocked(zx_socket_ring_state_t* state) const TA_REQ(get_lock());
+
+    // The data is kept in |ring_| for shared ring sockets and in |data_|
+    // otherwise.
+    bool is_full() const TA_REQ(get_lock()) {
+        return ring_ ? ring_->is_full() : data_.is_full();
+    }
+    bool is_empty() const TA_REQ(get_lock()) {
+        return ring_ ? ring_->is_empty() : data_.is_empty();
+    }
+    size_t data_size(bool datagram = false) const TA_REQ(get_lock()) {
+        return ring_ ? ring_->size() : data_.size(datagram);
+    }
+    size_t data_max_size() const TA_REQ(get_lock()) {
+        return ring_ ? ring_->max_size() : data_.max_size();
+    }
 
     fbl::Canary<fbl::magic("SOCK")> canary_;
 
@@ -93,6 +126,7 @@ private:
 
     // The shared |get_lock()| protects all members below.
     MBufChain data_ TA_GUARDED(get_lock());
+    ktl::unique_ptr<SocketRing> ring_ TA_GUARDED(get_lock());
     ktl::unique_ptr<ControlMsg> control_msg_ TA_GUARDED(get_lock());
     size_t control_msg_len_ TA_GUARDED(get_lock());
     HandleOwner accept_queue_ TA_GUARDED(get_lock());
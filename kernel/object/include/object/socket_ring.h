@@ -0,0 +1,97 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fbl/macros.h>
+#include <fbl/ref_ptr.h>
+#include <ktl/unique_ptr.h>
+#include <lib/user_copy/user_ptr.h>
+#include <object/dispatcher.h>
+#include <vm/vm_address_region.h>
+#include <zircon/types.h>
+
+// SocketRing is a byte stream kept in a ring buffer in a VMO that both the
+// kernel and userspace can map.  It backs sockets created with
+// ZX_SOCKET_SHARED_RING in place of an MBufChain.
+//
+// Data lives at stream offsets: the byte at offset n is stored at n % size()
+// in the VMO.  The kernel only keeps the |head| (offset of the first byte not
+// yet read) and |tail| (offset one past the last byte written) indices.
+// Write() and Read() copy through the kernel's own mapping of the VMO, so
+// zx_socket_write() and zx_socket_read() keep working, while clients that map
+// the VMO themselves move data directly and call Produce() and Consume() to
+// publish how far they got.
+//
+// The VMO starts out empty, and its pages are committed as the ring is used.
+// Each page is pinned the first time the kernel copies through it, so that
+// userspace can't decommit it from under the kernel's mapping; pages only
+// ever touched through userspace mappings stay unpinned.
+//
+// SocketRing does no locking; its owner serializes access.
+class SocketRing {
+public:
+    // Size of the ring, which must be a power of two.
+    static constexpr size_t kSize = 256 * 1024;
+
+    static zx_status_t Create(ktl::unique_ptr<SocketRing>* out);
+    ~SocketRing();
+
+    // Copies up to |len| bytes from |src| into the ring and sets |written| to
+    // the number of bytes copied.  Returns ZX_ERR_SHOULD_WAIT if the ring is
+    // full.
+    zx_status_t Write(user_in_ptr<const void> src, size_t len, size_t* written);
+
+    // Copies up to |len| bytes out of the ring into |dst| and sets |nread| to
+    // the number of bytes copied.  Fails only if no bytes could be copied
+    // because the ring's pages could not be committed.
+    zx_status_t Read(user_out_ptr<void> dst, size_t len, size_t* nread);
+
+    // Advances the tail past |count| bytes the writer put in the VMO itself.
+    // Returns ZX_ERR_OUT_OF_RANGE if there is not that much free space.
+    zx_status_t Produce(size_t count);
+
+    // Advances the head past |count| bytes the reader took from the VMO
+    // itself.  Returns ZX_ERR_OUT_OF_RANGE if there is not that much data.
+    zx_status_t Consume(size_t count);
+
+    bool is_full() const { return size() == kSize; }
+    bool is_empty() const { return head_ == tail_; }
+
+    // Returns the number of bytes in the ring.
+    size_t size() const { return static_cast<size_t>(tail_ - head_); }
+
+    // Returns the maximum number of bytes the ring can hold.
+    size_t max_size() const { return kSize; }
+
+    uint64_t head() const { return head_; }
+    uint64_t tail() const { return tail_; }
+
+    // The dispatcher for the ring's VMO, for handing out to userspace.
+    const fbl::RefPtr<Dispatcher>& vmo_dispatcher() const { return vmo_dispatcher_; }
+
+private:
+    SocketRing(fbl::RefPtr<VmObject> vmo, fbl::RefPtr<Dispatcher> vmo_dispatcher,
+               fbl::RefPtr<VmMapping> mapping);
+    DISALLOW_COPY_ASSIGN_AND_MOVE(SocketRing);
+
+    uint8_t* base() const { return reinterpret_cast<uint8_t*>(mapping_->base()); }
+
+    // Commits, pins and maps the pages of the ring holding
+    // [|offset|, |offset| + |len|) that aren't pinned yet.
+    zx_status_t PinRange(size_t offset, size_t len);
+
+    const fbl::RefPtr<VmObject> vmo_;
+    const fbl::RefPtr<Dispatcher> vmo_dispatcher_;
+    // The kernel's mapping of the whole ring.  Only pinned pages are mapped.
+    const fbl::RefPtr<VmMapping> mapping_;
+    // Bit n is set once page n of the ring is pinned.
+    uint64_t pinned_pages_ = 0u;
+    uint64_t head_ = 0u;
+    uint64_t tail_ = 0u;
+};
@@ -44,6 +44,9 @@ public:
 
     zx_status_t Unmap(vaddr_t base, size_t len);
 
+    // Performs one of the ZX_VMAR_OP_* operations on a range of mappings.
+    zx_status_t RangeOp(uint32_t op, vaddr_t base, size_t len, zx_rights_t rights);
+
     const fbl::RefPtr<VmAddressRegion>& vmar() const { return vmar_; }
 
     // Check if the given flags define an allowed combination of RWX
@@ -57,6 +57,7 @@ public:
     zx_status_t SetMappingCachePolicy(uint32_t cache_policy);
 
     zx_info_vmo_t GetVmoInfo();
+    zx_status_t GetVmoReclaimInfo(zx_info_vmo_reclaim_t* info);
 
     const fbl::RefPtr<VmObject>& vmo() const { return vmo_; }
     zx_koid_t pager_koid() const { return pager_koid_; }
@@ -8,9 +8,15 @@
 
 #include <err.h>
 #include <fbl/algorithm.h>
+#include <kernel/thread.h>
+#include <lib/counters.h>
 #include <new>
 #include <stdint.h>
 #include <string.h>
+#include <vm/vm_aspace.h>
+
+KCOUNTER(payload_pages_moved, "kernel.channel.payload_pages.moved");
+KCOUNTER(payload_pages_copied, "kernel.channel.payload_pages.copied");
 
 // MessagePackets have special allocation requirements because they can contain a variable number of
 // handles and a variable size payload.
@@ -21,6 +27,11 @@
 //
 // The first buffer in a MessagePacket's BufferChain contains the MessagePacket object, followed by
 // its handles (if any), and finally its payload data (if any).
+//
+// Payloads of kPageTransferThreshold bytes or more are instead stored in a list of whole pages,
+// one page per PAGE_SIZE bytes of payload.  When such a message is read into a page aligned
+// buffer, the pages holding whole pages of payload are moved into the reader's VMO in place of
+// the pages there, so the payload is only copied once, on write.
 
 // The MessagePacket object, its handles and zx_txid_t must all fit in the first buffer.
 static constexpr size_t kContiguousBytes =
@@ -50,15 +61,31 @@ inline zx_status_t MessagePacket::CreateCommon(uint32_t data_size, uint32_t num_
     }
 
     const uint32_t payload_offset = PayloadOffset(num_handles);
+    const bool paged = data_size >= kPageTransferThreshold;  // See is_paged().
 
     // MessagePackets lives *inside* a list of buffers.  The first buffer holds the MessagePacket
     // object, followed by its handles (if any), and finally the payload data.
-    BufferChain* chain = BufferChain::Alloc(payload_offset + data_size);
+    BufferChain* chain = BufferChain::Alloc(payload_offset + (paged ? 0 : data_size));
     if (unlikely(!chain)) {
         return ZX_ERR_NO_MEMORY;
     }
     DEBUG_ASSERT(!chain->buffers()->is_empty());
 
+    list_node payload_pages = LIST_INITIAL_VALUE(payload_pages);
+    if (paged) {
+        zx_status_t status = pmm_alloc_pages(ROUNDUP_PAGE_SIZE(data_size) / PAGE_SIZE, 0,
+                                             &payload_pages);
+        if (unlikely(status != ZX_OK)) {
+            BufferChain::Free(chain);
+            return ZX_ERR_NO_MEMORY;
+        }
+        vm_page_t* page;
+        list_for_every_entry (&payload_pages, page, vm_page_t, queue_node) {
+            DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+            page->state = VM_PAGE_STATE_IPC;
+        }
+    }
+
     char* const data = chain->buffers()->front().data();
     Handle** const handles = reinterpret_cast<Handle**>(data + kHandlesOffset);
 
@@ -66,12 +93,29 @@ inline zx_status_t MessagePacket::CreateCommon(uint32_t data_size, uint32_t num_
     MessagePacket* const packet = reinterpret_cast<MessagePacket*>(data);
     static_assert(kMaxMessageHandles <= UINT16_MAX, "");
     msg->reset(new (packet) MessagePacket(chain, data_size, payload_offset,
-                                          static_cast<uint16_t>(num_handles), handles));
-    // The MessagePacket now owns the BufferChain and msg owns the MessagePacket.
+                                          static_cast<uint16_t>(num_handles), handles,
+                                          &payload_pages));
+    // The MessagePacket now owns the BufferChain and payload pages, and msg owns the
+    // MessagePacket.
 
     return ZX_OK;
 }
 
+template <typename CopyFn>
+zx_status_t MessagePacket::CopyInPages(CopyFn copy_fn) {
+    size_t offset = 0;
+    vm_page_t* page;
+    list_for_every_entry (&payload_pages_, page, vm_page_t, queue_node) {
+        const size_t len = fbl::min(static_cast<size_t>(PAGE_SIZE), data_size_ - offset);
+        zx_status_t status = copy_fn(paddr_to_physmap(page->paddr()), offset, len);
+        if (unlikely(status != ZX_OK)) {
+            return status;
+        }
+        offset += len;
+    }
+    return ZX_OK;
+}
+
 // static
 zx_status_t MessagePacket::Create(user_in_ptr<const void> data, uint32_t data_size,
                                   uint32_t num_handles, MessagePacketPtr* msg) {
@@ -80,7 +124,13 @@ zx_status_t MessagePacket::Create(user_in_ptr<const void> data, uint32_t data_si
     if (unlikely(status != ZX_OK)) {
         return status;
     }
-    status = new_msg->buffer_chain_->CopyIn(data, PayloadOffset(num_handles), data_size);
+    if (!new_msg->is_paged()) {
+        status = new_msg->buffer_chain_->CopyIn(data, PayloadOffset(num_handles), data_size);
+    } else {
+        status = new_msg->CopyInPages([data](void* dst, size_t offset, size_t len) {
+            return data.byte_offset(offset).copy_array_from_user(dst, len);
+        });
+    }
     if (unlikely(status != ZX_OK)) {
         return status;
     }
@@ -96,7 +146,14 @@ zx_status_t MessagePacket::Create(const void* data, uint32_t data_size, uint32_t
     if (unlikely(status != ZX_OK)) {
         return status;
     }
-    status = new_msg->buffer_chain_->CopyInKernel(data, PayloadOffset(num_handles), data_size);
+    if (!new_msg->is_paged()) {
+        status = new_msg->buffer_chain_->CopyInKernel(data, PayloadOffset(num_handles), data_size);
+    } else {
+        status = new_msg->CopyInPages([data](void* dst, size_t offset, size_t len) {
+            memcpy(dst, static_cast<const char*>(data) + offset, len);
+            return ZX_OK;
+        });
+    }
     if (unlikely(status != ZX_OK)) {
         return status;
     }
@@ -104,14 +161,60 @@ zx_status_t MessagePacket::Create(const void* data, uint32_t data_size, uint32_t
     return ZX_OK;
 }
 
+zx_status_t MessagePacket::CopyDataTo(user_out_ptr<void> buf) {
+    if (!is_paged()) {
+        return buffer_chain_->CopyOut(buf, payload_offset_, data_size_);
+    }
+
+    // Try to move the pages holding whole pages of payload into |buf|.  This needs a page
+    // aligned |buf| within a single writable mapping; otherwise just copy everything.
+    size_t offset = 0;
+    const size_t whole_pages = data_size_ / PAGE_SIZE;
+    const vaddr_t va = reinterpret_cast<vaddr_t>(buf.get());
+    VmAspace* aspace = vmm_aspace_to_obj(get_current_thread()->aspace);
+    if (whole_pages > 0 && IS_PAGE_ALIGNED(va) && aspace != nullptr && aspace->is_user()) {
+        // Split the whole pages off the front of |payload_pages_|.
+        list_node* last = &payload_pages_;
+        for (size_t i = 0; i < whole_pages; i++) {
+            last = last->next;
+        }
+        list_node rest = LIST_INITIAL_VALUE(rest);
+        list_split_after(&payload_pages_, last, &rest);
+
+        // On success this empties |payload_pages_|.  Either way, put back what's left.
+        if (aspace->ReplaceUserPages(va, &payload_pages_) == ZX_OK) {
+            kcounter_add(payload_pages_moved, whole_pages);
+            offset = whole_pages * PAGE_SIZE;
+            buf = buf.byte_offset(offset);
+        }
+        list_splice_after(&rest, payload_pages_.prev);
+    }
+
+    vm_page_t* page;
+    list_for_every_entry (&payload_pages_, page, vm_page_t, queue_node) {
+        const size_t len = fbl::min(static_cast<size_t>(PAGE_SIZE), data_size_ - offset);
+        const zx_status_t status = buf.copy_array_to_user(paddr_to_physmap(page->paddr()), len);
+        if (unlikely(status != ZX_OK)) {
+            return status;
+        }
+        kcounter_add(payload_pages_copied, 1);
+        buf = buf.byte_offset(len);
+        offset += len;
+    }
+    return ZX_OK;
+}
+
 void MessagePacket::recycle(MessagePacket* packet) {
-    // Grab the buffer chain for this packet
+    // Grab the buffer chain and payload pages for this packet
     BufferChain* chain = packet->buffer_chain_;
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    list_move(&packet->payload_pages_, &pages);
 
     // Manually destruct the packet.  Do not delete it; its memory did not come
     // from new, it is contained as part of the buffer chain.
     packet->~MessagePacket();
 
-    // Now return the buffer chain to where it came from.
+    // Now return the buffer chain and pages to where they came from.
     BufferChain::Free(chain);
+    pmm_free(&pages);
 }
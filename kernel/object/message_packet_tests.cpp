@@ -141,6 +141,55 @@ static bool copy_bad_mem() {
     END_TEST;
 }
 
+// Create a MessagePacket big enough to store its payload in pages and read it
+// into both a page aligned buffer, which moves the pages, and an unaligned one,
+// which copies them.
+static bool copy_paged() {
+    BEGIN_TEST;
+    constexpr size_t kSize = MessagePacket::kPageTransferThreshold + PAGE_SIZE + 123;
+    static_assert(kSize <= kMaxMessageSize, "");
+    ktl::unique_ptr<UserMemory> mem = UserMemory::Create(kSize);
+    auto mem_in = make_user_in_ptr(mem->in());
+    auto mem_out = make_user_out_ptr(mem->out());
+
+    fbl::AllocChecker ac;
+    auto buf = ktl::unique_ptr<char[]>(new (&ac) char[kSize]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kSize; i++) {
+        buf[i] = static_cast<char>(i * 7);
+    }
+    ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(buf.get(), kSize), "");
+
+    auto result_buf = ktl::unique_ptr<char[]>(new (&ac) char[kSize]);
+    ASSERT_TRUE(ac.check(), "");
+
+    for (size_t misalign : {0u, 1u}) {
+        MessagePacketPtr mp;
+        ASSERT_EQ(ZX_OK, MessagePacket::Create(mem_in, kSize, 0, &mp), "");
+        ASSERT_EQ(kSize, mp->data_size(), "");
+
+        ktl::unique_ptr<UserMemory> read_mem = UserMemory::Create(kSize + misalign);
+        auto read_in = make_user_in_ptr(read_mem->in()).byte_offset(misalign);
+        auto read_out = make_user_out_ptr(read_mem->out()).byte_offset(misalign);
+
+        // Whatever was in the reader's buffer beforehand is replaced.
+        memset(result_buf.get(), 'E', kSize);
+        ASSERT_EQ(ZX_OK, read_out.copy_array_to_user(result_buf.get(), kSize), "");
+
+        // The aligned buffer's first page is replaced by one of the packet's,
+        // while the unaligned one keeps its page.
+        paddr_t before, after;
+        ASSERT_EQ(ZX_OK, read_mem->vmo()->GetPage(0, 0, nullptr, nullptr, nullptr, &before), "");
+        ASSERT_EQ(ZX_OK, mp->CopyDataTo(read_out), "");
+        ASSERT_EQ(ZX_OK, read_mem->vmo()->GetPage(0, 0, nullptr, nullptr, nullptr, &after), "");
+        EXPECT_EQ(misalign == 0, before != after, "");
+
+        ASSERT_EQ(ZX_OK, read_in.copy_array_from_user(result_buf.get(), kSize), "");
+        EXPECT_EQ(0, memcmp(buf.get(), result_buf.get(), kSize), "");
+    }
+    END_TEST;
+}
+
 }  // namespace
 
 UNITTEST_START_TESTCASE(message_packet_tests)
@@ -150,4 +199,5 @@ UNITTEST("create_zero", create_zero)
 UNITTEST("create_too_many_handles", create_too_many_handles)
 UNITTEST("create_bad_mem", create_bad_mem)
 UNITTEST("copy_bad_mem", copy_bad_mem)
+UNITTEST("copy_paged", copy_paged)
 UNITTEST_END_TESTCASE(message_packet_tests, "message_packet", "MessagePacket tests");
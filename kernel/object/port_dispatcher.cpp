@@ -12,9 +12,9 @@
 #include <pow2.h>
 
 #include <fbl/alloc_checker.h>
-#include <fbl/arena.h>
 #include <fbl/auto_lock.h>
 #include <lib/counters.h>
+#include <lib/slab_cache.h>
 #include <object/excp_port.h>
 #include <object/handle.h>
 #include <object/process_dispatcher.h>
@@ -39,16 +39,21 @@ static_assert(sizeof(zx_packet_page_request_t) == 32,
 KCOUNTER(port_arena_count, "kernel.port.arena.count");
 KCOUNTER(port_full_count, "kernel.port.full.count");
 
-class ArenaPortAllocator final : public PortAllocator {
+SLAB_CACHE_COUNTERS(port_packet_slab_counters, "port_packet");
+SLAB_CACHE_COUNTERS(port_observer_slab_counters, "port_observer");
+
+// Ephemeral port packets (e.g. from zx_port_queue) come from a slab cache so
+// that queueing and dequeueing them does not serialize on a global lock.
+class SlabPortAllocator final : public PortAllocator {
 public:
-    zx_status_t Init();
-    virtual ~ArenaPortAllocator() = default;
+    explicit SlabPortAllocator(size_t max_count);
+    virtual ~SlabPortAllocator() = default;
 
     virtual PortPacket* Alloc();
     virtual void Free(PortPacket* port_packet);
 
 private:
-    fbl::TypedArena<PortPacket, fbl::Mutex> arena_;
+    slab::TypedSlabCache<PortPacket> cache_;
 };
 
 namespace {
@@ -56,15 +61,19 @@ constexpr size_t kMaxPendingPacketCount = 16 * 1024u;
 
 // TODO(maniscalco): Enforce this limit per process via the job policy.
 constexpr size_t kMaxPendingPacketCountPerPort = kMaxPendingPacketCount / 8;
-ArenaPortAllocator port_allocator;
+SlabPortAllocator port_allocator(kMaxPendingPacketCount);
+
+// PortObservers are created and destroyed by every zx_object_wait_async.
+slab::SlabCache port_observer_cache("port_observer", sizeof(PortObserver), 0,
+                                    port_observer_slab_counters);
 } // namespace.
 
-zx_status_t ArenaPortAllocator::Init() {
-    return arena_.Init("packets", kMaxPendingPacketCount);
+SlabPortAllocator::SlabPortAllocator(size_t max_count)
+    : cache_("port_packet", max_count, port_packet_slab_counters) {
 }
 
-PortPacket* ArenaPortAllocator::Alloc() {
-    PortPacket* packet = arena_.New(nullptr, this);
+PortPacket* SlabPortAllocator::Alloc() {
+    PortPacket* packet = cache_.New(nullptr, this);
     if (packet == nullptr) {
         printf("WARNING: Could not allocate new port packet\n");
         return nullptr;
@@ -73,8 +82,8 @@ PortPacket* ArenaPortAllocator::Alloc() {
     return packet;
 }
 
-void ArenaPortAllocator::Free(PortPacket* port_packet) {
-    arena_.Delete(port_packet);
+void SlabPortAllocator::Free(PortPacket* port_packet) {
+    cache_.Delete(port_packet);
     kcounter_add(port_arena_count, -1);
 }
 
@@ -88,6 +97,17 @@ PortPacket::PortPacket(const void* handle, PortAllocator* allocator)
     }
 }
 
+void* PortObserver::operator new(size_t size, fbl::AllocChecker* ac) noexcept {
+    DEBUG_ASSERT(size == sizeof(PortObserver));
+    void* mem = port_observer_cache.Alloc();
+    ac->arm(size, mem != nullptr);
+    return mem;
+}
+
+void PortObserver::operator delete(void* obj) {
+    port_observer_cache.Free(obj);
+}
+
 PortObserver::PortObserver(uint32_t type, const Handle* handle, fbl::RefPtr<PortDispatcher> port,
                            uint64_t key, zx_signals_t signals)
     : type_(type),
@@ -162,10 +182,6 @@ StateObserver::Flags PortObserver::MaybeQueue(zx_signals_t new_state, uint64_t c
 
 /////////////////////////////////////////////////////////////////////////////////////////
 
-void PortDispatcher::Init() {
-    port_allocator.Init();
-}
-
 PortAllocator* PortDispatcher::DefaultPortAllocator() {
     return &port_allocator;
 }
@@ -300,45 +316,66 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
 
 zx_status_t PortDispatcher::Dequeue(const Deadline& deadline,
                                     zx_port_packet_t* out_packet) {
+    size_t actual;
+    return DequeueMany(deadline, out_packet, 1, &actual);
+}
+
+zx_status_t PortDispatcher::DequeueMany(const Deadline& deadline, zx_port_packet_t* out_packets,
+                                        size_t count, size_t* actual) {
     canary_.Assert();
+    DEBUG_ASSERT(count > 0);
 
     while (true) {
+        size_t dequeued = 0;
         if (options_ == ZX_PORT_BIND_TO_INTERRUPT) {
             Guard<SpinLock, IrqSave> guard{&spinlock_};
-            PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
-            if (port_interrupt_packet != nullptr) {
+            while (dequeued < count) {
+                PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
+                if (port_interrupt_packet == nullptr)
+                    break;
+                zx_port_packet_t* out_packet = &out_packets[dequeued++];
                 *out_packet = {};
                 out_packet->key = port_interrupt_packet->key;
                 out_packet->type = ZX_PKT_TYPE_INTERRUPT;
                 out_packet->status = ZX_OK;
                 out_packet->interrupt.timestamp = port_interrupt_packet->timestamp;
-                return ZX_OK;
             }
         }
-        {
-            Guard<fbl::Mutex> guard{get_lock()};
-            PortPacket* port_packet = packets_.pop_front();
-            if (port_packet != nullptr) {
-                --num_packets_;
-                *out_packet = port_packet->packet;
-
-                bool is_ephemeral = port_packet->is_ephemeral();
-                // The reference to the port that the observer holds cannot be the last one
-                // because another reference was used to call Dequeue, so we don't need to
-                // worry about destroying ourselves.
-                port_packet->observer.reset();
-                guard.Release();
-
-                // If the packet is ephemeral, free it outside of the lock. We need to read
-                // is_ephemeral inside the lock because it's possible for a non-ephemeral packet
-                // to get deleted after a call to |MaybeReap| as soon as we release the lock.
-                if (is_ephemeral) {
-                    port_packet->Free();
+        if (dequeued < count) {
+            fbl::DoublyLinkedList<PortPacket*> ephemeral;
+            {
+                Guard<fbl::Mutex> guard{get_lock()};
+                while (dequeued < count) {
+                    PortPacket* port_packet = packets_.pop_front();
+                    if (port_packet == nullptr)
+                        break;
+                    --num_packets_;
+                    out_packets[dequeued++] = port_packet->packet;
+
+                    // The reference to the port that the observer holds cannot be the last one
+                    // because another reference was used to call Dequeue, so we don't need to
+                    // worry about destroying ourselves.
+                    port_packet->observer.reset();
+
+                    // If the packet is ephemeral, free it outside of the lock. We need to check
+                    // is_ephemeral inside the lock because it's possible for a non-ephemeral
+                    // packet to get deleted after a call to |MaybeReap| as soon as we release
+                    // the lock.
+                    if (port_packet->is_ephemeral())
+                        ephemeral.push_back(port_packet);
                 }
-                return ZX_OK;
             }
+            while (!ephemeral.is_empty())
+                ephemeral.pop_front()->Free();
+        }
+        if (dequeued > 0) {
+            *actual = dequeued;
+            return ZX_OK;
         }
 
+        // |sema_| is posted once per queued packet, so after taking several
+        // packets at once it may wake us here without a packet to take; we
+        // just go around again.
         {
             ThreadDispatcher::AutoBlocked by(ThreadDispatcher::Blocked::PORT);
             zx_status_t st = sema_.Wait(deadline);
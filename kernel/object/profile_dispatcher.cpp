@@ -16,10 +16,25 @@
 #include <zircon/rights.h>
 
 zx_status_t validate_profile(const zx_profile_info_t& info) {
-    if (info.type != ZX_PROFILE_INFO_SCHEDULER)
+    switch (info.type) {
+    case ZX_PROFILE_INFO_SCHEDULER:
+        if ((info.scheduler.priority < LOWEST_PRIORITY) ||
+            (info.scheduler.priority  > HIGHEST_PRIORITY))
+            return ZX_ERR_INVALID_ARGS;
+        return ZX_OK;
+    default:
         return ZX_ERR_NOT_SUPPORTED;
-    if ((info.scheduler.priority < LOWEST_PRIORITY) ||
-        (info.scheduler.priority  > HIGHEST_PRIORITY))
+    }
+}
+
+zx_status_t validate_profile(const zx_profile_deadline_info_t& info) {
+    if (info.type != ZX_PROFILE_INFO_DEADLINE)
+        return ZX_ERR_NOT_SUPPORTED;
+    if ((info.reserved != 0) ||
+        (info.deadline.capacity <= 0) ||
+        (info.deadline.capacity > info.deadline.relative_deadline) ||
+        (info.deadline.relative_deadline > info.deadline.period) ||
+        (info.deadline.period > ZX_PROFILE_DEADLINE_MAX_PERIOD))
         return ZX_ERR_INVALID_ARGS;
     return ZX_OK;
 }
@@ -41,13 +56,36 @@ zx_status_t ProfileDispatcher::Create(const zx_profile_info_t& info,
     return ZX_OK;
 }
 
+zx_status_t ProfileDispatcher::Create(const zx_profile_deadline_info_t& info,
+                                      fbl::RefPtr<Dispatcher>* dispatcher,
+                                      zx_rights_t* rights) {
+    auto status = validate_profile(info);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::AllocChecker ac;
+    auto disp = new (&ac) ProfileDispatcher(info);
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+
+    *rights = default_rights();
+    *dispatcher = fbl::AdoptRef<Dispatcher>(disp);
+    return ZX_OK;
+}
+
 ProfileDispatcher::ProfileDispatcher(const zx_profile_info_t& info)
-    : info_(info) {}
+    : type_(info.type), scheduler_(info.scheduler) {}
+
+ProfileDispatcher::ProfileDispatcher(const zx_profile_deadline_info_t& info)
+    : type_(info.type), deadline_(info.deadline) {}
 
 ProfileDispatcher::~ProfileDispatcher() {
 }
 
 zx_status_t ProfileDispatcher::ApplyProfile(fbl::RefPtr<ThreadDispatcher> thread) {
-    // At the moment, the only thing we support is the priority.
-    return thread->SetPriority(info_.scheduler.priority);
+    if (type_ == ZX_PROFILE_INFO_DEADLINE) {
+        return thread->SetDeadline(deadline_.capacity, deadline_.relative_deadline,
+                                   deadline_.period);
+    }
+    return thread->SetPriority(scheduler_.priority);
 }
@@ -44,6 +44,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/resource.cpp \
     $(LOCAL_DIR)/semaphore.cpp \
     $(LOCAL_DIR)/socket_dispatcher.cpp \
+    $(LOCAL_DIR)/socket_ring.cpp \
     $(LOCAL_DIR)/suspend_token_dispatcher.cpp \
     $(LOCAL_DIR)/thread_dispatcher.cpp \
     $(LOCAL_DIR)/timer_dispatcher.cpp \
@@ -59,6 +60,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/job_policy_tests.cpp \
     $(LOCAL_DIR)/mbuf_tests.cpp \
     $(LOCAL_DIR)/message_packet_tests.cpp \
+    $(LOCAL_DIR)/socket_ring_tests.cpp \
     $(LOCAL_DIR)/state_tracker_tests.cpp \
 
 MODULE_DEPS := \
@@ -69,5 +71,6 @@ MODULE_DEPS := \
     kernel/lib/oom \
     kernel/lib/pretty \
     kernel/lib/region-alloc \
+    kernel/lib/slab_cache \
 
 include make/module.mk
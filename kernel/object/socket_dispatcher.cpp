@@ -36,6 +36,10 @@ zx_status_t SocketDispatcher::Create(uint32_t flags,
     if (flags & ~ZX_SOCKET_CREATE_MASK)
         return ZX_ERR_INVALID_ARGS;
 
+    // A shared ring carries a byte stream.
+    if ((flags & ZX_SOCKET_SHARED_RING) && (flags & ZX_SOCKET_DATAGRAM))
+        return ZX_ERR_INVALID_ARGS;
+
     fbl::AllocChecker ac;
 
     zx_signals_t starting_signals = ZX_SOCKET_WRITABLE;
@@ -59,18 +63,33 @@ zx_status_t SocketDispatcher::Create(uint32_t flags,
             return ZX_ERR_NO_MEMORY;
     }
 
+    ktl::unique_ptr<SocketRing> ring0;
+    ktl::unique_ptr<SocketRing> ring1;
+
+    if (flags & ZX_SOCKET_SHARED_RING) {
+        zx_status_t status = SocketRing::Create(&ring0);
+        if (status != ZX_OK)
+            return status;
+
+        status = SocketRing::Create(&ring1);
+        if (status != ZX_OK)
+            return status;
+    }
+
     auto holder0 = fbl::AdoptRef(new (&ac) PeerHolder<SocketDispatcher>());
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
     auto holder1 = holder0;
 
     auto socket0 = fbl::AdoptRef(new (&ac) SocketDispatcher(ktl::move(holder0), starting_signals,
-                                                            flags, ktl::move(control0)));
+                                                            flags, ktl::move(control0),
+                                                            ktl::move(ring0)));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
     auto socket1 = fbl::AdoptRef(new (&ac) SocketDispatcher(ktl::move(holder1), starting_signals,
-                                                            flags, ktl::move(control1)));
+                                                            flags, ktl::move(control1),
+                                                            ktl::move(ring1)));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
@@ -85,9 +104,11 @@ zx_status_t SocketDispatcher::Create(uint32_t flags,
 
 SocketDispatcher::SocketDispatcher(fbl::RefPtr<PeerHolder<SocketDispatcher>> holder,
                                    zx_signals_t starting_signals, uint32_t flags,
-                                   ktl::unique_ptr<ControlMsg> control_msg)
+                                   ktl::unique_ptr<ControlMsg> control_msg,
+                                   ktl::unique_ptr<SocketRing> ring)
     : PeeredDispatcher(ktl::move(holder), starting_signals),
       flags_(flags),
+      ring_(ktl::move(ring)),
       control_msg_(ktl::move(control_msg)),
       control_msg_len_(0),
       read_threshold_(0),
@@ -256,7 +277,9 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
 
     size_t st = 0u;
     zx_status_t status;
-    if (flags_ & ZX_SOCKET_DATAGRAM) {
+    if (ring_) {
+        status = ring_->Write(src, len, &st);
+    } else if (flags_ & ZX_SOCKET_DATAGRAM) {
         status = data_.WriteDatagram(src, len, &st);
     } else {
         status = data_.WriteStream(src, len, &st);
@@ -264,14 +287,22 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
     if (status)
         return status;
 
+    DataWrittenLocked(was_empty, st);
+
+    *written = st;
+    return status;
+}
+
+void SocketDispatcher::DataWrittenLocked(bool was_empty, size_t count)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
     zx_signals_t clear = 0u;
     zx_signals_t set = 0u;
 
-    if (st > 0) {
+    if (count > 0) {
         if (was_empty)
             set |= ZX_SOCKET_READABLE;
         // Assert signal if we go above the read threshold
-        if ((read_threshold_ > 0) && (data_.size() >= read_threshold_))
+        if ((read_threshold_ > 0) && (data_size() >= read_threshold_))
             set |= ZX_SOCKET_READ_THRESHOLD;
         if (set) {
             UpdateStateLocked(0u, set);
@@ -280,7 +311,7 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
             size_t peer_write_threshold = peer_->write_threshold_;
             // If free space falls below threshold, de-signal
             if ((peer_write_threshold > 0) &&
-                ((data_.max_size() - data_.size()) < peer_write_threshold))
+                ((data_max_size() - data_size()) < peer_write_threshold))
                 clear |= ZX_SOCKET_WRITE_THRESHOLD;
         }
     }
@@ -290,9 +321,6 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
 
     if (clear)
         peer_->UpdateStateLocked(clear, 0u);
-
-    *written = st;
-    return status;
 }
 
 zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
@@ -318,13 +346,27 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
 
     bool was_full = is_full();
 
-    auto st = data_.Read(dst, len, flags_ & ZX_SOCKET_DATAGRAM);
+    size_t st;
+    if (ring_) {
+        zx_status_t status = ring_->Read(dst, len, &st);
+        if (status != ZX_OK)
+            return status;
+    } else {
+        st = data_.Read(dst, len, flags_ & ZX_SOCKET_DATAGRAM);
+    }
 
+    DataReadLocked(was_full, st);
+
+    *nread = st;
+    return ZX_OK;
+}
+
+void SocketDispatcher::DataReadLocked(bool was_full, size_t count) TA_NO_THREAD_SAFETY_ANALYSIS {
     zx_signals_t clear = 0u;
     zx_signals_t set = 0u;
 
     // Deassert signal if we fell below the read threshold
-    if ((read_threshold_ > 0) && (data_.size() < read_threshold_))
+    if ((read_threshold_ > 0) && (data_size() < read_threshold_))
         clear |= ZX_SOCKET_READ_THRESHOLD;
 
     if (is_empty()) {
@@ -339,16 +381,13 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
         // threshold.
         size_t peer_write_threshold = peer_->write_threshold_;
         if (peer_write_threshold > 0 &&
-            ((data_.max_size() - data_.size()) >= peer_write_threshold))
+            ((data_max_size() - data_size()) >= peer_write_threshold))
             set |= ZX_SOCKET_WRITE_THRESHOLD;
-        if (was_full && (st > 0))
+        if (was_full && (count > 0))
             set |= ZX_SOCKET_WRITABLE;
         if (set)
             peer_->UpdateStateLocked(0u, set);
     }
-
-    *nread = static_cast<size_t>(st);
-    return ZX_OK;
 }
 
 zx_status_t SocketDispatcher::ReadControl(user_out_ptr<void> dst, size_t len,
@@ -438,6 +477,85 @@ zx_status_t SocketDispatcher::Accept(HandleOwner* h) TA_NO_THREAD_SAFETY_ANALYSI
     return ZX_OK;
 }
 
+zx_status_t SocketDispatcher::GetRingVmo(uint32_t options, fbl::RefPtr<Dispatcher>* vmo,
+                                        zx_rights_t* rights) TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+
+    if ((flags_ & ZX_SOCKET_SHARED_RING) == 0)
+        return ZX_ERR_BAD_STATE;
+
+    Guard<fbl::Mutex> guard{get_lock()};
+
+    // The reader only needs to see the RX ring; the writer fills the TX ring.
+    switch (options) {
+    case ZX_SOCKET_RING_RX:
+        *vmo = ring_->vmo_dispatcher();
+        *rights = ZX_RIGHTS_BASIC | ZX_RIGHT_READ | ZX_RIGHT_MAP | ZX_RIGHT_GET_PROPERTY;
+        return ZX_OK;
+    case ZX_SOCKET_RING_TX:
+        if (!peer_)
+            return ZX_ERR_PEER_CLOSED;
+        *vmo = peer_->ring_->vmo_dispatcher();
+        *rights = ZX_RIGHTS_BASIC | ZX_RIGHTS_IO | ZX_RIGHT_MAP | ZX_RIGHT_GET_PROPERTY;
+        return ZX_OK;
+    default:
+        return ZX_ERR_INVALID_ARGS;
+    }
+}
+
+zx_status_t SocketDispatcher::AdvanceRing(uint32_t options, size_t count,
+                                         zx_socket_ring_state_t* state)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+
+    if ((flags_ & ZX_SOCKET_SHARED_RING) == 0)
+        return ZX_ERR_BAD_STATE;
+
+    Guard<fbl::Mutex> guard{get_lock()};
+
+    switch (options) {
+    case ZX_SOCKET_RING_RX: {
+        bool was_full = is_full();
+        zx_status_t status = ring_->Consume(count);
+        if (status != ZX_OK)
+            return status;
+        DataReadLocked(was_full, count);
+        GetRingStateLocked(state);
+        return ZX_OK;
+    }
+    case ZX_SOCKET_RING_TX:
+        if (!peer_)
+            return ZX_ERR_PEER_CLOSED;
+        if ((count > 0) && (GetSignalsStateLocked() & ZX_SOCKET_WRITE_DISABLED))
+            return ZX_ERR_BAD_STATE;
+        return peer_->ProduceSelfLocked(count, state);
+    default:
+        return ZX_ERR_INVALID_ARGS;
+    }
+}
+
+zx_status_t SocketDispatcher::ProduceSelfLocked(size_t count, zx_socket_ring_state_t* state)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+
+    bool was_empty = is_empty();
+    zx_status_t status = ring_->Produce(count);
+    if (status != ZX_OK)
+        return status;
+    DataWrittenLocked(was_empty, count);
+    GetRingStateLocked(state);
+    return ZX_OK;
+}
+
+void SocketDispatcher::GetRingStateLocked(zx_socket_ring_state_t* state) const
+    TA_NO_THREAD_SAFETY_ANALYSIS {
+    *state = zx_socket_ring_state_t{
+        .head = ring_->head(),
+        .tail = ring_->tail(),
+        .size = ring_->max_size(),
+    };
+}
+
 // NOTE(abdulla): peer_ is protected by get_lock() while peer_->data_
 // is protected by peer_->get_lock(). These two locks are aliases of
 // one another so must only acquire one of them. Thread-safety
@@ -448,11 +566,11 @@ void SocketDispatcher::GetInfo(zx_info_socket_t* info) const TA_NO_THREAD_SAFETY
     Guard<fbl::Mutex> guard{get_lock()};
     *info = zx_info_socket_t{
         .options = flags_,
-        .rx_buf_max = data_.max_size(),
-        .rx_buf_size = data_.size(),
-        .rx_buf_available = data_.size(flags_ & ZX_SOCKET_DATAGRAM),
-        .tx_buf_max = peer_ ? peer_->data_.max_size() : 0,
-        .tx_buf_size = peer_ ? peer_->data_.size() : 0,
+        .rx_buf_max = data_max_size(),
+        .rx_buf_size = data_size(),
+        .rx_buf_available = data_size(flags_ & ZX_SOCKET_DATAGRAM),
+        .tx_buf_max = peer_ ? peer_->data_max_size() : 0,
+        .tx_buf_size = peer_ ? peer_->data_size() : 0,
     };
 }
 
@@ -471,14 +589,14 @@ size_t SocketDispatcher::GetWriteThreshold() const TA_NO_THREAD_SAFETY_ANALYSIS
 zx_status_t SocketDispatcher::SetReadThreshold(size_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
     canary_.Assert();
     Guard<fbl::Mutex> guard{get_lock()};
-    if (value > data_.max_size())
+    if (value > data_max_size())
         return ZX_ERR_INVALID_ARGS;
     read_threshold_ = value;
     // Setting 0 disables thresholding. Deassert signal unconditionally.
     if (value == 0) {
         UpdateStateLocked(ZX_SOCKET_READ_THRESHOLD, 0u);
     } else {
-        if (data_.size() >= read_threshold_) {
+        if (data_size() >= read_threshold_) {
             // Assert signal if we have queued data above the read threshold
             UpdateStateLocked(0u, ZX_SOCKET_READ_THRESHOLD);
         } else {
@@ -494,7 +612,7 @@ zx_status_t SocketDispatcher::SetWriteThreshold(size_t value) TA_NO_THREAD_SAFET
     Guard<fbl::Mutex> guard{get_lock()};
     if (peer_ == NULL)
         return ZX_ERR_PEER_CLOSED;
-    if (value > peer_->data_.max_size())
+    if (value > peer_->data_max_size())
         return ZX_ERR_INVALID_ARGS;
     write_threshold_ = value;
     // Setting 0 disables thresholding. Deassert signal unconditionally.
@@ -502,7 +620,7 @@ zx_status_t SocketDispatcher::SetWriteThreshold(size_t value) TA_NO_THREAD_SAFET
         UpdateStateLocked(ZX_SOCKET_WRITE_THRESHOLD, 0u);
     } else {
         // Assert signal if we have available space above the write threshold
-        if ((peer_->data_.max_size() - peer_->data_.size()) >= write_threshold_) {
+        if ((peer_->data_max_size() - peer_->data_size()) >= write_threshold_) {
             // Assert signal if we have available space above the write threshold
             UpdateStateLocked(0u, ZX_SOCKET_WRITE_THRESHOLD);
         } else {
@@ -0,0 +1,177 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/socket_ring.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <pow2.h>
+#include <trace.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <lib/user_copy/user_ptr.h>
+#include <object/vm_object_dispatcher.h>
+#include <vm/vm_aspace.h>
+#include <vm/vm_object_paged.h>
+
+#define LOCAL_TRACE 0
+
+constexpr size_t SocketRing::kSize;
+
+static_assert(ispow2(SocketRing::kSize), "the ring size must be a power of two");
+static_assert(SocketRing::kSize / PAGE_SIZE <= 64, "pinned pages must fit in a uint64_t");
+
+// static
+zx_status_t SocketRing::Create(ktl::unique_ptr<SocketRing>* out) {
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, kSize, &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+    static const char kName[] = "socket-ring";
+    vmo->set_name(kName, sizeof(kName));
+
+    fbl::RefPtr<VmMapping> mapping;
+    status = VmAspace::kernel_aspace()->RootVmar()->CreateVmMapping(
+        0 /* ignored */, kSize, 0 /* align pow2 */, 0 /* vmar flags */, vmo, 0 /* vmo offset */,
+        ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE, kName, &mapping);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    status = VmObjectDispatcher::Create(vmo, &dispatcher, &rights);
+    if (status != ZX_OK) {
+        mapping->Destroy();
+        return status;
+    }
+
+    fbl::AllocChecker ac;
+    ktl::unique_ptr<SocketRing> ring(
+        new (&ac) SocketRing(ktl::move(vmo), ktl::move(dispatcher), mapping));
+    if (!ac.check()) {
+        mapping->Destroy();
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    LTRACEF("ring %p mapped at %#" PRIxPTR "\n", ring.get(), mapping->base());
+    *out = ktl::move(ring);
+    return ZX_OK;
+}
+
+SocketRing::SocketRing(fbl::RefPtr<VmObject> vmo, fbl::RefPtr<Dispatcher> vmo_dispatcher,
+                       fbl::RefPtr<VmMapping> mapping)
+    : vmo_(ktl::move(vmo)), vmo_dispatcher_(ktl::move(vmo_dispatcher)),
+      mapping_(ktl::move(mapping)) {}
+
+SocketRing::~SocketRing() {
+    // Userspace may still have the VMO mapped; only the kernel's view and
+    // pins go.
+    mapping_->Destroy();
+    for (size_t page = 0; page < kSize / PAGE_SIZE; page++) {
+        if (pinned_pages_ & (1ull << page)) {
+            vmo_->Unpin(page * PAGE_SIZE, PAGE_SIZE);
+        }
+    }
+}
+
+zx_status_t SocketRing::PinRange(size_t offset, size_t len) {
+    const size_t first = offset / PAGE_SIZE;
+    const size_t last = (offset + len - 1) / PAGE_SIZE;
+    for (size_t page = first; page <= last; page++) {
+        if (pinned_pages_ & (1ull << page)) {
+            continue;
+        }
+
+        // Userspace may decommit the page between the commit and the pin, in
+        // which case the pin fails and we try once more.
+        const uint64_t page_offset = page * PAGE_SIZE;
+        zx_status_t status;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            status = vmo_->CommitRange(page_offset, PAGE_SIZE);
+            if (status != ZX_OK) {
+                return status;
+            }
+            status = vmo_->Pin(page_offset, PAGE_SIZE);
+            if (status == ZX_OK) {
+                break;
+            }
+        }
+        if (status != ZX_OK) {
+            return status;
+        }
+
+        // Map it now so that copying in and out of the ring only ever faults
+        // on the user side.
+        status = mapping_->MapRange(page_offset, PAGE_SIZE, false);
+        if (status != ZX_OK) {
+            vmo_->Unpin(page_offset, PAGE_SIZE);
+            return status;
+        }
+        pinned_pages_ |= 1ull << page;
+    }
+    return ZX_OK;
+}
+
+zx_status_t SocketRing::Write(user_in_ptr<const void> src, size_t len, size_t* written) {
+    size_t pos = 0;
+    while (pos < len && !is_full()) {
+        const size_t offset = static_cast<size_t>(tail_ & (kSize - 1));
+        const size_t copy_len = fbl::min(len - pos, fbl::min(kSize - offset, kSize - size()));
+        zx_status_t status = PinRange(offset, copy_len);
+        if (status != ZX_OK) {
+            if (pos == 0)
+                return status;
+            break;
+        }
+        if (src.byte_offset(pos).copy_array_from_user(base() + offset, copy_len) != ZX_OK)
+            break;
+        pos += copy_len;
+        tail_ += copy_len;
+    }
+
+    if (pos == 0)
+        return ZX_ERR_SHOULD_WAIT;
+
+    *written = pos;
+    return ZX_OK;
+}
+
+zx_status_t SocketRing::Read(user_out_ptr<void> dst, size_t len, size_t* nread) {
+    size_t pos = 0;
+    while (pos < len && !is_empty()) {
+        const size_t offset = static_cast<size_t>(head_ & (kSize - 1));
+        const size_t copy_len = fbl::min(len - pos, fbl::min(kSize - offset, size()));
+        zx_status_t status = PinRange(offset, copy_len);
+        if (status != ZX_OK) {
+            if (pos == 0)
+                return status;
+            break;
+        }
+        if (dst.byte_offset(pos).copy_array_to_user(base() + offset, copy_len) != ZX_OK)
+            break;
+        pos += copy_len;
+        head_ += copy_len;
+    }
+    *nread = pos;
+    return ZX_OK;
+}
+
+zx_status_t SocketRing::Produce(size_t count) {
+    if (count > kSize - size())
+        return ZX_ERR_OUT_OF_RANGE;
+    tail_ += count;
+    return ZX_OK;
+}
+
+zx_status_t SocketRing::Consume(size_t count) {
+    if (count > size())
+        return ZX_ERR_OUT_OF_RANGE;
+    head_ += count;
+    return ZX_OK;
+}
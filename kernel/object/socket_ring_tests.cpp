@@ -0,0 +1,149 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/socket_ring.h>
+
+#include <fbl/alloc_checker.h>
+#include <ktl/unique_ptr.h>
+#include <lib/unittest/unittest.h>
+#include <lib/unittest/user_memory.h>
+#include <object/vm_object_dispatcher.h>
+#include <string.h>
+
+namespace {
+
+using testing::UserMemory;
+
+static bool initial_state() {
+    BEGIN_TEST;
+    ktl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+    EXPECT_TRUE(ring->is_empty(), "");
+    EXPECT_FALSE(ring->is_full(), "");
+    EXPECT_EQ(0U, ring->size(), "");
+    EXPECT_EQ(SocketRing::kSize, ring->max_size(), "");
+    EXPECT_NONNULL(ring->vmo_dispatcher().get(), "");
+    END_TEST;
+}
+
+// Tests that data written across the end of the ring reads back intact.
+static bool write_read_wrap() {
+    BEGIN_TEST;
+    constexpr size_t kLen = SocketRing::kSize / 2 + PAGE_SIZE;
+
+    ktl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+
+    ktl::unique_ptr<UserMemory> mem = UserMemory::Create(kLen);
+    auto mem_in = make_user_in_ptr(mem->in());
+    auto mem_out = make_user_out_ptr(mem->out());
+
+    fbl::AllocChecker ac;
+    auto expected = ktl::unique_ptr<uint8_t[]>(new (&ac) uint8_t[kLen]);
+    ASSERT_TRUE(ac.check(), "");
+    auto actual = ktl::unique_ptr<uint8_t[]>(new (&ac) uint8_t[kLen]);
+    ASSERT_TRUE(ac.check(), "");
+
+    for (int pass = 0; pass < 3; ++pass) {
+        for (size_t i = 0; i < kLen; ++i) {
+            expected[i] = static_cast<uint8_t>(i + pass);
+        }
+        ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(expected.get(), kLen), "");
+
+        size_t written = 0;
+        ASSERT_EQ(ZX_OK, ring->Write(mem_in, kLen, &written), "");
+        ASSERT_EQ(kLen, written, "");
+        EXPECT_EQ(kLen, ring->size(), "");
+
+        memset(actual.get(), 0, kLen);
+        ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(actual.get(), kLen), "");
+        size_t nread = 0;
+        ASSERT_EQ(ZX_OK, ring->Read(mem_out, kLen, &nread), "");
+        ASSERT_EQ(kLen, nread, "");
+        EXPECT_TRUE(ring->is_empty(), "");
+        ASSERT_EQ(ZX_OK, mem_in.copy_array_from_user(actual.get(), kLen), "");
+        EXPECT_EQ(0, memcmp(expected.get(), actual.get(), kLen), "");
+    }
+    EXPECT_EQ(3 * kLen, ring->head(), "");
+    EXPECT_EQ(3 * kLen, ring->tail(), "");
+    END_TEST;
+}
+
+// Tests that writes stop when the ring is full.
+static bool write_full() {
+    BEGIN_TEST;
+    ktl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+
+    ktl::unique_ptr<UserMemory> mem = UserMemory::Create(SocketRing::kSize + PAGE_SIZE);
+    auto mem_in = make_user_in_ptr(mem->in());
+
+    size_t written = 0;
+    ASSERT_EQ(ZX_OK, ring->Write(mem_in, SocketRing::kSize + PAGE_SIZE, &written), "");
+    EXPECT_EQ(SocketRing::kSize, written, "");
+    EXPECT_TRUE(ring->is_full(), "");
+    EXPECT_EQ(ZX_ERR_SHOULD_WAIT, ring->Write(mem_in, 1, &written), "");
+    END_TEST;
+}
+
+// Tests that pages are only committed as the kernel copies through them, and
+// that those can't be decommitted while the ring exists.
+static bool commit_on_use() {
+    BEGIN_TEST;
+    ktl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+    fbl::RefPtr<Dispatcher> dispatcher = ring->vmo_dispatcher();
+    fbl::RefPtr<VmObjectDispatcher> vmo_dispatcher =
+        DownCastDispatcher<VmObjectDispatcher>(&dispatcher);
+    ASSERT_NONNULL(vmo_dispatcher.get(), "");
+    const fbl::RefPtr<VmObject>& vmo = vmo_dispatcher->vmo();
+    EXPECT_EQ(0U, vmo->AllocatedPagesInRange(0, SocketRing::kSize), "");
+
+    ktl::unique_ptr<UserMemory> mem = UserMemory::Create(PAGE_SIZE);
+    auto mem_in = make_user_in_ptr(mem->in());
+    size_t written = 0;
+    ASSERT_EQ(ZX_OK, ring->Write(mem_in, PAGE_SIZE, &written), "");
+    EXPECT_EQ(PAGE_SIZE, written, "");
+    EXPECT_EQ(1U, vmo->AllocatedPagesInRange(0, SocketRing::kSize), "");
+
+    // The page the kernel wrote is pinned; the ones it hasn't touched are
+    // left to userspace.
+    EXPECT_EQ(ZX_ERR_BAD_STATE, vmo->DecommitRange(0, PAGE_SIZE), "");
+    ASSERT_EQ(ZX_OK, vmo->CommitRange(PAGE_SIZE, PAGE_SIZE), "");
+    EXPECT_EQ(ZX_OK, vmo->DecommitRange(PAGE_SIZE, PAGE_SIZE), "");
+    END_TEST;
+}
+
+static bool produce_consume() {
+    BEGIN_TEST;
+    ktl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, ring->Consume(1), "");
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, ring->Produce(SocketRing::kSize + 1), "");
+
+    ASSERT_EQ(ZX_OK, ring->Produce(100), "");
+    EXPECT_EQ(100U, ring->size(), "");
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, ring->Produce(SocketRing::kSize - 99), "");
+    ASSERT_EQ(ZX_OK, ring->Produce(SocketRing::kSize - 100), "");
+    EXPECT_TRUE(ring->is_full(), "");
+
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, ring->Consume(SocketRing::kSize + 1), "");
+    ASSERT_EQ(ZX_OK, ring->Consume(SocketRing::kSize), "");
+    EXPECT_TRUE(ring->is_empty(), "");
+    EXPECT_EQ(SocketRing::kSize, ring->head(), "");
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(socket_ring_tests)
+UNITTEST("initial state", initial_state)
+UNITTEST("write read wrap", write_read_wrap)
+UNITTEST("write full", write_full)
+UNITTEST("commit on use", commit_on_use)
+UNITTEST("produce consume", produce_consume)
+UNITTEST_END_TESTCASE(socket_ring_tests, "socket_ring", "SocketRing test");
@@ -1017,6 +1017,19 @@ zx_status_t ThreadDispatcher::SetPriority(int32_t priority) {
     return ZX_OK;
 }
 
+zx_status_t ThreadDispatcher::SetDeadline(zx_duration_t capacity,
+                                          zx_duration_t relative_deadline,
+                                          zx_duration_t period) {
+    Guard<fbl::Mutex> guard{get_lock()};
+    if ((state_.lifecycle() == ThreadState::Lifecycle::INITIAL) ||
+        (state_.lifecycle() == ThreadState::Lifecycle::DYING) ||
+        (state_.lifecycle() == ThreadState::Lifecycle::DEAD)) {
+        return ZX_ERR_BAD_STATE;
+    }
+    // The parameters were already validated by the Profile dispatcher.
+    return thread_set_deadline(&thread_, capacity, relative_deadline, period);
+}
+
 const char* ThreadLifecycleToString(ThreadState::Lifecycle lifecycle) {
     switch (lifecycle) {
     case ThreadState::Lifecycle::INITIAL:
@@ -6,6 +6,7 @@
 
 #include <object/vm_address_region_dispatcher.h>
 
+#include <vm/fault.h>
 #include <vm/vm_address_region.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_object.h>
@@ -188,11 +189,26 @@ zx_status_t VmAddressRegionDispatcher::Map(size_t vmar_offset, fbl::RefPtr<VmObj
             return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // Place mappings of large page VMOs so that their aligned object ranges
+    // land on aligned addresses and can be mapped with large pages.
+    uint8_t align_pow2 = 0;
+    if (vmo->wants_large_pages() && len >= LARGE_PAGE_SIZE &&
+        IS_ALIGNED(vmo_offset, LARGE_PAGE_SIZE) && !(vmar_flags & VMAR_FLAG_SPECIFIC)) {
+        align_pow2 = LARGE_PAGE_SIZE_SHIFT;
+    }
+
     fbl::RefPtr<VmMapping> result(nullptr);
-    status = vmar_->CreateVmMapping(vmar_offset, len, /* align_pow2 */ 0,
-                                    vmar_flags, ktl::move(vmo), vmo_offset,
+    status = vmar_->CreateVmMapping(vmar_offset, len, align_pow2,
+                                    vmar_flags, vmo, vmo_offset,
                                     arch_mmu_flags, "useralloc",
                                     &result);
+    if (status == ZX_ERR_NO_MEMORY && align_pow2 != 0) {
+        // not enough aligned room left; any spot will do
+        status = vmar_->CreateVmMapping(vmar_offset, len, /* align_pow2 */ 0,
+                                        vmar_flags, ktl::move(vmo), vmo_offset,
+                                        arch_mmu_flags, "useralloc",
+                                        &result);
+    }
     if (status != ZX_OK) {
         return status;
     }
@@ -234,6 +250,43 @@ zx_status_t VmAddressRegionDispatcher::Unmap(vaddr_t base, size_t len) {
     return vmar_->Unmap(base, len);
 }
 
+zx_status_t VmAddressRegionDispatcher::RangeOp(uint32_t op, vaddr_t base, size_t len,
+                                              zx_rights_t rights) {
+    canary_.Assert();
+
+    if (!IS_PAGE_ALIGNED(base)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    switch (op) {
+        case ZX_VMAR_OP_COMMIT:
+            if ((rights & ZX_RIGHT_WRITE) == 0) {
+                return ZX_ERR_ACCESS_DENIED;
+            }
+            return vmar_->Populate(base, len, VMM_PF_FLAG_SW_FAULT | VMM_PF_FLAG_WRITE);
+        case ZX_VMAR_OP_DECOMMIT:
+            if ((rights & ZX_RIGHT_WRITE) == 0) {
+                return ZX_ERR_ACCESS_DENIED;
+            }
+            return vmar_->Decommit(base, len);
+        case ZX_VMAR_OP_MAP_RANGE:
+            // Only maps pages that are already resident.
+            if ((rights & ZX_RIGHT_READ) == 0) {
+                return ZX_ERR_ACCESS_DENIED;
+            }
+            return vmar_->Populate(base, len, 0);
+        case ZX_VMAR_OP_WILLNEED:
+            // Read faults the range, so pager-backed pages are requested
+            // from the pager now rather than when first touched.
+            if ((rights & ZX_RIGHT_READ) == 0) {
+                return ZX_ERR_ACCESS_DENIED;
+            }
+            return vmar_->Populate(base, len, VMM_PF_FLAG_SW_FAULT);
+        default:
+            return ZX_ERR_INVALID_ARGS;
+    }
+}
+
 bool VmAddressRegionDispatcher::is_valid_mapping_protection(uint32_t flags) {
     if (!(flags & ZX_VM_PERM_READ)) {
         // No way to express non-readable mappings that are also writeable or
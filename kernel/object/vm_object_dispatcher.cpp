@@ -8,6 +8,7 @@
 
 #include <vm/vm_aspace.h>
 #include <vm/vm_object.h>
+#include <vm/vm_object_paged.h>
 
 #include <zircon/rights.h>
 
@@ -126,6 +127,27 @@ zx_info_vmo_t VmObjectDispatcher::GetVmoInfo(void)
     return VmoToInfoEntry(vmo().get(), true, 0);
 }
 
+zx_status_t VmObjectDispatcher::GetVmoReclaimInfo(zx_info_vmo_reclaim_t* info) {
+    canary_.Assert();
+
+    VmObjectPaged* paged = VmObjectPaged::AsVmObjectPaged(vmo_);
+    if (!paged) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    VmObjectPaged::ReclaimStats stats;
+    zx_status_t status = paged->GetReclaimStats(&stats);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    info->active_bytes = stats.active_pages * PAGE_SIZE;
+    info->inactive_bytes = stats.inactive_pages * PAGE_SIZE;
+    info->modified_bytes = stats.modified_pages * PAGE_SIZE;
+    info->evicted_bytes = stats.evicted_pages * PAGE_SIZE;
+    return ZX_OK;
+}
+
 zx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t size,
                                         user_inout_ptr<void> buffer, size_t buffer_size,
                                         zx_rights_t rights) {
@@ -13,6 +13,7 @@ MODULES += \
     kernel/lib/userboot \
     kernel/lib/debuglog \
     kernel/lib/ktrace \
+    kernel/lib/profiler \
     kernel/lib/mtrace \
     kernel/object \
     kernel/syscalls \
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <trace.h>
 
+#include <fbl/algorithm.h>
 #include <lib/console.h>
 #include <lib/debuglog.h>
 #include <lib/user_copy/user_ptr.h>
@@ -145,6 +146,18 @@ zx_status_t sys_ktrace_control(
         name[sizeof(name) - 1] = 0;
         return ktrace_control(action, options, name);
     }
+    case KTRACE_ACTION_GET_DROPPED: {
+        // one entry per cpu, and one for the metadata buffer
+        uint64_t dropped[SMP_MAX_CPUS + 1] = {};
+        options = fbl::min<uint32_t>(options, SMP_MAX_CPUS + 1);
+        zx_status_t count = ktrace_control(action, options, dropped);
+        if (count < 0)
+            return count;
+        if (_ptr.reinterpret<uint64_t>().copy_array_to_user(
+                dropped, fbl::min<uint32_t>(options, count)) != ZX_OK)
+            return ZX_ERR_INVALID_ARGS;
+        return count;
+    }
     default:
         return ktrace_control(action, options, nullptr);
     }
@@ -162,14 +175,11 @@ zx_status_t sys_ktrace_write(zx_handle_t handle, uint32_t event_id, uint32_t arg
         return ZX_ERR_INVALID_ARGS;
     }
 
-    uint32_t* args = static_cast<uint32_t*>(ktrace_open(TAG_PROBE_24(event_id)));
-    if (!args) {
+    uint32_t args[2] = {arg0, arg1};
+    if (!ktrace_write(TAG_PROBE_24(event_id), args, sizeof(args))) {
         //  There is not a single reason for failure. Assume it reached the end.
         return ZX_ERR_UNAVAILABLE;
     }
-
-    args[0] = arg0;
-    args[1] = arg1;
     return ZX_OK;
 }
 
@@ -12,6 +12,7 @@
 #include <kernel/stats.h>
 #include <kernel/thread_lock.h>
 #include <lib/heap.h>
+#include <lib/lockstat.h>
 #include <platform.h>
 #include <vm/pmm.h>
 #include <vm/vm.h>
@@ -415,6 +416,20 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
         }
         return status;
     }
+    case ZX_INFO_VMO_RECLAIM: {
+        fbl::RefPtr<VmObjectDispatcher> vmo;
+        zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_INSPECT, &vmo);
+        if (status != ZX_OK)
+            return status;
+
+        zx_info_vmo_reclaim_t info = {};
+        status = vmo->GetVmoReclaimInfo(&info);
+        if (status != ZX_OK)
+            return status;
+
+        return single_record_result(
+            _buffer, buffer_size, _actual, _avail, &info, sizeof(info));
+    }
     case ZX_INFO_VMAR: {
         fbl::RefPtr<VmAddressRegionDispatcher> vmar;
         zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_INSPECT, &vmar);
@@ -553,6 +568,44 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
         return single_record_result(
             _buffer, buffer_size, _actual, _avail, &stats, sizeof(stats));
     }
+    case ZX_INFO_LOCK_STATS: {
+        auto status = validate_resource(handle, ZX_RSRC_KIND_ROOT);
+        if (status != ZX_OK)
+            return status;
+
+        size_t num_classes = lockstat::GetClassCount();
+        if (num_classes == 0)
+            return ZX_ERR_NOT_SUPPORTED;
+
+        size_t num_space_for = buffer_size / sizeof(zx_info_lock_stats_t);
+        size_t num_to_copy = MIN(num_classes, num_space_for);
+
+        user_out_ptr<zx_info_lock_stats_t> stats_buf =
+            _buffer.reinterpret<zx_info_lock_stats_t>();
+
+        for (size_t i = 0; i < num_to_copy; i++) {
+            zx_info_lock_stats_t stats;
+            status = lockstat::GetClassInfo(i, &stats);
+            if (status != ZX_OK)
+                return status;
+
+            // copy out one at a time
+            if (stats_buf.copy_array_to_user(&stats, 1, i) != ZX_OK)
+                return ZX_ERR_INVALID_ARGS;
+        }
+
+        if (_actual) {
+            status = _actual.copy_to_user(num_to_copy);
+            if (status != ZX_OK)
+                return status;
+        }
+        if (_avail) {
+            status = _avail.copy_to_user(num_classes);
+            if (status != ZX_OK)
+                return status;
+        }
+        return ZX_OK;
+    }
     case ZX_INFO_RESOURCE: {
         // grab a reference to the dispatcher
         fbl::RefPtr<ResourceDispatcher> resource;
@@ -6,6 +6,7 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <string.h>
 #include <trace.h>
 
 #include <lib/ktrace.h>
@@ -13,6 +14,7 @@
 #include <object/port_dispatcher.h>
 #include <object/process_dispatcher.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/ref_ptr.h>
 
@@ -23,6 +25,9 @@
 
 #define LOCAL_TRACE 0
 
+// Number of packets zx_port_wait_many() copies out at a time.
+static constexpr size_t kMaxPortWaitBatch = 16;
+
 // zx_status_t zx_port_create
 zx_status_t sys_port_create(uint32_t options, user_out_handle* out) {
     LTRACEF("options %u\n", options);
@@ -96,6 +101,81 @@ zx_status_t sys_port_wait(zx_handle_t handle, zx_time_t deadline,
     return ZX_OK;
 }
 
+// zx_status_t zx_port_wait_many
+zx_status_t sys_port_wait_many(zx_handle_t handle, zx_time_t deadline,
+                               user_out_ptr<zx_port_packet_t> packets_out, size_t count,
+                               user_out_ptr<size_t> actual_out) {
+    LTRACEF("handle %x count %zu\n", handle, count);
+
+    if (count == 0)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<PortDispatcher> port;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &port);
+    if (status != ZX_OK)
+        return status;
+
+    const Deadline slackDeadline(deadline, up->GetTimerSlackPolicy());
+
+    ktrace(TAG_PORT_WAIT, (uint32_t)port->get_koid(), 0, 0, 0);
+
+    // Check that |actual_out| can be written before taking any packets, so a
+    // bad pointer doesn't lose them.
+    if (actual_out) {
+        status = actual_out.copy_to_user(size_t{0});
+        if (status != ZX_OK)
+            return status;
+    }
+
+    // Packets are staged on the stack, kMaxPortWaitBatch at a time.  Only
+    // the first batch blocks; later batches take whatever is already queued.
+    zx_port_packet_t pp[kMaxPortWaitBatch];
+    size_t total = 0;
+    zx_status_t st;
+    do {
+        size_t batch = fbl::min(count - total, kMaxPortWaitBatch);
+
+        // Packets can't be put back once dequeued, so probe the part of
+        // |packets_out| they will go to first.  If that fails, hand back
+        // whatever was already copied out.
+        memset(pp, 0, batch * sizeof(pp[0]));
+        st = packets_out.copy_array_to_user(pp, batch, total);
+        if (st != ZX_OK)
+            break;
+
+        size_t dequeued;
+        st = port->DequeueMany(total == 0 ? slackDeadline
+                                          : Deadline::no_slack(ZX_TIME_INFINITE_PAST),
+                               pp, batch, &dequeued);
+        if (st != ZX_OK)
+            break;
+
+        // This can still fail if another thread unmaps the buffer after the
+        // probe, in which case the packets just dequeued are lost.
+        st = packets_out.copy_array_to_user(pp, dequeued, total);
+        if (st != ZX_OK)
+            break;
+        total += dequeued;
+        if (dequeued < batch)
+            break;
+    } while (total < count);
+
+    ktrace(TAG_PORT_WAIT_DONE, (uint32_t)port->get_koid(), st, 0, 0);
+
+    if (total == 0)
+        return st;
+
+    if (actual_out) {
+        status = actual_out.copy_to_user(total);
+        if (status != ZX_OK)
+            return status;
+    }
+
+    return ZX_OK;
+}
+
 // zx_status_t zx_port_cancel
 zx_status_t sys_port_cancel(zx_handle_t handle, zx_handle_t source, uint64_t key) {
     auto up = ProcessDispatcher::GetCurrent();
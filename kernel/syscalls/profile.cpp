@@ -23,6 +23,10 @@
 KCOUNTER(profile_create, "kernel.profile.create");
 KCOUNTER(profile_set,    "kernel.profile.set");
 
+static_assert(sizeof(zx_profile_info_t) == 20, "zx_profile_info_t is part of the ABI");
+static_assert(offsetof(zx_profile_deadline_info_t, type) == offsetof(zx_profile_info_t, type),
+              "profile create reads the type before knowing which struct it has");
+
 
 // zx_status_t zx_profile_create
 zx_status_t sys_profile_create(zx_handle_t root_job,
@@ -43,14 +47,29 @@ zx_status_t sys_profile_create(zx_handle_t root_job,
         return ZX_ERR_ACCESS_DENIED;
     }
 
-    zx_profile_info_t profile_info;
-    status = user_profile_info.copy_from_user(&profile_info);
+    // Deadline profiles are passed as a zx_profile_deadline_info_t, which
+    // starts with the same |type| field.
+    uint32_t type;
+    status = user_profile_info.reinterpret<const uint32_t>().copy_from_user(&type);
     if (status != ZX_OK)
         return status;
 
     fbl::RefPtr<Dispatcher> dispatcher;
     zx_rights_t rights;
-    status = ProfileDispatcher::Create(profile_info, &dispatcher, &rights);
+    if (type == ZX_PROFILE_INFO_DEADLINE) {
+        zx_profile_deadline_info_t deadline_info;
+        status = user_profile_info.reinterpret<const zx_profile_deadline_info_t>()
+                     .copy_from_user(&deadline_info);
+        if (status != ZX_OK)
+            return status;
+        status = ProfileDispatcher::Create(deadline_info, &dispatcher, &rights);
+    } else {
+        zx_profile_info_t profile_info;
+        status = user_profile_info.copy_from_user(&profile_info);
+        if (status != ZX_OK)
+            return status;
+        status = ProfileDispatcher::Create(profile_info, &dispatcher, &rights);
+    }
     if (status != ZX_OK)
         return status;
 
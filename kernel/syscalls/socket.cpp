@@ -182,3 +182,63 @@ zx_status_t sys_socket_shutdown(zx_handle_t handle, uint32_t options) {
 
     return socket->Shutdown(options & ZX_SOCKET_SHUTDOWN_MASK);
 }
+
+// The RX ring is read from and the TX ring written to.
+static zx_rights_t socket_ring_rights(uint32_t options) {
+    switch (options) {
+    case ZX_SOCKET_RING_RX:
+        return ZX_RIGHT_READ;
+    case ZX_SOCKET_RING_TX:
+        return ZX_RIGHT_WRITE;
+    default:
+        return 0u;
+    }
+}
+
+// zx_status_t zx_socket_ring_vmo
+zx_status_t sys_socket_ring_vmo(zx_handle_t handle, uint32_t options, user_out_handle* out) {
+    LTRACEF("handle %x options %#x\n", handle, options);
+
+    zx_rights_t socket_rights = socket_ring_rights(options);
+    if (socket_rights == 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<SocketDispatcher> socket;
+    zx_status_t status = up->GetDispatcherWithRights(handle, socket_rights, &socket);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<Dispatcher> vmo;
+    zx_rights_t rights;
+    status = socket->GetRingVmo(options, &vmo, &rights);
+    if (status != ZX_OK)
+        return status;
+
+    return out->make(ktl::move(vmo), rights);
+}
+
+// zx_status_t zx_socket_ring_advance
+zx_status_t sys_socket_ring_advance(zx_handle_t handle, uint32_t options, size_t count,
+                                    user_out_ptr<zx_socket_ring_state_t> state_out) {
+    LTRACEF("handle %x options %#x count %zu\n", handle, options, count);
+
+    zx_rights_t socket_rights = socket_ring_rights(options);
+    if (socket_rights == 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<SocketDispatcher> socket;
+    zx_status_t status = up->GetDispatcherWithRights(handle, socket_rights, &socket);
+    if (status != ZX_OK)
+        return status;
+
+    zx_socket_ring_state_t state;
+    status = socket->AdvanceRing(options, count, &state);
+    if (status != ZX_OK)
+        return status;
+
+    return state_out.copy_to_user(state);
+}
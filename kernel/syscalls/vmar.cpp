@@ -233,6 +233,23 @@ zx_status_t sys_vmar_protect(zx_handle_t handle, zx_vm_option_t options, zx_vadd
     return vmar->Protect(addr, len, options);
 }
 
+// zx_status_t zx_vmar_op_range
+zx_status_t sys_vmar_op_range(zx_handle_t handle, uint32_t op, zx_vaddr_t addr, uint64_t len) {
+    LTRACEF("handle %x op %u addr %#" PRIxPTR " len %#" PRIx64 "\n", handle, op, addr, len);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // lookup the dispatcher from handle
+    // save the rights and pass down into the dispatcher for further testing
+    fbl::RefPtr<VmAddressRegionDispatcher> vmar;
+    zx_rights_t rights;
+    zx_status_t status = up->GetDispatcherAndRights(handle, &vmar, &rights);
+    if (status != ZX_OK)
+        return status;
+
+    return vmar->RangeOp(op, addr, len, rights);
+}
+
 // zx_status_t zx_vmar_protect_old
 zx_status_t sys_vmar_protect_old(zx_handle_t vmar_handle, zx_vaddr_t addr, uint64_t len, uint32_t prot) {
     return sys_vmar_protect(vmar_handle, prot, addr, len);
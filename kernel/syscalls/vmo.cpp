@@ -42,11 +42,16 @@ zx_status_t sys_vmo_create(uint64_t size, uint32_t options,
                            user_out_handle* out) {
     LTRACEF("size %#" PRIx64 "\n", size);
 
+    // large pages are a hint that combines with either of the options below
+    const uint32_t large_pages = (options & ZX_VMO_LARGE_PAGES) ? VmObjectPaged::kLargePages : 0u;
+    options &= ~ZX_VMO_LARGE_PAGES;
+
     switch (options) {
     case 0: options = VmObjectPaged::kResizable; break;
     case ZX_VMO_NON_RESIZABLE: options = 0u; break;
     default: return ZX_ERR_INVALID_ARGS;
     }
+    options |= large_pages;
 
     auto up = ProcessDispatcher::GetCurrent();
     zx_status_t res = up->QueryBasicPolicy(ZX_POL_NEW_VMO);
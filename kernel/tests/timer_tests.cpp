@@ -187,6 +187,68 @@ static void timer_far_deadline(void) {
     event_destroy(&event);
 }
 
+static void timer_diag_nop_cb(timer_t*, zx_time_t, void*) {
+}
+
+// Sets |count| timers on the current cpu behind |queued| already pending
+// timers, then cancels them, and returns the average time each timer_set()
+// and timer_cancel() took.  None of the timers get to fire.
+static bool time_queue_ops(size_t queued, size_t count,
+                           zx_duration_t* set_cost, zx_duration_t* cancel_cost) {
+    timer_t* timers = (timer_t*)malloc(sizeof(timer_t) * (queued + count));
+    if (timers == nullptr) {
+        return false;
+    }
+
+    // Spread the pending timers out and put the measured ones after all of
+    // them, which is the worst case for a sorted list.
+    const zx_time_t base = current_time() + ZX_SEC(3600);
+    for (size_t i = 0; i < queued + count; i++) {
+        timer_init(&timers[i]);
+    }
+    for (size_t i = 0; i < queued; i++) {
+        timer_set(&timers[i], Deadline::no_slack(base + ZX_USEC(i)), timer_diag_nop_cb, nullptr);
+    }
+
+    zx_time_t start = current_time();
+    for (size_t i = queued; i < queued + count; i++) {
+        timer_set(&timers[i], Deadline::no_slack(base + ZX_USEC(i)), timer_diag_nop_cb, nullptr);
+    }
+    *set_cost = (current_time() - start) / count;
+
+    start = current_time();
+    for (size_t i = queued; i < queued + count; i++) {
+        timer_cancel(&timers[i]);
+    }
+    *cancel_cost = (current_time() - start) / count;
+
+    for (size_t i = 0; i < queued; i++) {
+        timer_cancel(&timers[i]);
+    }
+    free(timers);
+    return true;
+}
+
+// Times setting and canceling a timer with more and more timers pending.
+static void timer_diag_queue_scaling(void) {
+    constexpr size_t kMeasuredTimers = 256;
+
+    // Keep every timer on the same cpu's queue.
+    thread_set_cpu_affinity(get_current_thread(), cpu_num_to_mask(arch_curr_cpu_num()));
+
+    printf("pending timers    set (ns)    cancel (ns)\n");
+    for (size_t queued = 256; queued <= 16384; queued *= 4) {
+        zx_duration_t set_cost, cancel_cost;
+        if (!time_queue_ops(queued, kMeasuredTimers, &set_cost, &cancel_cost)) {
+            printf("out of memory\n");
+            break;
+        }
+        printf("%14zu %11" PRIi64 " %14" PRIi64 "\n", queued, set_cost, cancel_cost);
+    }
+
+    thread_set_cpu_affinity(get_current_thread(), CPU_MASK_ALL);
+}
+
 // Print timer diagnostics for manual review.
 int timer_diag(int, const cmd_args*, uint32_t) {
     timer_diag_coalescing_center();
@@ -194,6 +256,7 @@ int timer_diag(int, const cmd_args*, uint32_t) {
     timer_diag_coalescing_early();
     timer_diag_all_cpus();
     timer_far_deadline();
+    timer_diag_queue_scaling();
     return 0;
 }
 
@@ -485,6 +548,88 @@ static bool trylock_or_cancel_get_lock() {
     END_TEST;
 }
 
+// The cpu's timer queue used to be a sorted list, which timer_set() walked to
+// find a timer to coalesce with.  Returns the time that walk would schedule a
+// timer with |deadline| at, given the deadlines of the |count| timers
+// already queued, in order.
+static zx_time_t list_walk_schedule(const zx_time_t* queue, size_t count,
+                                    const Deadline& deadline) {
+    const zx_time_t t = deadline.when();
+    const zx_time_t earliest_deadline = deadline.earliest();
+    const zx_time_t latest_deadline = deadline.latest();
+    for (size_t i = 0; i < count; i++) {
+        const zx_time_t e = queue[i];
+        if (e > latest_deadline) {
+            return t;
+        }
+        if (e >= t) {
+            return e;
+        }
+        if (e < earliest_deadline) {
+            continue;
+        }
+        if (i + 1 < count) {
+            const zx_time_t n = queue[i + 1];
+            if (n <= t) {
+                continue;
+            }
+            if (n < latest_deadline && n - t < t - e) {
+                continue;
+            }
+        }
+        return e;
+    }
+    return t;
+}
+
+// See that timers are coalesced exactly as the sorted list did, including
+// when the slack window ends right on a queued timer.
+static bool coalescing_matches_list_walk() {
+    BEGIN_TEST;
+
+    constexpr size_t kTimers = 512;
+    timer_t* timers = (timer_t*)malloc(sizeof(timer_t) * kTimers);
+    zx_time_t* queue = (zx_time_t*)malloc(sizeof(zx_time_t) * kTimers);
+    ASSERT_NONNULL(timers, "");
+    ASSERT_NONNULL(queue, "");
+
+    // Keep every timer on the same cpu's queue.
+    thread_set_cpu_affinity(get_current_thread(), cpu_num_to_mask(arch_curr_cpu_num()));
+
+    // Crowd the timers together with slacks that are multiples of their
+    // spacing, so that the slack windows often end exactly on other timers.
+    const zx_time_t base = current_time() + ZX_HOUR(1);
+    const slack_mode modes[] = {TIMER_SLACK_CENTER, TIMER_SLACK_LATE, TIMER_SLACK_EARLY};
+    for (size_t i = 0; i < kTimers; i++) {
+        const zx_time_t when = base + ZX_USEC(rand() % 256);
+        const TimerSlack slack(ZX_USEC(5 * (rand() % 4)), modes[rand() % 3]);
+        const Deadline deadline(when, slack);
+
+        const zx_time_t expected = list_walk_schedule(queue, i, deadline);
+        timer_init(&timers[i]);
+        timer_set(&timers[i], deadline, timer_cb, nullptr);
+        EXPECT_EQ(expected, timers[i].scheduled_time, "");
+        EXPECT_EQ(expected - when, timers[i].slack, "");
+
+        size_t pos = i;
+        for (; pos > 0 && queue[pos - 1] > expected; pos--) {
+            queue[pos] = queue[pos - 1];
+        }
+        queue[pos] = expected;
+    }
+
+    for (size_t i = 0; i < kTimers; i++) {
+        EXPECT_TRUE(timer_cancel(&timers[i]), "");
+    }
+
+    thread_set_cpu_affinity(get_current_thread(), CPU_MASK_ALL);
+
+    free(queue);
+    free(timers);
+
+    END_TEST;
+}
+
 UNITTEST_START_TESTCASE(timer_tests)
 UNITTEST("cancel_before_deadline", cancel_before_deadline)
 UNITTEST("cancel_after_fired", cancel_after_fired)
@@ -492,4 +637,5 @@ UNITTEST("cancel_from_callback", cancel_from_callback)
 UNITTEST("set_from_callback", set_from_callback)
 UNITTEST("trylock_or_cancel_canceled", trylock_or_cancel_canceled)
 UNITTEST("trylock_or_cancel_get_lock", trylock_or_cancel_get_lock)
+UNITTEST("coalescing_matches_list_walk", coalescing_matches_list_walk)
 UNITTEST_END_TESTCASE(timer_tests, "timer", "timer tests");
@@ -29,6 +29,10 @@ const uint ARCH_MMU_FLAG_INVALID = (1u << 7); // Indicates that flags are not sp
 const uint ARCH_ASPACE_FLAG_KERNEL = (1u << 0);
 const uint ARCH_ASPACE_FLAG_GUEST = (1u << 1);
 
+// Called by HarvestAccessed with each run of |count| pages starting at |vaddr|
+// whose accessed flags were set.
+using HarvestAccessedCallback = void (*)(vaddr_t vaddr, size_t count, void* context);
+
 // per arch base class api to encapsulate the mmu routines on an aspace
 class ArchVmAspaceInterface {
 public:
@@ -58,6 +62,15 @@ public:
 
     virtual zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) = 0;
 
+    // Clear the hardware accessed flags of the pages mapped in the given
+    // virtual address range, calling |callback| with the pages whose flags
+    // were set. Unmapped pages are skipped. Returns
+    // ZX_ERR_NOT_SUPPORTED if the aspace doesn't track accesses. The TLB
+    // entries of the reported pages are flushed once for the whole range, so
+    // that the next access sets the flags again.
+    virtual zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                                        HarvestAccessedCallback callback, void* context) = 0;
+
     virtual vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags,
                              vaddr_t end, uint next_region_mmu_flags,
                              vaddr_t align, size_t size, uint mmu_flags) = 0;
@@ -26,6 +26,9 @@ enum vm_page_state {
     VM_PAGE_STATE_COUNT_
 };
 
+// vm_page flags
+#define VM_PAGE_FLAG_ZEROED (1u << 0) // page contents are known to be all zeros
+
 #define VM_PAGE_STATE_BITS 3
 static_assert((1u << VM_PAGE_STATE_BITS) >= VM_PAGE_STATE_COUNT_, "");
 
@@ -47,7 +50,17 @@ typedef struct vm_page {
 #define VM_PAGE_OBJECT_MAX_PIN_COUNT ((1ul << VM_PAGE_OBJECT_PIN_COUNT_BITS) - 1)
 
             uint8_t pin_count : VM_PAGE_OBJECT_PIN_COUNT_BITS;
+            // set once the page may differ from what its page source supplied
+            uint8_t modified : 1;
+            // page scanner passes since the page was last seen accessed
+            uint8_t age;
         } object; // attached to a vm object
+        struct {
+            // objects carved out of the page, and how many of them are free;
+            // only kept up to date while the cache looks for idle pages
+            uint16_t object_count;
+            uint16_t free_count;
+        } slab; // backing a slab cache
     };
 
     // helper routines
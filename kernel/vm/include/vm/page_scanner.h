@@ -0,0 +1,23 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+// The page scanner periodically ages the pages of pager-backed VMOs, using the
+// accessed bits of their mappings, so that the coldest ones can be evicted when
+// memory runs low.  Evicted pages are requested from the pager again on the
+// next fault.
+
+// Evicts up to |target| clean pages of pager-backed VMOs, oldest first, and
+// returns the number evicted.  Recently accessed pages are left alone.
+uint64_t page_scanner_reclaim(uint64_t target);
+
+__END_CDECLS
@@ -75,6 +75,10 @@ public:
     // calls will fail.
     void Close();
 
+    // Returns true once the source has been detached, after which pages
+    // dropped from the owning vmo can no longer be brought back.
+    bool IsDetached() const;
+
 protected:
     // Synchronously gets a page from the backing source.
     virtual bool GetPage(uint64_t offset,
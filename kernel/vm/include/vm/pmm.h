@@ -32,6 +32,12 @@ zx_status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 // flags for allocation routines below
 #define PMM_ALLOC_FLAG_ANY (0x0)    // no restrictions on which arena to allocate from
 #define PMM_ALLOC_FLAG_LO_MEM (0x1) // allocate only from arenas marked LO_MEM
+#define PMM_ALLOC_FLAG_ZEROED (0x2) // prefer pages from the pre-zeroed pool
+
+// Pages handed out from the pre-zeroed pool have VM_PAGE_FLAG_ZEROED set in
+// their flags. PMM_ALLOC_FLAG_ZEROED is only a hint: when the pool is empty
+// the allocation falls back to ordinary pages, which the caller must zero
+// itself. The flag is cleared whenever a page is freed.
 
 // Allocate count pages of physical memory, adding to the tail of the passed list.
 // The list must be initialized.
@@ -57,6 +63,14 @@ void pmm_free(list_node* list) __NONNULL((1));
 // Free a single page.
 void pmm_free_page(vm_page_t* page) __NONNULL((1));
 
+// Return all pages held in the per-cpu free page caches to the global free
+// list. Used when memory is low so that the cached pages can be found by any
+// cpu and by the contiguous allocator.
+void pmm_drain_cpu_caches();
+
+// Return all pages held in the pre-zeroed page pool to the global free list.
+void pmm_drain_zero_pool();
+
 // Return count of unallocated physical pages in system.
 uint64_t pmm_count_free_pages();
 
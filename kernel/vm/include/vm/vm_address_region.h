@@ -242,6 +242,19 @@ public:
     // Protect() will fail.
     virtual zx_status_t Protect(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Populate the page tables of a subset of the region of memory in the
+    // containing address space as if each page had taken a fault with
+    // |pf_flags|.  With VMM_PF_FLAG_SW_FAULT pages are faulted in from the
+    // objects, waiting on their page sources if need be; without it only pages
+    // the objects already hold are mapped.  As with Protect(), the range must
+    // be entirely covered by mappings and may not overlap with a subregion.
+    virtual zx_status_t Populate(vaddr_t base, size_t size, uint pf_flags);
+
+    // Decommit the pages backing a subset of the region of memory in the
+    // containing address space.  The range has the same restrictions as for
+    // Populate().
+    virtual zx_status_t Decommit(vaddr_t base, size_t size);
+
     const char* name() const { return name_; }
     bool is_mapping() const override { return false; }
     bool has_parent() const;
@@ -316,6 +329,11 @@ private:
     zx_status_t UnmapInternalLocked(vaddr_t base, size_t size, bool can_destroy_regions,
                                     bool allow_partial_vmar);
 
+    // Checks that [base, base+size) is entirely covered by mappings that
+    // are direct children of this region and that all have the
+    // |required_arch_mmu_flags|.  Used by Populate() and Decommit().
+    zx_status_t CheckMappedRangeLocked(vaddr_t base, size_t size, uint required_arch_mmu_flags);
+
     // internal utilities for interacting with the children list
 
     // returns true if it would be valid to create a child in the
@@ -380,6 +398,14 @@ public:
         return ZX_ERR_BAD_STATE;
     }
 
+    zx_status_t Populate(vaddr_t base, size_t size, uint pf_flags) override {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    zx_status_t Decommit(vaddr_t base, size_t size) override {
+        return ZX_ERR_BAD_STATE;
+    }
+
     zx_status_t Unmap(vaddr_t base, size_t size) override {
         return ZX_ERR_BAD_STATE;
     }
@@ -464,6 +490,11 @@ protected:
     // unmap any pages that map the passed in vmo range. May not intersect with this range
     zx_status_t UnmapVmoRangeLocked(uint64_t start, uint64_t size) const;
 
+    // clear the accessed flags of the pages mapping the vmo range, reporting the ranges
+    // that were set to |accessed_fn|
+    void HarvestAccessedLocked(uint64_t offset, uint64_t len,
+                               VmObject::AccessedFn accessed_fn, void* context) const;
+
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmMapping);
 
@@ -487,6 +518,14 @@ private:
     // Implementation for Protect().  This does not acquire the aspace lock.
     zx_status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Implementation for VmAddressRegion::Populate() on the part of the range
+    // within this mapping.  Pages already mapped to what a fault would map are
+    // left alone.  If a page source has to be waited on, returns
+    // ZX_ERR_SHOULD_WAIT with |page_request| initialized and |*next_va| set to
+    // the first page not yet populated.
+    zx_status_t PopulateLocked(vaddr_t base, size_t size, uint pf_flags,
+                               PageRequest* page_request, vaddr_t* next_va);
+
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
@@ -497,6 +536,16 @@ private:
     // in Clang around capability aliasing, we need to relax the analysis.
     void ActivateLocked();
 
+    // Tries to map the LARGE_PAGE_SIZE aligned range around |va| with a single
+    // large page from the object. Requires the object_ lock; see ActivateLocked()
+    // for why this is not annotated.
+    zx_status_t MapLargePageLocked(vaddr_t va, uint pf_flags);
+
+    // Maps pages of the object that are already resident in the window
+    // around |va|, which has just been faulted in, so that touching them
+    // does not fault.  Requires the object_ lock, like MapLargePageLocked().
+    void FaultAroundLocked(vaddr_t va, uint pf_flags);
+
     // pointer and region of the object we are mapping
     fbl::RefPtr<VmObject> object_;
     uint64_t object_offset_ = 0;
@@ -124,6 +124,14 @@ public:
     // VMAR in the tree that includes *va*.
     fbl::RefPtr<VmAddressRegionOrMapping> FindRegion(vaddr_t va);
 
+    // Moves |pages| into this user aspace at the page aligned address |va|, as if
+    // their contents had been copied there.  The range must lie within a single
+    // writable mapping of a paged VMO.  See VmObjectPaged::ReplacePages().
+    //
+    // On success |pages| is empty; on failure it is unchanged and the caller
+    // should fall back to copying.
+    zx_status_t ReplaceUserPages(vaddr_t va, list_node* pages);
+
     // For region creation routines
     static const uint VMM_FLAG_VALLOC_SPECIFIC = (1u << 0); // allocate at specific address
     static const uint VMM_FLAG_COMMIT = (1u << 1);          // commit memory up front (no demand paging)
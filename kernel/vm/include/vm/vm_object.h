@@ -57,6 +57,11 @@ public:
     virtual bool is_contiguous() const { return false; }
     // Returns true if the object size can be changed.
     virtual bool is_resizable() const { return false; }
+    // Returns true if the object tries to back aligned ranges with large pages.
+    virtual bool wants_large_pages() const { return false; }
+    // Returns true if the object's pages are supplied by a page source, and so
+    // can be dropped and faulted back in as long as they are unmodified.
+    virtual bool is_pager_backed() const { return false; }
 
     // Returns the number of physical pages currently allocated to the
     // object where (offset <= page_offset < offset+len).
@@ -208,6 +213,24 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // Returns true if the page at |offset| is resident in the object itself
+    // and writing to it would not need a fault to copy or dirty it, so that it
+    // can be mapped writable before it is written to.
+    virtual bool IsPageWritableLocked(uint64_t offset) TA_REQ(lock_) {
+        return false;
+    }
+
+    // Returns in |pa| the physical base of a LARGE_PAGE_SIZE aligned run of
+    // pages backing the LARGE_PAGE_SIZE aligned range of the object that
+    // contains |offset|, so that it can be mapped as a single large page.
+    // Objects that support large pages may commit such a run if the range is
+    // empty and |pf_flags| is a write fault. Fails if the range cannot be
+    // backed by one run, in which case the caller should use GetPageLocked().
+    virtual zx_status_t GetLargePageLocked(uint64_t offset, uint pf_flags,
+                                           paddr_t* pa) TA_REQ(lock_) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     Lock<fbl::Mutex>* lock() TA_RET_CAP(lock_) { return &lock_; }
     Lock<fbl::Mutex>& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
@@ -265,6 +288,24 @@ protected:
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS { RangeChangeUpdateLocked(offset, len); }
 
+    // Called by HarvestAccessedLocked with each range of the vmo that was
+    // accessed.
+    using AccessedFn = void (*)(uint64_t offset, uint64_t len, void* context);
+
+    // Clears the hardware accessed flags of every mapping of the pages in
+    // [offset, offset + len), including mappings of children that see the
+    // pages through this vmo, and calls |accessed_fn| with the ranges whose
+    // flags were set. Mappings in aspaces that don't track accesses report
+    // their whole range, since none of it can be shown to be unused.
+    void HarvestAccessedLocked(uint64_t offset, uint64_t len,
+                               AccessedFn accessed_fn, void* context) TA_REQ(lock_);
+
+    // above call but called from a parent
+    virtual void HarvestAccessedFromParentLocked(uint64_t offset, uint64_t len,
+                                                 AccessedFn accessed_fn, void* context)
+        // Called under the parent's lock, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS { HarvestAccessedLocked(offset, len, accessed_fn, context); }
+
     // magic value
     fbl::Canary<fbl::magic("VMO_")> canary_;
 
@@ -32,6 +32,9 @@ public:
     // |options_| is a bitmask of:
     static constexpr uint32_t kResizable = (1u << 0);
     static constexpr uint32_t kContiguous = (1u << 1);
+    // Back aligned LARGE_PAGE_SIZE ranges with contiguous runs of pages where
+    // possible so that mappings can use large pages.
+    static constexpr uint32_t kLargePages = (1u << 2);
 
     static zx_status_t Create(uint32_t pmm_alloc_flags,
                               uint32_t options,
@@ -67,6 +70,8 @@ public:
     bool is_paged() const override { return true; }
     bool is_contiguous() const override { return (options_ & kContiguous); }
     bool is_resizable() const override { return (options_ & kResizable); }
+    bool wants_large_pages() const override { return (options_ & kLargePages); }
+    bool is_pager_backed() const override { return page_source_ != nullptr; }
 
     size_t AllocatedPagesInRange(uint64_t offset, uint64_t len) const override;
 
@@ -87,6 +92,19 @@ public:
     zx_status_t TakePages(uint64_t offset, uint64_t len, VmPageSpliceList* pages) override;
     zx_status_t SupplyPages(uint64_t offset, uint64_t len, VmPageSpliceList* pages) override;
 
+    // Replaces the pages committed at [offset, offset + n * PAGE_SIZE), where n is the
+    // length of |pages|, with |pages|.  To anyone observing the VMO this is the same as
+    // writing the contents of |pages| there, but without the copy.  The pages in |pages|
+    // must not belong to any other object.
+    //
+    // On success |pages| is empty.  On failure it is unchanged; in particular
+    // ZX_ERR_NOT_SUPPORTED is returned for VMOs that must keep their pages physically
+    // arranged (contiguous and large page VMOs), that are backed by a page source or that
+    // are not cached, and ZX_ERR_BAD_STATE if any page in the range is pinned.  If the
+    // page list can't grow to hold |pages|, ZX_ERR_NO_MEMORY is returned and the range
+    // is left decommitted.
+    zx_status_t ReplacePages(uint64_t offset, list_node* pages);
+
     void Dump(uint depth, bool verbose) override;
 
     zx_status_t InvalidateCache(const uint64_t offset, const uint64_t len) override;
@@ -99,6 +117,11 @@ public:
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    zx_status_t GetLargePageLocked(uint64_t offset, uint pf_flags, paddr_t* pa) override
+        TA_REQ(lock_);
+
+    bool IsPageWritableLocked(uint64_t offset) override TA_REQ(lock_);
+
     zx_status_t CloneCOW(bool resizable, uint64_t offset, uint64_t size, bool copy_name,
                          fbl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
@@ -108,6 +131,11 @@ public:
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    void HarvestAccessedFromParentLocked(uint64_t offset, uint64_t len,
+                                         AccessedFn accessed_fn, void* context) override
+        // Called under the parent's lock, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
     uint32_t GetMappingCachePolicy() const override;
     zx_status_t SetMappingCachePolicy(const uint32_t cache_policy) override;
 
@@ -116,6 +144,30 @@ public:
         page_source_->Detach();
     }
 
+    // Pages of pager-backed vmos are aged by the page scanner: a page's age is
+    // the number of aging passes since it was last seen accessed, saturating at
+    // kMaxAge.  Pages at least kInactiveAge old are considered inactive.
+    static constexpr uint8_t kInactiveAge = 2;
+    static constexpr uint8_t kMaxAge = 6;
+
+    struct ReclaimStats {
+        uint64_t active_pages;
+        uint64_t inactive_pages;
+        uint64_t modified_pages;
+        uint64_t evicted_pages;
+    };
+    // Returns ZX_ERR_NOT_SUPPORTED if the vmo is not backed by a pager.
+    zx_status_t GetReclaimStats(ReclaimStats* stats);
+
+    // Runs one aging pass over every pager-backed vmo.
+    static void AgePagerBackedPages();
+
+    // Evicts up to |target| pages at least |min_age| old from pager-backed vmos,
+    // returning the number evicted.  Only pages that are unmodified and unpinned
+    // are evicted, so that the page source can supply them again on the next
+    // fault.
+    static uint64_t EvictPagerBackedPages(uint8_t min_age, uint64_t target);
+
     // The size is clamped to allow VmPageList to use a one-past-the-end for
     // VmPageListNode offsets.
     static const uint64_t MAX_SIZE = ROUNDDOWN(UINT64_MAX, VmPageListNode::kPageFanOut * PAGE_SIZE);
@@ -167,6 +219,10 @@ private:
     // set our offset within our parent
     zx_status_t SetParentOffsetLocked(uint64_t o) TA_REQ(lock_);
 
+    // see AgePagerBackedPages and EvictPagerBackedPages
+    void AgePagesLocked() TA_REQ(lock_);
+    uint64_t EvictPagesLocked(uint8_t min_age, uint64_t target) TA_REQ(lock_);
+
     // members
     const uint32_t options_;
     uint64_t size_ TA_GUARDED(lock_) = 0;
@@ -179,4 +235,24 @@ private:
 
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // number of pages evicted by the page scanner
+    uint64_t evicted_pages_ TA_GUARDED(lock_) = 0;
+
+    // Per-node state for the list of pager-backed vmos.
+    using ReclaimNodeState = fbl::DoublyLinkedListNodeState<VmObjectPaged*>;
+    ReclaimNodeState reclaim_list_state_;
+
+    // The list of pager-backed vmos, which the page scanner walks.  A vmo is
+    // removed from it before anything else in its destructor, so vmos on the
+    // list may be used for as long as ReclaimListLock is held even though
+    // their refcount may already have dropped to zero.
+    struct ReclaimListTraits {
+        static ReclaimNodeState& node_state(VmObjectPaged& vmo) {
+            return vmo.reclaim_list_state_;
+        }
+    };
+    using ReclaimList = fbl::DoublyLinkedList<VmObjectPaged*, ReclaimListTraits>;
+    DECLARE_SINGLETON_MUTEX(ReclaimListLock);
+    static ReclaimList reclaim_list_ TA_GUARDED(ReclaimListLock::Get());
 };
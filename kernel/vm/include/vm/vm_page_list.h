@@ -230,9 +230,14 @@ public:
     void FreePages(uint64_t start_offset, uint64_t end_offset);
     bool IsEmpty();
 
+    // Returns the number of pages in the list. The count is kept up to date as
+    // pages are added and removed, so this does not walk the list.
+    size_t page_count() const { return page_count_; }
+
     // Takes the pages in the range [offset, length) out of this page list.
     VmPageSpliceList TakePages(uint64_t offset, uint64_t length);
 
 private:
     fbl::WAVLTree<uint64_t, ktl::unique_ptr<VmPageListNode>> list_;
+    size_t page_count_ = 0;
 };
@@ -0,0 +1,107 @@
+// Copyright 2019 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <vm/page_scanner.h>
+
+#include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/thread.h>
+#include <lib/console.h>
+#include <lib/counters.h>
+#include <lk/init.h>
+#include <platform.h>
+#include <stdio.h>
+#include <string.h>
+#include <trace.h>
+#include <vm/vm_object_paged.h>
+#include <zircon/time.h>
+
+#define LOCAL_TRACE 0
+
+KCOUNTER(page_scanner_passes, "kernel.vm.page_scanner.passes");
+KCOUNTER(page_scanner_evicted, "kernel.vm.page_scanner.evicted");
+
+namespace {
+
+int page_scanner_thread(void* arg) {
+    const zx_duration_t interval = *static_cast<const zx_duration_t*>(arg);
+
+    for (;;) {
+        thread_sleep_relative(interval);
+
+        VmObjectPaged::AgePagerBackedPages();
+        kcounter_add(page_scanner_passes, 1);
+    }
+
+    return 0;
+}
+
+zx_duration_t page_scanner_interval;
+
+void page_scanner_init(uint level) {
+    const uint64_t interval_ms = cmdline_get_uint64("kernel.page-scanner.interval-ms", 1000);
+    if (interval_ms == 0) {
+        printf("page scanner: disabled\n");
+        return;
+    }
+    page_scanner_interval = ZX_MSEC(interval_ms);
+
+    thread_t* t = thread_create("page-scanner", &page_scanner_thread, &page_scanner_interval,
+                                LOW_PRIORITY);
+    if (!t) {
+        printf("page scanner: failed to create thread\n");
+        return;
+    }
+    thread_detach_and_resume(t);
+}
+
+} // namespace
+
+LK_INIT_HOOK(page_scanner, &page_scanner_init, LK_INIT_LEVEL_THREADING);
+
+uint64_t page_scanner_reclaim(uint64_t target) {
+    // Evict the oldest pages first, only falling back to younger ones if that
+    // doesn't free enough.  Pages that were accessed since the inactive age
+    // was reached are never taken.
+    uint64_t evicted = 0;
+    for (uint8_t age = VmObjectPaged::kMaxAge;
+         age >= VmObjectPaged::kInactiveAge && evicted < target; age--) {
+        evicted += VmObjectPaged::EvictPagerBackedPages(age, target - evicted);
+    }
+
+    LTRACEF("evicted %" PRIu64 " of %" PRIu64 " pages\n", evicted, target);
+    kcounter_add(page_scanner_evicted, static_cast<int64_t>(evicted));
+    return evicted;
+}
+
+static int cmd_page_scanner(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc < 2) {
+    usage:
+        printf("usage:\n");
+        printf("%s age            : run an aging pass now\n", argv[0].str);
+        printf("%s reclaim <pages> : evict up to <pages> inactive pages\n", argv[0].str);
+        return ZX_ERR_INTERNAL;
+    }
+
+    if (!strcmp(argv[1].str, "age")) {
+        VmObjectPaged::AgePagerBackedPages();
+    } else if (!strcmp(argv[1].str, "reclaim")) {
+        if (argc < 3) {
+            goto usage;
+        }
+        uint64_t evicted = page_scanner_reclaim(argv[2].u);
+        printf("evicted %" PRIu64 " pages\n", evicted);
+    } else {
+        printf("unknown command\n");
+        goto usage;
+    }
+
+    return ZX_OK;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("page_scanner", "page aging and reclamation", &cmd_page_scanner)
+STATIC_COMMAND_END(page_scanner);
@@ -46,6 +46,11 @@ void PageSource::Detach() {
 }
 
 
+bool PageSource::IsDetached() const {
+    Guard<fbl::Mutex> guard{&page_source_mtx_};
+    return detached_;
+}
+
 void PageSource::Close() {
     canary_.Assert();
     LTRACEF("%p\n", this);
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/mp.h>
 #include <kernel/timer.h>
 #include <lib/console.h>
@@ -47,6 +48,22 @@ static void pmm_enforce_fill(uint level) {
 LK_INIT_HOOK(pmm_fill, &pmm_enforce_fill, LK_INIT_LEVEL_VM);
 #endif
 
+// The per-cpu page caches are left off until threading is up so that early
+// boot allocations don't depend on per-cpu state.
+static void pmm_enable_cpu_caches(uint level) {
+    if (cmdline_get_bool("kernel.pmm.pcpu-cache", true)) {
+        pmm_node.EnablePcpuCaches();
+    }
+}
+LK_INIT_HOOK(pmm_cpu_caches, &pmm_enable_cpu_caches, LK_INIT_LEVEL_THREADING);
+
+// Pages are zeroed ahead of time by a low priority thread so that
+// PMM_ALLOC_FLAG_ZEROED allocations, such as VMO page faults, can skip it.
+static void pmm_start_zero_pool(uint level) {
+    pmm_node.StartZeroPool(cmdline_get_uint64("kernel.pmm.zero-pool-pages", 1024));
+}
+LK_INIT_HOOK(pmm_zero_pool, &pmm_start_zero_pool, LK_INIT_LEVEL_THREADING);
+
 vm_page_t* paddr_to_vm_page(paddr_t addr) {
     return pmm_node.PaddrToPage(addr);
 }
@@ -99,6 +116,14 @@ void pmm_free_page(vm_page* page) {
     pmm_node.FreePage(page);
 }
 
+void pmm_drain_cpu_caches() {
+    pmm_node.DrainPcpuCaches();
+}
+
+void pmm_drain_zero_pool() {
+    pmm_node.DrainZeroPool();
+}
+
 uint64_t pmm_count_free_pages() {
     return pmm_node.CountFreePages();
 }
@@ -5,8 +5,12 @@
 // https://opensource.org/licenses/MIT
 #include "pmm_node.h"
 
+#include <arch/ops.h>
+#include <fbl/algorithm.h>
 #include <inttypes.h>
 #include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <lib/counters.h>
 #include <new>
 #include <trace.h>
 #include <vm/bootalloc.h>
@@ -16,6 +20,16 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(pcpu_cache_hit, "kernel.pmm.pcpu_cache.hit");
+KCOUNTER(pcpu_cache_miss, "kernel.pmm.pcpu_cache.miss");
+KCOUNTER(pcpu_cache_refill, "kernel.pmm.pcpu_cache.refill");
+KCOUNTER(pcpu_cache_drain, "kernel.pmm.pcpu_cache.drain");
+KCOUNTER(zero_pool_pages, "kernel.pmm.zero_pool.pages");
+KCOUNTER(zero_pool_hit, "kernel.pmm.zero_pool.hit");
+KCOUNTER(zero_pool_miss, "kernel.pmm.zero_pool.miss");
+KCOUNTER(zero_pool_zeroed, "kernel.pmm.zero_pool.zeroed");
+KCOUNTER(zero_pool_zero_time, "kernel.pmm.zero_pool.zero_time_ns");
+
 namespace {
 
 void set_state_alloc(vm_page* page) {
@@ -91,12 +105,10 @@ void PmmNode::AddFreePages(list_node* list) TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACEF("free count now %" PRIu64 "\n", free_count_);
 }
 
-zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
-    Guard<fbl::Mutex> guard{&lock_};
-
+vm_page* PmmNode::AllocPageLocked() {
     vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
     if (!page) {
-        return ZX_ERR_NO_MEMORY;
+        return nullptr;
     }
 
     DEBUG_ASSERT(free_count_ > 0);
@@ -110,6 +122,51 @@ zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t*
     CheckFreeFill(page);
 #endif
 
+    return page;
+}
+
+size_t PmmNode::AllocPagesLocked(size_t count, list_node* list) {
+    size_t allocated = 0;
+    while (allocated < count) {
+        vm_page* page = AllocPageLocked();
+        if (unlikely(!page)) {
+            break;
+        }
+
+        LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page->paddr());
+
+        list_add_tail(list, &page->queue_node);
+        allocated++;
+    }
+
+    return allocated;
+}
+
+zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
+    list_node list = LIST_INITIAL_VALUE(list);
+    vm_page* page = nullptr;
+
+    if ((alloc_flags & PMM_ALLOC_FLAG_ZEROED) && AllocPagesFromZeroPool(1, &list) == 1) {
+        page = list_remove_head_type(&list, vm_page, queue_node);
+    } else if (AllocPagesFromPcpuCache(1, &list) == 1) {
+        page = list_remove_head_type(&list, vm_page, queue_node);
+    } else {
+        Guard<fbl::Mutex> guard{&lock_};
+        page = AllocPageLocked();
+    }
+
+    if (unlikely(!page)) {
+        // the per-cpu caches or the zero pool may be holding on to the last
+        // free pages
+        DrainCachedPages();
+
+        Guard<fbl::Mutex> guard{&lock_};
+        page = AllocPageLocked();
+        if (!page) {
+            return ZX_ERR_NO_MEMORY;
+        }
+    }
+
     if (pa_out) {
         *pa_out = page->paddr();
     }
@@ -133,31 +190,35 @@ zx_status_t PmmNode::AllocPages(size_t count, uint alloc_flags, list_node* list)
         return ZX_OK;
     }
 
-    Guard<fbl::Mutex> guard{&lock_};
-
-    while (count > 0) {
-        vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
-        if (unlikely(!page)) {
-            // free pages that have already been allocated
-            FreeListLocked(list);
-            return ZX_ERR_NO_MEMORY;
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        count -= AllocPagesFromZeroPool(count, list);
+        if (count == 0) {
+            return ZX_OK;
         }
+    }
 
-        LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page->paddr());
-
-        DEBUG_ASSERT(free_count_ > 0);
-
-        free_count_--;
+    count -= AllocPagesFromPcpuCache(count, list);
+    if (count == 0) {
+        return ZX_OK;
+    }
 
-        DEBUG_ASSERT(page->is_free());
-#if PMM_ENABLE_FREE_FILL
-        CheckFreeFill(page);
-#endif
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+        count -= AllocPagesLocked(count, list);
+    }
 
-        page->state = VM_PAGE_STATE_ALLOC;
-        list_add_tail(list, &page->queue_node);
+    if (unlikely(count > 0)) {
+        // the per-cpu caches and the zero pool may be holding enough pages to
+        // make up the difference
+        DrainCachedPages();
 
-        count--;
+        Guard<fbl::Mutex> guard{&lock_};
+        count -= AllocPagesLocked(count, list);
+        if (count > 0) {
+            // free pages that have already been allocated
+            FreeListLocked(list);
+            return ZX_ERR_NO_MEMORY;
+        }
     }
 
     return ZX_OK;
@@ -169,14 +230,31 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
     // list must be initialized prior to calling this
     DEBUG_ASSERT(list);
 
-    size_t allocated = 0;
     if (count == 0) {
         return ZX_OK;
     }
 
     address = ROUNDDOWN(address, PAGE_SIZE);
 
-    Guard<fbl::Mutex> guard{&lock_};
+    zx_status_t status;
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+        status = AllocRangeLocked(address, count, list);
+    }
+
+    if (status == ZX_ERR_NOT_FOUND) {
+        // some of the range may be parked in the per-cpu caches or the zero pool
+        DrainCachedPages();
+
+        Guard<fbl::Mutex> guard{&lock_};
+        status = AllocRangeLocked(address, count, list);
+    }
+
+    return status;
+}
+
+zx_status_t PmmNode::AllocRangeLocked(paddr_t address, size_t count, list_node* list) {
+    size_t allocated = 0;
 
     // walk through the arenas, looking to see if the physical page belongs to it
     for (auto& a : arena_list_) {
@@ -230,8 +308,26 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
     DEBUG_ASSERT(pa);
     DEBUG_ASSERT(list);
 
-    Guard<fbl::Mutex> guard{&lock_};
+    zx_status_t status;
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+        status = AllocContiguousLocked(count, alignment_log2, pa, list);
+    }
+
+    if (status == ZX_ERR_NOT_FOUND) {
+        // pages parked in the per-cpu caches and the zero pool are invisible
+        // to the arena search, so give them back and try once more
+        DrainCachedPages();
 
+        Guard<fbl::Mutex> guard{&lock_};
+        status = AllocContiguousLocked(count, alignment_log2, pa, list);
+    }
+
+    return status;
+}
+
+zx_status_t PmmNode::AllocContiguousLocked(size_t count, uint8_t alignment_log2, paddr_t* pa,
+                                           list_node* list) {
     for (auto& a : arena_list_) {
         vm_page_t* p = a.FindFreeContiguous(count, alignment_log2);
         if (!p) {
@@ -283,6 +379,7 @@ void PmmNode::FreePageLocked(vm_page* page) {
 
     // mark it free
     page->state = VM_PAGE_STATE_FREE;
+    page->flags &= ~VM_PAGE_FLAG_ZEROED;
 
     // add it to the free queue
     list_add_head(&free_list_, &page->queue_node);
@@ -291,6 +388,19 @@ void PmmNode::FreePageLocked(vm_page* page) {
 }
 
 void PmmNode::FreePage(vm_page* page) {
+    if (pcpu_caches_enabled_.load(fbl::memory_order_relaxed)) {
+        // remove it from its old queue
+        if (list_in_list(&page->queue_node)) {
+            list_delete(&page->queue_node);
+        }
+
+        list_node list = LIST_INITIAL_VALUE(list);
+        list_add_tail(&list, &page->queue_node);
+        if (FreeListToPcpuCache(&list) == 1) {
+            return;
+        }
+    }
+
     Guard<fbl::Mutex> guard{&lock_};
 
     FreePageLocked(page);
@@ -307,14 +417,303 @@ void PmmNode::FreeListLocked(list_node* list) {
 }
 
 void PmmNode::FreeList(list_node* list) {
+    // top up this cpu's cache and hand whatever is left to the global list
+    FreeListToPcpuCache(list);
+    if (list_is_empty(list)) {
+        return;
+    }
+
     Guard<fbl::Mutex> guard{&lock_};
 
     FreeListLocked(list);
 }
 
+void PmmNode::EnablePcpuCaches() {
+    pcpu_caches_enabled_.store(true);
+}
+
+size_t PmmNode::TakeFromPcpuCache(PcpuCache* cache, size_t count, list_node* list) {
+    size_t taken = 0;
+    {
+        Guard<SpinLock, IrqSave> guard{&cache->lock};
+        while (taken < count) {
+            vm_page* page = list_remove_head_type(&cache->free_list, vm_page, queue_node);
+            if (!page) {
+                break;
+            }
+            DEBUG_ASSERT(cache->count > 0);
+            cache->count--;
+
+#if PMM_ENABLE_FREE_FILL
+            CheckFreeFill(page);
+#endif
+
+            list_add_tail(list, &page->queue_node);
+            taken++;
+        }
+    }
+
+    pcpu_cached_count_.fetch_sub(taken, fbl::memory_order_relaxed);
+    return taken;
+}
+
+size_t PmmNode::AllocPagesFromPcpuCache(size_t count, list_node* list) {
+    // large requests go straight to the global list rather than churning the cache
+    if (!pcpu_caches_enabled_.load(fbl::memory_order_relaxed) || count > kPcpuCacheBatch) {
+        return 0;
+    }
+
+    PcpuCache* cache = &pcpu_caches_[arch_curr_cpu_num()];
+
+    size_t taken = TakeFromPcpuCache(cache, count, list);
+    if (taken == count) {
+        kcounter_add(pcpu_cache_hit, 1);
+        return taken;
+    }
+
+    kcounter_add(pcpu_cache_miss, 1);
+    RefillPcpuCache(cache);
+
+    return taken + TakeFromPcpuCache(cache, count - taken, list);
+}
+
+size_t PmmNode::FreeListToPcpuCache(list_node* list) {
+    if (!pcpu_caches_enabled_.load(fbl::memory_order_relaxed)) {
+        return 0;
+    }
+
+    PcpuCache* cache = &pcpu_caches_[arch_curr_cpu_num()];
+
+    size_t freed = 0;
+    bool over_high_water;
+    {
+        Guard<SpinLock, IrqSave> guard{&cache->lock};
+        while (cache->count <= kPcpuCacheHighWater) {
+            vm_page* page = list_remove_head_type(list, vm_page, queue_node);
+            if (!page) {
+                break;
+            }
+
+            LTRACEF("page %p state %u paddr %#" PRIxPTR "\n", page, page->state, page->paddr());
+
+            DEBUG_ASSERT(page->state != VM_PAGE_STATE_OBJECT || page->object.pin_count == 0);
+            DEBUG_ASSERT(!page->is_free());
+
+#if PMM_ENABLE_FREE_FILL
+            FreeFill(page);
+#endif
+
+            // cached pages stay allocated as far as the arenas are concerned
+            page->state = VM_PAGE_STATE_ALLOC;
+            page->flags &= ~VM_PAGE_FLAG_ZEROED;
+            list_add_head(&cache->free_list, &page->queue_node);
+            cache->count++;
+            freed++;
+        }
+        over_high_water = cache->count > kPcpuCacheHighWater;
+    }
+
+    pcpu_cached_count_.fetch_add(freed, fbl::memory_order_relaxed);
+
+    if (over_high_water) {
+        DrainPcpuCache(cache, kPcpuCacheLowWater);
+    }
+
+    return freed;
+}
+
+void PmmNode::RefillPcpuCache(PcpuCache* cache) {
+    list_node batch = LIST_INITIAL_VALUE(batch);
+    size_t count;
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+        count = AllocPagesLocked(kPcpuCacheBatch, &batch);
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    kcounter_add(pcpu_cache_refill, 1);
+    pcpu_cached_count_.fetch_add(count, fbl::memory_order_relaxed);
+
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+    list_splice_after(&batch, &cache->free_list);
+    cache->count += count;
+}
+
+void PmmNode::DrainPcpuCache(PcpuCache* cache, size_t target) {
+    list_node batch = LIST_INITIAL_VALUE(batch);
+    size_t count = 0;
+    {
+        Guard<SpinLock, IrqSave> guard{&cache->lock};
+        while (cache->count > target) {
+            // the tail holds the least recently freed, and coldest, pages
+            vm_page* page = list_remove_tail_type(&cache->free_list, vm_page, queue_node);
+            DEBUG_ASSERT(page);
+            list_add_tail(&batch, &page->queue_node);
+            cache->count--;
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    kcounter_add(pcpu_cache_drain, 1);
+
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+        FreeListLocked(&batch);
+    }
+
+    pcpu_cached_count_.fetch_sub(count, fbl::memory_order_relaxed);
+}
+
+void PmmNode::DrainPcpuCaches() {
+    if (pcpu_cached_count_.load(fbl::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        DrainPcpuCache(&pcpu_caches_[i], 0);
+    }
+}
+
+void PmmNode::DrainCachedPages() {
+    DrainPcpuCaches();
+    DrainZeroPool();
+}
+
+void PmmNode::StartZeroPool(size_t target) {
+    DEBUG_ASSERT(zero_pool_target_ == 0);
+
+    if (target == 0) {
+        return;
+    }
+    zero_pool_target_ = target;
+
+    // just above the idle threads, so zeroing mostly happens on otherwise idle cpus
+    thread_t* t = thread_create("pmm-zero", &PmmNode::ZeroPoolThread, this, IDLE_PRIORITY + 1);
+    if (!t) {
+        printf("PMM: failed to start the page zeroing thread\n");
+        zero_pool_target_ = 0;
+        return;
+    }
+    thread_detach_and_resume(t);
+}
+
+int PmmNode::ZeroPoolThread(void* arg) {
+    PmmNode* node = static_cast<PmmNode*>(arg);
+
+    for (;;) {
+        node->FillZeroPool();
+
+        // wait for the pool to run low, but look again every so often in
+        // case the last fill stopped short for lack of free pages
+        zx_time_t deadline = zx_time_add_duration(current_time(), ZX_SEC(1));
+        event_wait_deadline(&node->zero_pool_event_, deadline, false);
+    }
+
+    return 0;
+}
+
+void PmmNode::FillZeroPool() {
+    while (zero_pool_count_.load(fbl::memory_order_relaxed) < zero_pool_target_) {
+        list_node batch = LIST_INITIAL_VALUE(batch);
+        size_t count;
+        {
+            Guard<fbl::Mutex> guard{&lock_};
+
+            // don't soak up the last free pages of a system that is short on memory
+            if (free_count_ < zero_pool_target_ + kZeroPoolBatch) {
+                return;
+            }
+            count = AllocPagesLocked(kZeroPoolBatch, &batch);
+        }
+
+        zx_time_t start = current_time();
+        vm_page* page;
+        list_for_every_entry (&batch, page, vm_page, queue_node) {
+            arch_zero_page(paddr_to_physmap(page->paddr()));
+            page->flags |= VM_PAGE_FLAG_ZEROED;
+        }
+        kcounter_add(zero_pool_zero_time, zx_time_sub_time(current_time(), start));
+        kcounter_add(zero_pool_zeroed, count);
+
+        {
+            Guard<SpinLock, IrqSave> guard{&zero_pool_lock_};
+            list_splice_after(&batch, &zero_pool_);
+            zero_pool_count_.fetch_add(count, fbl::memory_order_relaxed);
+        }
+        kcounter_add(zero_pool_pages, count);
+    }
+}
+
+size_t PmmNode::AllocPagesFromZeroPool(size_t count, list_node* list) {
+    if (zero_pool_target_ == 0) {
+        return 0;
+    }
+
+    size_t taken = 0;
+    uint64_t prev;
+    {
+        Guard<SpinLock, IrqSave> guard{&zero_pool_lock_};
+        while (taken < count) {
+            vm_page* page = list_remove_head_type(&zero_pool_, vm_page, queue_node);
+            if (!page) {
+                break;
+            }
+            DEBUG_ASSERT(page->flags & VM_PAGE_FLAG_ZEROED);
+            list_add_tail(list, &page->queue_node);
+            taken++;
+        }
+        prev = zero_pool_count_.fetch_sub(taken, fbl::memory_order_relaxed);
+    }
+
+    kcounter_add(zero_pool_hit, taken);
+    kcounter_add(zero_pool_miss, count - taken);
+    if (taken == 0) {
+        return 0;
+    }
+    kcounter_add(zero_pool_pages, -static_cast<int64_t>(taken));
+
+    // kick the zeroing thread when the pool drops below half of its target
+    const size_t low_water = zero_pool_target_ / 2;
+    if (prev >= low_water && prev - taken < low_water) {
+        event_signal(&zero_pool_event_, false);
+    }
+
+    return taken;
+}
+
+void PmmNode::DrainZeroPool() {
+    if (zero_pool_count_.load(fbl::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    list_node pool = LIST_INITIAL_VALUE(pool);
+    size_t count;
+    {
+        Guard<SpinLock, IrqSave> guard{&zero_pool_lock_};
+        list_move(&zero_pool_, &pool);
+        count = list_length(&pool);
+        zero_pool_count_.fetch_sub(count, fbl::memory_order_relaxed);
+    }
+
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+        FreeListLocked(&pool);
+    }
+
+    kcounter_add(zero_pool_pages, -static_cast<int64_t>(count));
+}
+
 // okay if accessed outside of a lock
 uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS {
-    return free_count_;
+    return free_count_ + pcpu_cached_count_.load(fbl::memory_order_relaxed) +
+           zero_pool_count_.load(fbl::memory_order_relaxed);
 }
 
 uint64_t PmmNode::CountTotalBytes() const TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -328,6 +727,14 @@ void PmmNode::CountTotalStates(uint64_t state_count[VM_PAGE_STATE_COUNT_]) const
     for (auto& a : arena_list_) {
         a.CountStates(state_count);
     }
+
+    // pages in the per-cpu caches and the zero pool are marked allocated but
+    // are really free
+    uint64_t cached = pcpu_cached_count_.load(fbl::memory_order_relaxed) +
+                      zero_pool_count_.load(fbl::memory_order_relaxed);
+    cached = fbl::min(cached, state_count[VM_PAGE_STATE_ALLOC]);
+    state_count[VM_PAGE_STATE_ALLOC] -= cached;
+    state_count[VM_PAGE_STATE_FREE] += cached;
 }
 
 void PmmNode::DumpFree() const TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -340,6 +747,9 @@ void PmmNode::Dump(bool is_panic) const {
     auto dump = [this]() TA_NO_THREAD_SAFETY_ANALYSIS {
         printf("pmm node %p: free_count %zu (%zu bytes), total size %zu\n",
                this, free_count_, free_count_ * PAGE_SIZE, arena_cumulative_size_);
+        printf("\tper-cpu cached %zu\n", pcpu_cached_count_.load(fbl::memory_order_relaxed));
+        printf("\tzero pool %zu (target %zu)\n", zero_pool_count_.load(fbl::memory_order_relaxed),
+               zero_pool_target_);
         for (auto& a : arena_list_) {
             a.Dump(false, false);
         }
@@ -9,7 +9,11 @@
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
 
+#include <fbl/atomic.h>
+#include <kernel/align.h>
+#include <kernel/event.h>
 #include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
 #include <vm/pmm.h>
 
 #include "pmm_arena.h"
@@ -55,7 +59,60 @@ public:
     // add new pages to the free queue. used when boostrapping a PmmArena
     void AddFreePages(list_node* list);
 
+    // Turn on the per-cpu free page caches. Until this is called every
+    // allocation goes straight to the global free list.
+    void EnablePcpuCaches();
+
+    // Return every page held in the per-cpu caches to the global free list.
+    // Called on low memory and before falling back to a failed allocation.
+    void DrainPcpuCaches();
+
+    // Start the thread that keeps up to |target| pre-zeroed pages on hand
+    // for PMM_ALLOC_FLAG_ZEROED allocations. A |target| of zero leaves the
+    // pool off.
+    void StartZeroPool(size_t target);
+
+    // Return every page in the pre-zeroed pool to the global free list.
+    void DrainZeroPool();
+
+    // per-cpu cache tuning, in pages
+    static constexpr size_t kPcpuCacheBatch = 32;
+    static constexpr size_t kPcpuCacheHighWater = 128;
+    static constexpr size_t kPcpuCacheLowWater = kPcpuCacheHighWater - kPcpuCacheBatch;
+
+    // number of pages the zeroing thread takes from the free list at a time
+    static constexpr size_t kZeroPoolBatch = 16;
+
 private:
+    // A small stash of free pages owned by a single cpu. Pages sitting in a
+    // cache are in the ALLOC state as far as the arenas are concerned, so the
+    // contiguous and range allocators never see them; CountFreePages() and
+    // CountTotalStates() account for them as free.
+    struct PcpuCache {
+        DECLARE_SPINLOCK(PcpuCache) lock;
+        list_node free_list TA_GUARDED(lock) = LIST_INITIAL_VALUE(free_list);
+        size_t count TA_GUARDED(lock) = 0;
+    } __CPU_ALIGN;
+
+    size_t AllocPagesFromPcpuCache(size_t count, list_node* list);
+    size_t TakeFromPcpuCache(PcpuCache* cache, size_t count, list_node* list);
+    size_t FreeListToPcpuCache(list_node* list);
+    void RefillPcpuCache(PcpuCache* cache);
+    void DrainPcpuCache(PcpuCache* cache, size_t target);
+
+    // Give back pages parked in the per-cpu caches and the zero pool, which
+    // the arena searches can't see.
+    void DrainCachedPages();
+
+    size_t AllocPagesFromZeroPool(size_t count, list_node* list);
+    static int ZeroPoolThread(void* arg);
+    void FillZeroPool();
+
+    vm_page* AllocPageLocked() TA_REQ(lock_);
+    size_t AllocPagesLocked(size_t count, list_node* list) TA_REQ(lock_);
+    zx_status_t AllocRangeLocked(paddr_t address, size_t count, list_node* list) TA_REQ(lock_);
+    zx_status_t AllocContiguousLocked(size_t count, uint8_t alignment_log2, paddr_t* pa,
+                                      list_node* list) TA_REQ(lock_);
     void FreePageLocked(vm_page* page) TA_REQ(lock_);
     void FreeListLocked(list_node* list) TA_REQ(lock_);
 
@@ -70,11 +127,25 @@ private:
 
     // page queues
     list_node free_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(free_list_);
-    list_node inactive_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(inactive_list_);
-    list_node active_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(active_list_);
-    list_node modified_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(modified_list_);
     list_node wired_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(wired_list_);
 
+    // per-cpu free page caches in front of free_list_
+    fbl::atomic<bool> pcpu_caches_enabled_{false};
+    fbl::atomic<uint64_t> pcpu_cached_count_{0};
+    PcpuCache pcpu_caches_[SMP_MAX_CPUS];
+
+    // Free pages that have already been zeroed by the zeroing thread. Like
+    // the per-cpu caches, pooled pages are in the ALLOC state as far as the
+    // arenas are concerned and are accounted for as free.
+    DECLARE_SPINLOCK(PmmNode) zero_pool_lock_;
+    list_node zero_pool_ TA_GUARDED(zero_pool_lock_) = LIST_INITIAL_VALUE(zero_pool_);
+    fbl::atomic<uint64_t> zero_pool_count_{0};
+    // zero means the pool is off
+    size_t zero_pool_target_ = 0;
+    // signaled when the pool falls below half of its target
+    event_t zero_pool_event_ = EVENT_INITIAL_VALUE(zero_pool_event_, false,
+                                                   EVENT_FLAG_AUTOUNSIGNAL);
+
 #if PMM_ENABLE_FREE_FILL
     void FreeFill(vm_page_t* page);
     void CheckFreeFill(vm_page_t* page);
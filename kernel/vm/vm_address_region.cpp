@@ -14,6 +14,8 @@
 #include <lib/vdso.h>
 #include <pow2.h>
 #include <trace.h>
+#include <vm/fault.h>
+#include <vm/page_source.h>
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_object.h>
@@ -847,6 +849,136 @@ zx_status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mm
     return ZX_OK;
 }
 
+zx_status_t VmAddressRegion::CheckMappedRangeLocked(vaddr_t base, size_t size,
+                                                   uint required_arch_mmu_flags) {
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+    if (state_ != LifeCycleState::ALIVE) {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    if (!is_in_range(base, size)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    if (subregions_.is_empty()) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    const auto end = subregions_.lower_bound(base + size);
+    auto begin = --subregions_.upper_bound(base);
+    if (!begin.IsValid() || begin->base() + begin->size() <= base) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    vaddr_t last_mapped = begin->base();
+    for (auto itr = begin; itr != end; ++itr) {
+        if (!itr->is_mapping()) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        if (itr->base() != last_mapped) {
+            return ZX_ERR_NOT_FOUND;
+        }
+        const uint mmu_flags = itr->as_vm_mapping()->arch_mmu_flags();
+        if ((mmu_flags & required_arch_mmu_flags) != required_arch_mmu_flags) {
+            return ZX_ERR_ACCESS_DENIED;
+        }
+
+        last_mapped = itr->base() + itr->size();
+    }
+    if (last_mapped < base + size) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    return ZX_OK;
+}
+
+zx_status_t VmAddressRegion::Populate(vaddr_t base, size_t size, uint pf_flags) {
+    canary_.Assert();
+
+    size = ROUNDUP(size, PAGE_SIZE);
+    if (size == 0 || !IS_PAGE_ALIGNED(base)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    const vaddr_t end_addr = base + size;
+    const uint required_arch_mmu_flags = (pf_flags & VMM_PF_FLAG_WRITE)
+                                             ? ARCH_MMU_FLAG_PERM_WRITE
+                                             : ARCH_MMU_FLAG_PERM_READ;
+
+    // Like VmAspace::PageFault(), drop the aspace lock while waiting on a page
+    // source and then pick up where we left off.  The mappings may have
+    // changed in the meantime, so the remainder of the range is checked again.
+    PageRequest page_request;
+    vaddr_t va = base;
+    while (va < end_addr) {
+        zx_status_t status;
+        {
+            Guard<fbl::Mutex> guard{aspace_->lock()};
+
+            status = CheckMappedRangeLocked(va, end_addr - va, required_arch_mmu_flags);
+            if (status != ZX_OK) {
+                return status;
+            }
+
+            auto itr = --subregions_.upper_bound(va);
+            while (status == ZX_OK && va < end_addr) {
+                DEBUG_ASSERT(itr.IsValid() && itr->is_mapping());
+                const vaddr_t populate_end = fbl::min(itr->base() + itr->size(), end_addr);
+                status = itr->as_vm_mapping()->PopulateLocked(va, populate_end - va, pf_flags,
+                                                              &page_request, &va);
+                if (status == ZX_OK) {
+                    va = populate_end;
+                    ++itr;
+                }
+            }
+        }
+
+        if (status == ZX_ERR_SHOULD_WAIT) {
+            status = page_request.Wait();
+        }
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    return ZX_OK;
+}
+
+zx_status_t VmAddressRegion::Decommit(vaddr_t base, size_t size) {
+    canary_.Assert();
+
+    size = ROUNDUP(size, PAGE_SIZE);
+    if (size == 0 || !IS_PAGE_ALIGNED(base)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    Guard<fbl::Mutex> guard{aspace_->lock()};
+    zx_status_t status = CheckMappedRangeLocked(base, size, ARCH_MMU_FLAG_PERM_WRITE);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    const vaddr_t end_addr = base + size;
+    for (auto itr = --subregions_.upper_bound(base); itr.IsValid() && itr->base() < end_addr;
+         ++itr) {
+        VmMapping* mapping = itr->as_vm_mapping().get();
+        const vaddr_t decommit_base = fbl::max(mapping->base(), base);
+        const vaddr_t decommit_end = fbl::min(mapping->base() + mapping->size(), end_addr);
+
+        // VmObject::DecommitRange() unmaps the pages from every mapping of
+        // the object, including this one.
+        status = mapping->vmo()->DecommitRange(
+            mapping->object_offset() + (decommit_base - mapping->base()),
+            decommit_end - decommit_base);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    return ZX_OK;
+}
+
 zx_status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                          uint arch_mmu_flags, vaddr_t* spot) {
     DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
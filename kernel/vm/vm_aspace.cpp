@@ -540,6 +540,50 @@ void VmAspace::AttachToThread(thread_t* t) {
     t->aspace = reinterpret_cast<vmm_aspace_t*>(this);
 }
 
+zx_status_t VmAspace::ReplaceUserPages(vaddr_t va, list_node* pages) {
+    canary_.Assert();
+    DEBUG_ASSERT(is_user());
+
+    const size_t len = list_length(pages) * PAGE_SIZE;
+    if (!IS_PAGE_ALIGNED(va) || len == 0) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    // Hold the aspace lock, like a page fault would, so that the mapping can't
+    // change underneath us.
+    Guard<fbl::Mutex> guard{&lock_};
+
+    fbl::RefPtr<VmAddressRegion> vmar = root_vmar_;
+    if (!vmar) {
+        return ZX_ERR_BAD_STATE;
+    }
+    fbl::RefPtr<VmMapping> mapping;
+    while (!mapping) {
+        fbl::RefPtr<VmAddressRegionOrMapping> next = vmar->FindRegionLocked(va);
+        if (!next) {
+            return ZX_ERR_NOT_FOUND;
+        }
+        if (next->is_mapping()) {
+            mapping = next->as_vm_mapping();
+        } else {
+            vmar = next->as_vm_address_region();
+        }
+    }
+
+    if (!mapping->is_in_range(va, len)) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    if (!(mapping->arch_mmu_flags() & ARCH_MMU_FLAG_PERM_WRITE)) {
+        return ZX_ERR_ACCESS_DENIED;
+    }
+
+    VmObjectPaged* vmo = VmObjectPaged::AsVmObjectPaged(mapping->vmo());
+    if (!vmo) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    return vmo->ReplacePages(mapping->object_offset() + (va - mapping->base()), pages);
+}
+
 zx_status_t VmAspace::PageFault(vaddr_t va, uint flags) {
     canary_.Assert();
     DEBUG_ASSERT(!aspace_destroyed_);
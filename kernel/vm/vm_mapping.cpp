@@ -13,8 +13,13 @@
 #include <fbl/auto_call.h>
 #include <ktl/move.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <lib/counters.h>
+#include <lk/init.h>
+#include <pow2.h>
 #include <trace.h>
 #include <vm/fault.h>
+#include <vm/physmap.h>
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_object.h>
@@ -22,6 +27,24 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_large_page_map, "kernel.vm.large_page.map");
+KCOUNTER(vm_large_page_fallback, "kernel.vm.large_page.fallback");
+KCOUNTER(vm_fault_around_mapped, "kernel.vm.fault_around.mapped");
+
+// Number of pages, a power of two, around a faulting page that PageFault()
+// looks at for already resident pages to map in the same pass.  Each one it
+// maps is a fault avoided later.  0 turns this off.
+static size_t fault_around_pages = 16;
+
+static void vm_fault_around_init(uint level) {
+    uint32_t pages = cmdline_get_uint32("kernel.vm.fault-around", 16);
+    if (pages > 1 && !ispow2(pages)) {
+        pages = round_up_pow2_u32(pages);
+    }
+    fault_around_pages = MIN(pages, 256u);
+}
+LK_INIT_HOOK(vm_fault_around, &vm_fault_around_init, LK_INIT_LEVEL_VM);
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      fbl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags,
@@ -134,11 +157,20 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
         return ZX_OK;
     }
 
+    // Writes to pages of pager-backed VMOs are noticed through write faults, so
+    // rather than making existing read-only entries writable, drop them and
+    // let the next access fault.
+    uint pt_arch_mmu_flags = new_arch_mmu_flags;
+    if ((new_arch_mmu_flags & ARCH_MMU_FLAG_PERM_WRITE) &&
+        !(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE) && object_->is_pager_backed()) {
+        pt_arch_mmu_flags &= ~ARCH_MMU_FLAG_PERM_RWX_MASK;
+    }
+
     // TODO(teisenbe): deal with error mapping on arch_mmu_protect fail
 
     // If we're changing the whole mapping, just make the change.
     if (base_ == base && size_ == size) {
-        zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+        zx_status_t status = ProtectOrUnmap(aspace_, base, size, pt_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
         return ZX_OK;
@@ -155,7 +187,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
             return ZX_ERR_NO_MEMORY;
         }
 
-        zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+        zx_status_t status = ProtectOrUnmap(aspace_, base, size, pt_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
 
@@ -177,7 +209,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
             return ZX_ERR_NO_MEMORY;
         }
 
-        zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+        zx_status_t status = ProtectOrUnmap(aspace_, base, size, pt_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
 
         size_ -= size;
@@ -205,7 +237,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
         return ZX_ERR_NO_MEMORY;
     }
 
-    zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+    zx_status_t status = ProtectOrUnmap(aspace_, base, size, pt_arch_mmu_flags);
     LTRACEF("arch_mmu_protect returns %d\n", status);
 
     // Turn us into the left half
@@ -388,11 +420,52 @@ zx_status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const
     return ZX_OK;
 }
 
+void VmMapping::HarvestAccessedLocked(uint64_t offset, uint64_t len,
+                                      VmObject::AccessedFn accessed_fn, void* context) const {
+    canary_.Assert();
+
+    // NOTE: like UnmapVmoRangeLocked, called with the vmo lock held, which keeps us
+    // in the ALIVE state.
+    DEBUG_ASSERT(state_ == LifeCycleState::ALIVE);
+    DEBUG_ASSERT(object_->lock()->lock().IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(len));
+
+    // compute the intersection of the passed in vmo range and our mapping
+    uint64_t offset_new;
+    uint64_t len_new;
+    if (!GetIntersect(object_offset_, static_cast<uint64_t>(size_), offset, len,
+                      &offset_new, &len_new)) {
+        return;
+    }
+
+    // translate the accessed pages back into vmo offsets
+    struct Harvest {
+        vaddr_t base;
+        uint64_t offset;
+        VmObject::AccessedFn accessed_fn;
+        void* context;
+    } harvest = {base_ + (offset_new - object_offset_), offset_new, accessed_fn, context};
+
+    zx_status_t status = aspace_->arch_aspace().HarvestAccessed(
+        harvest.base, static_cast<size_t>(len_new) / PAGE_SIZE,
+        [](vaddr_t vaddr, size_t count, void* ctx) {
+            auto h = static_cast<Harvest*>(ctx);
+            h->accessed_fn(h->offset + (vaddr - h->base), count * PAGE_SIZE, h->context);
+        },
+        &harvest);
+    if (status == ZX_ERR_NOT_SUPPORTED) {
+        accessed_fn(offset_new, len_new, context);
+    }
+}
+
 namespace {
 
 class VmMappingCoalescer {
 public:
     VmMappingCoalescer(VmMapping* mapping, vaddr_t base);
+    // Maps with |mmu_flags| instead of the mapping's own flags.
+    VmMappingCoalescer(VmMapping* mapping, vaddr_t base, uint mmu_flags);
     ~VmMappingCoalescer();
 
     // Add a page to the mapping run.  If this fails, the VmMappingCoalescer is
@@ -430,10 +503,14 @@ private:
     paddr_t phys_[16];
     size_t count_;
     bool aborted_;
+    const uint mmu_flags_;
 };
 
 VmMappingCoalescer::VmMappingCoalescer(VmMapping* mapping, vaddr_t base)
-    : mapping_(mapping), base_(base), count_(0), aborted_(false) {}
+    : VmMappingCoalescer(mapping, base, mapping->arch_mmu_flags()) {}
+
+VmMappingCoalescer::VmMappingCoalescer(VmMapping* mapping, vaddr_t base, uint mmu_flags)
+    : mapping_(mapping), base_(base), count_(0), aborted_(false), mmu_flags_(mmu_flags) {}
 
 VmMappingCoalescer::~VmMappingCoalescer() {
     // Make sure we've flushed or aborted
@@ -445,7 +522,7 @@ zx_status_t VmMappingCoalescer::Flush() {
         return ZX_OK;
     }
 
-    uint flags = mapping_->arch_mmu_flags();
+    uint flags = mmu_flags_;
     if (flags & ARCH_MMU_FLAG_PERM_RWX_MASK) {
         size_t mapped;
         zx_status_t ret = mapping_->aspace()->arch_aspace().Map(base_, phys_, count_, flags,
@@ -531,6 +608,68 @@ zx_status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     return coalescer.Flush();
 }
 
+zx_status_t VmMapping::PopulateLocked(vaddr_t base, size_t size, uint pf_flags,
+                                      PageRequest* page_request, vaddr_t* next_va) {
+    canary_.Assert();
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
+    DEBUG_ASSERT(is_in_range(base, size));
+
+    LTRACEF("region %p, base %#" PRIxPTR ", size %#zx, pf_flags %#x\n", this, base, size,
+            pf_flags);
+
+    // as in PageFault(), pages we did not write fault on are mapped read-only so
+    // that a later write can still copy or allocate them
+    uint mmu_flags = arch_mmu_flags_;
+    if (!(pf_flags & VMM_PF_FLAG_WRITE)) {
+        mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+    }
+
+    Guard<fbl::Mutex> guard{object_->lock()};
+
+    DEBUG_ASSERT(!currently_faulting_);
+    currently_faulting_ = true;
+    auto ac = fbl::MakeAutoCall([&]() { currently_faulting_ = false; });
+
+    VmMappingCoalescer coalescer(this, base, mmu_flags);
+    for (vaddr_t va = base; va < base + size; va += PAGE_SIZE) {
+        paddr_t new_pa;
+        zx_status_t status = object_->GetPageLocked(va - base_ + object_offset_, pf_flags,
+                                                    nullptr, page_request, nullptr, &new_pa);
+        if (status == ZX_ERR_NOT_FOUND && !(pf_flags & VMM_PF_FLAG_FAULT_MASK)) {
+            // not resident and we were not asked to fault it in
+            continue;
+        }
+        if (status != ZX_OK) {
+            *next_va = va;
+            zx_status_t flush_status = coalescer.Flush();
+            return flush_status != ZX_OK ? flush_status : status;
+        }
+
+        // leave alone pages that are already mapped the way a fault would map them
+        paddr_t pa;
+        uint page_flags;
+        if (aspace_->arch_aspace().Query(va, &pa, &page_flags) == ZX_OK) {
+            if (pa == new_pa && (page_flags == arch_mmu_flags_ || page_flags == mmu_flags)) {
+                continue;
+            }
+            status = aspace_->arch_aspace().Unmap(va, 1, nullptr);
+            if (status != ZX_OK) {
+                coalescer.Abort();
+                return status;
+            }
+        }
+
+        DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) ||
+                     !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
+        status = coalescer.Append(va, new_pa);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    return coalescer.Flush();
+}
+
 zx_status_t VmMapping::DecommitRange(size_t offset, size_t len) {
     canary_.Assert();
     LTRACEF("%p [%#zx+%#zx], offset %#zx, len %#zx\n",
@@ -597,6 +736,139 @@ zx_status_t VmMapping::DestroyLocked() {
     return ZX_OK;
 }
 
+zx_status_t VmMapping::MapLargePageLocked(vaddr_t va, uint pf_flags) {
+    canary_.Assert();
+    DEBUG_ASSERT(object_->lock()->lock().IsHeld());
+
+    if (!object_->wants_large_pages() || (pf_flags & VMM_PF_FLAG_GUEST)) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    // the whole large page must land inside this mapping at an aligned object offset
+    const vaddr_t large_va = ROUNDDOWN(va, LARGE_PAGE_SIZE);
+    if (size_ < LARGE_PAGE_SIZE || large_va < base_ ||
+        large_va - base_ > size_ - LARGE_PAGE_SIZE) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    const uint64_t vmo_offset = large_va - base_ + object_offset_;
+    if (!IS_ALIGNED(vmo_offset, LARGE_PAGE_SIZE)) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    paddr_t pa;
+    zx_status_t status = object_->GetLargePageLocked(vmo_offset, pf_flags, &pa);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // as with single pages, map read only until something writes to it
+    uint mmu_flags = arch_mmu_flags_;
+    if (!(pf_flags & VMM_PF_FLAG_WRITE)) {
+        mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+    }
+
+    const size_t count = LARGE_PAGE_SIZE / PAGE_SIZE;
+
+    // replace whatever small pages (or a read only large page) were mapped here
+    status = aspace_->arch_aspace().Unmap(large_va, count, nullptr);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    size_t mapped;
+    status = aspace_->arch_aspace().MapContiguous(large_va, pa, count, mmu_flags, &mapped);
+    if (status != ZX_OK) {
+        // the next fault will fill the range in one page at a time
+        aspace_->arch_aspace().Unmap(large_va, count, nullptr);
+        return status;
+    }
+    DEBUG_ASSERT(mapped == count);
+
+#if ARCH_ARM64
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE) {
+        arch_sync_cache_range(large_va, LARGE_PAGE_SIZE);
+    }
+#endif
+
+    kcounter_add(vm_large_page_map, 1);
+    LTRACEF("mapped large page pa %#" PRIxPTR " at va %#" PRIxPTR "\n", pa, large_va);
+    return ZX_OK;
+}
+
+void VmMapping::FaultAroundLocked(vaddr_t va, uint pf_flags) {
+    canary_.Assert();
+    DEBUG_ASSERT(object_->lock()->lock().IsHeld());
+
+    if (fault_around_pages <= 1 || (pf_flags & VMM_PF_FLAG_GUEST)) {
+        return;
+    }
+
+    // Neighbours the object can already take writes to are mapped with the
+    // mapping's permissions.  The rest are mapped read only: they may belong
+    // to a parent of a clone, or be clean pages of a page source, and a write
+    // still has to fault so the page can be copied or marked modified.
+    if (!(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_READ)) {
+        return;
+    }
+    const uint ro_mmu_flags = arch_mmu_flags_ & ~ARCH_MMU_FLAG_PERM_WRITE;
+
+    // the aligned window around va, clipped to the mapping
+    const size_t window = fault_around_pages * PAGE_SIZE;
+    const vaddr_t start = MAX(ROUNDDOWN(va, window), base_);
+    const vaddr_t last = MIN(ROUNDDOWN(va, window) + (window - 1), base_ + (size_ - 1));
+    const size_t count = (last - start) / PAGE_SIZE + 1;
+
+    VmMappingCoalescer rw_coalescer(this, start, arch_mmu_flags_);
+    VmMappingCoalescer ro_coalescer(this, start, ro_mmu_flags);
+    size_t mapped = 0;
+    for (size_t i = 0; i < count; i++) {
+        const vaddr_t addr = start + i * PAGE_SIZE;
+        if (addr == va) {
+            continue;
+        }
+
+        // leave alone anything that is already mapped
+        paddr_t pa;
+        uint flags;
+        if (aspace_->arch_aspace().Query(addr, &pa, &flags) == ZX_OK) {
+            continue;
+        }
+
+        // without any fault flags only resident pages are returned; nothing
+        // is allocated, zero filled or requested from a page source.  The page
+        // isn't being accessed, so leave its age for the page scanner to judge
+        // from the accessed flag of the new mapping.
+        const uint64_t vmo_offset = addr - base_ + object_offset_;
+        if (object_->GetPageLocked(vmo_offset, VMM_PF_FLAG_NO_ACCESS, nullptr, nullptr, nullptr,
+                                   &pa) != ZX_OK) {
+            continue;
+        }
+
+#if ARCH_ARM64
+        if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE) {
+            arch_sync_cache_range((addr_t)paddr_to_physmap(pa), PAGE_SIZE);
+        }
+#endif
+
+        const bool writable = (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE) &&
+                              object_->IsPageWritableLocked(vmo_offset);
+        VmMappingCoalescer& coalescer = writable ? rw_coalescer : ro_coalescer;
+        if (coalescer.Append(addr, pa) != ZX_OK) {
+            (writable ? ro_coalescer : rw_coalescer).Abort();
+            return;
+        }
+        mapped++;
+    }
+
+    if (rw_coalescer.Flush() != ZX_OK) {
+        ro_coalescer.Abort();
+        return;
+    }
+    if (ro_coalescer.Flush() == ZX_OK) {
+        kcounter_add(vm_fault_around_mapped, mapped);
+    }
+}
+
 zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* page_request) {
     canary_.Assert();
     DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
@@ -644,6 +916,14 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
     currently_faulting_ = true;
     auto ac = fbl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
+    // try to map the whole surrounding large page first
+    if (object_->wants_large_pages()) {
+        if (MapLargePageLocked(va, pf_flags) == ZX_OK) {
+            return ZX_OK;
+        }
+        kcounter_add(vm_large_page_fallback, 1);
+    }
+
     // fault in or grab an existing page
     paddr_t new_pa;
     vm_page_t* page;
@@ -715,6 +995,7 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
             }
             DEBUG_ASSERT(mapped == 1);
 
+            FaultAroundLocked(va, pf_flags);
             return ZX_OK;
         }
     } else {
@@ -732,6 +1013,8 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
             return ZX_ERR_NO_MEMORY;
         }
         DEBUG_ASSERT(mapped == 1);
+
+        FaultAroundLocked(va, pf_flags);
     }
 
 // TODO: figure out what to do with this
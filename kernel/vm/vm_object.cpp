@@ -249,6 +249,20 @@ void VmObject::RangeChangeUpdateLocked(uint64_t offset, uint64_t len) {
     }
 }
 
+void VmObject::HarvestAccessedLocked(uint64_t offset, uint64_t len,
+                                     AccessedFn accessed_fn, void* context) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset) && IS_PAGE_ALIGNED(len));
+
+    for (auto& m : mapping_list_) {
+        m.HarvestAccessedLocked(offset, len, accessed_fn, context);
+    }
+    for (auto& child : children_list_) {
+        child.HarvestAccessedFromParentLocked(offset, len, accessed_fn, context);
+    }
+}
+
 static int cmd_vm_object(int argc, const cmd_args* argv, uint32_t flags) {
     if (argc < 2) {
     notenoughargs:
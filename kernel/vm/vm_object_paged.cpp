@@ -11,11 +11,13 @@
 #include <arch/ops.h>
 #include <assert.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <inttypes.h>
 #include <ktl/move.h>
 #include <lib/console.h>
+#include <lib/counters.h>
 #include <stdlib.h>
 #include <string.h>
 #include <trace.h>
@@ -28,6 +30,9 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_large_page_commit, "kernel.vm.large_page.commit");
+KCOUNTER(vm_large_page_alloc_failed, "kernel.vm.large_page.alloc_failed");
+
 namespace {
 
 void ZeroPage(paddr_t pa) {
@@ -37,7 +42,13 @@ void ZeroPage(paddr_t pa) {
     arch_zero_page(ptr);
 }
 
+// Zeroes |p| unless the pmm handed it out of its pre-zeroed pool.
 void ZeroPage(vm_page_t* p) {
+    if (p->flags & VM_PAGE_FLAG_ZEROED) {
+        p->flags &= ~VM_PAGE_FLAG_ZEROED;
+        return;
+    }
+
     paddr_t pa = p->paddr();
     ZeroPage(pa);
 }
@@ -46,6 +57,8 @@ void InitializeVmPage(vm_page_t* p) {
     DEBUG_ASSERT(p->state == VM_PAGE_STATE_ALLOC);
     p->state = VM_PAGE_STATE_OBJECT;
     p->object.pin_count = 0;
+    p->object.modified = 0;
+    p->object.age = 0;
 }
 
 // round up the size to the next page size boundary and make sure we dont wrap
@@ -65,6 +78,8 @@ zx_status_t RoundSize(uint64_t size, uint64_t* out_size) {
 
 } // namespace
 
+VmObjectPaged::ReclaimList VmObjectPaged::reclaim_list_ = {};
+
 VmObjectPaged::VmObjectPaged(
     uint32_t options, uint32_t pmm_alloc_flags, uint64_t size,
     fbl::RefPtr<VmObject> parent, fbl::RefPtr<PageSource> page_source)
@@ -77,6 +92,11 @@ VmObjectPaged::VmObjectPaged(
 
     DEBUG_ASSERT(IS_PAGE_ALIGNED(size_));
     DEBUG_ASSERT(page_source_ == nullptr || parent_ == nullptr);
+
+    if (page_source_) {
+        Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+        reclaim_list_.push_back(this);
+    }
 }
 
 VmObjectPaged::~VmObjectPaged() {
@@ -84,6 +104,14 @@ VmObjectPaged::~VmObjectPaged() {
 
     LTRACEF("%p\n", this);
 
+    // Pager-backed vmos have no parent and own their lock, so it can't be held
+    // here and taking ReclaimListLock respects the ReclaimListLock -> vmo lock
+    // order.
+    if (page_source_) {
+        Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+        reclaim_list_.erase(*this);
+    }
+
     page_list_.ForEveryPage(
         [this](const auto p, uint64_t off) {
             if (this->is_contiguous()) {
@@ -171,7 +199,7 @@ zx_status_t VmObjectPaged::CreateContiguous(uint32_t pmm_alloc_flags, uint64_t s
 
         InitializeVmPage(p);
 
-        // TODO: remove once pmm returns zeroed pages
+        // contiguous runs never come from the pmm's pre-zeroed pool
         ZeroPage(p);
 
         // We don't need thread-safety analysis here, since this VMO has not
@@ -320,11 +348,7 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
 
     Guard<fbl::Mutex> guard{&lock_};
 
-    size_t count = 0;
-    page_list_.ForEveryPage([&count](const auto p, uint64_t) {
-        count++;
-        return ZX_ERR_NEXT;
-    });
+    size_t count = page_list_.page_count();
 
     for (uint i = 0; i < depth; ++i) {
         printf("  ");
@@ -356,16 +380,23 @@ size_t VmObjectPaged::AllocatedPagesInRangeLocked(uint64_t offset, uint64_t len)
     if (!TrimRange(offset, len, size_, &new_len)) {
         return 0;
     }
-    size_t count = 0;
     // TODO: Figure out what to do with our parent's pages. If we're a clone,
     // page_list_ only contains pages that we've made copies of.
-    page_list_.ForEveryPage(
-        [&count, offset, new_len](const auto p, uint64_t off) {
-            if (off >= offset && off < offset + new_len) {
-                count++;
-            }
+
+    // The page list counts its pages, so asking about the whole object (as
+    // the task stats and vmo info queries do for every mapping and handle)
+    // does not need to walk it.
+    if (offset == 0 && new_len == size_) {
+        return page_list_.page_count();
+    }
+
+    size_t count = 0;
+    page_list_.ForEveryPageInRange(
+        [&count](const auto p, uint64_t off) {
+            count++;
             return ZX_ERR_NEXT;
-        });
+        },
+        offset, offset + new_len);
     return count;
 }
 
@@ -421,6 +452,14 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
     // see if we already have a page at that offset
     p = page_list_.GetPage(offset);
     if (p) {
+        if (page_source_) {
+            if (!(pf_flags & VMM_PF_FLAG_NO_ACCESS)) {
+                p->object.age = 0;
+            }
+            if (pf_flags & VMM_PF_FLAG_WRITE) {
+                p->object.modified = 1;
+            }
+        }
         if (page_out) {
             *page_out = p;
         }
@@ -473,7 +512,12 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
                 }
             }
             if (!p_clone) {
-                status = pmm_alloc_page(pmm_alloc_flags_, &p_clone, &pa_clone);
+                // a copy of the zero page can come straight from the pre-zeroed pool
+                uint alloc_flags = pmm_alloc_flags_;
+                if (pa == vm_get_zero_page_paddr()) {
+                    alloc_flags |= PMM_ALLOC_FLAG_ZEROED;
+                }
+                status = pmm_alloc_page(alloc_flags, &p_clone, &pa_clone);
             }
             if (!p_clone) {
                 return ZX_ERR_NO_MEMORY;
@@ -489,9 +533,10 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
                 const void* src = paddr_to_physmap(pa);
                 DEBUG_ASSERT(src);
                 memcpy(dst, src, PAGE_SIZE);
+                p_clone->flags &= ~VM_PAGE_FLAG_ZEROED;
             } else {
                 // avoid pointless fetches by directly zeroing dst
-                arch_zero_page(dst);
+                ZeroPage(p_clone);
             }
 
             // add the new page and return it
@@ -527,6 +572,9 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
         if (status != ZX_OK) {
             return status;
         }
+        if (pf_flags & VMM_PF_FLAG_WRITE) {
+            p->object.modified = 1;
+        }
     } else {
         // if we're read faulting, we don't already have a page, and the parent doesn't have it,
         // return the single global zero page
@@ -549,7 +597,7 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
             }
         }
         if (!p) {
-            pmm_alloc_page(pmm_alloc_flags_, &p, &pa);
+            pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &p, &pa);
         }
         if (!p) {
             return ZX_ERR_NO_MEMORY;
@@ -557,8 +605,7 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
 
         InitializeVmPage(p);
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(pa);
+        ZeroPage(p);
 
         // if ARM and not fully cached, clean/invalidate the page after zeroing it
 #if ARCH_ARM64
@@ -586,6 +633,105 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
     return ZX_OK;
 }
 
+bool VmObjectPaged::IsPageWritableLocked(uint64_t offset) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    // Pages of a parent have to be copied on write, and a clean page of a
+    // page source has to be marked modified by a write fault.
+    const vm_page_t* p = page_list_.GetPage(offset);
+    return p && (!page_source_ || p->object.modified);
+}
+
+zx_status_t VmObjectPaged::GetLargePageLocked(uint64_t offset, uint pf_flags, paddr_t* pa_out) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    // clones and pager backed objects get their pages one at a time
+    if (!(options_ & kLargePages) || parent_ || page_source_) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    const uint64_t base = ROUNDDOWN(offset, LARGE_PAGE_SIZE);
+    if (base >= size_ || size_ - base < LARGE_PAGE_SIZE) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    const size_t count = LARGE_PAGE_SIZE / PAGE_SIZE;
+
+    // see if the range is already backed by a single aligned run
+    vm_page_t* first = page_list_.GetPage(base);
+    if (first) {
+        const paddr_t run_pa = first->paddr();
+        if (!IS_ALIGNED(run_pa, LARGE_PAGE_SIZE)) {
+            return ZX_ERR_NOT_FOUND;
+        }
+
+        size_t found = 0;
+        page_list_.ForEveryPageInRange(
+            [run_pa, base, &found](const auto p, uint64_t off) {
+                if (p->paddr() != run_pa + (off - base)) {
+                    return ZX_ERR_STOP;
+                }
+                found++;
+                return ZX_ERR_NEXT;
+            },
+            base, base + LARGE_PAGE_SIZE);
+
+        // a partial decommit or a resize leaves holes behind
+        if (found != count) {
+            return ZX_ERR_NOT_FOUND;
+        }
+
+        *pa_out = run_pa;
+        return ZX_OK;
+    }
+
+    // only commit a whole run on a write fault into an untouched range
+    if ((pf_flags & VMM_PF_FLAG_FAULT_MASK) == 0 || !(pf_flags & VMM_PF_FLAG_WRITE)) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    if (AllocatedPagesInRangeLocked(base, LARGE_PAGE_SIZE) != 0) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    list_node page_list = LIST_INITIAL_VALUE(page_list);
+    paddr_t run_pa;
+    zx_status_t status = pmm_alloc_contiguous(count, pmm_alloc_flags_, LARGE_PAGE_SIZE_SHIFT,
+                                              &run_pa, &page_list);
+    if (status != ZX_OK) {
+        kcounter_add(vm_large_page_alloc_failed, 1);
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    uint64_t off = base;
+    vm_page_t* p;
+    while ((p = list_remove_head_type(&page_list, vm_page, queue_node)) != nullptr) {
+        InitializeVmPage(p);
+        ZeroPage(p);
+
+        status = AddPageLocked(p, off);
+        DEBUG_ASSERT(status == ZX_OK);
+        off += PAGE_SIZE;
+    }
+
+    // if ARM and not fully cached, clean/invalidate the pages after zeroing them
+#if ARCH_ARM64
+    if (cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+        arch_clean_invalidate_cache_range((addr_t)paddr_to_physmap(run_pa), LARGE_PAGE_SIZE);
+    }
+#endif
+
+    // other mappings may have covered this range with the zero page
+    RangeChangeUpdateLocked(base, LARGE_PAGE_SIZE);
+
+    kcounter_add(vm_large_page_commit, 1);
+    LTRACEF("committed large page at offset %#" PRIx64 ", pa %#" PRIxPTR "\n", base, run_pa);
+
+    *pa_out = run_pa;
+    return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
     canary_.Assert();
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -613,6 +759,17 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
     DEBUG_ASSERT(end > offset);
     offset = ROUNDDOWN(offset, PAGE_SIZE);
 
+    // commit whole large pages where the range covers them
+    if (options_ & kLargePages) {
+        const uint flags = VMM_PF_FLAG_SW_FAULT | VMM_PF_FLAG_WRITE;
+        for (uint64_t o = ROUNDUP(offset, LARGE_PAGE_SIZE);
+             o < end && end - o >= LARGE_PAGE_SIZE; o += LARGE_PAGE_SIZE) {
+            paddr_t pa;
+            // failure just means this part gets committed one page at a time
+            GetLargePageLocked(o, flags, &pa);
+        }
+    }
+
     // make a pass through the list, counting the number of pages we need to allocate
     size_t count = 0;
     uint64_t expected_next_off = offset;
@@ -637,7 +794,8 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
     list_node page_list;
     list_initialize(&page_list);
 
-    zx_status_t status = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    zx_status_t status = pmm_alloc_pages(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                         &page_list);
     if (status != ZX_OK) {
         return status;
     }
@@ -1136,6 +1294,8 @@ zx_status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, VmPageSpli
     page_source_->OnPagesSupplied(offset, len);
     while (!pages->IsDone()) {
         vm_page* src_page = pages->Pop();
+        src_page->object.modified = 0;
+        src_page->object.age = 0;
         zx_status_t status = AddPageLocked(src_page, offset);
         if (status == ZX_ERR_ALREADY_EXISTS) {
             pmm_free_page(src_page);
@@ -1148,6 +1308,66 @@ zx_status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, VmPageSpli
     return ZX_OK;
 }
 
+zx_status_t VmObjectPaged::ReplacePages(uint64_t offset, list_node* pages) {
+    canary_.Assert();
+
+    if ((options_ & (kContiguous | kLargePages)) || page_source_) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    const uint64_t len = list_length(pages) * PAGE_SIZE;
+    if (!IS_PAGE_ALIGNED(offset) || len == 0) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    Guard<fbl::Mutex> guard{&lock_};
+
+    if (!InRange(offset, len, size_)) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    if (AnyPagesPinnedLocked(offset, len)) {
+        return ZX_ERR_BAD_STATE;
+    }
+    // the new pages were written through the cache, which an uncached mapping
+    // would bypass
+    if (cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    // unmap the old pages from every mapping, then swap in the new ones
+    RangeChangeUpdateLocked(offset, len);
+    page_list_.FreePages(offset, offset + len);
+
+    uint64_t end = offset;
+    vm_page_t* p;
+    while ((p = list_remove_head_type(pages, vm_page_t, queue_node)) != nullptr) {
+        DEBUG_ASSERT(p->state != VM_PAGE_STATE_FREE && p->state != VM_PAGE_STATE_OBJECT);
+        const uint32_t state = p->state;
+        p->state = VM_PAGE_STATE_OBJECT;
+        p->object.pin_count = 0;
+        p->object.modified = 0;
+        p->object.age = 0;
+        zx_status_t status = page_list_.AddPage(p, end);
+        if (status != ZX_OK) {
+            // Give back every page, leaving the range decommitted. The caller
+            // still has the contents to copy in.
+            p->state = state;
+            list_add_head(pages, &p->queue_node);
+            while (end > offset) {
+                end -= PAGE_SIZE;
+                bool removed = page_list_.RemovePage(end, &p);
+                DEBUG_ASSERT(removed);
+                p->state = state;
+                list_add_head(pages, &p->queue_node);
+            }
+            return status;
+        }
+        end += PAGE_SIZE;
+    }
+
+    return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::InvalidateCache(const uint64_t offset, const uint64_t len) {
     return CacheOp(offset, len, CacheOpType::Invalidate);
 }
@@ -1306,3 +1526,171 @@ fbl::RefPtr<PageSource> VmObjectPaged::GetRootPageSourceLocked() {
     }
     return vm_object->page_source_;
 }
+
+void VmObjectPaged::HarvestAccessedFromParentLocked(uint64_t offset, uint64_t len,
+                                                    AccessedFn accessed_fn, void* context) {
+    canary_.Assert();
+
+    // our parent is asking about its pages, which we only see through our
+    // mappings where they're in range and we haven't replaced them with our own
+    uint64_t offset_new;
+    uint64_t len_new;
+    if (!GetIntersect(parent_offset_, size_, offset, len, &offset_new, &len_new)) {
+        return;
+    }
+
+    struct Harvest {
+        VmObjectPaged* vmo;
+        AccessedFn accessed_fn;
+        void* context;
+    } harvest = {this, accessed_fn, context};
+
+    HarvestAccessedLocked(
+        offset_new - parent_offset_, len_new,
+        // Called with our lock held, which confuses analysis.
+        [](uint64_t off, uint64_t len, void* ctx) TA_NO_THREAD_SAFETY_ANALYSIS {
+            auto h = static_cast<Harvest*>(ctx);
+            const uint64_t parent_offset = h->vmo->parent_offset_;
+            const uint64_t end = off + len;
+            while (off < end) {
+                if (h->vmo->page_list_.GetPage(off)) {
+                    off += PAGE_SIZE;
+                    continue;
+                }
+                uint64_t run_end = off + PAGE_SIZE;
+                while (run_end < end && !h->vmo->page_list_.GetPage(run_end)) {
+                    run_end += PAGE_SIZE;
+                }
+                h->accessed_fn(off + parent_offset, run_end - off, h->context);
+                off = run_end;
+            }
+        },
+        &harvest);
+}
+
+zx_status_t VmObjectPaged::GetReclaimStats(ReclaimStats* stats) {
+    canary_.Assert();
+
+    if (!page_source_) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    Guard<fbl::Mutex> guard{&lock_};
+
+    *stats = {};
+    page_list_.ForEveryPage(
+        [stats](const auto p, uint64_t off) {
+            if (p->object.modified) {
+                stats->modified_pages++;
+            } else if (p->object.age >= kInactiveAge) {
+                stats->inactive_pages++;
+            } else {
+                stats->active_pages++;
+            }
+            return ZX_ERR_NEXT;
+        });
+    stats->evicted_pages = evicted_pages_;
+    return ZX_OK;
+}
+
+void VmObjectPaged::AgePagesLocked() {
+    canary_.Assert();
+    DEBUG_ASSERT(page_source_);
+
+    page_list_.ForEveryPage(
+        [](auto p, uint64_t off) {
+            if (p->object.age < kMaxAge) {
+                p->object.age++;
+            }
+            return ZX_ERR_NEXT;
+        });
+
+    // pages accessed since the last pass start over, found with one harvest
+    // per mapping rather than one per page
+    HarvestAccessedLocked(
+        0, size_,
+        // Called with our lock held, which confuses analysis.
+        [](uint64_t offset, uint64_t len, void* context) TA_NO_THREAD_SAFETY_ANALYSIS {
+            auto vmo = static_cast<VmObjectPaged*>(context);
+            vmo->page_list_.ForEveryPageInRange(
+                [](auto p, uint64_t off) {
+                    p->object.age = 0;
+                    return ZX_ERR_NEXT;
+                },
+                offset, offset + len);
+        },
+        this);
+}
+
+uint64_t VmObjectPaged::EvictPagesLocked(uint8_t min_age, uint64_t target) {
+    canary_.Assert();
+    DEBUG_ASSERT(page_source_);
+
+    // evicted pages have to be supplied again on the next fault
+    if (page_source_->IsDetached()) {
+        return 0;
+    }
+
+    // Pages can't be removed while the page list is being walked, so collect
+    // the offsets of a batch of candidates at a time.
+    constexpr size_t kBatch = 16;
+    uint64_t offsets[kBatch];
+    uint64_t start = 0;
+    uint64_t evicted = 0;
+    while (evicted < target && start < size_) {
+        size_t count = 0;
+        const uint64_t limit = fbl::min<uint64_t>(kBatch, target - evicted);
+        page_list_.ForEveryPageInRange(
+            [&](const auto p, uint64_t off) {
+                start = off + PAGE_SIZE;
+                if (p->object.modified || p->object.pin_count > 0 ||
+                    p->object.age < min_age) {
+                    return ZX_ERR_NEXT;
+                }
+                offsets[count++] = off;
+                return count < limit ? ZX_ERR_NEXT : ZX_ERR_STOP;
+            },
+            start, size_);
+        if (count == 0) {
+            break;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            // unmap the page everywhere it's seen, including through children
+            RangeChangeUpdateLocked(offsets[i], PAGE_SIZE);
+
+            vm_page_t* page;
+            bool removed = page_list_.RemovePage(offsets[i], &page);
+            DEBUG_ASSERT(removed);
+            pmm_free_page(page);
+        }
+        evicted += count;
+        if (count < limit) {
+            break;
+        }
+    }
+
+    evicted_pages_ += evicted;
+    return evicted;
+}
+
+void VmObjectPaged::AgePagerBackedPages() {
+    Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+    for (auto& vmo : reclaim_list_) {
+        Guard<fbl::Mutex> vmo_guard{&vmo.lock_};
+        vmo.AgePagesLocked();
+    }
+}
+
+uint64_t VmObjectPaged::EvictPagerBackedPages(uint8_t min_age, uint64_t target) {
+    Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+    uint64_t evicted = 0;
+    for (auto& vmo : reclaim_list_) {
+        if (evicted >= target) {
+            break;
+        }
+        Guard<fbl::Mutex> vmo_guard{&vmo.lock_};
+        evicted += vmo.EvictPagesLocked(min_age, target - evicted);
+    }
+    return evicted;
+}
@@ -123,9 +123,14 @@ zx_status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
         DEBUG_ASSERT(status == ZX_OK);
 
         list_.insert(ktl::move(pl));
+        page_count_++;
         return ZX_OK;
     } else {
-        return pln->AddPage(p, index);
+        zx_status_t status = pln->AddPage(p, index);
+        if (status == ZX_OK) {
+            page_count_++;
+        }
+        return status;
     }
 }
 
@@ -169,6 +174,7 @@ bool VmPageList::RemovePage(uint64_t offset, vm_page_t** page_out) {
             list_.erase(*pln);
         }
 
+        page_count_--;
         *page_out = page;
         return true;
     } else {
@@ -192,9 +198,10 @@ void VmPageList::FreePages(uint64_t start_offset, uint64_t end_offset) {
 
     // Visitor function which moves the pages from the VmPageListNode
     // to the accumulation list.
-    auto per_page_func = [&list](vm_page*& p, uint64_t offset) {
+    auto per_page_func = [this, &list](vm_page*& p, uint64_t offset) {
         list_add_tail(&list, &p->queue_node);
         p = nullptr;
+        page_count_--;
         return ZX_ERR_NEXT;
     };
 
@@ -237,6 +244,8 @@ size_t VmPageList::FreeAllPages() {
 
     // empty the tree
     list_.clear();
+    DEBUG_ASSERT(count == page_count_);
+    page_count_ = 0;
 
     return count;
 }
@@ -264,6 +273,10 @@ VmPageSpliceList VmPageList::TakePages(uint64_t offset, uint64_t length) {
     while (offset_to_node_offset(offset) != offset_to_node_offset(end)) {
         ktl::unique_ptr<VmPageListNode> node = list_.erase(offset_to_node_offset(offset));
         if (node) {
+            node->ForEveryPage([this](const vm_page* p, uint64_t) {
+                page_count_--;
+                return ZX_ERR_NEXT;
+            }, node->offset(), node->offset() + VmPageListNode::kPageFanOut * PAGE_SIZE);
             res.middle_.insert(ktl::move(node));
         }
         offset += (PAGE_SIZE * VmPageListNode::kPageFanOut);
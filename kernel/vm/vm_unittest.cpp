@@ -6,8 +6,13 @@
 
 #include <assert.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
+#include <inttypes.h>
 #include <fbl/array.h>
+#include <kernel/cmdline.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
 #include <ktl/move.h>
 #include <lib/unittest/unittest.h>
 #include <vm/physmap.h>
@@ -71,6 +76,147 @@ static bool pmm_oversized_alloc_test() {
     END_TEST;
 }
 
+struct pmm_stress_args {
+    event_t* gate;
+    size_t iterations;
+    bool failed;
+};
+
+// Repeatedly allocates and frees small batches of pages, the pattern the
+// per-cpu page caches are meant to serve without touching the global lock.
+static int pmm_stress_thread(void* arg) {
+    auto* args = static_cast<pmm_stress_args*>(arg);
+    event_wait(args->gate);
+
+    for (size_t i = 0; i < args->iterations; i++) {
+        vm_page_t* pages[8];
+        for (auto& page : pages) {
+            if (pmm_alloc_page(0, &page) != ZX_OK) {
+                args->failed = true;
+                return -1;
+            }
+        }
+        for (auto& page : pages) {
+            pmm_free_page(page);
+        }
+    }
+    return 0;
+}
+
+// Gives the free page count a moment to get back to |expected|. Pages that
+// other threads are moving between the free list, a per-cpu cache or the zero
+// pool drop out of the count until the move is done.
+static uint64_t pmm_settled_free_pages(uint64_t expected) {
+    uint64_t count = pmm_count_free_pages();
+    for (int i = 0; i < 100 && count != expected; i++) {
+        thread_sleep_relative(ZX_MSEC(1));
+        count = pmm_count_free_pages();
+    }
+    return count;
+}
+
+// Runs the alloc/free loop on 1..N cpus at once and reports the aggregate
+// throughput, which should scale with the number of cpus. Every page is freed
+// again, so the free page count, which includes the pages parked in the
+// per-cpu caches, must end up where it started.
+static bool pmm_pcpu_cache_stress_test() {
+    BEGIN_TEST;
+
+    static const size_t kIterations = 20000;
+    const uint num_cpus = arch_max_num_cpus();
+    const uint64_t free_pages = pmm_count_free_pages();
+
+    for (uint active = 1; active <= num_cpus; active++) {
+        event_t gate = EVENT_INITIAL_VALUE(gate, false, 0);
+        thread_t* threads[SMP_MAX_CPUS] = {};
+        pmm_stress_args args[SMP_MAX_CPUS] = {};
+
+        uint created = 0;
+        for (uint i = 0; i < active; i++) {
+            if (!mp_is_cpu_online(i)) {
+                continue;
+            }
+            args[i] = {&gate, kIterations, false};
+            threads[i] = thread_create("pmm stress", &pmm_stress_thread, &args[i],
+                                       DEFAULT_PRIORITY);
+            ASSERT_NONNULL(threads[i], "thread_create");
+            thread_set_cpu_affinity(threads[i], cpu_num_to_mask(i));
+            thread_resume(threads[i]);
+            created++;
+        }
+
+        zx_time_t start = current_time();
+        event_signal(&gate, true);
+
+        for (uint i = 0; i < active; i++) {
+            if (threads[i]) {
+                thread_join(threads[i], nullptr, ZX_TIME_INFINITE);
+                EXPECT_FALSE(args[i].failed, "pmm_alloc_page failed under stress");
+            }
+        }
+        zx_duration_t elapsed = zx_time_sub_time(current_time(), start);
+        event_destroy(&gate);
+
+        uint64_t pages = created * kIterations * 8;
+        printf("\n%u cpus: %" PRIu64 " pages in %" PRIi64 " us (%" PRIu64 " pages/ms)",
+               created, pages, elapsed / 1000,
+               pages * ZX_MSEC(1) / fbl::max<zx_duration_t>(elapsed, 1));
+
+        EXPECT_EQ(free_pages, pmm_settled_free_pages(free_pages),
+                  "free page count changed by the stress run");
+    }
+    printf("\n");
+
+    // hand the stress pages back so they don't linger in the caches
+    pmm_drain_cpu_caches();
+    EXPECT_EQ(free_pages, pmm_settled_free_pages(free_pages),
+              "free page count changed by draining the per-cpu caches");
+
+    END_TEST;
+}
+
+// Allocates pages with PMM_ALLOC_FLAG_ZEROED and checks that any page handed
+// out of the pre-zeroed pool really is zero, and that freeing clears the flag.
+static bool pmm_alloc_zeroed_test() {
+    BEGIN_TEST;
+
+    // give the zeroing thread a chance to top the pool up
+    thread_sleep_relative(ZX_MSEC(100));
+
+    static const size_t kCount = 64;
+    list_node list = LIST_INITIAL_VALUE(list);
+    zx_status_t status = pmm_alloc_pages(kCount, PMM_ALLOC_FLAG_ZEROED, &list);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc_pages");
+    ASSERT_EQ(kCount, list_length(&list), "");
+
+    vm_page_t* page;
+    list_for_every_entry (&list, page, vm_page_t, queue_node) {
+        if (!(page->flags & VM_PAGE_FLAG_ZEROED)) {
+            continue;
+        }
+        const uint8_t* bytes = static_cast<const uint8_t*>(paddr_to_physmap(page->paddr()));
+        for (size_t i = 0; i < PAGE_SIZE; i++) {
+            ASSERT_EQ(0u, bytes[i], "pre-zeroed page is not zero");
+        }
+        // dirty the page so a stale flag would be caught on reuse
+        memset(paddr_to_physmap(page->paddr()), 0xa5, PAGE_SIZE);
+    }
+
+    pmm_free(&list);
+
+    // with the pool drained, ordinary allocations never claim to be zeroed,
+    // including the dirtied pages that were just freed
+    pmm_drain_zero_pool();
+    status = pmm_alloc_pages(kCount, 0, &list);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc_pages");
+    list_for_every_entry (&list, page, vm_page_t, queue_node) {
+        EXPECT_FALSE(page->flags & VM_PAGE_FLAG_ZEROED, "stale zeroed flag");
+    }
+    pmm_free(&list);
+
+    END_TEST;
+}
+
 // Allocates one page and frees it.
 static bool pmm_alloc_contiguous_one_test() {
     BEGIN_TEST;
@@ -375,6 +521,41 @@ static bool vmo_commit_test() {
     END_TEST;
 }
 
+// Checks that the allocated page counts kept by a vmo follow commits,
+// decommits and copy-on-write faults.
+static bool vmo_allocated_pages_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 64;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+
+    EXPECT_EQ(ZX_OK, vmo->CommitRange(0, alloc_size), "committing vm object\n");
+    EXPECT_EQ(64u, vmo->AllocatedPages(), "committed pages\n");
+
+    EXPECT_EQ(ZX_OK, vmo->DecommitRange(PAGE_SIZE * 8, PAGE_SIZE * 20), "decommit\n");
+    EXPECT_EQ(44u, vmo->AllocatedPages(), "pages after decommit\n");
+    EXPECT_EQ(8u, vmo->AllocatedPagesInRange(0, PAGE_SIZE * 16), "pages in range\n");
+    EXPECT_EQ(0u, vmo->AllocatedPagesInRange(PAGE_SIZE * 8, PAGE_SIZE * 20), "pages in range\n");
+
+    // A clone only owns the pages it has copied.
+    fbl::RefPtr<VmObject> clone;
+    status = vmo->CloneCOW(true, 0, alloc_size, false, &clone);
+    ASSERT_EQ(status, ZX_OK, "vmobject clone\n");
+    EXPECT_EQ(0u, clone->AllocatedPages(), "pages of new clone\n");
+
+    uint32_t value = 0x12345678;
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(ZX_OK, clone->Write(&value, i * PAGE_SIZE, sizeof(value)), "write\n");
+    }
+    EXPECT_EQ(4u, clone->AllocatedPages(), "pages after copy-on-write\n");
+    EXPECT_EQ(44u, vmo->AllocatedPages(), "parent pages after copy-on-write\n");
+
+    EXPECT_EQ(ZX_OK, clone->Resize(PAGE_SIZE * 2), "resize\n");
+    EXPECT_EQ(2u, clone->AllocatedPages(), "pages after shrinking\n");
+    END_TEST;
+}
+
 // Creates a paged VMO, pins it, and tries operations that should unpin it.
 static bool vmo_pin_test() {
     BEGIN_TEST;
@@ -637,6 +818,139 @@ static bool vmo_demand_paged_map_test() {
     END_TEST;
 }
 
+// Creates a large page vm object, maps it demand paged on a large page
+// boundary, makes sure a single write fault maps a whole large page and that
+// the mapping agrees with the object.
+static bool vmo_large_page_map_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = LARGE_PAGE_SIZE * 2;
+
+    // Without a free aligned run there is nothing to back a large page with.
+    {
+        list_node run = LIST_INITIAL_VALUE(run);
+        paddr_t run_pa;
+        if (pmm_alloc_contiguous(LARGE_PAGE_SIZE / PAGE_SIZE, 0, LARGE_PAGE_SIZE_SHIFT, &run_pa,
+                                 &run) != ZX_OK) {
+            unittest_printf("no contiguous memory for a large page, skipping\n");
+            END_TEST;
+        }
+        pmm_free(&run);
+    }
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, VmObjectPaged::kLargePages,
+                                               alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+    ASSERT_TRUE(vmo, "vmobject creation\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    auto ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                     LARGE_PAGE_SIZE_SHIFT, 0, kArchRwFlags);
+    ASSERT_EQ(ret, ZX_OK, "mapping object");
+    EXPECT_TRUE(IS_ALIGNED(ptr, LARGE_PAGE_SIZE), "mapping alignment");
+
+    // One write commits and maps the whole first large page.  Fault-around
+    // never reaches this far, so the last page being mapped, at the end of
+    // the same aligned run as the first, means a large page was used.
+    *static_cast<volatile uint8_t*>(ptr) = 1;
+    EXPECT_EQ(LARGE_PAGE_SIZE / PAGE_SIZE, vmo->AllocatedPages(), "pages committed by one fault");
+    paddr_t first_pa, last_pa;
+    uint flags;
+    const vaddr_t last_va = reinterpret_cast<vaddr_t>(ptr) + LARGE_PAGE_SIZE - PAGE_SIZE;
+    ASSERT_EQ(ZX_OK, ka->arch_aspace().Query(reinterpret_cast<vaddr_t>(ptr), &first_pa, &flags),
+              "first page mapped\n");
+    ASSERT_EQ(ZX_OK, ka->arch_aspace().Query(last_va, &last_pa, &flags), "last page mapped\n");
+    EXPECT_TRUE(IS_ALIGNED(first_pa, LARGE_PAGE_SIZE), "large page alignment\n");
+    EXPECT_EQ(first_pa + LARGE_PAGE_SIZE - PAGE_SIZE, last_pa, "large page contiguity\n");
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, ka->arch_aspace().Query(last_va + PAGE_SIZE, nullptr, nullptr),
+              "second large page untouched\n");
+
+    // fill with known pattern and test
+    if (!fill_and_test(ptr, alloc_size)) {
+        all_ok = false;
+    }
+    EXPECT_EQ(alloc_size / PAGE_SIZE, vmo->AllocatedPages(), "committed pages");
+
+    struct context {
+        vaddr_t base;
+        ArchVmAspace* aspace;
+        bool ok;
+    } ctx = {reinterpret_cast<vaddr_t>(ptr), &ka->arch_aspace(), true};
+    auto lookup_fn = [](void* context, size_t offset, size_t index, paddr_t pa) {
+        auto ctx = static_cast<struct context*>(context);
+        paddr_t mapped_pa;
+        uint flags;
+        if (ctx->aspace->Query(ctx->base + offset, &mapped_pa, &flags) != ZX_OK ||
+            mapped_pa != pa) {
+            ctx->ok = false;
+        }
+        return ZX_OK;
+    };
+    status = vmo->Lookup(0, alloc_size, lookup_fn, &ctx);
+    EXPECT_EQ(ZX_OK, status, "lookup\n");
+    EXPECT_TRUE(ctx.ok, "mapping matches object\n");
+
+    // changing the protection of one page must leave the rest writable
+    ret = ka->RootVmar()->Protect(reinterpret_cast<vaddr_t>(ptr) + PAGE_SIZE, PAGE_SIZE,
+                                  kArchRwFlags & ~ARCH_MMU_FLAG_PERM_WRITE);
+    EXPECT_EQ(ZX_OK, ret, "protecting one page\n");
+    if (!fill_and_test(ptr, PAGE_SIZE)) {
+        all_ok = false;
+    }
+
+    auto err = ka->FreeRegion((vaddr_t)ptr);
+    EXPECT_EQ(ZX_OK, err, "unmapping object");
+    END_TEST;
+}
+
+// Creates a committed vm object and a clone of it, maps each demand paged
+// and makes sure a single fault maps the neighbouring pages too.  Pages the
+// object owns are mapped writable, pages of the clone's parent read only.
+static bool vmo_fault_around_test() {
+    BEGIN_TEST;
+    if (cmdline_get_uint32("kernel.vm.fault-around", 16) < 2) {
+        unittest_printf("fault around is turned off, skipping\n");
+        END_TEST;
+    }
+
+    static const size_t alloc_size = PAGE_SIZE * 16;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+    ASSERT_EQ(ZX_OK, vmo->CommitRange(0, alloc_size), "committing object\n");
+    fbl::RefPtr<VmObject> clone;
+    status = vmo->CloneCOW(false, 0, alloc_size, false, &clone);
+    ASSERT_EQ(ZX_OK, status, "cloning object\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    const fbl::RefPtr<VmObject> objects[] = {vmo, clone};
+    for (const auto& object : objects) {
+        // Align the mapping to more than any fault around window, so that
+        // the first two pages always share one.
+        void* ptr;
+        auto ret = ka->MapObjectInternal(object, "test", 0, alloc_size, &ptr,
+                                         LARGE_PAGE_SIZE_SHIFT, 0, kArchRwFlags);
+        ASSERT_EQ(ZX_OK, ret, "mapping object");
+
+        const vaddr_t base = reinterpret_cast<vaddr_t>(ptr);
+        EXPECT_EQ(ZX_ERR_NOT_FOUND, ka->arch_aspace().Query(base + PAGE_SIZE, nullptr, nullptr),
+                  "neighbour mapped before the fault\n");
+        EXPECT_EQ(0u, *reinterpret_cast<volatile uint8_t*>(ptr), "reading first page\n");
+
+        paddr_t pa;
+        uint flags;
+        EXPECT_EQ(ZX_OK, ka->arch_aspace().Query(base + PAGE_SIZE, &pa, &flags),
+                  "neighbour mapped after the fault\n");
+        EXPECT_EQ(object == vmo, !!(flags & ARCH_MMU_FLAG_PERM_WRITE),
+                  "neighbour write permission\n");
+
+        auto err = ka->FreeRegion(base);
+        EXPECT_EQ(ZX_OK, err, "unmapping object");
+    }
+    END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test() {
     BEGIN_TEST;
@@ -1066,6 +1380,46 @@ static bool vmpl_add_remove_page_test() {
     END_TEST;
 }
 
+// Checks that the list counts its pages as they are added, removed and taken.
+static bool vmpl_page_count_test() {
+    BEGIN_TEST;
+
+    VmPageList pl;
+    constexpr uint32_t kCount = 3 * VmPageListNode::kPageFanOut;
+    vm_page_t test_pages[kCount] = {};
+    for (uint32_t i = 0; i < kCount; i++) {
+        EXPECT_EQ(ZX_OK, pl.AddPage(test_pages + i, i * PAGE_SIZE), "add failure\n");
+    }
+    EXPECT_EQ(kCount, pl.page_count(), "unexpected count\n");
+
+    // Adding a page at an occupied offset fails and must not be counted.
+    vm_page_t extra_page{};
+    EXPECT_EQ(ZX_ERR_ALREADY_EXISTS, pl.AddPage(&extra_page, 0), "double add\n");
+    EXPECT_EQ(kCount, pl.page_count(), "unexpected count\n");
+
+    vm_page* remove_page;
+    EXPECT_TRUE(pl.RemovePage(0, &remove_page), "remove failure\n");
+    EXPECT_FALSE(pl.RemovePage(0, &remove_page), "double remove\n");
+    EXPECT_EQ(kCount - 1, pl.page_count(), "unexpected count\n");
+
+    // Take whole nodes as well as the pages around them.
+    constexpr uint32_t kTakeOffset = VmPageListNode::kPageFanOut - 1;
+    constexpr uint32_t kTakeCount = VmPageListNode::kPageFanOut + 2;
+    VmPageSpliceList splice = pl.TakePages(kTakeOffset * PAGE_SIZE, kTakeCount * PAGE_SIZE);
+    EXPECT_EQ(kCount - 1 - kTakeCount, pl.page_count(), "unexpected count\n");
+    while (!splice.IsDone()) {
+        splice.Pop();
+    }
+
+    for (uint32_t i = 1; i < kCount; i++) {
+        pl.RemovePage(i * PAGE_SIZE, &remove_page);
+    }
+    EXPECT_EQ(0u, pl.page_count(), "unexpected count\n");
+    EXPECT_TRUE(pl.IsEmpty(), "non-empty list\n");
+
+    END_TEST;
+}
+
 // Test for freeing a range of pages
 static bool vmpl_free_pages_test() {
     BEGIN_TEST;
@@ -1340,12 +1694,15 @@ VM_UNITTEST(vmo_create_maximum_size)
 VM_UNITTEST(vmo_pin_test)
 VM_UNITTEST(vmo_multiple_pin_test)
 VM_UNITTEST(vmo_commit_test)
+VM_UNITTEST(vmo_allocated_pages_test)
 VM_UNITTEST(vmo_odd_size_commit_test)
 VM_UNITTEST(vmo_create_physical_test)
 VM_UNITTEST(vmo_create_contiguous_test)
 VM_UNITTEST(vmo_contiguous_decommit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_large_page_map_test)
+VM_UNITTEST(vmo_fault_around_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
@@ -1361,12 +1718,15 @@ UNITTEST_START_TESTCASE(pmm_tests)
 VM_UNITTEST(pmm_smoke_test)
 VM_UNITTEST(pmm_alloc_contiguous_one_test)
 VM_UNITTEST(pmm_multi_alloc_test)
+VM_UNITTEST(pmm_pcpu_cache_stress_test)
+VM_UNITTEST(pmm_alloc_zeroed_test)
 // runs the system out of memory, uncomment for debugging
 //VM_UNITTEST(pmm_oversized_alloc_test)
 UNITTEST_END_TESTCASE(pmm_tests, "pmm", "Physical memory manager tests");
 
 UNITTEST_START_TESTCASE(vm_page_list_tests)
 VM_UNITTEST(vmpl_add_remove_page_test)
+VM_UNITTEST(vmpl_page_count_test)
 VM_UNITTEST(vmpl_free_pages_test)
 VM_UNITTEST(vmpl_free_pages_last_page_test)
 VM_UNITTEST(vmpl_near_last_offset_free)
@@ -27,6 +27,7 @@ ENABLE_INSTALL_SAMPLES ?= false
 ENABLE_NEW_BOOTDATA := true
 ENABLE_LOCK_DEP ?= false
 ENABLE_LOCK_DEP_TESTS ?= $(ENABLE_LOCK_DEP)
+ENABLE_LOCK_STAT ?= false
 DISABLE_UTEST ?= false
 ENABLE_ULIB_ONLY ?= false
 ENABLE_DRIVER_TRACING ?= true
@@ -426,6 +427,16 @@ KERNEL_DEFINES += WITH_LOCK_DEP=1
 KERNEL_DEFINES += LOCK_DEP_ENABLE_VALIDATION=1
 endif
 
+# Kernel lock statistics. These are kept per lock class, so they require lock
+# dependency tracking.
+ifeq ($(call TOBOOL,$(ENABLE_LOCK_STAT)),true)
+ifneq ($(call TOBOOL,$(ENABLE_LOCK_DEP)),true)
+$(error ENABLE_LOCK_STAT requires ENABLE_LOCK_DEP)
+endif
+KERNEL_DEFINES += WITH_LOCK_STAT=1
+KERNEL_DEFINES += LOCK_DEP_ENABLE_STATISTICS=1
+endif
+
 # Kernel lock dependency tracking tests. By default this is enabled when
 # tracking is enabled, but can also be eanbled independently to assess whether
 # the tests build and *fail correctly* when lockdep is disabled.
@@ -607,6 +607,7 @@ zx_status_t block_device_added(int dirfd, int event, const char* name, void* coo
 
         mount_options_t options = default_mount_options;
         options.enable_journal = true;
+        options.enable_pager = true;
         zx_status_t status = watcher->MountBlob(std::move(fd), &options);
         if (status != ZX_OK) {
             printf("devmgr: Failed to mount blobfs partition %s at %s: %s.\n",
@@ -622,6 +623,7 @@ zx_status_t block_device_added(int dirfd, int event, const char* name, void* coo
             return ZX_OK;
         }
         mount_options_t options = default_mount_options;
+        options.enable_journal = true;
         mount_minfs(watcher, std::move(fd), &options);
         return ZX_OK;
     }
@@ -0,0 +1,219 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Turns the samples of the kernel's sampling profiler in a ktrace dump into
+// "folded stacks": one line per distinct stack, outermost frame first and
+// frames separated by ';', followed by the number of samples with that stack.
+// This is the input format of the common flame graph tools.
+//
+// Frames are written as {{{pc:...}}} symbolizer markup elements (see
+// docs/symbolizer_markup.md), so the output can be piped through the
+// symbolizer to get function names. The symbolizer needs the {{{module}}} and
+// {{{mmap}}} elements describing the sampled processes and the kernel; they
+// can be passed with -c and are copied to the start of the output.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <lib/zircon-internal/ktrace.h>
+
+namespace {
+
+struct Options {
+    const char* context_path = nullptr;
+    bool filter_pid = false;
+    uint32_t pid = 0;
+    bool kernel_only = false;
+    bool user_only = false;
+};
+
+void Usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] <ktrace file>\n"
+            "Writes the profiler samples in a ktrace dump as folded stacks.\n"
+            "Options:\n"
+            "  -c <file>  copy the symbolizer context elements in <file>\n"
+            "             ({{{module}}}, {{{mmap}}}, ...) to the output\n"
+            "  -p <koid>  only use samples of process <koid>\n"
+            "  -k         only use samples taken in the kernel\n"
+            "  -u         only use samples taken in user mode\n",
+            argv0);
+}
+
+bool ReadFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        fprintf(stderr, "error: cannot open '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data->insert(data->end(), buf, buf + len);
+    }
+    bool ok = !ferror(f);
+    if (!ok) {
+        fprintf(stderr, "error: cannot read '%s'\n", path);
+    }
+    fclose(f);
+    return ok;
+}
+
+std::string FormatPc(uint64_t pc) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "{{{pc:%#" PRIx64 "}}}", pc);
+    return buf;
+}
+
+class Profile {
+public:
+    explicit Profile(const Options& options) : options_(options) {}
+
+    // Adds the records in |data|. Returns false if the data is malformed.
+    bool AddRecords(const std::vector<uint8_t>& data) {
+        size_t off = 0;
+        while (off + sizeof(uint32_t) <= data.size()) {
+            uint32_t tag;
+            memcpy(&tag, &data[off], sizeof(tag));
+            const size_t len = KTRACE_LEN(tag);
+            if (len == 0 || off + len > data.size()) {
+                fprintf(stderr, "error: bad record at offset %zu\n", off);
+                return false;
+            }
+            AddRecord(tag, &data[off], len);
+            off += len;
+        }
+        return true;
+    }
+
+    void Print(FILE* out) const {
+        for (const auto& stack : stacks_) {
+            fprintf(out, "%s %" PRIu64 "\n", stack.first.c_str(), stack.second);
+        }
+    }
+
+    size_t sample_count() const { return samples_; }
+
+private:
+    void AddRecord(uint32_t tag, const uint8_t* rec, size_t len) {
+        if (KTRACE_EVENT(tag) == KTRACE_EVENT(TAG_PROC_NAME) &&
+            KTRACE_GROUP(tag) == KTRACE_GROUP(TAG_PROC_NAME)) {
+            constexpr size_t kNameOffset = offsetof(ktrace_rec_name_t, name);
+            ktrace_rec_name_t name;
+            memcpy(&name, rec, kNameOffset);
+            const char* str = reinterpret_cast<const char*>(rec) + kNameOffset;
+            process_names_[name.id] = std::string(str, strnlen(str, len - kNameOffset));
+            return;
+        }
+        if (KTRACE_EVENT(tag) != KTRACE_EVENT(TAG_PROFILE_SAMPLE(1)) ||
+            KTRACE_GROUP(tag) != KTRACE_GRP_PROFILE) {
+            return;
+        }
+
+        ktrace_rec_profile_t sample = {};
+        memcpy(&sample, rec, len < sizeof(sample) ? len : sizeof(sample));
+        const size_t frames = (len - offsetof(ktrace_rec_profile_t, pc)) / sizeof(sample.pc[0]);
+        const bool user = sample.flags & KTRACE_PROFILE_FLAG_USER;
+        if ((options_.filter_pid && sample.pid != options_.pid) ||
+            (options_.kernel_only && user) || (options_.user_only && !user)) {
+            return;
+        }
+
+        // Samples taken in the kernel on behalf of a process are attributed
+        // to the process, so that its time in syscalls shows up under it.
+        std::string stack = ProcessName(sample.pid);
+        if (!user && sample.pid != 0) {
+            stack += ";kernel";
+        }
+        for (size_t i = frames; i > 0; i--) {
+            stack += ';';
+            stack += FormatPc(sample.pc[i - 1]);
+        }
+        stacks_[stack]++;
+        samples_++;
+    }
+
+    std::string ProcessName(uint32_t pid) const {
+        if (pid == 0) {
+            return "kernel";
+        }
+        auto it = process_names_.find(pid);
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%" PRIu32, pid);
+        return it == process_names_.end() ? buf : it->second + ":" + buf;
+    }
+
+    const Options& options_;
+    std::map<uint32_t, std::string> process_names_;
+    std::map<std::string, uint64_t> stacks_;
+    size_t samples_ = 0;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:kuh")) != -1) {
+        switch (opt) {
+        case 'c':
+            options.context_path = optarg;
+            break;
+        case 'p':
+            options.filter_pid = true;
+            options.pid = static_cast<uint32_t>(strtoul(optarg, nullptr, 0));
+            break;
+        case 'k':
+            options.kernel_only = true;
+            break;
+        case 'u':
+            options.user_only = true;
+            break;
+        default:
+            Usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 1 || (options.kernel_only && options.user_only)) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> trace;
+    if (!ReadFile(argv[optind], &trace)) {
+        return 1;
+    }
+
+    Profile profile(options);
+    if (!profile.AddRecords(trace)) {
+        return 1;
+    }
+    if (profile.sample_count() == 0) {
+        fprintf(stderr, "warning: no profiler samples found; was ktrace group %#x enabled?\n",
+                KTRACE_GRP_PROFILE);
+    }
+
+    if (options.context_path != nullptr) {
+        std::vector<uint8_t> context;
+        if (!ReadFile(options.context_path, &context)) {
+            return 1;
+        }
+        fwrite(context.data(), 1, context.size(), stdout);
+        if (!context.empty() && context.back() != '\n') {
+            fputc('\n', stdout);
+        }
+    }
+    profile.Print(stdout);
+    return 0;
+}
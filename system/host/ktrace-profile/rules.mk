@@ -0,0 +1,19 @@
+# Copyright 2019 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := hostapp
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/ktrace-profile.cpp
+
+MODULE_HEADER_DEPS := \
+    system/ulib/zircon-internal \
+
+MODULE_PACKAGE := bin
+
+include make/module.mk
@@ -30,6 +30,7 @@ MODULE_HOST_LIBS := \
     system/ulib/fbl.hostlib \
     system/ulib/fs.hostlib \
     system/ulib/minfs.hostlib \
+    third_party/ulib/cksum.hostlib \
     system/ulib/fs-host.hostlib \
 
 MODULE_PACKAGE := bin
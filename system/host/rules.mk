@@ -15,6 +15,7 @@ HOSTAPPS := \
     $(LOCAL_DIR)/fvm/rules.mk \
     $(LOCAL_DIR)/h2md/rules.mk \
     $(LOCAL_DIR)/kernel-buildsig/rules.mk \
+    $(LOCAL_DIR)/ktrace-profile/rules.mk \
     $(LOCAL_DIR)/loglistener/rules.mk \
     $(LOCAL_DIR)/merkleroot/rules.mk \
     $(LOCAL_DIR)/minfs/rules.mk \
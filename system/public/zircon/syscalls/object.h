@@ -36,6 +36,8 @@ typedef uint32_t zx_object_info_topic_t;
 #define ZX_INFO_PROCESS_HANDLE_STATS    ((zx_object_info_topic_t) 21u) // zx_info_process_handle_stats_t[1]
 #define ZX_INFO_SOCKET                  ((zx_object_info_topic_t) 22u) // zx_info_socket_t[1]
 #define ZX_INFO_VMO                     ((zx_object_info_topic_t) 23u) // zx_info_vmo_t[1]
+#define ZX_INFO_VMO_RECLAIM             ((zx_object_info_topic_t) 24u) // zx_info_vmo_reclaim_t[1]
+#define ZX_INFO_LOCK_STATS              ((zx_object_info_topic_t) 25u) // zx_info_lock_stats_t[n]
 
 typedef uint32_t zx_obj_props_t;
 #define ZX_OBJ_PROP_NONE                ((zx_obj_props_t)0u)
@@ -319,6 +321,24 @@ typedef struct zx_info_vmo {
     uint32_t cache_policy;
 } zx_info_vmo_t;
 
+// Describes how the pages of a VMO backed by a pager are aged and reclaimed.
+typedef struct zx_info_vmo_reclaim {
+    // Memory held by pages that were accessed recently.
+    uint64_t active_bytes;
+
+    // Memory held by pages that have not been accessed for a while, and which
+    // may be evicted if the system runs low on memory.
+    uint64_t inactive_bytes;
+
+    // Memory held by pages that may have been written to since the pager
+    // supplied them. These are never evicted.
+    uint64_t modified_bytes;
+
+    // Total memory evicted from this VMO so far. Evicted pages are requested
+    // from the pager again the next time they are accessed.
+    uint64_t evicted_bytes;
+} zx_info_vmo_reclaim_t;
+
 // kernel statistics per cpu
 // TODO(cpu), expose the deprecated stats via a new syscall.
 typedef struct zx_info_cpu_stats {
@@ -387,6 +407,45 @@ typedef struct zx_info_kmem_stats {
     uint64_t other_bytes;
 } zx_info_kmem_stats_t;
 
+#define ZX_LOCK_STATS_NAME_LEN 96
+#define ZX_LOCK_STATS_CALL_SITES 4
+
+// A kernel code location that waited for a lock.
+typedef struct zx_lock_stats_call_site {
+    // Return address of the kernel function that acquired the lock.
+    uint64_t caller;
+
+    // Number of contended acquisitions made from |caller|.
+    uint64_t contentions;
+
+    // Total time |caller| spent waiting in contended acquisitions.
+    zx_duration_t total_wait;
+} zx_lock_stats_call_site_t;
+
+// Statistics of one class of kernel locks, summed across all cpus.
+typedef struct zx_info_lock_stats {
+    // The name of the lock class, truncated to fit.
+    char name[ZX_LOCK_STATS_NAME_LEN];
+
+    // Number of times a lock of this class was acquired.
+    uint64_t acquisitions;
+
+    // Number of acquisitions that had to wait for the lock.
+    uint64_t contentions;
+
+    // Total and longest time spent waiting by contended acquisitions.
+    zx_duration_t total_wait;
+    zx_duration_t max_wait;
+
+    // Total and longest time the lock was held.
+    zx_duration_t total_hold;
+    zx_duration_t max_hold;
+
+    // The code locations that waited the longest for the lock, longest first.
+    // Unused entries have a |caller| of zero.
+    zx_lock_stats_call_site_t call_sites[ZX_LOCK_STATS_CALL_SITES];
+} zx_info_lock_stats_t;
+
 typedef struct zx_info_resource {
     // The resource kind; resource object kinds are detailed in the resource.md
     uint32_t kind;
@@ -12,6 +12,7 @@ __BEGIN_CDECLS
 // clang-format off
 
 #define ZX_PROFILE_INFO_SCHEDULER   1
+#define ZX_PROFILE_INFO_DEADLINE    2
 
 typedef struct zx_profile_scheduler {
     int32_t priority;
@@ -26,6 +27,18 @@ typedef struct zx_profile_scheduler {
 #define ZX_PRIORITY_HIGH                24
 #define ZX_PRIORITY_HIGHEST             31
 
+// Parameters of the deadline scheduling class: every |period| the thread is
+// guaranteed |capacity| of cpu time within |relative_deadline| of the start of
+// the period, provided 0 < capacity <= relative_deadline <= period and
+// period <= ZX_PROFILE_DEADLINE_MAX_PERIOD.
+typedef struct zx_profile_deadline {
+    zx_duration_t capacity;
+    zx_duration_t relative_deadline;
+    zx_duration_t period;
+} zx_profile_deadline_t;
+
+#define ZX_PROFILE_DEADLINE_MAX_PERIOD  ZX_SEC(1)
+
 typedef struct zx_profile_info {
     uint32_t type;                  // one of ZX_PROFILE_INFO_
     union {
@@ -33,5 +46,14 @@ typedef struct zx_profile_info {
     };
 } zx_profile_info_t;
 
+// The parameters of a deadline profile don't fit in zx_profile_info_t, so it
+// is described by this struct instead, whose address is passed to
+// zx_profile_create() in place of a zx_profile_info_t.
+typedef struct zx_profile_deadline_info {
+    uint32_t type;                  // ZX_PROFILE_INFO_DEADLINE
+    uint32_t reserved;              // must be zero
+    zx_profile_deadline_t deadline;
+} zx_profile_deadline_info_t;
+
 
 __END_CDECLS
@@ -205,6 +205,7 @@ typedef struct zx_wait_item {
 
 // VM Object creation options
 #define ZX_VMO_NON_RESIZABLE             ((uint32_t)1u)
+#define ZX_VMO_LARGE_PAGES               ((uint32_t)1u << 1)
 
 // VM Object opcodes
 #define ZX_VMO_OP_COMMIT                 ((uint32_t)1u)
@@ -217,6 +218,12 @@ typedef struct zx_wait_item {
 #define ZX_VMO_OP_CACHE_CLEAN            ((uint32_t)8u)
 #define ZX_VMO_OP_CACHE_CLEAN_INVALIDATE ((uint32_t)9u)
 
+// VM Address Region opcodes
+#define ZX_VMAR_OP_COMMIT                ((uint32_t)1u)
+#define ZX_VMAR_OP_DECOMMIT              ((uint32_t)2u)
+#define ZX_VMAR_OP_MAP_RANGE             ((uint32_t)3u)
+#define ZX_VMAR_OP_WILLNEED              ((uint32_t)4u)
+
 // VM Object clone flags
 #define ZX_VMO_CLONE_COPY_ON_WRITE        ((uint32_t)1u << 0)
 #define ZX_VMO_CLONE_NON_RESIZEABLE       ((uint32_t)1u << 1)
@@ -293,11 +300,28 @@ typedef uint64_t zx_off_t;
 #define ZX_SOCKET_DATAGRAM                  ((uint32_t)1u << 0)
 #define ZX_SOCKET_HAS_CONTROL               ((uint32_t)1u << 1)
 #define ZX_SOCKET_HAS_ACCEPT                ((uint32_t)1u << 2)
-#define ZX_SOCKET_CREATE_MASK               (ZX_SOCKET_DATAGRAM | ZX_SOCKET_HAS_CONTROL | ZX_SOCKET_HAS_ACCEPT)
+#define ZX_SOCKET_SHARED_RING               ((uint32_t)1u << 3)
+#define ZX_SOCKET_CREATE_MASK               (ZX_SOCKET_DATAGRAM | ZX_SOCKET_HAS_CONTROL | ZX_SOCKET_HAS_ACCEPT | \
+                                             ZX_SOCKET_SHARED_RING)
 
 // These can be passed to zx_socket_read() and zx_socket_write().
 #define ZX_SOCKET_CONTROL                   ((uint32_t)1u << 2)
 
+// These can be passed to zx_socket_ring_vmo() and zx_socket_ring_advance().
+#define ZX_SOCKET_RING_RX                   ((uint32_t)1u << 0)
+#define ZX_SOCKET_RING_TX                   ((uint32_t)1u << 1)
+
+// The indices of a ZX_SOCKET_SHARED_RING socket's ring, as stream offsets.
+// The byte at stream offset n is stored at n % size in the ring's VMO.
+typedef struct zx_socket_ring_state {
+    // Stream offset of the first byte not yet read.
+    uint64_t head;
+    // Stream offset one past the last byte written.
+    uint64_t tail;
+    // Size of the ring in bytes, a power of two.
+    uint64_t size;
+} zx_socket_ring_state_t;
+
 // Flags which can be used to to control cache policy for APIs which map memory.
 #define ZX_CACHE_POLICY_CACHED              ((uint32_t)0u)
 #define ZX_CACHE_POLICY_UNCACHED            ((uint32_t)1u)
@@ -99,6 +99,8 @@ int usage() {
             "\n"
             "options: -r|--readonly  Mount filesystem read-only\n"
             "         -m|--metrics   Collect filesystem metrics\n"
+            "         -p|--pager     Read blobs from disk as they are accessed\n"
+            "         -z|--lz4-frame Compress new blobs as a single LZ4 frame\n"
             "         -h|--help      Display this message\n"
             "\n"
             "On Fuchsia, blobfs takes the block device argument by handle.\n"
@@ -120,11 +122,13 @@ int ProcessArgs(int argc, char** argv, CommandFunction* func, blobfs::MountOptio
             {"readonly", no_argument, nullptr, 'r'},
             {"metrics", no_argument, nullptr, 'm'},
             {"journal", no_argument, nullptr, 'j'},
+            {"pager", no_argument, nullptr, 'p'},
+            {"lz4-frame", no_argument, nullptr, 'z'},
             {"help", no_argument, nullptr, 'h'},
             {nullptr, 0, nullptr, 0},
         };
         int opt_index;
-        int c = getopt_long(argc, argv, "rmjh", opts, &opt_index);
+        int c = getopt_long(argc, argv, "rmjpzh", opts, &opt_index);
         if (c < 0) {
             break;
         }
@@ -138,6 +142,12 @@ int ProcessArgs(int argc, char** argv, CommandFunction* func, blobfs::MountOptio
         case 'j':
             options->journal = true;
             break;
+        case 'p':
+            options->pager = true;
+            break;
+        case 'z':
+            options->lz4_frame = true;
+            break;
         case 'h':
         default:
             return usage();
@@ -34,8 +34,14 @@ struct TestArgs {
     uint32_t size;
     uint32_t handles;
     uint32_t queue;
+    // Offset of the message buffer from a page boundary.  The kernel can move
+    // the pages of large messages into a page aligned read buffer instead of
+    // copying them, so a nonzero offset measures the copying path.
+    uint32_t misalign;
 };
 
+constexpr size_t kPageSize = 4096;
+
 void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     __UNUSED zx_status_t status;
 
@@ -52,9 +58,13 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     assert(status == ZX_OK);
 
     // Storage space for our messages' stuff.
-    fbl::unique_ptr<uint8_t[]> data;
+    void* data_storage = nullptr;
+    uint8_t* data = nullptr;
     if (test_args.size) {
-        data.reset(new uint8_t[test_args.size]);
+        data_storage = aligned_alloc(kPageSize, fbl::round_up(test_args.size + test_args.misalign,
+                                                              kPageSize));
+        assert(data_storage);
+        data = static_cast<uint8_t*>(data_storage) + test_args.misalign;
         for (uint32_t i = 0; i < test_args.size; i++)
             data[i] = static_cast<uint8_t>(i);
     }
@@ -65,7 +75,7 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     // Pre-queue |test_args.queue| messages (there'll always be this many messages in the queue).
     for (uint32_t i = 0; i < test_args.queue; i++) {
         duplicate_handles(test_args.handles, event, handles.get());
-        status = zx_channel_write(mp[0], 0u, data.get(), test_args.size,
+        status = zx_channel_write(mp[0], 0u, data, test_args.size,
                                   handles.get(), test_args.handles);
         assert(status == ZX_OK);
     }
@@ -79,13 +89,13 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     for (;;) {
         big_its++;
         for (uint32_t i = 0; i < big_it_size; i++) {
-            status = zx_channel_write(mp[0], 0, data.get(), test_args.size,
+            status = zx_channel_write(mp[0], 0, data, test_args.size,
                                       handles.get(), test_args.handles);
             assert(status == ZX_OK);
 
             uint32_t r_size = test_args.size;
             uint32_t r_handles = test_args.handles;
-            status = zx_channel_read(mp[1], 0u, data.get(), handles.get(), r_size,
+            status = zx_channel_read(mp[1], 0u, data, handles.get(), r_size,
                                      r_handles, &r_size, &r_handles);
             assert(status == ZX_OK);
             assert(r_size == test_args.size);
@@ -107,12 +117,15 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     assert(status == ZX_OK);
     status = zx_handle_close(mp[1]);
     assert(status == ZX_OK);
+    free(data_storage);
 
     double real_duration = static_cast<double>(zx_time_sub_time(end_ns, start_ns)) / 1000000000.0;
     double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
-    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
-               "%.0f iterations/second\n",
-           test_args.size, test_args.handles, test_args.queue, its_per_second);
+    double mib_per_second = its_per_second * test_args.size / (1024.0 * 1024.0);
+    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued, "
+               "buffer offset %" PRIu32 "): %.0f iterations/second, %.1f MiB/second\n",
+           test_args.size, test_args.handles, test_args.queue, test_args.misalign,
+           its_per_second, mib_per_second);
 }
 
 }  // namespace
@@ -129,7 +142,8 @@ int main(int argc, char** argv) {
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -A N  offset the message buffer N bytes from a page boundary (default: 0)\n";
 
     bool run_suite = false;  // -o/-s
     uint32_t duration = 5;   // -d
@@ -138,11 +152,12 @@ int main(int argc, char** argv) {
     TestArgs test_args = {
         10,                  // -S (size)
         0,                   // -H (handles)
-        0                    // -Q (queue)
+        0,                   // -Q (queue)
+        0                    // -A (misalign)
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:A:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -184,6 +199,10 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'A':
+                assert(optarg);
+                test_args.misalign = value;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -202,21 +221,31 @@ int main(int argc, char** argv) {
 
         if (run_suite) {
             static constexpr TestArgs suite[] = {
-                {10, 0, 0},
-                {100, 0, 0},
-                {1000, 0, 0},
-                {10, 1, 0},
-                {100, 1, 0},
-                {1000, 1, 0},
-                {10, 2, 0},
-                {100, 2, 0},
-                {1000, 2, 0},
-                {10, 5, 0},
-                {100, 5, 0},
-                {1000, 5, 0},
-                {10, 0, 1},
-                {100, 0, 1},
-                {1000, 0, 1},
+                {10, 0, 0, 0},
+                {100, 0, 0, 0},
+                {1000, 0, 0, 0},
+                {10, 1, 0, 0},
+                {100, 1, 0, 0},
+                {1000, 1, 0, 0},
+                {10, 2, 0, 0},
+                {100, 2, 0, 0},
+                {1000, 2, 0, 0},
+                {10, 5, 0, 0},
+                {100, 5, 0, 0},
+                {1000, 5, 0, 0},
+                {10, 0, 1, 0},
+                {100, 0, 1, 0},
+                {1000, 0, 1, 0},
+                // Large messages, read into page aligned buffers (pages may be
+                // moved) and into unaligned buffers (always copied).
+                {4096, 0, 0, 0},
+                {4096, 0, 0, 64},
+                {16384, 0, 0, 0},
+                {16384, 0, 0, 64},
+                {32768, 0, 0, 0},
+                {32768, 0, 0, 64},
+                {65536, 0, 0, 0},
+                {65536, 0, 0, 64},
             };
             for (size_t i = 0; i < fbl::count_of(suite); i++)
                 do_test(duration, suite[i]);
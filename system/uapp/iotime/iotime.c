@@ -54,7 +54,9 @@ static void bytes_per_second(uint64_t bytes, uint64_t nanos) {
     fprintf(stderr, "%g %s/s\n", rate, unit);
 }
 
-static zx_duration_t iotime_posix(int is_read, int fd, size_t total, size_t bufsz) {
+// When |sync| is set, the time taken to flush written data to the device is
+// included: filesystems may otherwise defer most of the work of a write.
+static zx_duration_t iotime_posix(int is_read, int fd, size_t total, size_t bufsz, int sync) {
     void* buffer = malloc(bufsz);
     if (buffer == NULL) {
         fprintf(stderr, "error: out of memory\n");
@@ -77,6 +79,10 @@ static zx_duration_t iotime_posix(int is_read, int fd, size_t total, size_t bufs
         }
         n -= xfer;
     }
+    if (sync && fsync(fd) < 0) {
+        fprintf(stderr, "error: fsync() error %d\n", errno);
+        return ZX_TIME_INFINITE;
+    }
     zx_time_t t1 = zx_clock_get_monotonic();
 
     return zx_time_sub_time(t1, t0);
@@ -98,7 +104,7 @@ static zx_duration_t iotime_block(int is_read, int fd, size_t total, size_t bufs
         return ZX_TIME_INFINITE;
     }
 
-    return iotime_posix(is_read, fd, total, bufsz);
+    return iotime_posix(is_read, fd, total, bufsz, 0);
 }
 
 static zx_duration_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_t bufsz) {
@@ -167,7 +173,9 @@ static int usage(void) {
     fprintf(stderr,
             "usage: iotime <read|write> <posix|block|fifo> <device|--ramdisk> <bytes> <bufsize>\n\n"
             "        <bytes> and <bufsize> must be a multiple of 4k for block mode\n"
-            "        --ramdisk only supported for block mode\n");
+            "        --ramdisk only supported for block mode\n"
+            "        posix mode creates the file to write if needed, and includes the\n"
+            "        time to fsync it\n");
     return -1;
 }
 
@@ -192,7 +200,11 @@ int main(int argc, char** argv) {
             return -1;
         }
     } else {
-        if ((fd = open(argv[3], is_read ? O_RDONLY : O_WRONLY)) < 0) {
+        int flags = is_read ? O_RDONLY : O_WRONLY;
+        if (!is_read && !strcmp(argv[2], "posix")) {
+            flags |= O_CREAT;
+        }
+        if ((fd = open(argv[3], flags, 0644)) < 0) {
             fprintf(stderr, "error: cannot open '%s'\n", argv[3]);
             return -1;
         }
@@ -200,7 +212,7 @@ int main(int argc, char** argv) {
 
     zx_duration_t res;
     if (!strcmp(argv[2], "posix")) {
-        res = iotime_posix(is_read, fd, total, bufsz);
+        res = iotime_posix(is_read, fd, total, bufsz, !is_read);
     } else if (!strcmp(argv[2], "block")) {
         res = iotime_block(is_read, fd, total, bufsz);
     } else if (!strcmp(argv[2], "fifo")) {
@@ -0,0 +1,221 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/algorithm.h>
+#include <inttypes.h>
+#include <lib/zx/channel.h>
+#include <lib/zx/port.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/port.h>
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "stress_test.h"
+
+class IpcStressTest : public StressTest {
+public:
+    IpcStressTest() = default;
+    virtual ~IpcStressTest() = default;
+
+    virtual zx_status_t Start();
+    virtual zx_status_t Stop();
+
+    virtual const char* name() const { return "IPC Stress"; }
+
+private:
+    int stress_thread();
+
+    // Dequeues up to |count| packets from |port| without blocking, and
+    // counts the user packets among them.
+    void Drain(const zx::port& port, size_t count);
+
+    thrd_t threads_[16]{};
+
+    // Shared by all the worker threads, so that packets and observers are
+    // routinely allocated on one cpu and freed on another.
+    zx::port ports_[4];
+
+    // used by the worker threads at runtime
+    std::atomic<bool> shutdown_{false};
+    std::atomic<uint64_t> user_queued_{0};
+    std::atomic<uint64_t> user_dequeued_{0};
+};
+
+// our singleton
+IpcStressTest ipcstress;
+
+void IpcStressTest::Drain(const zx::port& port, size_t count) {
+    zx_port_packet_t packets[16];
+    while (count > 0) {
+        size_t actual;
+        zx_status_t status = zx_port_wait_many(port.get(), 0, packets,
+                                               fbl::min(count, fbl::count_of(packets)), &actual);
+        if (status != ZX_OK) {
+            return;
+        }
+        for (size_t i = 0; i < actual; i++) {
+            if (packets[i].type == ZX_PKT_TYPE_USER) {
+                user_dequeued_.fetch_add(1);
+            }
+        }
+        count -= actual;
+    }
+}
+
+// IPC Stresser
+//
+// The worker threads churn the kernel objects allocated on every IPC through
+// a few shared ports: they queue user packets on one port while other threads
+// drain it, arm async waits on their own channels that fire into, are
+// canceled from, or are torn down with the channel while bound to a shared
+// port, and write and read channel messages. Run with the kernel.slab.*
+// kcounters (see the kcounter tool) to watch the per-cpu slab caches backing
+// port packets and observers.
+//
+// Every user packet queued has to be dequeued exactly once, which is checked
+// when the test stops.
+int IpcStressTest::stress_thread() {
+    zx::channel ch0, ch1;
+    zx_status_t status = zx::channel::create(0, &ch0, &ch1);
+    if (status != ZX_OK) {
+        fprintf(stderr, "failed to create channel, error %d (%s)\n", status, zx_status_get_string(status));
+        return 0;
+    }
+
+    uint64_t key = 0;
+    while (!shutdown_.load()) {
+        const zx::port& port = ports_[rand() % fbl::count_of(ports_)];
+        int r = rand() % 100;
+        switch (r) {
+        case 0 ... 29: {
+            // queue a burst of user packets for any thread to drain
+            Printf("q");
+            const int count = rand() % 64 + 1;
+            for (int i = 0; i < count; i++) {
+                zx_port_packet_t packet{};
+                packet.key = key++;
+                packet.type = ZX_PKT_TYPE_USER;
+                if (port.queue(&packet) == ZX_OK) {
+                    user_queued_.fetch_add(1);
+                }
+            }
+            break;
+        }
+        case 30 ... 54: {
+            // drain packets, most of them queued by other threads
+            Printf("d");
+            Drain(port, rand() % 128 + 1);
+            break;
+        }
+        case 55 ... 69: {
+            // write a message and read it back
+            Printf("c");
+            uint32_t msg = static_cast<uint32_t>(r);
+            status = ch0.write(0, &msg, sizeof(msg), nullptr, 0);
+            if (status != ZX_OK) {
+                fprintf(stderr, "error writing to channel\n");
+                break;
+            }
+            uint32_t actual_bytes;
+            ch1.read(0, &msg, sizeof(msg), &actual_bytes, nullptr, 0, nullptr);
+            break;
+        }
+        case 70 ... 89: {
+            // arm an async wait, and sometimes fire it right away; whoever
+            // drains the port frees the packet
+            Printf("w");
+            const uint32_t options = (r % 3) ? ZX_WAIT_ASYNC_ONCE : ZX_WAIT_ASYNC_REPEATING;
+            status = ch1.wait_async(port, key++, ZX_CHANNEL_READABLE, options);
+            if (status != ZX_OK) {
+                fprintf(stderr, "error waiting on channel\n");
+                break;
+            }
+            if (r % 2) {
+                uint32_t msg = 0;
+                uint32_t actual_bytes;
+                ch0.write(0, &msg, sizeof(msg), nullptr, 0);
+                ch1.read(0, &msg, sizeof(msg), &actual_bytes, nullptr, 0, nullptr);
+            }
+            break;
+        }
+        case 90 ... 94: {
+            // cancel the waits armed with the last few keys, queued or not
+            Printf("x");
+            for (uint64_t k = key > 8 ? key - 8 : 0; k < key; k++) {
+                for (const auto& p : ports_) {
+                    zx_port_cancel(p.get(), ch1.get(), k);
+                }
+            }
+            break;
+        }
+        case 95 ... 99: {
+            // close the channel with waits still armed, and start over
+            Printf("r");
+            ch0.reset();
+            ch1.reset();
+            status = zx::channel::create(0, &ch0, &ch1);
+            if (status != ZX_OK) {
+                fprintf(stderr, "failed to create channel, error %d (%s)\n", status,
+                        zx_status_get_string(status));
+                return 0;
+            }
+            break;
+        }
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+
+zx_status_t IpcStressTest::Start() {
+    for (auto& port : ports_) {
+        zx_status_t status = zx::port::create(0, &port);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    // create a pile of threads
+    auto worker = [](void* arg) -> int {
+        IpcStressTest* test = static_cast<IpcStressTest*>(arg);
+        return test->stress_thread();
+    };
+
+    for (auto& t : threads_) {
+        thrd_create_with_name(&t, worker, this, "ipcstress_worker");
+    }
+
+    return ZX_OK;
+}
+
+zx_status_t IpcStressTest::Stop() {
+    shutdown_.store(true);
+
+    for (auto& t : threads_) {
+        thrd_join(t, nullptr);
+    }
+
+    // Take whatever is left, then see that no user packet went missing or
+    // was returned twice.
+    for (auto& port : ports_) {
+        Drain(port, SIZE_MAX);
+        port.reset();
+    }
+
+    const uint64_t queued = user_queued_.load();
+    const uint64_t dequeued = user_dequeued_.load();
+    PrintfAlways("IPC stress test: %" PRIu64 " user packets queued, %" PRIu64 " dequeued\n",
+                 queued, dequeued);
+    if (queued != dequeued) {
+        fprintf(stderr, "IPC stress test: user packet count mismatch\n");
+        return ZX_ERR_INTERNAL;
+    }
+
+    return ZX_OK;
+}
@@ -83,6 +83,7 @@ int usage() {
                     "    -v|--verbose                  Some debug messages\n"
                     "    -r|--readonly                 Mount filesystem read-only\n"
                     "    -m|--metrics                  Collect filesystem metrics\n"
+                    "    -j|--journal                  Write metadata through the journal\n"
                     "    -s|--fvm_data_slices SLICES   When mkfs on top of FVM,\n"
                     "                                  preallocate |SLICES| slices of data. \n"
                     "    -h|--help                     Display this message\n"
@@ -139,9 +140,8 @@ int main(int argc, char** argv) {
             options.metrics = true;
             break;
         case 'j':
-            //TODO(planders): Enable journaling here once minfs supports it.
-            fprintf(stderr, "minfs: Journaling option not supported\n");
-            return usage();
+            options.journal = true;
+            break;
         case 'v':
             options.verbose = true;
             break;
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <zircon/assert.h>
 #include <zircon/listnode.h>
@@ -26,6 +27,9 @@
 // The port wait key associated with the dispatcher's control messages.
 #define KEY_CONTROL (0u)
 
+// The maximum number of packets read from the port per zx_port_wait_many() call.
+#define PACKET_BATCH (16u)
+
 static zx_time_t async_loop_now(async_dispatcher_t* dispatcher);
 static zx_status_t async_loop_begin_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
 static zx_status_t async_loop_cancel_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
@@ -90,9 +94,18 @@ typedef struct async_loop {
     list_node_t due_list; // due tasks, earliest deadline first
     list_node_t thread_list; // earliest created thread first
     list_node_t exception_list; // most recently added first
+
+    // Packets read from the port in a batch but not yet dispatched, oldest
+    // first. Each call to |async_loop_run_once| still dispatches one packet.
+    zx_port_packet_t pending[PACKET_BATCH - 1u];
+    size_t pending_head;
+    size_t pending_count;
 } async_loop_t;
 
 static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline);
+static zx_status_t async_loop_next_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* out_packet);
+static bool async_loop_drop_pending_locked(async_loop_t* loop, uint64_t key);
 static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wait,
                                             zx_status_t status, const zx_packet_signal_t* signal);
 static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop);
@@ -254,7 +267,7 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
         return ZX_ERR_CANCELED;
 
     zx_port_packet_t packet;
-    zx_status_t status = zx_port_wait(loop->port, deadline, &packet);
+    zx_status_t status = async_loop_next_packet(loop, deadline, &packet);
     if (status != ZX_OK)
         return status;
 
@@ -303,6 +316,59 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
     return ZX_ERR_INTERNAL;
 }
 
+// Returns the next packet to dispatch, reading a batch of packets from the
+// port when none are pending.
+static zx_status_t async_loop_next_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* out_packet) {
+    mtx_lock(&loop->lock);
+    if (loop->pending_count) {
+        *out_packet = loop->pending[loop->pending_head++];
+        loop->pending_count--;
+        mtx_unlock(&loop->lock);
+        return ZX_OK;
+    }
+    mtx_unlock(&loop->lock);
+
+    // Only batch when this is the only thread running the loop.  Packets held
+    // in |pending| can't be picked up by other threads blocked on the port,
+    // and this also means at most one thread refills |pending| at a time.
+    zx_port_packet_t packets[PACKET_BATCH];
+    size_t count = 1u;
+    if (atomic_load_explicit(&loop->active_threads, memory_order_acquire) == 1u)
+        count = PACKET_BATCH;
+
+    size_t actual;
+    zx_status_t status = zx_port_wait_many(loop->port, deadline, packets, count, &actual);
+    if (status != ZX_OK)
+        return status;
+
+    *out_packet = packets[0];
+    if (actual > 1u) {
+        mtx_lock(&loop->lock);
+        ZX_DEBUG_ASSERT(loop->pending_count == 0u);
+        loop->pending_head = 0u;
+        loop->pending_count = actual - 1u;
+        memcpy(loop->pending, &packets[1], loop->pending_count * sizeof(zx_port_packet_t));
+        mtx_unlock(&loop->lock);
+    }
+    return ZX_OK;
+}
+
+// Discards pending packets with the given key, which were read from the port
+// before their wait or exception port was cancelled.  Returns true if any were
+// discarded.
+static bool async_loop_drop_pending_locked(async_loop_t* loop, uint64_t key) {
+    size_t end = loop->pending_head + loop->pending_count;
+    size_t kept = loop->pending_head;
+    for (size_t i = loop->pending_head; i < end; i++) {
+        if (loop->pending[i].key != key)
+            loop->pending[kept++] = loop->pending[i];
+    }
+    bool dropped = kept != end;
+    loop->pending_count = kept - loop->pending_head;
+    return dropped;
+}
+
 async_dispatcher_t* async_loop_get_dispatcher(async_loop_t* loop) {
     // Note: The loop's implementation inherits from async_t so we can upcast to it.
     return (async_dispatcher_t*)loop;
@@ -520,9 +586,13 @@ static zx_status_t async_loop_cancel_wait(async_dispatcher_t* async, async_wait_
 
     // Next, cancel the wait.  This may be racing with another thread that
     // has read the wait's packet but not yet dispatched it.  So if we fail
-    // to cancel then we assume we lost the race.
+    // to cancel then we assume we lost the race, unless the packet is still
+    // pending in this loop.
     zx_status_t status = zx_port_cancel(loop->port, wait->object,
                                         (uintptr_t)wait);
+    if (status == ZX_ERR_NOT_FOUND &&
+        async_loop_drop_pending_locked(loop, (uintptr_t)wait))
+        status = ZX_OK;
     if (status == ZX_OK) {
         list_delete(node);
     } else {
@@ -675,6 +745,7 @@ static zx_status_t async_loop_unbind_exception_port(async_dispatcher_t* async,
                                                      ZX_HANDLE_INVALID, key, 0);
 
     if (status == ZX_OK) {
+        async_loop_drop_pending_locked(loop, key);
         list_delete(node);
     }
 
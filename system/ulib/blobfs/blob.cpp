@@ -138,7 +138,7 @@ zx_status_t Blob::InitVmos() {
         return status;
     }
 
-    if ((inode_.header.flags & kBlobFlagLZ4Compressed) != 0) {
+    if ((inode_.header.flags & kBlobFlagMaskAnyCompression) != 0) {
         if ((status = InitCompressed()) != ZX_OK) {
             return status;
         }
@@ -155,6 +155,33 @@ zx_status_t Blob::InitVmos() {
     return ZX_OK;
 }
 
+bool Blob::UsePager() const {
+    return blobfs_->GetPager() != nullptr && !mapping_.vmo();
+}
+
+zx_status_t Blob::InitPagedVmo() {
+    TRACE_DURATION("blobfs", "Blobfs::InitPagedVmo");
+
+    if (page_source_) {
+        return ZX_OK;
+    }
+
+    fbl::RefPtr<PageSource> source;
+    zx_status_t status = PageSource::Create(blobfs_->GetPager(), blobfs_,
+                                            blobfs_->GetAllocator(), GetMapIndex(), inode_,
+                                            &source);
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("Failed to initialize paged vmo; error: %d\n", status);
+        return status;
+    }
+    if ((status = paged_mapping_.Map(source->vmo(), 0, 0, ZX_VM_PERM_READ)) != ZX_OK) {
+        source->Detach();
+        return status;
+    }
+    page_source_ = std::move(source);
+    return ZX_OK;
+}
+
 zx_status_t Blob::InitCompressed() {
     TRACE_DURATION("blobfs", "Blobfs::InitCompressed", "size", inode_.blob_size, "blocks",
                    inode_.block_count);
@@ -223,8 +250,13 @@ zx_status_t Blob::InitCompressed() {
 
     // Decompress the compressed data into the target buffer.
     size_t target_size = inode_.blob_size;
-    status = Decompressor::Decompress(GetData(), &target_size, compressed_mapper.start(),
-                                      &compressed_size);
+    if (inode_.header.flags & kBlobFlagChunkCompressed) {
+        status = ChunkedDecompressor::Decompress(GetData(), target_size,
+                                                 compressed_mapper.start(), compressed_size);
+    } else {
+        status = Decompressor::Decompress(GetData(), &target_size, compressed_mapper.start(),
+                                          &compressed_size);
+    }
     if (status != ZX_OK) {
         FS_TRACE_ERROR("Failed to decompress data: %d\n", status);
         return status;
@@ -354,13 +386,21 @@ zx_status_t Blob::SpaceAllocate(uint64_t size_data) {
     }
 
     if (inode_.blob_size >= kCompressionMinBytesSaved) {
-        size_t max = Compressor::BufferMax(inode_.blob_size);
+        const bool lz4_frame = blobfs_->UseLZ4Frame();
+        size_t max = lz4_frame ? Compressor::BufferMax(inode_.blob_size) :
+                                 ChunkedCompressor::BufferMax(inode_.blob_size);
         status = write_info->compressed_blob.CreateAndMap(max, "compressed-blob");
         if (status != ZX_OK) {
             return status;
         }
-        status = write_info->compressor.Initialize(write_info->compressed_blob.start(),
-                                                   write_info->compressed_blob.size());
+        if (lz4_frame) {
+            status = write_info->compressor.Initialize(write_info->compressed_blob.start(),
+                                                       write_info->compressed_blob.size());
+        } else {
+            status = write_info->chunked_compressor.Initialize(
+                write_info->compressed_blob.start(), write_info->compressed_blob.size(),
+                inode_.blob_size);
+        }
         if (status != ZX_OK) {
             FS_TRACE_ERROR("blobfs: Failed to initialize compressor: %d\n", status);
             return status;
@@ -461,7 +501,7 @@ zx_status_t Blob::WriteMetadata() {
         ZX_ASSERT(populator.Walk(on_node, on_extent) == ZX_OK);
 
         // Ensure all non-allocation flags are propagated to the inode.
-        mapped_inode->header.flags |= (inode_.header.flags & kBlobFlagLZ4Compressed);
+        mapped_inode->header.flags |= (inode_.header.flags & kBlobFlagMaskAnyCompression);
     } else {
         // Special case: Empty node.
         ZX_DEBUG_ASSERT(write_info_->node_indices.size() == 1);
@@ -501,8 +541,8 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
         *actual = to_write;
         write_info_->bytes_written += to_write;
 
-        if (write_info_->compressor.Compressing()) {
-            if ((status = write_info_->compressor.Update(data, to_write)) != ZX_OK) {
+        if (write_info_->Compressing()) {
+            if ((status = write_info_->UpdateCompression(data, to_write)) != ZX_OK) {
                 return status;
             }
             ConsiderCompressionAbort();
@@ -530,8 +570,8 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
             SetState(kBlobStateError);
         });
 
-        if (write_info_->compressor.Compressing()) {
-            if ((status = write_info_->compressor.End()) != ZX_OK) {
+        if (write_info_->Compressing()) {
+            if ((status = write_info_->EndCompression()) != ZX_OK) {
                 return status;
             }
             ConsiderCompressionAbort();
@@ -580,9 +620,9 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
             return status;
         }
 
-        if (write_info_->compressor.Compressing()) {
+        if (write_info_->Compressing()) {
             uint64_t blocks64 =
-                fbl::round_up(write_info_->compressor.Size(), kBlobfsBlockSize) / kBlobfsBlockSize;
+                fbl::round_up(write_info_->CompressedSize(), kBlobfsBlockSize) / kBlobfsBlockSize;
             ZX_DEBUG_ASSERT(blocks64 <= std::numeric_limits<uint32_t>::max());
             uint32_t blocks = static_cast<uint32_t>(blocks64);
             int64_t vmo_bias = -static_cast<int64_t>(merkle_blocks);
@@ -603,7 +643,7 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
             ZX_DEBUG_ASSERT(inode_.block_count > blocks);
 
             inode_.block_count = blocks;
-            inode_.header.flags |= kBlobFlagLZ4Compressed;
+            inode_.header.flags |= write_info_->CompressionFlag();
         } else {
             uint64_t blocks64 =
                 fbl::round_up(inode_.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
@@ -641,10 +681,9 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
 }
 
 void Blob::ConsiderCompressionAbort() {
-    ZX_DEBUG_ASSERT(write_info_->compressor.Compressing());
-    if (inode_.blob_size - kCompressionMinBytesSaved < write_info_->compressor.Size()) {
-        write_info_->compressor.Reset();
-        write_info_->compressed_blob.Reset();
+    ZX_DEBUG_ASSERT(write_info_->Compressing());
+    if (inode_.blob_size - kCompressionMinBytesSaved < write_info_->CompressedSize()) {
+        write_info_->ResetCompression();
     }
 }
 
@@ -675,17 +714,29 @@ zx_status_t Blob::CloneVmo(zx_rights_t rights, zx_handle_t* out_vmo, size_t* out
     if (inode_.blob_size == 0) {
         return ZX_ERR_BAD_STATE;
     }
-    zx_status_t status = InitVmos();
-    if (status != ZX_OK) {
-        return status;
+
+    // When paged, the data is read and verified as the clone is accessed.
+    // Otherwise, all of it is read and verified before cloning.
+    zx_status_t status;
+    const zx::vmo* vmo;
+    size_t offset;
+    if (UsePager()) {
+        if ((status = InitPagedVmo()) != ZX_OK) {
+            return status;
+        }
+        vmo = &page_source_->vmo();
+        offset = 0;
+    } else {
+        if ((status = InitVmos()) != ZX_OK) {
+            return status;
+        }
+        vmo = &mapping_.vmo();
+        offset = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
     }
 
-    // TODO(smklein): Only clone / verify the part of the vmo that
-    // was requested.
-    const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
     zx::vmo clone;
-    if ((status = mapping_.vmo().clone(ZX_VMO_CLONE_COPY_ON_WRITE, merkle_bytes, inode_.blob_size,
-                                       &clone)) != ZX_OK) {
+    if ((status = vmo->clone(ZX_VMO_CLONE_COPY_ON_WRITE, offset, inode_.blob_size,
+                             &clone)) != ZX_OK) {
         return status;
     }
 
@@ -701,7 +752,7 @@ zx_status_t Blob::CloneVmo(zx_rights_t rights, zx_handle_t* out_vmo, size_t* out
     *out_size = inode_.blob_size;
 
     if (clone_watcher_.object() == ZX_HANDLE_INVALID) {
-        clone_watcher_.set_object(mapping_.vmo().get());
+        clone_watcher_.set_object(vmo->get());
         clone_watcher_.set_trigger(ZX_VMO_ZERO_CHILDREN);
 
         // Keep a reference to "this" alive, preventing the blob
@@ -722,7 +773,11 @@ void Blob::HandleNoClones(async_dispatcher_t* dispatcher, async::WaitBase* wait,
     ZX_DEBUG_ASSERT((signal->observed & ZX_VMO_ZERO_CHILDREN) != 0);
     ZX_DEBUG_ASSERT(clone_watcher_.object() != ZX_HANDLE_INVALID);
     clone_watcher_.set_object(ZX_HANDLE_INVALID);
-    clone_ref_ = nullptr;
+    fbl::RefPtr<Blob> ref = std::move(clone_ref_);
+    // A paged blob which was unlinked while it was still cloned is purged here.
+    if ((status = TryPurge()) != ZX_OK) {
+        FS_TRACE_ERROR("blobfs: Failed to purge unlinked blob: %d\n", status);
+    }
 }
 
 zx_status_t Blob::ReadInternal(void* data, size_t len, size_t off, size_t* actual) {
@@ -737,13 +792,6 @@ zx_status_t Blob::ReadInternal(void* data, size_t len, size_t off, size_t* actua
         return ZX_OK;
     }
 
-    zx_status_t status = InitVmos();
-    if (status != ZX_OK) {
-        return status;
-    }
-
-    Digest d(GetKey());
-
     if (off >= inode_.blob_size) {
         *actual = 0;
         return ZX_OK;
@@ -752,6 +800,25 @@ zx_status_t Blob::ReadInternal(void* data, size_t len, size_t off, size_t* actua
         len = inode_.blob_size - off;
     }
 
+    zx_status_t status;
+    if (UsePager()) {
+        // Page in the range before copying it, so that a corrupt blob fails
+        // the read instead of faulting blobfs.
+        if ((status = InitPagedVmo()) != ZX_OK) {
+            return status;
+        }
+        if ((status = page_source_->Populate(off, len)) != ZX_OK) {
+            return status;
+        }
+        memcpy(data, static_cast<const uint8_t*>(paged_mapping_.start()) + off, len);
+        *actual = len;
+        return ZX_OK;
+    }
+
+    if ((status = InitVmos()) != ZX_OK) {
+        return status;
+    }
+
     const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
     status = mapping_.vmo().read(data, merkle_bytes + off, len);
     if (status == ZX_OK) {
@@ -799,6 +866,11 @@ void Blob::ActivateLowMemory() {
         blobfs_->DetachVmo(vmoid_);
     }
     mapping_.Reset();
+    paged_mapping_.Unmap();
+    if (page_source_) {
+        page_source_->Detach();
+        page_source_ = nullptr;
+    }
 }
 
 Blob::~Blob() {
@@ -951,6 +1023,11 @@ fbl::RefPtr<Blob> Blob::CloneWatcherTeardown() {
     if (clone_watcher_.is_pending()) {
         clone_watcher_.Cancel();
         clone_watcher_.set_object(ZX_HANDLE_INVALID);
+        // Finish purging a paged blob which was held off by its clones.
+        zx_status_t status = TryPurge();
+        if (status != ZX_OK) {
+            FS_TRACE_ERROR("blobfs: Failed to purge unlinked blob: %d\n", status);
+        }
         return std::move(clone_ref_);
     }
     return nullptr;
@@ -983,6 +1060,12 @@ zx_status_t Blob::Purge() {
     if (GetState() == kBlobStateReadable) {
         // A readable blob should only be purged if it has been unlinked.
         ZX_ASSERT(DeletionQueued());
+        if (page_source_ && clone_watcher_.is_pending()) {
+            // Pages evicted from the clients' clones are read again from the
+            // blob's blocks, so those can't be freed yet. The blob is purged
+            // once the last clone is closed instead.
+            return ZX_OK;
+        }
         fbl::unique_ptr<WritebackWork> wb;
         zx_status_t status = blobfs_->CreateWork(&wb, this);
         if (status != ZX_OK) {
@@ -562,6 +562,10 @@ Blobfs::~Blobfs() {
 
     Cache().Reset();
 
+    // Blobs detach their VMOs from the pager as they are destroyed, and the
+    // pager may still need the block device to release their resources.
+    pager_.reset();
+
     if (blockfd_) {
         ioctl_block_fifo_close(Fd());
     }
@@ -642,6 +646,14 @@ zx_status_t Blobfs::Create(fbl::unique_fd fd, const MountOptions& options, const
         return status;
     }
 
+    if (options.pager) {
+        if ((status = Pager::Create(&fs->pager_)) != ZX_OK) {
+            FS_TRACE_ERROR("blobfs: Failed to create pager: %d\n", status);
+            return status;
+        }
+    }
+    fs->lz4_frame_ = options.lz4_frame;
+
     *out = std::move(fs);
     return ZX_OK;
 }
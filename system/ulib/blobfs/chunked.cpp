@@ -0,0 +1,303 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <lz4/lz4.h>
+#include <lz4/lz4hc.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fs/trace.h>
+#include <zircon/types.h>
+
+#include <utility>
+
+#include <blobfs/chunked.h>
+
+namespace blobfs {
+namespace {
+
+// The LZ4 HC level used for CompressionLevel::kHigh. Higher levels barely
+// improve the ratio of typical blobs, and are much slower.
+constexpr int kHighCompressionLevel = 9;
+
+uint64_t ChunkCount(uint64_t blob_size, uint32_t chunk_size) {
+    return fbl::round_up(blob_size, chunk_size) / chunk_size;
+}
+
+size_t SeekTableOffset(uint64_t chunk_count) {
+    return sizeof(ChunkedHeader) + chunk_count * sizeof(uint64_t);
+}
+
+} // namespace
+
+ChunkedCompressor::ChunkedCompressor() {}
+
+ChunkedCompressor::~ChunkedCompressor() {
+    Reset();
+}
+
+size_t ChunkedCompressor::BufferMax(size_t blob_size) {
+    // Chunks which do not compress are stored as is, so the compressed data
+    // is never larger than the blob itself.
+    return SeekTableOffset(ChunkCount(blob_size, kChunkedDefaultChunkSize) + 1) + blob_size;
+}
+
+void ChunkedCompressor::Reset() {
+    buf_ = nullptr;
+    buf_max_ = 0;
+    buf_used_ = 0;
+    blob_size_ = 0;
+    consumed_ = 0;
+    chunk_count_ = 0;
+    chunks_done_ = 0;
+    state_.reset();
+    chunk_.reset();
+    chunk_used_ = 0;
+}
+
+zx_status_t ChunkedCompressor::Initialize(void* buf, size_t buf_max, uint64_t blob_size,
+                                          CompressionLevel level) {
+    ZX_DEBUG_ASSERT(!Compressing());
+    const uint64_t chunk_count = ChunkCount(blob_size, kChunkedDefaultChunkSize);
+    if (chunk_count > UINT32_MAX) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    const size_t header_size = SeekTableOffset(chunk_count + 1);
+    if (header_size > buf_max) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+
+    const size_t state_size = level == CompressionLevel::kHigh ? LZ4_sizeofStateHC() :
+                                                                 LZ4_sizeofState();
+    fbl::AllocChecker ac;
+    state_.reset(new (&ac) uint8_t[state_size]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    chunk_.reset(new (&ac) uint8_t[kChunkedDefaultChunkSize]);
+    if (!ac.check()) {
+        state_.reset();
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    buf_ = static_cast<uint8_t*>(buf);
+    buf_max_ = buf_max;
+    buf_used_ = header_size;
+    blob_size_ = blob_size;
+    chunk_count_ = static_cast<uint32_t>(chunk_count);
+    level_ = level;
+
+    ChunkedHeader header = {};
+    header.magic = kChunkedMagic;
+    header.version = kChunkedVersion;
+    header.codec = kChunkedCodecLZ4;
+    header.chunk_size = kChunkedDefaultChunkSize;
+    header.chunk_count = chunk_count_;
+    memcpy(buf_, &header, sizeof(header));
+    SeekTable()[0] = buf_used_;
+    return ZX_OK;
+}
+
+size_t ChunkedCompressor::Size() const {
+    ZX_DEBUG_ASSERT(Compressing());
+    return buf_used_;
+}
+
+zx_status_t ChunkedCompressor::Update(const void* data_, size_t length) {
+    ZX_DEBUG_ASSERT(Compressing());
+    if (length > blob_size_ - consumed_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    const uint8_t* data = static_cast<const uint8_t*>(data_);
+    consumed_ += length;
+
+    while (length > 0) {
+        const uint64_t chunk_start = static_cast<uint64_t>(chunks_done_) *
+                                     kChunkedDefaultChunkSize;
+        const size_t chunk_length = static_cast<size_t>(
+            fbl::min<uint64_t>(kChunkedDefaultChunkSize, blob_size_ - chunk_start));
+
+        // Whole chunks are compressed straight from the caller's buffer.
+        if (chunk_used_ == 0 && length >= chunk_length) {
+            zx_status_t status = CompressChunk(data, chunk_length);
+            if (status != ZX_OK) {
+                return status;
+            }
+            data += chunk_length;
+            length -= chunk_length;
+            continue;
+        }
+
+        const size_t copy = fbl::min(length, chunk_length - chunk_used_);
+        memcpy(chunk_.get() + chunk_used_, data, copy);
+        chunk_used_ += copy;
+        data += copy;
+        length -= copy;
+        if (chunk_used_ == chunk_length) {
+            zx_status_t status = CompressChunk(chunk_.get(), chunk_length);
+            if (status != ZX_OK) {
+                return status;
+            }
+            chunk_used_ = 0;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::End() {
+    ZX_DEBUG_ASSERT(Compressing());
+    if (consumed_ != blob_size_ || chunks_done_ != chunk_count_) {
+        return ZX_ERR_BAD_STATE;
+    }
+    return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::CompressChunk(const uint8_t* data, size_t length) {
+    TRACE_DURATION("blobfs", "ChunkedCompressor::CompressChunk", "length", length);
+    const char* src = reinterpret_cast<const char*>(data);
+    char* dst = reinterpret_cast<char*>(buf_ + buf_used_);
+    const size_t remaining = buf_max_ - buf_used_;
+    // Any output which is not smaller than the chunk is useless, so LZ4 is
+    // allowed to give up as soon as it would need that much room.
+    const int max_dst = static_cast<int>(fbl::min(remaining, length - 1));
+    const int src_size = static_cast<int>(length);
+
+    int r;
+    if (level_ == CompressionLevel::kHigh) {
+        r = LZ4_compress_HC_extStateHC(state_.get(), src, dst, src_size, max_dst,
+                                       kHighCompressionLevel);
+    } else {
+        r = LZ4_compress_fast_extState(state_.get(), src, dst, src_size, max_dst, 1);
+    }
+
+    size_t written;
+    if (r > 0) {
+        written = r;
+    } else if (remaining >= length) {
+        memcpy(dst, data, length);
+        written = length;
+    } else {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+
+    buf_used_ += written;
+    chunks_done_++;
+    SeekTable()[chunks_done_] = buf_used_;
+    return ZX_OK;
+}
+
+uint64_t* ChunkedCompressor::SeekTable() const {
+    return reinterpret_cast<uint64_t*>(buf_ + sizeof(ChunkedHeader));
+}
+
+size_t ChunkedDecompressor::HeaderSize(const ChunkedHeader& header) {
+    return SeekTableOffset(static_cast<uint64_t>(header.chunk_count) + 1);
+}
+
+zx_status_t ChunkedDecompressor::Decompress(void* target_buf, size_t target_size,
+                                            const void* src_buf, size_t src_size) {
+    TRACE_DURATION("blobfs", "ChunkedDecompressor::Decompress", "target_size", target_size,
+                   "src_size", src_size);
+    ChunkedDecompressor decompressor;
+    zx_status_t status = decompressor.Init(src_buf, src_size, target_size, src_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+    return decompressor.DecompressChunks(0, decompressor.chunk_count(), target_buf, src_buf);
+}
+
+zx_status_t ChunkedDecompressor::Init(const void* src_buf, size_t src_size, uint64_t blob_size,
+                                      uint64_t compressed_size) {
+    if (src_size < sizeof(ChunkedHeader)) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    ChunkedHeader header;
+    memcpy(&header, src_buf, sizeof(header));
+    if (header.magic != kChunkedMagic || header.version != kChunkedVersion) {
+        FS_TRACE_ERROR("blobfs: Bad chunked blob header (version %08x)\n", header.version);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    if (header.codec != kChunkedCodecLZ4) {
+        FS_TRACE_ERROR("blobfs: Unsupported chunked blob codec %u\n", header.codec);
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    if (header.chunk_size == 0 || header.chunk_size % kBlobfsBlockSize != 0 ||
+        header.chunk_size > kChunkedMaxChunkSize ||
+        header.chunk_count != ChunkCount(blob_size, header.chunk_size)) {
+        FS_TRACE_ERROR("blobfs: Bad chunked blob geometry: %u chunks of %u bytes, for %" PRIu64
+                       " bytes\n", header.chunk_count, header.chunk_size, blob_size);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const size_t header_size = HeaderSize(header);
+    if (header_size > compressed_size) {
+        FS_TRACE_ERROR("blobfs: Chunked blob seek table does not fit in the blob\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    if (src_size < header_size) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::Array<uint64_t> seek_table(new (&ac) uint64_t[header.chunk_count + 1],
+                                    header.chunk_count + 1);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    memcpy(seek_table.get(), static_cast<const uint8_t*>(src_buf) + sizeof(header),
+           seek_table.size() * sizeof(uint64_t));
+
+    // Chunks are laid out in order right after the seek table, and none of
+    // them may be larger than it is uncompressed.
+    if (seek_table[0] != header_size || seek_table[header.chunk_count] > compressed_size) {
+        FS_TRACE_ERROR("blobfs: Chunked blob seek table out of bounds\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    for (uint32_t i = 0; i < header.chunk_count; i++) {
+        const uint64_t chunk_length =
+            fbl::min<uint64_t>(header.chunk_size,
+                               blob_size - static_cast<uint64_t>(i) * header.chunk_size);
+        if (seek_table[i + 1] <= seek_table[i] ||
+            seek_table[i + 1] - seek_table[i] > chunk_length) {
+            FS_TRACE_ERROR("blobfs: Chunked blob seek table entry %u is invalid\n", i);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+
+    blob_size_ = blob_size;
+    chunk_size_ = header.chunk_size;
+    chunk_count_ = header.chunk_count;
+    seek_table_ = std::move(seek_table);
+    return ZX_OK;
+}
+
+zx_status_t ChunkedDecompressor::DecompressChunks(uint32_t first, uint32_t last,
+                                                  void* target_buf, const void* src_buf) const {
+    TRACE_DURATION("blobfs", "ChunkedDecompressor::DecompressChunks", "first", first, "last",
+                   last);
+    ZX_DEBUG_ASSERT(first <= last && last <= chunk_count_);
+    const char* src = static_cast<const char*>(src_buf);
+    char* target = static_cast<char*>(target_buf);
+
+    for (uint32_t i = first; i < last; i++) {
+        const uint64_t offset = static_cast<uint64_t>(i) * chunk_size_;
+        const size_t chunk_length = static_cast<size_t>(
+            fbl::min<uint64_t>(chunk_size_, blob_size_ - offset));
+        const size_t src_length = static_cast<size_t>(seek_table_[i + 1] - seek_table_[i]);
+        if (src_length == chunk_length) {
+            memcpy(target + offset, src + seek_table_[i], chunk_length);
+            continue;
+        }
+        int r = LZ4_decompress_safe(src + seek_table_[i], target + offset,
+                                    static_cast<int>(src_length), static_cast<int>(chunk_length));
+        if (r < 0 || static_cast<size_t>(r) != chunk_length) {
+            FS_TRACE_ERROR("blobfs: Failed to decompress chunk %u\n", i);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    return ZX_OK;
+}
+
+} // namespace blobfs
@@ -43,7 +43,7 @@ zx_status_t CheckSuperblock(const Superblock* info, uint64_t max) {
         FS_TRACE_ERROR("blobfs: bad magic\n");
         return ZX_ERR_INVALID_ARGS;
     }
-    if (info->version != kBlobfsVersion) {
+    if ((info->version > kBlobfsVersion) || (info->version < kBlobfsVersionLZ4Frame)) {
         FS_TRACE_ERROR("blobfs: FS Version: %08x. Driver version: %08x\n", info->version,
                        kBlobfsVersion);
         return ZX_ERR_INVALID_ARGS;
@@ -152,7 +152,7 @@ int Mkfs(int fd, uint64_t block_count) {
     memset(&info, 0x00, sizeof(info));
     info.magic0 = kBlobfsMagic0;
     info.magic1 = kBlobfsMagic1;
-    info.version = kBlobfsVersion;
+    info.version = kBlobfsVersionLZ4Frame;
     info.flags = kBlobFlagClean;
     info.block_size = kBlobfsBlockSize;
     //TODO(planders): Consider modifying the inode count if we are low on space.
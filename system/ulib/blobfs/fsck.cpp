@@ -54,7 +54,20 @@ void BlobfsChecker::TraverseInodeBitmap() {
                 inode_blocks_ += extent->Length();
             }
 
-            if (blobfs_->VerifyBlob(n) != ZX_OK) {
+            // The seek table of chunk-compressed blobs is validated, and every
+            // chunk decompressed, as the blob is verified.
+            const uint16_t compression = inode->header.flags & kBlobFlagMaskAnyCompression;
+            if (compression != 0 && compression != kBlobFlagLZ4Compressed &&
+                compression != kBlobFlagChunkCompressed) {
+                FS_TRACE_ERROR("check: ino %u has conflicting compression flags 0x%x\n", n,
+                               compression);
+                valid = false;
+            } else if (compression == kBlobFlagChunkCompressed &&
+                       blobfs_->info_.version < kBlobfsVersion) {
+                FS_TRACE_ERROR("check: ino %u is chunk-compressed, which version %u predates\n",
+                               n, blobfs_->info_.version);
+                valid = false;
+            } else if (blobfs_->VerifyBlob(n) != ZX_OK) {
                 FS_TRACE_ERROR("check: detected inode %u with bad state\n", n);
                 valid = false;
             }
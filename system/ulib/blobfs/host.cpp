@@ -24,6 +24,7 @@
 
 #define ZXDEBUG 0
 
+#include <blobfs/chunked.h>
 #include <blobfs/format.h>
 #include <blobfs/fsck.h>
 #include <blobfs/host.h>
@@ -80,8 +81,10 @@ zx_status_t buffer_create_merkle(const FileMapping& mapping, MerkleInfo* out_inf
     return ZX_OK;
 }
 
+// Images are built ahead of time, so blobs are compressed for the best ratio
+// rather than for speed.
 zx_status_t buffer_compress(const FileMapping& mapping, MerkleInfo* out_info) {
-    size_t max = Compressor::BufferMax(mapping.length());
+    size_t max = ChunkedCompressor::BufferMax(mapping.length());
     out_info->compressed_data.reset(new uint8_t[max]);
     out_info->compressed = false;
 
@@ -90,8 +93,9 @@ zx_status_t buffer_compress(const FileMapping& mapping, MerkleInfo* out_info) {
     }
 
     zx_status_t status;
-    Compressor compressor;
-    if ((status = compressor.Initialize(out_info->compressed_data.get(), max)) != ZX_OK) {
+    ChunkedCompressor compressor;
+    if ((status = compressor.Initialize(out_info->compressed_data.get(), max, mapping.length(),
+                                        CompressionLevel::kHigh)) != ZX_OK) {
         FS_TRACE_ERROR("Failed to initialize blobfs compressor: %d\n", status);
         return status;
     }
@@ -145,7 +149,10 @@ zx_status_t blobfs_add_mapped_blob_with_merkle(Blobfs* bs, const FileMapping& ma
     Inode* inode = inode_block->GetInode();
     inode->blob_size = mapping.length();
     inode->block_count = MerkleTreeBlocks(*inode) + info.GetDataBlocks();
-    inode->header.flags |= kBlobFlagAllocated | (info.compressed ? kBlobFlagLZ4Compressed : 0);
+    inode->header.flags |= kBlobFlagAllocated | (info.compressed ? kBlobFlagChunkCompressed : 0);
+    if (info.compressed) {
+        bs->UpgradeVersion(kBlobfsVersion);
+    }
 
     // TODO(smklein): Currently, host-side tools can only generate single-extent
     // blobs. This should be fixed.
@@ -512,6 +519,12 @@ zx_status_t Blobfs::WriteInfo() {
     return WriteBlock(0, info_block_);
 }
 
+void Blobfs::UpgradeVersion(uint32_t version) {
+    if (info_.version < version) {
+        info_.version = version;
+    }
+}
+
 zx_status_t Blobfs::ReadBlock(size_t bno) {
     if (dirty_) {
         return ZX_ERR_ACCESS_DENIED;
@@ -573,7 +586,7 @@ zx_status_t Blobfs::VerifyBlob(uint32_t node_index) {
 
     // Create data buffer.
     fbl::unique_ptr<uint8_t[]> data(new uint8_t[target_size]);
-    if (inode.header.flags & kBlobFlagLZ4Compressed) {
+    if (inode.header.flags & kBlobFlagMaskAnyCompression) {
         // Read in uncompressed merkle blocks.
         for (unsigned i = 0; i < merkle_blocks; i++) {
             ReadBlock(data_start_block_ + inode.extents[0].Start() + i);
@@ -601,8 +614,14 @@ zx_status_t Blobfs::VerifyBlob(uint32_t node_index) {
         zx_status_t status;
         target_size = inode.blob_size;
         uint8_t* data_ptr = data.get() + (merkle_blocks * kBlobfsBlockSize);
-        if ((status = Decompressor::Decompress(data_ptr, &target_size, compressed_data.get(),
-                                               &compressed_size)) != ZX_OK) {
+        if (inode.header.flags & kBlobFlagChunkCompressed) {
+            status = ChunkedDecompressor::Decompress(data_ptr, target_size,
+                                                     compressed_data.get(), compressed_size);
+        } else {
+            status = Decompressor::Decompress(data_ptr, &target_size, compressed_data.get(),
+                                              &compressed_size);
+        }
+        if (status != ZX_OK) {
             return status;
         }
         if (target_size != inode.blob_size) {
@@ -24,16 +24,19 @@
 #include <fuchsia/io/c/fidl.h>
 #include <lib/async/cpp/wait.h>
 #include <lib/fzl/owned-vmo-mapper.h>
+#include <lib/fzl/vmo-mapper.h>
 #include <lib/zx/event.h>
 
 #include <blobfs/allocator.h>
 #include <blobfs/blob-cache.h>
+#include <blobfs/chunked.h>
 #include <blobfs/common.h>
 #include <blobfs/extent-reserver.h>
 #include <blobfs/format.h>
 #include <blobfs/lz4.h>
 #include <blobfs/metrics.h>
 #include <blobfs/node-reserver.h>
+#include <blobfs/pager.h>
 
 #include <atomic>
 
@@ -213,12 +216,19 @@ private:
 
     // Reads both VMOs into memory, if we haven't already.
     //
-    // TODO(ZX-1481): When we have can register the Blob Store as a pager
-    // service, and it can properly handle pages faults on a vnode's contents,
-    // then we can avoid reading the entire blob up-front. Until then, read
-    // the contents of a VMO into memory when it is opened.
+    // Used when blobfs runs without a pager, and for blobs which are still
+    // in memory from being written.
     zx_status_t InitVmos();
 
+    // Returns true if the contents of the blob are served by the pager,
+    // rather than by |mapping_|.
+    bool UsePager() const;
+
+    // Creates the pager-backed VMO of the blob, if we haven't already.
+    // Only the merkle tree is read; the data is read and verified as it is
+    // accessed.
+    zx_status_t InitPagedVmo();
+
     // Initializes a compressed blob by reading it from disk and decompressing
     // it.
     // Does not verify the blob.
@@ -250,7 +260,12 @@ private:
     fzl::OwnedVmoMapper mapping_;
     vmoid_t vmoid_ = {};
 
-    // Watches any clones of "vmo_" provided to clients.
+    // When paged, the blob's data lives in the VMO of |page_source_| instead,
+    // which is mapped by |paged_mapping_| to serve reads.
+    fbl::RefPtr<PageSource> page_source_;
+    fzl::VmoMapper paged_mapping_;
+
+    // Watches any clones of the blob's VMO provided to clients.
     // Observes the ZX_VMO_ZERO_CHILDREN signal.
     async::WaitMethod<Blob, &Blob::HandleNoClones> clone_watcher_;
     // Keeps a reference to the blob alive (from within itself)
@@ -278,8 +293,39 @@ private:
         fbl::Vector<ReservedExtent> extents;
         fbl::Vector<ReservedNode> node_indices;
 
+        // While compressing, exactly one of the compressors is in use: the
+        // chunked one, unless the blob is written as a single LZ4 frame.
         Compressor compressor;
+        ChunkedCompressor chunked_compressor;
         fzl::OwnedVmoMapper compressed_blob;
+
+        bool Compressing() const {
+            return compressor.Compressing() || chunked_compressor.Compressing();
+        }
+
+        size_t CompressedSize() const {
+            return compressor.Compressing() ? compressor.Size() : chunked_compressor.Size();
+        }
+
+        // The inode flag identifying the format of the compressed blob.
+        uint16_t CompressionFlag() const {
+            return compressor.Compressing() ? kBlobFlagLZ4Compressed : kBlobFlagChunkCompressed;
+        }
+
+        zx_status_t UpdateCompression(const void* data, size_t length) {
+            return compressor.Compressing() ? compressor.Update(data, length) :
+                                              chunked_compressor.Update(data, length);
+        }
+
+        zx_status_t EndCompression() {
+            return compressor.Compressing() ? compressor.End() : chunked_compressor.End();
+        }
+
+        void ResetCompression() {
+            compressor.Reset();
+            chunked_compressor.Reset();
+            compressed_blob.Reset();
+        }
     };
 
     fbl::unique_ptr<WritebackInfo> write_info_ = {};
@@ -51,6 +51,7 @@
 #include <blobfs/lz4.h>
 #include <blobfs/metrics.h>
 #include <blobfs/node-reserver.h>
+#include <blobfs/pager.h>
 #include <blobfs/writeback.h>
 
 #include <atomic>
@@ -65,6 +66,9 @@ struct MountOptions {
     bool readonly = false;
     bool metrics = false;
     bool journal = false;
+    bool pager = false;
+    // Write compressed blobs as a single LZ4 frame rather than in chunks.
+    bool lz4_frame = false;
     CachePolicy cache_policy = CachePolicy::EvictImmediately;
 };
 
@@ -137,6 +141,15 @@ public:
 
     Allocator* GetAllocator() { return allocator_.get(); }
 
+    // Returns the pager backing the contents of readable blobs, or nullptr if
+    // blobs are read into memory in full when first accessed.
+    Pager* GetPager() { return pager_.get(); }
+
+    // Returns whether new blobs are compressed as a single LZ4 frame, which
+    // can only be decompressed as a whole, rather than in chunks. Filesystems
+    // older than kBlobfsVersion cannot hold chunk-compressed blobs.
+    bool UseLZ4Frame() const { return lz4_frame_ || (info_.version < kBlobfsVersion); }
+
     Inode* GetNode(uint32_t node_index) { return allocator_->GetNode(node_index); }
     zx_status_t ReserveBlocks(size_t num_blocks, fbl::Vector<ReservedExtent>* out_extents) {
         return allocator_->ReserveBlocks(num_blocks, out_extents);
@@ -251,6 +264,8 @@ private:
 
     fbl::unique_ptr<WritebackQueue> writeback_;
     fbl::unique_ptr<Journal> journal_;
+    fbl::unique_ptr<Pager> pager_;
+    bool lz4_frame_ = false;
     Superblock info_;
 
     BlobCache blob_cache_;
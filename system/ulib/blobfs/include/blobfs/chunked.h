@@ -0,0 +1,139 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file contains the compressor and decompressor of the chunked blob
+// format (see ChunkedHeader), which, unlike a single LZ4 frame, allows any
+// range of a blob to be read by decompressing only the chunks it touches.
+
+#pragma once
+
+#include <blobfs/format.h>
+#include <fbl/array.h>
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/types.h>
+
+namespace blobfs {
+
+enum class CompressionLevel {
+    // Fast enough to compress blobs as they are written.
+    kDefault,
+    // Slower to compress, for a better ratio. Decompression is just as fast.
+    kHigh,
+};
+
+// A ChunkedCompressor is used to compress a blob transparently before it is
+// written back to disk.
+class ChunkedCompressor {
+public:
+    ChunkedCompressor();
+
+    ~ChunkedCompressor();
+
+    // Returns the maximum possible size a buffer would need to be
+    // in order to compress a blob of size |blob_size|.
+    //
+    // Typically used in conjunction with |Initialize()|.
+    static size_t BufferMax(size_t blob_size);
+
+    // Identifies if compression is underway.
+    bool Compressing() const {
+        return buf_ != nullptr;
+    }
+
+    // Resets the compression process.
+    void Reset();
+
+    // Initializes the compression of a blob of |blob_size| bytes into a
+    // provided buffer of a specified size.
+    //
+    // Although ChunkedCompressor uses this buffer, it does not own the buffer,
+    // assuming that a parent object is responsible for the lifetime.
+    zx_status_t Initialize(void* buf, size_t buf_max, uint64_t blob_size,
+                           CompressionLevel level = CompressionLevel::kDefault);
+
+    // The following functions are only safe to call after |Initialize()|.
+
+    // Returns the compressed size of the blob so far. Simply starting initialization
+    // results in a nonzero |Size()|, since room is kept for the seek table.
+    size_t Size() const;
+
+    // Continues the compression after initialization.
+    zx_status_t Update(const void* data, size_t length);
+
+    // Finishes the compression process, once all |blob_size| bytes were provided.
+    // Must be called before compression is considered complete.
+    zx_status_t End();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ChunkedCompressor);
+
+    // Compresses |length| bytes at |data| as the next chunk.
+    zx_status_t CompressChunk(const uint8_t* data, size_t length);
+
+    uint64_t* SeekTable() const;
+
+    uint8_t* buf_ = nullptr;
+    size_t buf_max_ = 0;
+    size_t buf_used_ = 0;
+    uint64_t blob_size_ = 0;
+    uint64_t consumed_ = 0;
+    uint32_t chunk_count_ = 0;
+    uint32_t chunks_done_ = 0;
+    CompressionLevel level_ = CompressionLevel::kDefault;
+
+    // The LZ4 compression state, and the data of the current chunk when it
+    // is not provided in a single |Update()|.
+    fbl::unique_ptr<uint8_t[]> state_;
+    fbl::unique_ptr<uint8_t[]> chunk_;
+    size_t chunk_used_ = 0;
+};
+
+// A ChunkedDecompressor holds the seek table of a chunked blob, which it uses
+// to decompress chunks of the blob independently.
+class ChunkedDecompressor {
+public:
+    ChunkedDecompressor() = default;
+
+    // Returns the number of bytes taken by the header and seek table of the
+    // chunked blob whose compressed data starts with |header|.
+    static size_t HeaderSize(const ChunkedHeader& header);
+
+    // Decompresses a whole chunked blob, from |src_size| bytes at |src_buf|
+    // into |target_buf|. |target_size| must be the exact size of the blob.
+    static zx_status_t Decompress(void* target_buf, size_t target_size,
+                                  const void* src_buf, size_t src_size);
+
+    // Parses and validates the header and seek table of a blob of |blob_size|
+    // bytes, whose compressed data is |compressed_size| bytes long and starts
+    // with the |src_size| bytes at |src_buf|.
+    //
+    // Returns ZX_ERR_BUFFER_TOO_SMALL if |src_size| is smaller than the
+    // header and seek table, which are |HeaderSize()| bytes long.
+    zx_status_t Init(const void* src_buf, size_t src_size, uint64_t blob_size,
+                     uint64_t compressed_size);
+
+    uint32_t chunk_size() const { return chunk_size_; }
+    uint32_t chunk_count() const { return chunk_count_; }
+
+    // Returns the offset, within the compressed data, of chunk |index|.
+    // |index| may be |chunk_count()|, for the end of the compressed data.
+    uint64_t ChunkOffset(uint32_t index) const { return seek_table_[index]; }
+
+    // Decompresses the chunks [|first|, |last|) from |src_buf|, holding the
+    // compressed data of the blob (at least the part of it the chunks are in),
+    // into their place in |target_buf|, which holds the uncompressed blob.
+    zx_status_t DecompressChunks(uint32_t first, uint32_t last, void* target_buf,
+                                 const void* src_buf) const;
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ChunkedDecompressor);
+
+    uint64_t blob_size_ = 0;
+    uint32_t chunk_size_ = 0;
+    uint32_t chunk_count_ = 0;
+    fbl::Array<uint64_t> seek_table_;
+};
+
+} // namespace blobfs
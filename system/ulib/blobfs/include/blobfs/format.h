@@ -28,7 +28,15 @@
 namespace blobfs {
 constexpr uint64_t kBlobfsMagic0  = (0xac2153479e694d21ULL);
 constexpr uint64_t kBlobfsMagic1  = (0x985000d4d4d3d314ULL);
-constexpr uint32_t kBlobfsVersion = 0x00000007;
+// Version 8 added chunk-compressed blobs (kBlobFlagChunkCompressed), which
+// drivers of earlier versions cannot read.
+constexpr uint32_t kBlobfsVersion = 0x00000008;
+// Filesystems of the previous version are still mounted, since they differ
+// only in that they cannot contain chunk-compressed blobs. Mkfs writes that
+// version, and blobs written to it are compressed as a single LZ4 frame. It is
+// upgraded to kBlobfsVersion when the host tools add its first chunk-compressed
+// blob.
+constexpr uint32_t kBlobfsVersionLZ4Frame = 0x00000007;
 
 constexpr uint32_t kBlobFlagClean        = 1;
 constexpr uint32_t kBlobFlagDirty        = 2;
@@ -263,6 +271,14 @@ constexpr uint16_t kBlobFlagLZ4Compressed = 1 << 1;
 // Identifies that this node is a container for extents.
 constexpr uint16_t kBlobFlagExtentContainer = 1 << 2;
 
+// Identifies that the on-disk storage of the blob is compressed in
+// independently compressed chunks, described by a ChunkedHeader.
+constexpr uint16_t kBlobFlagChunkCompressed = 1 << 3;
+
+// All the flags which identify a compressed blob.
+constexpr uint16_t kBlobFlagMaskAnyCompression = kBlobFlagLZ4Compressed |
+                                                 kBlobFlagChunkCompressed;
+
 // The number of extents within a normal inode.
 constexpr uint32_t kInlineMaxExtents = 1;
 // The number of extents within an extent container node.
@@ -325,4 +341,37 @@ constexpr uint64_t BlobDataBlocks(const Inode& blobNode) {
     return fbl::round_up(blobNode.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
 }
 
+constexpr uint64_t kChunkedMagic   = (0x6b6e756863626c62ULL);
+constexpr uint32_t kChunkedVersion = 0x00000001;
+
+// Each chunk is an LZ4 block, or, when compressing it did not make it any
+// smaller, the uncompressed chunk itself. A chunk is stored uncompressed if and
+// only if its compressed length equals its uncompressed length.
+constexpr uint32_t kChunkedCodecLZ4 = 1;
+
+// Chunk sizes must be multiples of the block size, so that every chunk covers
+// whole merkle tree nodes and can be verified on its own.
+constexpr uint32_t kChunkedDefaultChunkSize = 4 * kBlobfsBlockSize;
+constexpr uint32_t kChunkedMaxChunkSize     = 128 * kBlobfsBlockSize;
+
+// The header of a blob stored with kBlobFlagChunkCompressed, found at the
+// start of its data blocks (after the merkle tree).
+//
+// The blob is split in chunks of |chunk_size| bytes (the last one may be
+// shorter) which are compressed independently. The header is followed by the
+// seek table: |chunk_count| + 1 uint64_t offsets, relative to the start of the
+// header, of the compressed data of each chunk, the last one being the end of
+// the compressed data. The compressed chunks follow the seek table.
+struct ChunkedHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t codec;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+};
+
+static_assert(sizeof(ChunkedHeader) == 24, "Blobfs ChunkedHeader size is wrong");
+static_assert(kChunkedDefaultChunkSize % kBlobfsBlockSize == 0,
+              "Chunks must consist of whole blocks");
+
 } // namespace blobfs
@@ -156,6 +156,10 @@ public:
     zx_status_t WriteNode(fbl::unique_ptr<InodeBlock> ino_block);
     zx_status_t WriteInfo();
 
+    // Raises the version of the filesystem to |version| if it is older. The
+    // superblock is written back by the next WriteInfo().
+    void UpgradeVersion(uint32_t version);
+
     // Access the |node_index|-th inode
     Inode* GetNode(uint32_t node_index) final;
 
@@ -0,0 +1,176 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file contains the pager which backs the contents of readable blobs,
+// reading and verifying them from disk only when they are accessed.
+
+#pragma once
+
+#ifndef __Fuchsia__
+#error Fuchsia-only Header
+#endif
+
+#include <threads.h>
+
+#include <blobfs/allocator.h>
+#include <blobfs/chunked.h>
+#include <blobfs/common.h>
+#include <blobfs/format.h>
+#include <digest/digest.h>
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/macros.h>
+#include <fbl/mutex.h>
+#include <fbl/ref_counted.h>
+#include <fbl/ref_ptr.h>
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+#include <lib/fzl/owned-vmo-mapper.h>
+#include <lib/zx/handle.h>
+#include <lib/zx/port.h>
+#include <lib/zx/vmo.h>
+#include <zircon/device/block.h>
+#include <zircon/syscalls/port.h>
+
+namespace blobfs {
+
+class Pager;
+class TransactionManager;
+
+// Supplies the pages of a single blob's pager-backed VMO.
+//
+// The merkle tree of the blob, and the seek table of a chunk-compressed blob,
+// are read when the source is created. The data is read from disk only when a
+// range of the VMO is accessed, at which point just that range (or the chunks
+// covering it) is decompressed and verified against the merkle tree before its
+// pages are handed to the kernel. The kernel may evict those pages again, in
+// which case they are requested, and read, once more.
+class PageSource : public fbl::RefCounted<PageSource>,
+                   public fbl::WAVLTreeContainable<fbl::RefPtr<PageSource>> {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PageSource);
+
+    // Creates the source of the blob stored in |inode| at |node_index|, and
+    // a VMO of the blob's data backed by it.
+    static zx_status_t Create(Pager* pager, TransactionManager* txn_manager,
+                              Allocator* allocator, uint32_t node_index, const Inode& inode,
+                              fbl::RefPtr<PageSource>* out);
+    ~PageSource();
+
+    uint64_t GetKey() const { return key_; }
+
+    // The pager-backed VMO holding the blob's data, starting at offset zero.
+    const zx::vmo& vmo() const { return vmo_; }
+
+    // Reads and verifies the pages holding [|offset|, |offset| + |length|) of
+    // the blob, and supplies any which are not present in the VMO.
+    //
+    // On failure, the VMO is detached from the pager, so any pending and future
+    // page faults on it fail as well.
+    zx_status_t Populate(uint64_t offset, uint64_t length);
+
+    // Detaches the VMO from the pager.
+    void Detach();
+
+private:
+    friend class Pager;
+
+    // A run of the blob's data blocks, which are contiguous on disk.
+    struct BlockRange {
+        uint64_t data_block;
+        uint64_t dev_block;
+        uint32_t length;
+    };
+
+    PageSource(Pager* pager, TransactionManager* txn_manager, const Inode& inode);
+
+    // Reads, verifies and supplies the merkle tree nodes [|first|, |last|) of
+    // an uncompressed blob.
+    zx_status_t PopulateNodesLocked(size_t first, size_t last) __TA_REQUIRES(lock_);
+
+    // Reads, decompresses, verifies and supplies the chunks of a chunk-compressed
+    // blob which cover the merkle tree nodes [|first|, |last|).
+    zx_status_t PopulateChunksLocked(size_t first, size_t last) __TA_REQUIRES(lock_);
+
+    // Reads, decompresses, verifies and supplies the whole of a blob compressed
+    // as a single LZ4 frame.
+    zx_status_t PopulateLZ4FrameLocked() __TA_REQUIRES(lock_);
+
+    // Reads the data blocks [|first|, |last|) of the blob into |vmoid|, at
+    // their offset within the data.
+    zx_status_t ReadBlocks(vmoid_t vmoid, uint64_t first, uint64_t last);
+
+    // Reads the header and seek table of a chunk-compressed blob.
+    zx_status_t InitChunksLocked() __TA_REQUIRES(lock_);
+
+    // Moves the pages [|offset|, |offset| + |length|) of |transfer_vmo_| into |vmo_|.
+    zx_status_t SupplyLocked(uint64_t offset, uint64_t length) __TA_REQUIRES(lock_);
+
+    Pager* const pager_;
+    TransactionManager* const txn_manager_;
+    const digest::Digest digest_;
+    const uint64_t blob_size_;
+    const bool chunked_;
+    const bool lz4_frame_;
+
+    uint64_t key_ = 0;
+    zx::vmo vmo_;
+
+    // Where the blob's data (or, for a compressed blob, the compressed data) lives on disk.
+    fbl::Vector<BlockRange> ranges_;
+    uint32_t data_blocks_ = 0;
+
+    fzl::OwnedVmoMapper merkle_;
+    size_t merkle_size_ = 0;
+
+    fbl::Mutex lock_;
+    // Data is read into |transfer_vmo_| at its offset within the blob, and
+    // moved into |vmo_| from there once verified.
+    zx::vmo transfer_vmo_ __TA_GUARDED(lock_);
+    vmoid_t transfer_vmoid_ __TA_GUARDED(lock_) = VMOID_INVALID;
+    // For a chunk-compressed blob, the compressed chunks are read into
+    // |compressed_| at their offset within the compressed data, and released
+    // once decompressed into |transfer_vmo_|.
+    ChunkedDecompressor chunks_ __TA_GUARDED(lock_);
+    fzl::OwnedVmoMapper compressed_ __TA_GUARDED(lock_);
+    vmoid_t compressed_vmoid_ __TA_GUARDED(lock_) = VMOID_INVALID;
+    zx_status_t status_ __TA_GUARDED(lock_) = ZX_OK;
+};
+
+// Serves the page requests of all the pager-backed blob VMOs of a blobfs
+// instance on a dedicated thread.
+class Pager {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Pager);
+
+    static zx_status_t Create(fbl::unique_ptr<Pager>* out);
+
+    // Stops the pager thread. Blobs must have detached their VMOs beforehand.
+    ~Pager();
+
+private:
+    friend class PageSource;
+
+    Pager() = default;
+
+    zx_handle_t get() const { return pager_.get(); }
+
+    // Creates the VMO of |source|, of |size| bytes, and starts serving its page requests.
+    zx_status_t Register(const fbl::RefPtr<PageSource>& source, uint64_t size);
+
+    void HandleRequest(uint64_t key, const zx_packet_page_request_t& request);
+
+    static int PagerThread(void* arg);
+
+    zx::handle pager_;
+    zx::port port_;
+    thrd_t thread_;
+    bool running_ = false;
+
+    fbl::Mutex lock_;
+    uint64_t next_key_ __TA_GUARDED(lock_) = 1;
+    // Sources are registered until the kernel reports their VMO as complete.
+    fbl::WAVLTree<uint64_t, fbl::RefPtr<PageSource>> sources_ __TA_GUARDED(lock_);
+};
+
+} // namespace blobfs
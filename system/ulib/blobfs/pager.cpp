@@ -0,0 +1,435 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <blobfs/pager.h>
+
+#include <blobfs/chunked.h>
+#include <blobfs/iterator/allocated-extent-iterator.h>
+#include <blobfs/iterator/block-iterator.h>
+#include <blobfs/lz4.h>
+#include <blobfs/transaction-manager.h>
+#include <digest/merkle-tree.h>
+#include <fbl/algorithm.h>
+#include <fbl/auto_call.h>
+#include <fbl/auto_lock.h>
+#include <fs/block-txn.h>
+#include <fs/trace.h>
+#include <lib/fzl/vmo-mapper.h>
+#include <trace/event.h>
+#include <zircon/limits.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+#include <utility>
+
+namespace blobfs {
+namespace {
+
+using digest::MerkleTree;
+
+static_assert(MerkleTree::kNodeSize == kBlobfsBlockSize,
+              "Blobs are paged in by merkle tree node, which must be one block");
+
+} // namespace
+
+PageSource::PageSource(Pager* pager, TransactionManager* txn_manager, const Inode& inode)
+    : pager_(pager), txn_manager_(txn_manager), digest_(inode.merkle_root_hash),
+      blob_size_(inode.blob_size),
+      chunked_((inode.header.flags & kBlobFlagChunkCompressed) != 0),
+      lz4_frame_((inode.header.flags & kBlobFlagLZ4Compressed) != 0) {}
+
+PageSource::~PageSource() {
+    if (transfer_vmoid_ != VMOID_INVALID) {
+        txn_manager_->DetachVmo(transfer_vmoid_);
+    }
+    if (compressed_vmoid_ != VMOID_INVALID) {
+        txn_manager_->DetachVmo(compressed_vmoid_);
+    }
+}
+
+zx_status_t PageSource::Create(Pager* pager, TransactionManager* txn_manager,
+                               Allocator* allocator, uint32_t node_index, const Inode& inode,
+                               fbl::RefPtr<PageSource>* out) {
+    TRACE_DURATION("blobfs", "PageSource::Create", "size", inode.blob_size, "blocks",
+                   inode.block_count);
+    fbl::RefPtr<PageSource> source = fbl::AdoptRef(new PageSource(pager, txn_manager, inode));
+
+    const uint32_t merkle_blocks = MerkleTreeBlocks(inode);
+    const uint64_t data_start = DataStartBlock(txn_manager->Info());
+    source->merkle_size_ = MerkleTree::GetTreeLength(inode.blob_size);
+    source->data_blocks_ = (inode.header.flags & kBlobFlagMaskAnyCompression) ?
+                           inode.block_count - merkle_blocks :
+                           static_cast<uint32_t>(BlobDataBlocks(inode));
+
+    AllocatedExtentIterator extent_iter(allocator, node_index);
+    BlockIterator block_iter(&extent_iter);
+
+    // The merkle tree is needed to verify any part of the blob, so read all of it now.
+    zx_status_t status;
+    if (merkle_blocks > 0) {
+        if ((status = source->merkle_.CreateAndMap(merkle_blocks * kBlobfsBlockSize,
+                                                   "blob-merkle")) != ZX_OK) {
+            return status;
+        }
+        vmoid_t merkle_vmoid;
+        if ((status = txn_manager->AttachVmo(source->merkle_.vmo(), &merkle_vmoid)) != ZX_OK) {
+            FS_TRACE_ERROR("blobfs: Failed to attach merkle VMO: %d\n", status);
+            return status;
+        }
+        auto detach = fbl::MakeAutoCall([&]() { txn_manager->DetachVmo(merkle_vmoid); });
+
+        fs::ReadTxn txn(txn_manager);
+        status = StreamBlocks(&block_iter, merkle_blocks,
+                              [&](uint64_t vmo_offset, uint64_t dev_offset, uint32_t length) {
+                                  txn.Enqueue(merkle_vmoid, vmo_offset, dev_offset + data_start,
+                                              length);
+                                  return ZX_OK;
+                              });
+        if (status != ZX_OK) {
+            return status;
+        }
+        if ((status = txn.Transact()) != ZX_OK) {
+            FS_TRACE_ERROR("blobfs: Failed to read merkle tree: %d\n", status);
+            return status;
+        }
+    }
+
+    // Remember where the rest of the blob lives, so that page requests never
+    // need to look at the allocator.
+    ZX_DEBUG_ASSERT(block_iter.BlockIndex() == merkle_blocks);
+    status = StreamBlocks(&block_iter, source->data_blocks_,
+                          [&](uint64_t vmo_offset, uint64_t dev_offset, uint32_t length) {
+                              source->ranges_.push_back({vmo_offset - merkle_blocks,
+                                                         dev_offset + data_start, length});
+                              return ZX_OK;
+                          });
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    fbl::AutoLock lock(&source->lock_);
+    const uint64_t nodes = fbl::round_up(inode.blob_size, MerkleTree::kNodeSize) /
+                           MerkleTree::kNodeSize;
+    if ((status = zx::vmo::create(nodes * kBlobfsBlockSize, 0, &source->transfer_vmo_)) != ZX_OK) {
+        return status;
+    }
+    if ((status = txn_manager->AttachVmo(source->transfer_vmo_,
+                                         &source->transfer_vmoid_)) != ZX_OK) {
+        FS_TRACE_ERROR("blobfs: Failed to attach transfer VMO: %d\n", status);
+        return status;
+    }
+    if (source->chunked_ && (status = source->InitChunksLocked()) != ZX_OK) {
+        return status;
+    }
+    const uint64_t vmo_size = fbl::round_up(inode.blob_size, ZX_PAGE_SIZE);
+    if ((status = pager->Register(source, vmo_size)) != ZX_OK) {
+        FS_TRACE_ERROR("blobfs: Failed to create pager VMO: %d\n", status);
+        return status;
+    }
+
+    *out = std::move(source);
+    return ZX_OK;
+}
+
+zx_status_t PageSource::Populate(uint64_t offset, uint64_t length) {
+    TRACE_DURATION("blobfs", "PageSource::Populate", "offset", offset, "length", length);
+    fbl::AutoLock lock(&lock_);
+    if (status_ != ZX_OK) {
+        return status_;
+    }
+    // Requests may cover the tail of the last page, past the end of the blob.
+    if (offset >= blob_size_) {
+        return ZX_OK;
+    }
+    length = fbl::min(length, blob_size_ - offset);
+
+    // Pages may have been evicted since they were last supplied, so everything
+    // requested is read again. Pages the kernel still has are left alone.
+    const size_t first = offset / MerkleTree::kNodeSize;
+    const size_t last = fbl::round_up(offset + length, MerkleTree::kNodeSize) /
+                        MerkleTree::kNodeSize;
+    zx_status_t status;
+    if (chunked_) {
+        status = PopulateChunksLocked(first, last);
+    } else if (lz4_frame_) {
+        status = PopulateLZ4FrameLocked();
+    } else {
+        status = PopulateNodesLocked(first, last);
+    }
+
+    if (status != ZX_OK) {
+        char name[digest::Digest::kLength * 2 + 1];
+        ZX_ASSERT(digest_.ToString(name, sizeof(name)) == ZX_OK);
+        FS_TRACE_ERROR("blobfs: Failed to page in %s at %" PRIu64 ": %s\n", name, offset,
+                       zx_status_get_string(status));
+        status_ = status;
+        Detach();
+    }
+    return status;
+}
+
+void PageSource::Detach() {
+    zx_pager_detach_vmo(pager_->get(), vmo_.get());
+}
+
+zx_status_t PageSource::ReadBlocks(vmoid_t vmoid, uint64_t first, uint64_t last) {
+    fs::ReadTxn txn(txn_manager_);
+    for (const BlockRange& range : ranges_) {
+        const uint64_t start = fbl::max(range.data_block, first);
+        const uint64_t end = fbl::min(range.data_block + range.length, last);
+        if (start < end) {
+            txn.Enqueue(vmoid, start, range.dev_block + (start - range.data_block), end - start);
+        }
+    }
+    return txn.Transact();
+}
+
+zx_status_t PageSource::InitChunksLocked() {
+    const uint64_t compressed_size = static_cast<uint64_t>(data_blocks_) * kBlobfsBlockSize;
+    zx_status_t status = compressed_.CreateAndMap(compressed_size, "compressed-blob");
+    if (status != ZX_OK) {
+        return status;
+    }
+    if ((status = txn_manager_->AttachVmo(compressed_.vmo(), &compressed_vmoid_)) != ZX_OK) {
+        FS_TRACE_ERROR("blobfs: Failed to attach compressed VMO: %d\n", status);
+        return status;
+    }
+
+    // The seek table is usually small enough to share the first block with the
+    // header; read more of it only if it is not.
+    uint64_t blocks = fbl::min(data_blocks_, 1u);
+    while (true) {
+        if ((status = ReadBlocks(compressed_vmoid_, 0, blocks)) != ZX_OK) {
+            return status;
+        }
+        status = chunks_.Init(compressed_.start(), blocks * kBlobfsBlockSize, blob_size_,
+                              compressed_size);
+        if (status != ZX_ERR_BUFFER_TOO_SMALL || blocks == data_blocks_) {
+            break;
+        }
+        ChunkedHeader header;
+        memcpy(&header, compressed_.start(), sizeof(header));
+        blocks = fbl::min<uint64_t>(data_blocks_,
+                                    fbl::round_up(ChunkedDecompressor::HeaderSize(header),
+                                                  kBlobfsBlockSize) / kBlobfsBlockSize);
+    }
+    compressed_.vmo().op_range(ZX_VMO_OP_DECOMMIT, 0, blocks * kBlobfsBlockSize, nullptr, 0);
+    if (status == ZX_ERR_BUFFER_TOO_SMALL) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    return status;
+}
+
+zx_status_t PageSource::PopulateNodesLocked(size_t first, size_t last) {
+    TRACE_DURATION("blobfs", "PageSource::PopulateNodes", "first", first, "last", last);
+    zx_status_t status = ReadBlocks(transfer_vmoid_, first, last);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    const uint64_t offset = first * MerkleTree::kNodeSize;
+    const uint64_t end = fbl::min(last * MerkleTree::kNodeSize, blob_size_);
+    {
+        // Only the nodes in range have been read, and only those are looked at
+        // by the verification.
+        fzl::VmoMapper mapping;
+        if ((status = mapping.Map(transfer_vmo_, 0, 0, ZX_VM_PERM_READ)) != ZX_OK) {
+            return status;
+        }
+        if ((status = MerkleTree::Verify(mapping.start(), blob_size_, merkle_.start(),
+                                         merkle_size_, offset, end - offset,
+                                         digest_)) != ZX_OK) {
+            return status;
+        }
+    }
+
+    return SupplyLocked(offset, fbl::round_up(end, ZX_PAGE_SIZE) - offset);
+}
+
+zx_status_t PageSource::PopulateChunksLocked(size_t first, size_t last) {
+    const size_t nodes_per_chunk = chunks_.chunk_size() / MerkleTree::kNodeSize;
+    const uint32_t first_chunk = static_cast<uint32_t>(first / nodes_per_chunk);
+    const uint32_t last_chunk = static_cast<uint32_t>(fbl::round_up(last, nodes_per_chunk) /
+                                                      nodes_per_chunk);
+    TRACE_DURATION("blobfs", "PageSource::PopulateChunks", "first", first_chunk, "last",
+                   last_chunk);
+
+    const uint64_t first_block = chunks_.ChunkOffset(first_chunk) / kBlobfsBlockSize;
+    const uint64_t last_block = fbl::round_up(chunks_.ChunkOffset(last_chunk),
+                                              kBlobfsBlockSize) / kBlobfsBlockSize;
+    // The compressed chunks are only needed until they are decompressed.
+    auto decommit = fbl::MakeAutoCall([&]() {
+        compressed_.vmo().op_range(ZX_VMO_OP_DECOMMIT, first_block * kBlobfsBlockSize,
+                                   (last_block - first_block) * kBlobfsBlockSize, nullptr, 0);
+    });
+    zx_status_t status = ReadBlocks(compressed_vmoid_, first_block, last_block);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    const uint64_t offset = static_cast<uint64_t>(first_chunk) * chunks_.chunk_size();
+    const uint64_t end = fbl::min(static_cast<uint64_t>(last_chunk) * chunks_.chunk_size(),
+                                  blob_size_);
+    {
+        fzl::VmoMapper mapping;
+        if ((status = mapping.Map(transfer_vmo_, 0, 0,
+                                  ZX_VM_PERM_READ | ZX_VM_PERM_WRITE)) != ZX_OK) {
+            return status;
+        }
+        if ((status = chunks_.DecompressChunks(first_chunk, last_chunk, mapping.start(),
+                                               compressed_.start())) != ZX_OK) {
+            return status;
+        }
+        if ((status = MerkleTree::Verify(mapping.start(), blob_size_, merkle_.start(),
+                                         merkle_size_, offset, end - offset,
+                                         digest_)) != ZX_OK) {
+            return status;
+        }
+    }
+
+    return SupplyLocked(offset, fbl::round_up(end, ZX_PAGE_SIZE) - offset);
+}
+
+zx_status_t PageSource::PopulateLZ4FrameLocked() {
+    TRACE_DURATION("blobfs", "PageSource::PopulateLZ4Frame", "size", blob_size_);
+    // There is no way to decompress part of an LZ4 frame, so page in the
+    // whole blob on the first access.
+    fzl::OwnedVmoMapper compressed;
+    size_t compressed_size = data_blocks_ * kBlobfsBlockSize;
+    zx_status_t status = compressed.CreateAndMap(compressed_size, "compressed-blob");
+    if (status != ZX_OK) {
+        return status;
+    }
+    vmoid_t compressed_vmoid;
+    if ((status = txn_manager_->AttachVmo(compressed.vmo(), &compressed_vmoid)) != ZX_OK) {
+        return status;
+    }
+    auto detach = fbl::MakeAutoCall([&]() { txn_manager_->DetachVmo(compressed_vmoid); });
+
+    if ((status = ReadBlocks(compressed_vmoid, 0, data_blocks_)) != ZX_OK) {
+        return status;
+    }
+
+    {
+        fzl::VmoMapper mapping;
+        if ((status = mapping.Map(transfer_vmo_, 0, 0,
+                                  ZX_VM_PERM_READ | ZX_VM_PERM_WRITE)) != ZX_OK) {
+            return status;
+        }
+        size_t target_size = blob_size_;
+        if ((status = Decompressor::Decompress(mapping.start(), &target_size, compressed.start(),
+                                               &compressed_size)) != ZX_OK) {
+            return status;
+        }
+        if (target_size != blob_size_) {
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        if ((status = MerkleTree::Verify(mapping.start(), blob_size_, merkle_.start(),
+                                         merkle_size_, 0, blob_size_, digest_)) != ZX_OK) {
+            return status;
+        }
+    }
+
+    return SupplyLocked(0, fbl::round_up(blob_size_, ZX_PAGE_SIZE));
+}
+
+zx_status_t PageSource::SupplyLocked(uint64_t offset, uint64_t length) {
+    // The pages are moved rather than copied, which leaves the transfer VMO
+    // without pages again. It must not be mapped while they are taken.
+    return zx_pager_supply_pages(pager_->get(), vmo_.get(), offset, length,
+                                 transfer_vmo_.get(), offset);
+}
+
+zx_status_t Pager::Create(fbl::unique_ptr<Pager>* out) {
+    fbl::unique_ptr<Pager> pager(new Pager());
+
+    zx_status_t status = zx_pager_create(0, pager->pager_.reset_and_get_address());
+    if (status != ZX_OK) {
+        return status;
+    }
+    if ((status = zx::port::create(0, &pager->port_)) != ZX_OK) {
+        return status;
+    }
+    if (thrd_create_with_name(&pager->thread_, Pager::PagerThread, pager.get(),
+                              "blobfs-pager") != thrd_success) {
+        return ZX_ERR_NO_RESOURCES;
+    }
+    pager->running_ = true;
+
+    *out = std::move(pager);
+    return ZX_OK;
+}
+
+Pager::~Pager() {
+    if (running_) {
+        // Any completions of detached VMOs are queued ahead of this packet,
+        // so they are handled before the thread exits.
+        zx_port_packet_t packet = {};
+        packet.type = ZX_PKT_TYPE_USER;
+        ZX_ASSERT(port_.queue(&packet) == ZX_OK);
+        thrd_join(thread_, nullptr);
+    }
+
+    fbl::AutoLock lock(&lock_);
+    sources_.clear();
+}
+
+zx_status_t Pager::Register(const fbl::RefPtr<PageSource>& source, uint64_t size) {
+    fbl::AutoLock lock(&lock_);
+    const uint64_t key = next_key_++;
+    zx_status_t status = zx_pager_create_vmo(pager_.get(), 0, port_.get(), key, size,
+                                             source->vmo_.reset_and_get_address());
+    if (status != ZX_OK) {
+        return status;
+    }
+    source->key_ = key;
+    sources_.insert(source);
+    return ZX_OK;
+}
+
+void Pager::HandleRequest(uint64_t key, const zx_packet_page_request_t& request) {
+    fbl::RefPtr<PageSource> source;
+    {
+        fbl::AutoLock lock(&lock_);
+        auto iter = sources_.find(key);
+        if (!iter.IsValid()) {
+            return;
+        }
+        if (request.command == ZX_PAGER_VMO_COMPLETE) {
+            // Drop the registry's reference outside of the lock.
+            source = sources_.erase(iter);
+            return;
+        }
+        source = fbl::WrapRefPtr(&*iter);
+    }
+
+    if (request.command == ZX_PAGER_VMO_READ) {
+        // Failures are logged, and detach the VMO, by the source itself.
+        source->Populate(request.offset, request.length);
+    }
+}
+
+int Pager::PagerThread(void* arg) {
+    Pager* pager = reinterpret_cast<Pager*>(arg);
+
+    while (true) {
+        zx_port_packet_t packet;
+        zx_status_t status = pager->port_.wait(zx::time::infinite(), &packet);
+        if (status != ZX_OK) {
+            FS_TRACE_ERROR("blobfs: Pager failed to wait on port: %d\n", status);
+            return status;
+        }
+        if (packet.type == ZX_PKT_TYPE_USER) {
+            return 0;
+        }
+        if (packet.type == ZX_PKT_TYPE_PAGE_REQUEST) {
+            pager->HandleRequest(packet.key, packet.page_request);
+        }
+    }
+}
+
+} // namespace blobfs
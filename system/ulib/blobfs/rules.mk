@@ -16,6 +16,7 @@ MODULE_COMPILEFLAGS += -fvisibility=hidden
 
 # Sources common between host, target, and tests.
 COMMON_SRCS := \
+    $(LOCAL_DIR)/chunked.cpp \
     $(LOCAL_DIR)/common.cpp \
     $(LOCAL_DIR)/fsck.cpp \
     $(LOCAL_DIR)/extent-reserver.cpp \
@@ -37,6 +38,7 @@ COMMON_TARGET_SRCS := \
     $(LOCAL_DIR)/iterator/node-populator.cpp \
     $(LOCAL_DIR)/journal.cpp \
     $(LOCAL_DIR)/metrics.cpp \
+    $(LOCAL_DIR)/pager.cpp \
     $(LOCAL_DIR)/writeback.cpp \
 
 TARGET_MODULE_STATIC_LIBS := \
@@ -98,6 +100,7 @@ MODULE_SRCS := \
     $(TEST_DIR)/allocated-extent-iterator-test.cpp \
     $(TEST_DIR)/allocator-test.cpp \
     $(TEST_DIR)/blob-cache-test.cpp \
+    $(TEST_DIR)/chunked-test.cpp \
     $(TEST_DIR)/compressor-test.cpp \
     $(TEST_DIR)/extent-reserver-test.cpp \
     $(TEST_DIR)/journal-test.cpp \
@@ -0,0 +1,219 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <blobfs/chunked.h>
+#include <unittest/unittest.h>
+
+namespace blobfs {
+namespace {
+
+// Generates runs of repeated bytes, which compress well, or random bytes,
+// which do not compress at all.
+std::unique_ptr<char[]> GenerateInput(unsigned seed, size_t size, bool compressible) {
+    std::unique_ptr<char[]> input(new char[size]);
+    size_t i = 0;
+    while (i < size) {
+        const size_t run = compressible ? std::min<size_t>(1 + rand_r(&seed) % 32, size - i) : 1;
+        memset(&input[i], rand_r(&seed), run);
+        i += run;
+    }
+    return input;
+}
+
+bool CompressionHelper(ChunkedCompressor* compressor, const char* input, size_t size, size_t step,
+                       CompressionLevel level, std::unique_ptr<char[]>* out_compressed) {
+    BEGIN_HELPER;
+
+    size_t max_output = ChunkedCompressor::BufferMax(size);
+    std::unique_ptr<char[]> compressed(new char[max_output]);
+    ASSERT_EQ(ZX_OK, compressor->Initialize(compressed.get(), max_output, size, level));
+    EXPECT_TRUE(compressor->Compressing());
+
+    size_t offset = 0;
+    while (offset != size) {
+        const size_t incremental_size = std::min(step, size - offset);
+        ASSERT_EQ(ZX_OK, compressor->Update(input + offset, incremental_size));
+        offset += incremental_size;
+    }
+    ASSERT_EQ(ZX_OK, compressor->End());
+    EXPECT_LE(compressor->Size(), max_output);
+
+    *out_compressed = std::move(compressed);
+
+    END_HELPER;
+}
+
+// Tests compressing in steps of |kStep| bytes, and decompressing all of the
+// blob at once as well as chunk by chunk.
+template <size_t kSize, size_t kStep, CompressionLevel kLevel>
+bool CompressDecompress() {
+    BEGIN_TEST;
+
+    std::unique_ptr<char[]> input(GenerateInput(0, kSize, true));
+    ChunkedCompressor compressor;
+    std::unique_ptr<char[]> compressed;
+    ASSERT_TRUE(CompressionHelper(&compressor, input.get(), kSize, kStep, kLevel, &compressed));
+    EXPECT_LT(compressor.Size(), kSize);
+
+    std::unique_ptr<char[]> output(new char[kSize]);
+    ASSERT_EQ(ZX_OK, ChunkedDecompressor::Decompress(output.get(), kSize, compressed.get(),
+                                                     compressor.Size()));
+    EXPECT_EQ(0, memcmp(input.get(), output.get(), kSize));
+
+    ChunkedDecompressor decompressor;
+    ASSERT_EQ(ZX_OK, decompressor.Init(compressed.get(), compressor.Size(), kSize,
+                                       compressor.Size()));
+    EXPECT_EQ(kChunkedDefaultChunkSize, decompressor.chunk_size());
+    memset(output.get(), 0, kSize);
+    for (uint32_t i = decompressor.chunk_count(); i > 0; i--) {
+        ASSERT_EQ(ZX_OK, decompressor.DecompressChunks(i - 1, i, output.get(), compressed.get()));
+    }
+    EXPECT_EQ(0, memcmp(input.get(), output.get(), kSize));
+
+    END_TEST;
+}
+
+// Tests that decompressing a chunk only touches that chunk, and only needs its
+// own compressed data.
+bool DecompressOneChunk() {
+    BEGIN_TEST;
+
+    const size_t size = kChunkedDefaultChunkSize * 5 + kChunkedDefaultChunkSize / 2;
+    std::unique_ptr<char[]> input(GenerateInput(1, size, true));
+    ChunkedCompressor compressor;
+    std::unique_ptr<char[]> compressed;
+    ASSERT_TRUE(CompressionHelper(&compressor, input.get(), size, size,
+                                  CompressionLevel::kDefault, &compressed));
+
+    ChunkedDecompressor decompressor;
+    ASSERT_EQ(ZX_OK, decompressor.Init(compressed.get(), compressor.Size(), size,
+                                       compressor.Size()));
+    ASSERT_EQ(6u, decompressor.chunk_count());
+
+    // Wipe everything but the compressed data of the chunk.
+    std::unique_ptr<char[]> partial(new char[compressor.Size()]);
+    memset(partial.get(), 0xff, compressor.Size());
+    const uint64_t start = decompressor.ChunkOffset(2);
+    const uint64_t end = decompressor.ChunkOffset(3);
+    memcpy(&partial[start], &compressed[start], end - start);
+
+    std::unique_ptr<char[]> output(new char[size]);
+    memset(output.get(), 0, size);
+    ASSERT_EQ(ZX_OK, decompressor.DecompressChunks(2, 3, output.get(), partial.get()));
+    const size_t offset = 2 * kChunkedDefaultChunkSize;
+    EXPECT_EQ(0, memcmp(&input[offset], &output[offset], kChunkedDefaultChunkSize));
+    for (size_t i = 0; i < size; i++) {
+        if (i < offset || i >= offset + kChunkedDefaultChunkSize) {
+            ASSERT_EQ(0, output[i]);
+        }
+    }
+
+    END_TEST;
+}
+
+// Tests that chunks which do not compress are stored as they are.
+bool IncompressibleChunks() {
+    BEGIN_TEST;
+
+    const size_t size = kChunkedDefaultChunkSize * 2 + 100;
+    std::unique_ptr<char[]> input(GenerateInput(2, size, false));
+    ChunkedCompressor compressor;
+    std::unique_ptr<char[]> compressed;
+    ASSERT_TRUE(CompressionHelper(&compressor, input.get(), size, 1000,
+                                  CompressionLevel::kHigh, &compressed));
+    EXPECT_EQ(ChunkedCompressor::BufferMax(size), compressor.Size());
+
+    std::unique_ptr<char[]> output(new char[size]);
+    ASSERT_EQ(ZX_OK, ChunkedDecompressor::Decompress(output.get(), size, compressed.get(),
+                                                     compressor.Size()));
+    EXPECT_EQ(0, memcmp(input.get(), output.get(), size));
+
+    END_TEST;
+}
+
+// Tests that the compressor wants exactly the number of bytes it was set up for.
+bool WrongInputSize() {
+    BEGIN_TEST;
+
+    const size_t size = kChunkedDefaultChunkSize + 1;
+    std::unique_ptr<char[]> input(GenerateInput(3, size + 1, true));
+    const size_t max_output = ChunkedCompressor::BufferMax(size);
+    std::unique_ptr<char[]> compressed(new char[max_output]);
+
+    ChunkedCompressor compressor;
+    ASSERT_EQ(ZX_OK, compressor.Initialize(compressed.get(), max_output, size));
+    ASSERT_EQ(ZX_OK, compressor.Update(input.get(), size - 1));
+    EXPECT_EQ(ZX_ERR_BAD_STATE, compressor.End());
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, compressor.Update(input.get(), 2));
+    ASSERT_EQ(ZX_OK, compressor.Update(input.get(), 1));
+    EXPECT_EQ(ZX_OK, compressor.End());
+
+    compressor.Reset();
+    EXPECT_FALSE(compressor.Compressing());
+    EXPECT_EQ(ZX_ERR_BUFFER_TOO_SMALL, compressor.Initialize(compressed.get(), 8, size));
+
+    END_TEST;
+}
+
+// Tests that damaged headers and seek tables are rejected.
+bool CorruptSeekTable() {
+    BEGIN_TEST;
+
+    const size_t size = kChunkedDefaultChunkSize * 3;
+    std::unique_ptr<char[]> input(GenerateInput(4, size, true));
+    ChunkedCompressor compressor;
+    std::unique_ptr<char[]> compressed;
+    ASSERT_TRUE(CompressionHelper(&compressor, input.get(), size, size,
+                                  CompressionLevel::kDefault, &compressed));
+    const size_t compressed_size = compressor.Size();
+
+    ChunkedDecompressor decompressor;
+    // Truncated seek tables can be completed by reading more.
+    EXPECT_EQ(ZX_ERR_BUFFER_TOO_SMALL, decompressor.Init(compressed.get(),
+                                                         sizeof(ChunkedHeader) + 8, size,
+                                                         compressed_size));
+    // The size of the blob must match the number of chunks.
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, decompressor.Init(compressed.get(), compressed_size,
+                                                          size + kChunkedDefaultChunkSize,
+                                                          compressed_size));
+    // The compressed data must fit in the blob.
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, decompressor.Init(compressed.get(), compressed_size,
+                                                          size, compressed_size - 1));
+
+    // Chunks must be in order.
+    uint64_t* seek_table = reinterpret_cast<uint64_t*>(&compressed[sizeof(ChunkedHeader)]);
+    std::swap(seek_table[1], seek_table[2]);
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, decompressor.Init(compressed.get(), compressed_size,
+                                                          size, compressed_size));
+    std::swap(seek_table[1], seek_table[2]);
+    ASSERT_EQ(ZX_OK, decompressor.Init(compressed.get(), compressed_size, size,
+                                       compressed_size));
+
+    ChunkedHeader* header = reinterpret_cast<ChunkedHeader*>(compressed.get());
+    header->magic++;
+    EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, decompressor.Init(compressed.get(), compressed_size,
+                                                          size, compressed_size));
+
+    END_TEST;
+}
+
+} // namespace
+} // namespace blobfs
+
+BEGIN_TEST_CASE(blobfsChunkedTests)
+RUN_TEST((blobfs::CompressDecompress<1 << 12, 1 << 0, blobfs::CompressionLevel::kDefault>))
+RUN_TEST((blobfs::CompressDecompress<1 << 16, 1 << 10, blobfs::CompressionLevel::kDefault>))
+RUN_TEST((blobfs::CompressDecompress<(1 << 20) + 7, 3000, blobfs::CompressionLevel::kDefault>))
+RUN_TEST((blobfs::CompressDecompress<(1 << 20) + 7, 1 << 20, blobfs::CompressionLevel::kHigh>))
+RUN_TEST(blobfs::DecompressOneChunk)
+RUN_TEST(blobfs::IncompressibleChunks)
+RUN_TEST(blobfs::WrongInputSize)
+RUN_TEST(blobfs::CorruptSeekTable)
+END_TEST_CASE(blobfsChunkedTests);
@@ -85,6 +85,11 @@ typedef struct mount_options {
     bool create_mountpoint;
     // Enable journaling on the file system (if supported).
     bool enable_journal;
+    // Read file contents from disk as they are accessed (blobfs only).
+    bool enable_pager;
+    // Compress new files as a single LZ4 frame rather than in independently
+    // compressed chunks (blobfs only).
+    bool lz4_frame_compression;
 } mount_options_t;
 
 extern const mount_options_t default_mount_options;
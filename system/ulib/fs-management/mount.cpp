@@ -196,8 +196,11 @@ zx_status_t Mounter::MountNativeFs(const char* binary, unique_fd device,
     // 2. (optional) readonly
     // 3. (optional) verbose
     // 4. (optional) metrics
-    // 5. command
-    const char* argv[5] = {binary};
+    // 5. (optional) journal
+    // 6. (optional) pager
+    // 7. (optional) lz4 frame compression
+    // 8. command
+    const char* argv[8] = {binary};
     int argc = 1;
     if (options.readonly) {
         argv[argc++] = "--readonly";
@@ -211,6 +214,12 @@ zx_status_t Mounter::MountNativeFs(const char* binary, unique_fd device,
     if (options.enable_journal) {
         argv[argc++] = "--journal";
     }
+    if (options.enable_pager) {
+        argv[argc++] = "--pager";
+    }
+    if (options.lz4_frame_compression) {
+        argv[argc++] = "--lz4-frame";
+    }
     argv[argc++] = "mount";
     return LaunchAndMount(cb, options, argv, argc);
 }
@@ -262,6 +271,8 @@ const mount_options_t default_mount_options = {
     .wait_until_ready = true,
     .create_mountpoint = false,
     .enable_journal = false,
+    .enable_pager = false,
+    .lz4_frame_compression = false,
 };
 
 const mkfs_options_t default_mkfs_options = {
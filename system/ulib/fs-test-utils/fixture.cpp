@@ -247,6 +247,8 @@ zx_status_t Fixture::Mount() {
     mount_options_t mount_options = default_mount_options;
     mount_options.create_mountpoint = true;
     mount_options.wait_until_ready = true;
+    mount_options.enable_pager = options_.fs_enable_pager;
+    mount_options.lz4_frame_compression = options_.fs_lz4_frame_compression;
 
     disk_format_t format = detect_disk_format(fd.get());
     zx_status_t result = mount(fd.release(), fs_path_.c_str(), format,
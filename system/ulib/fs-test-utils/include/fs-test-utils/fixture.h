@@ -92,6 +92,12 @@ struct FixtureOptions {
     // Mount the device in |Fixture::fs_path()|. Format is auto detected.
     bool fs_mount = true;
 
+    // Mount the filesystem with demand paging of file contents (blobfs only).
+    bool fs_enable_pager = false;
+
+    // Compress new files as a single LZ4 frame rather than in chunks (blobfs only).
+    bool fs_lz4_frame_compression = false;
+
     // Seed for pseudo random number generator.
     unsigned int seed = 0;
 };
@@ -54,6 +54,15 @@ Usage:
         --seed SEED                    An unsigned integer to initialize
                                        pseudo-ramdom number generator.
 
+        --enable_pager                 The filesystem will read file contents
+                                       from disk as they are accessed.
+                                       (Options: blobfs)
+
+        --lz4_frame_compression        The filesystem will compress new files
+                                       as a single LZ4 frame rather than in
+                                       chunks.
+                                       (Options: blobfs)
+
     [Test Options]
          --out PATH                    In performance test mode, collected
                                        results will be written to PATH.
@@ -312,6 +321,8 @@ bool ParseCommandLineArgs(int argc, const char* const* argv, FixtureOptions* fix
         {"print_statistics", no_argument, nullptr, 0},
         {"runs", required_argument, nullptr, 0},
         {"seed", required_argument, nullptr, 0},
+        {"enable_pager", no_argument, nullptr, 0},
+        {"lz4_frame_compression", no_argument, nullptr, 0},
         {0, 0, 0, 0},
     };
     // Resets the internal state of getopt*, making this function idempotent.
@@ -379,6 +390,12 @@ bool ParseCommandLineArgs(int argc, const char* const* argv, FixtureOptions* fix
             case 12:
                 fixture_options->seed = static_cast<unsigned int>(strtoul(optarg, NULL, 0));
                 break;
+            case 13:
+                fixture_options->fs_enable_pager = true;
+                break;
+            case 14:
+                fixture_options->fs_lz4_frame_compression = true;
+                break;
             default:
                 break;
             }
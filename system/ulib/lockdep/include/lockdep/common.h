@@ -30,8 +30,14 @@ namespace lockdep {
 #define LOCK_DEP_ENABLE_VALIDATION 0
 #endif
 
-// Id type used to identify each lock class.
-using LockClassId = uintptr_t;
+// Configures whether lock statistics are collected or not. Defaults to
+// disabled. When enabled each acquisition reports its wait time and each
+// release its hold time to the system-defined runtime handlers, keyed by lock
+// class. This requires lock validation to be enabled to provide the lock class
+// ids.
+#ifndef LOCK_DEP_ENABLE_STATISTICS
+#define LOCK_DEP_ENABLE_STATISTICS 0
+#endif
 
 // A sentinel value indicating an empty slot in lock tracking data structures.
 constexpr LockClassId kInvalidLockClassId = 0;
@@ -81,6 +87,19 @@ using IfLockValidationEnabled = typename std::conditional<kLockValidationEnabled
                                                           EnabledType,
                                                           DisabledType>::type;
 
+// Whether or not lock statistics are globally enabled.
+constexpr bool kLockStatisticsEnabled = static_cast<bool>(LOCK_DEP_ENABLE_STATISTICS);
+
+static_assert(!kLockStatisticsEnabled || kLockValidationEnabled,
+              "LOCK_DEP_ENABLE_STATISTICS requires LOCK_DEP_ENABLE_VALIDATION!");
+
+// Utility template alias to simplify selecting different types based whether
+// lock statistics are enabled or disabled.
+template <typename EnabledType, typename DisabledType>
+using IfLockStatisticsEnabled = typename std::conditional<kLockStatisticsEnabled,
+                                                          EnabledType,
+                                                          DisabledType>::type;
+
 // Result type that represents whether a lock attempt was successful, or if not
 // which check failed.
 enum class LockResult : uint8_t {
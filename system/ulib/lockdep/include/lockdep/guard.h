@@ -74,16 +74,17 @@ public:
     // resolution when the underlying lock type is not nestable.
     template <typename Lockable, typename... Args,
               typename = internal::EnableIfNotNestable<Lockable, LockType>>
-    Guard(Lockable* lock, Args&&... state_args)
+    __ALWAYS_INLINE Guard(Lockable* lock, Args&&... state_args)
         __TA_ACQUIRE(lock) __TA_ACQUIRE(lock->capability())
-        : validator_{lock->id()}, lock_{&lock->lock()},
+        : validator_{lock->id()}, statistics_{lock->id(), __GET_CALLER(0)},
+          lock_{&lock->lock()},
           state_{fbl::forward<Args>(state_args)...} { ValidateAndAcquire(); }
 
     // Acquires the given lock. This constructor participates in overload
     // resolution when the underlying lock type is nestable.
     template <typename Lockable, typename... Args,
               typename = internal::EnableIfNestable<Lockable, LockType>>
-    Guard(Lockable* lock, uintptr_t order, Args&&... state_args)
+    __ALWAYS_INLINE Guard(Lockable* lock, uintptr_t order, Args&&... state_args)
         __TA_ACQUIRE(lock) __TA_ACQUIRE(lock->capability())
         : Guard{OrderedLock, lock, order, fbl::forward<Args>(state_args)...} {}
 
@@ -98,6 +99,7 @@ public:
         if (lock_ != nullptr) {
             LockPolicy<LockType, Option>::Release(lock_, &state_,
                                                   fbl::forward<Args>(args)...);
+            statistics_.Released();
             validator_.ValidateRelease();
             lock_ = nullptr;
         }
@@ -133,7 +135,8 @@ public:
     //  Guard<fbl::Mutex> guard{AdoptLock, std::move(rvalue_arugment)};
     //
     Guard(AdoptLockTag, Guard&& other) __TA_ACQUIRE(other.lock_)
-        : validator_{std::move(other.validator_)}, lock_{other.lock_},
+        : validator_{std::move(other.validator_)},
+          statistics_{std::move(other.statistics_)}, lock_{other.lock_},
           state_{std::move(other.state_)} { other.lock_ = nullptr; }
 
     // Temporarily releases and un-tracks the guarded lock before executing the
@@ -158,6 +161,7 @@ public:
 
         LockPolicy<LockType, Option>::Release(
             lock_, &state_, fbl::forward<ReleaseArgs>(release_args)...);
+        statistics_.Released();
         validator_.ValidateRelease();
 
         fbl::forward<Op>(op)();
@@ -177,7 +181,10 @@ private:
     // body.
     void ValidateAndAcquire() __TA_NO_THREAD_SAFETY_ANALYSIS {
         validator_.ValidateAcquire();
-        if (!LockPolicy<LockType, Option>::Acquire(lock_, &state_)) {
+        statistics_.BeginAcquire();
+        if (LockPolicy<LockType, Option>::Acquire(lock_, &state_)) {
+            statistics_.Acquired();
+        } else {
             lock_ = nullptr;
             validator_.ValidateRelease();
         }
@@ -186,10 +193,11 @@ private:
     // Ordered lock constructor used by the nestable lock constructor above and
     // by GuardMultiple.
     template <typename Lockable, typename... Args>
-    Guard(OrderedLockTag, Lockable* lock,
-          uintptr_t order, Args&&... state_args)
+    __ALWAYS_INLINE Guard(OrderedLockTag, Lockable* lock,
+                          uintptr_t order, Args&&... state_args)
         __TA_ACQUIRE(lock) __TA_ACQUIRE(lock->capability())
-        : validator_{lock->id(), order}, lock_{&lock->lock()},
+        : validator_{lock->id(), order}, statistics_{lock->id(), __GET_CALLER(0)},
+          lock_{&lock->lock()},
           state_{fbl::forward<Args>(state_args)...} { ValidateAndAcquire(); }
 
     // Validator type used when lock validation is enabled. Provides the
@@ -222,6 +230,51 @@ private:
     // The validator to use when acquiring and releasing the lock.
     Validator validator_;
 
+    // Statistics type used when lock statistics are enabled. Reports the wait
+    // time of the acquisition and the hold time of the lock to the system.
+    // Failed try-lock attempts are not reported. The call site is captured by
+    // the always inlined Guard constructors, since how far this is inlined
+    // into them would otherwise decide which frame gets the blame.
+    struct LockStatistics {
+        LockStatistics(LockClassId id, void* caller)
+            : id{id}, caller{caller} {}
+        LockStatistics(LockStatistics&& other)
+            : id{other.id}, caller{other.caller}, acquired{other.acquired} {
+            other.acquired = 0;
+        }
+
+        void BeginAcquire() {
+            begin = SystemLockStatBeginAcquire();
+        }
+        void Acquired() {
+            acquired = SystemLockStatAcquired(id, begin, caller);
+        }
+        void Released() {
+            if (acquired != 0)
+                SystemLockStatReleased(id, acquired);
+            acquired = 0;
+        }
+
+        LockClassId id;
+        void* caller;
+        uint64_t begin{0};
+        uint64_t acquired{0};
+    };
+
+    // Statistics type used when lock statistics are disabled.
+    struct DummyStatistics {
+        DummyStatistics(LockClassId, void*) {}
+        void BeginAcquire() {}
+        void Acquired() {}
+        void Released() {}
+    };
+
+    // Alias of the configured statistics type.
+    using Statistics = IfLockStatisticsEnabled<LockStatistics, DummyStatistics>;
+
+    // The statistics to update when acquiring and releasing the lock.
+    Statistics statistics_;
+
     // Pointer to the acquired lock.
     LockType* lock_;
 
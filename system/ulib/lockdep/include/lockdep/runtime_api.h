@@ -15,6 +15,9 @@
 
 namespace lockdep {
 
+// Id type used to identify each lock class.
+using LockClassId = uintptr_t;
+
 // Forward declarations.
 class AcquiredLockEntry;
 class ThreadLockState;
@@ -54,4 +57,20 @@ extern void SystemInitThreadLockState(ThreadLockState* state);
 // given time interval.
 extern void SystemTriggerLoopDetection();
 
+// System-defined hook that marks the start of an attempt to acquire a lock when
+// lock statistics are enabled. Returns an opaque timestamp that is passed to
+// SystemLockStatAcquired(), or zero if statistics are not being collected.
+extern uint64_t SystemLockStatBeginAcquire();
+
+// System-defined hook that records an acquisition of the lock class given by
+// |id|, started at |begin| and performed by |caller_address|. Returns an
+// opaque timestamp that is passed to SystemLockStatReleased(), or zero if
+// statistics are not being collected.
+extern uint64_t SystemLockStatAcquired(LockClassId id, uint64_t begin,
+                                       void* caller_address);
+
+// System-defined hook that records the release of the lock class given by |id|
+// that was acquired at |acquired|.
+extern void SystemLockStatReleased(LockClassId id, uint64_t acquired);
+
 } // namespace lockdep
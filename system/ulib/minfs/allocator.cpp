@@ -7,6 +7,7 @@
 #include <string.h>
 
 #include <bitmap/raw-bitmap.h>
+#include <fbl/algorithm.h>
 
 #include <minfs/allocator.h>
 #include <minfs/block-txn.h>
@@ -38,6 +39,28 @@ size_t AllocatorPromise::Allocate(WriteTxn* txn) {
     return allocator_->Allocate(txn);
 }
 
+size_t AllocatorPromise::AllocateRun(WriteTxn* txn, size_t hint, size_t count,
+                                     size_t* out_count) {
+    ZX_DEBUG_ASSERT(allocator_ != nullptr);
+    ZX_DEBUG_ASSERT(count > 0 && reserved_ >= count);
+    size_t start = allocator_->AllocateRun(txn, hint, count, out_count);
+    reserved_ -= *out_count;
+    return start;
+}
+
+void AllocatorPromise::Merge(AllocatorPromise* other) {
+    ZX_DEBUG_ASSERT(allocator_ == other->allocator_);
+    reserved_ += other->reserved_;
+    other->reserved_ = 0;
+}
+
+void AllocatorPromise::Cancel(size_t count) {
+    ZX_DEBUG_ASSERT(allocator_ != nullptr);
+    ZX_DEBUG_ASSERT(reserved_ >= count);
+    reserved_ -= count;
+    allocator_->Unreserve(count);
+}
+
 AllocatorFvmMetadata::AllocatorFvmMetadata() = default;
 AllocatorFvmMetadata::AllocatorFvmMetadata(uint32_t* data_slices,
                                            uint32_t* metadata_slices,
@@ -151,11 +174,45 @@ size_t Allocator::Allocate(WriteTxn* txn) {
     return bitoff_start;
 }
 
+size_t Allocator::AllocateRun(WriteTxn* txn, size_t hint, size_t count, size_t* out_count) {
+    ZX_DEBUG_ASSERT(reserved_ >= count);
+    // Prefer continuing from |hint|, then the first run long enough to satisfy the whole
+    // request, and otherwise settle for whatever run starts at the first free element.
+    size_t bitoff_start;
+    if (hint >= map_.size() || map_.Get(hint, hint + 1)) {
+        if (map_.Find(false, hint_, map_.size(), count, &bitoff_start) != ZX_OK &&
+            map_.Find(false, 0, map_.size(), count, &bitoff_start) != ZX_OK &&
+            map_.Find(false, hint_, map_.size(), 1, &bitoff_start) != ZX_OK) {
+            ZX_ASSERT(map_.Find(false, 0, hint_, 1, &bitoff_start) == ZX_OK);
+        }
+    } else {
+        bitoff_start = hint;
+    }
+
+    size_t bitoff_end = fbl::min(bitoff_start + count, map_.size());
+    map_.Find(true, bitoff_start, bitoff_end, 1, &bitoff_end);
+    const size_t run = bitoff_end - bitoff_start;
+
+    ZX_ASSERT(map_.Set(bitoff_start, bitoff_end) == ZX_OK);
+
+    Persist(txn, bitoff_start, run);
+    metadata_.PoolAllocate(static_cast<uint32_t>(run));
+    reserved_ -= run;
+    sb_->Write(txn);
+    hint_ = bitoff_end;
+    *out_count = run;
+    return bitoff_start;
+}
+
 void Allocator::Free(WriteTxn* txn, size_t index) {
-    ZX_DEBUG_ASSERT(map_.Get(index, index + 1));
-    map_.Clear(index, index + 1);
-    Persist(txn, index, 1);
-    metadata_.PoolRelease(1);
+    Free(txn, index, 1);
+}
+
+void Allocator::Free(WriteTxn* txn, size_t index, size_t count) {
+    ZX_DEBUG_ASSERT(map_.Get(index, index + count));
+    map_.Clear(index, index + count);
+    Persist(txn, index, count);
+    metadata_.PoolRelease(static_cast<uint32_t>(count));
     sb_->Write(txn);
 
     if (index < hint_) {
@@ -238,7 +295,7 @@ zx_status_t Allocator::Extend(WriteTxn* txn) {
 void Allocator::Persist(WriteTxn* txn, size_t index, size_t count) {
     blk_t rel_block = static_cast<blk_t>(index) / kMinfsBlockBits;
     blk_t abs_block = metadata_.MetadataStartBlock() + rel_block;
-    blk_t blk_count = BitmapBlocksForSize(count);
+    blk_t blk_count = BitmapBlocksForSize(index + count) - rel_block;
 
 #ifdef __Fuchsia__
     zx_handle_t data = map_.StorageUnsafe()->GetVmo().get();
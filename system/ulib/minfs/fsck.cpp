@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +10,7 @@
 
 #include <minfs/format.h>
 #include <minfs/fsck.h>
+#include <minfs/journal.h>
 
 #include "minfs-private.h"
 #include <utility>
@@ -48,6 +50,7 @@ private:
                                ino_t parent, uint32_t flags);
     const char* CheckDataBlock(blk_t bno);
     zx_status_t CheckFile(Inode* inode, ino_t ino);
+    zx_status_t CheckExtents(Inode* inode, ino_t ino);
 
     fbl::unique_ptr<Minfs> fs_;
     RawBitmap checked_inodes_;
@@ -177,6 +180,17 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
         return status;
     }
 
+    const bool hashed = inode->flags & kMinfsInodeFlagDirIndex;
+    if (hashed && (fs_->Info().version < kMinfsVersionDirIndex)) {
+        FS_TRACE_WARN("check: ino#%u: hashed directory, which version %u predates\n",
+                      ino, fs_->Info().version);
+        conforming_ = false;
+    }
+    if (hashed && ((status = vn->LoadDirIndex()) != ZX_OK)) {
+        FS_TRACE_ERROR("check: ino#%u: invalid directory index\n", ino);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
     size_t off = 0;
     while (true) {
         uint32_t data[MINFS_DIRENT_SIZE];
@@ -201,6 +215,11 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
             FS_TRACE_ERROR("check: ino#%u: de[%u]: bad dirent reclen (%u)\n", ino, eno, rlen);
             return ZX_ERR_IO_DATA_INTEGRITY;
         }
+        if (hashed && (is_last || ((off % kMinfsBlockSize) + rlen > kMinfsBlockSize))) {
+            FS_TRACE_ERROR("check: ino#%u: de[%u]: bad hashed dirent reclen (%u)\n",
+                           ino, eno, rlen);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
         if (de->ino == 0) {
             if (flags & CD_DUMP) {
                 FS_TRACE_DEBUG("ino#%u: de[%u]: <empty> reclen=%u\n", ino, eno, rlen);
@@ -240,6 +259,20 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
                     FS_TRACE_ERROR("check: ino#%u: de[%u]: '..' ino=%u (not parent!)\n", ino, eno, de->ino);
                 }
             }
+            if (hashed) {
+                // "." and ".." live in the index block, and every other entry in the leaf
+                // which its name hashes to.
+                blk_t leaf = 0;
+                if (!dot_or_dotdot) {
+                    leaf = vn->dir_index_[vn->FindLeaf(
+                            DirentHash(fbl::StringPiece(de->name, de->namelen)))].block;
+                }
+                if (off / kMinfsBlockSize != leaf) {
+                    FS_TRACE_ERROR("check: ino#%u: de[%u]: '%.*s' in block %zu, not %u\n", ino,
+                                   eno, de->namelen, de->name, off / kMinfsBlockSize, leaf);
+                    return ZX_ERR_IO_DATA_INTEGRITY;
+                }
+            }
             //TODO: check for cycles (non-dot/dotdot dir ref already in checked bitmap)
             if (flags & CD_DUMP) {
                 FS_TRACE_DEBUG("ino#%u: de[%u]: ino=%u type=%u '%.*s' %s\n", ino, eno, de->ino, de->type,
@@ -258,6 +291,9 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
         } else {
             off += rlen;
         }
+        if (hashed && (off >= inode->size)) {
+            break;
+        }
         eno++;
     }
     if (dirent_count != inode->dirent_count) {
@@ -292,6 +328,10 @@ const char* MinfsChecker::CheckDataBlock(blk_t bno) {
 }
 
 zx_status_t MinfsChecker::CheckFile(Inode* inode, ino_t ino) {
+    if (inode->flags & kMinfsInodeFlagExtents) {
+        return CheckExtents(inode, ino);
+    }
+
     FS_TRACE_DEBUG("Direct blocks: \n");
     for (unsigned n = 0; n < kMinfsDirect; n++) {
         FS_TRACE_DEBUG(" %d,", inode->dnum[n]);
@@ -391,6 +431,102 @@ zx_status_t MinfsChecker::CheckFile(Inode* inode, ino_t ino) {
     return ZX_OK;
 }
 
+zx_status_t MinfsChecker::CheckExtents(Inode* inode, ino_t ino) {
+    if (fs_->Info().version < kMinfsVersionExtents) {
+        FS_TRACE_WARN("check: ino#%u: mapped by extents, which version %u predates\n",
+                      ino, fs_->Info().version);
+        conforming_ = false;
+    }
+    const InodeExtents* header = GetInodeExtents(inode);
+    FS_TRACE_DEBUG("Extents: %u\n", header->count);
+
+    uint32_t block_count = 0;
+    // The first block of the file past the previous extent.
+    blk_t next_blk = 0;
+
+    // Check the extents held by the inode, then those of each ExtentBlock in turn.
+    const Extent* extents = header->extents;
+    uint32_t count = fbl::min(header->count, kMinfsInlineExtents);
+    uint32_t checked = 0;
+    blk_t bno = header->next;
+    char data[kMinfsBlockSize];
+    while (true) {
+        for (uint32_t i = 0; i < count; i++, checked++) {
+            const Extent& extent = extents[i];
+            if ((extent.length == 0) || (extent.file_block < next_blk) ||
+                (extent.file_block + extent.length > kMinfsMaxFileBlock)) {
+                FS_TRACE_WARN("check: ino#%u: extent %u: bad range\n", ino, checked);
+                conforming_ = false;
+            }
+            next_blk = extent.file_block + extent.length;
+            block_count += extent.length;
+            if ((extent.start + extent.length < extent.start) ||
+                (extent.start + extent.length > fs_->Info().block_count)) {
+                FS_TRACE_WARN("check: ino#%u: extent %u(@%u): out of range\n",
+                              ino, checked, extent.start);
+                conforming_ = false;
+                continue;
+            }
+            for (blk_t n = 0; n < extent.length; n++) {
+                const char* msg;
+                if ((msg = CheckDataBlock(extent.start + n)) != nullptr) {
+                    FS_TRACE_WARN("check: ino#%u: block %u(@%u): %s\n",
+                                  ino, extent.file_block + n, extent.start + n, msg);
+                    conforming_ = false;
+                }
+            }
+        }
+        if (checked == header->count) {
+            break;
+        }
+
+        const char* msg;
+        if (bno == 0) {
+            FS_TRACE_WARN("check: ino#%u: extent blocks end after %u of %u extents\n",
+                          ino, checked, header->count);
+            conforming_ = false;
+            break;
+        } else if ((msg = CheckDataBlock(bno)) != nullptr) {
+            FS_TRACE_WARN("check: ino#%u: extent block (@%u): %s\n", ino, bno, msg);
+            conforming_ = false;
+            break;
+        }
+        block_count++;
+
+        zx_status_t status;
+        if ((status = fs_->ReadDat(bno, data)) != ZX_OK) {
+            return status;
+        }
+        const ExtentBlock* block = reinterpret_cast<const ExtentBlock*>(data);
+        // Blocks of the chain need not be full, but are never empty.
+        count = block->count;
+        if ((block->magic != kMinfsExtentBlockMagic) || (count == 0) ||
+            (count > kMinfsExtentsPerBlock) || (count > header->count - checked)) {
+            FS_TRACE_WARN("check: ino#%u: extent block (@%u): bad header\n", ino, bno);
+            conforming_ = false;
+            break;
+        }
+        extents = block->extents;
+        bno = block->next;
+    }
+    if (checked == header->count && bno != 0) {
+        FS_TRACE_WARN("check: ino#%u: extent blocks continue past the last extent\n", ino);
+        conforming_ = false;
+    }
+
+    unsigned max_blocks = fbl::round_up(inode->size, kMinfsBlockSize) / kMinfsBlockSize;
+    if (next_blk > max_blocks) {
+        FS_TRACE_WARN("check: ino#%u: filesize too small\n", ino);
+        conforming_ = false;
+    }
+    if (block_count != inode->block_count) {
+        FS_TRACE_WARN("check: ino#%u: block count %u, actual blocks %u\n",
+             ino, inode->block_count, block_count);
+        conforming_ = false;
+    }
+    return ZX_OK;
+}
+
 void MinfsChecker::CheckReserved() {
     // Check reserved inode '0'.
     if (fs_->inodes_->inode_allocator_->map_.Get(0, 1)) {
@@ -584,10 +720,13 @@ zx_status_t MinfsChecker::CheckAllocatedCounts() const {
 zx_status_t MinfsChecker::CheckJournal() const {
     char data[kMinfsBlockSize];
     blk_t journal_block;
+    blk_t journal_blocks;
 #ifdef __Fuchsia__
     journal_block = fs_->Info().journal_start_block;
+    journal_blocks = JournalBlocks(fs_->Info());
 #else
     journal_block = fs_->offsets_.JournalStartBlock();
+    journal_blocks = fs_->offsets_.JournalBlockCount();
 #endif
 
     if (fs_->bc_->Readblk(journal_block, data) < 0) {
@@ -600,6 +739,11 @@ zx_status_t MinfsChecker::CheckJournal() const {
         FS_TRACE_ERROR("minfs: invalid journal magic\n");
         return ZX_ERR_BAD_STATE;
     }
+    if (journal_info->start_block >= journal_blocks) {
+        FS_TRACE_ERROR("minfs: journal start %" PRIu64 " out of range\n",
+                       journal_info->start_block);
+        return ZX_ERR_BAD_STATE;
+    }
 
     return ZX_OK;
 }
@@ -641,13 +785,19 @@ zx_status_t Fsck(fbl::unique_ptr<Bcache> bc) {
         FS_TRACE_ERROR("minfs: could not read info block\n");
         return ZX_ERR_IO;
     }
-    const Superblock* info = reinterpret_cast<const Superblock*>(data);
+    Superblock* info = reinterpret_cast<Superblock*>(data);
     DumpInfo(info);
     if ((status = CheckSuperblock(info, bc.get())) != ZX_OK) {
         FS_TRACE_ERROR("Fsck: check_info failure: %d\n", status);
         return status;
     }
 
+    // Check the filesystem as it would be mounted.
+    if ((status = ReplayJournal(bc.get(), info)) != ZX_OK) {
+        FS_TRACE_ERROR("Fsck: journal replay failure: %d\n", status);
+        return status;
+    }
+
     MinfsChecker chk;
     if ((status = chk.Init(std::move(bc), info)) != ZX_OK) {
         FS_TRACE_ERROR("Fsck: Init failure: %d\n", status);
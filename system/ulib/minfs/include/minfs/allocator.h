@@ -40,6 +40,20 @@ public:
 
     // Allocate a new item in allocator_. Return the index of the newly allocated item.
     size_t Allocate(WriteTxn* txn);
+
+    // Allocate a run of between 1 and |count| contiguous items in allocator_, starting at
+    // |hint| if that item is free. Return the index of the first item, and the length of the
+    // run in |out_count|. |count| may not exceed the number of items still reserved.
+    size_t AllocateRun(WriteTxn* txn, size_t hint, size_t count, size_t* out_count);
+
+    // Return the number of items which are reserved, but not yet allocated.
+    size_t Reserved() const { return reserved_; }
+
+    // Take over the reservation held by |other|, which must belong to the same allocator.
+    void Merge(AllocatorPromise* other);
+
+    // Give back |count| of the reserved items to allocator_.
+    void Cancel(size_t count);
 private:
     friend class Allocator;
 
@@ -202,6 +216,9 @@ public:
     // Free an item from the allocator.
     void Free(WriteTxn* txn, size_t index);
 
+    // Free |count| contiguous items, starting at |index|, from the allocator.
+    void Free(WriteTxn* txn, size_t index, size_t count);
+
 private:
     friend class MinfsChecker;
     friend class AllocatorPromise;
@@ -215,6 +232,9 @@ private:
     // Allocate an element and return the newly allocated index.
     size_t Allocate(WriteTxn* txn);
 
+    // Allocate a run of up to |count| elements and return the index of the first.
+    size_t AllocateRun(WriteTxn* txn, size_t hint, size_t count, size_t* out_count);
+
     // Write back the allocation of the following items to disk.
     void Persist(WriteTxn* txn, size_t index, size_t count);
 
@@ -21,6 +21,9 @@ struct WriteRequest {
     size_t vmo_offset;
     size_t dev_offset;
     size_t length;
+    // File data, which is not journaled (unlike metadata, including directory
+    // contents and indirect blocks).
+    bool data;
 };
 
 // A transaction consisting of enqueued VMOs to be written
@@ -40,10 +43,19 @@ public:
     // Identify that a block should be written to disk at a later point in time.
     void Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks);
 
+    // Identify that a block of file data should be written to disk at a later
+    // point in time. Unlike metadata, file data is written in place even when
+    // journaling.
+    void EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                     uint64_t nblocks);
+
     fbl::Vector<WriteRequest>& Requests() { return requests_; }
 
     size_t BlkCount() const;
 
+    // Returns the number of blocks which are not file data.
+    size_t MetadataBlkCount() const;
+
 protected:
     // Activate the transaction, writing it out to disk.
     //
@@ -52,6 +64,9 @@ protected:
     zx_status_t Flush(zx_handle_t vmo, vmoid_t vmoid);
 
 private:
+    void EnqueueRequest(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                        uint64_t nblocks, bool data);
+
     Bcache* bc_;
     fbl::Vector<WriteRequest> requests_;
 };
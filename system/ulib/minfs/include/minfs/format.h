@@ -16,6 +16,7 @@
 #include <limits.h>
 #include <limits>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 // clang-format off
@@ -32,7 +33,15 @@ typedef uint32_t ino_t;
 
 constexpr uint64_t kMinfsMagic0         = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1         = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion        = 0x00000007;
+constexpr uint32_t kMinfsVersion        = 0x00000009;
+// Filesystems of previous versions are still mounted, since they differ only
+// in the features they may contain. mkfs writes the oldest of them, and they
+// are upgraded to the version which introduced a feature when it is first used:
+// - version 7 filesystems cannot contain hashed directories (see DirIndex)
+// - version 8 filesystems cannot contain extent-mapped files (see InodeExtents)
+constexpr uint32_t kMinfsVersionLinearDirs = 0x00000007;
+constexpr uint32_t kMinfsVersionDirIndex   = 0x00000008;
+constexpr uint32_t kMinfsVersionExtents    = 0x00000009;
 
 constexpr ino_t    kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 0x00000001; // Currently unused
@@ -129,16 +138,54 @@ constexpr size_t kMinfsMinimumSlices = 7;
 
 constexpr uint64_t kMinfsDefaultInodeCount = 32768;
 
+constexpr uint64_t kJournalEntryHeaderMagic = (0x6d696e6a68656164ULL);
+constexpr uint64_t kJournalEntryCommitMagic = (0x6d696e6a636f6d6dULL);
+
+// Number of blocks of each journal entry which are not copies of metadata:
+// the header block and the commit block.
+constexpr blk_t kJournalEntryMetadataBlocks = 2;
+
 struct JournalInfo {
     uint64_t magic;
-    uint64_t reserved0;
-    uint64_t reserved1;
+    uint64_t start_block; // Journal block of the oldest live entry, or 0 if there is none.
+    uint64_t sequence;    // Sequence number of the entry at |start_block|.
     uint64_t reserved2;
     uint64_t reserved3;
 };
 
 static_assert(sizeof(JournalInfo) <= kMinfsBlockSize, "Journal info size is too large");
 
+struct JournalHeaderBlock {
+    uint64_t magic;
+    uint64_t sequence;
+    uint64_t reserved;
+    uint64_t num_blocks; // Number of metadata blocks between the header and commit blocks.
+    blk_t target_blocks[kJournalEntryHeaderMaxBlocks]; // Absolute destinations of those blocks.
+};
+
+static_assert(sizeof(JournalHeaderBlock) == kMinfsBlockSize, "Journal header size is wrong");
+
+struct JournalCommitBlock {
+    uint64_t magic;
+    uint64_t sequence;
+    uint32_t checksum; // crc32 of the header block and all metadata blocks of the entry.
+};
+
+static_assert(sizeof(JournalCommitBlock) <= kMinfsBlockSize, "Journal commit size is too large");
+
+// Notes:
+// - the journal starts with the JournalInfo block, and the rest of it is a
+//   circular log of entries, each made of a header block, copies of the
+//   metadata blocks of one or more transactions, and a commit block; entries
+//   may wrap around the end of the journal
+// - block N of the log is journal block (1 + N % (journal blocks - 1))
+// - an entry is valid if its header and commit carry the expected sequence
+//   number (one more than the previous entry) and the commit checksum matches
+// - metadata is only written in place once its entry is durable, so on
+//   mount, valid entries starting at |start_block| are replayed in order
+// - a zeroed JournalInfo (other than the magic) describes an empty journal,
+//   as written by mkfs
+
 struct Inode {
     uint32_t magic;
     uint32_t size;
@@ -151,7 +198,8 @@ struct Inode {
     uint32_t dirent_count;          // for directories
     ino_t last_inode;               // index to the previous unlinked inode
     ino_t next_inode;               // index to the next unlinked inode
-    uint32_t rsvd[3];
+    uint32_t flags;                 // kMinfsInodeFlag*
+    uint32_t rsvd[2];
     blk_t dnum[kMinfsDirect];    // direct blocks
     blk_t inum[kMinfsIndirect];  // indirect blocks
     blk_t dinum[kMinfsDoublyIndirect]; // doubly indirect blocks
@@ -160,6 +208,70 @@ struct Inode {
 static_assert(sizeof(Inode) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+// The directory is hashed: see DirIndex.
+constexpr uint32_t kMinfsInodeFlagDirIndex = 0x00000001;
+// The file is mapped by extents rather than block pointers: see InodeExtents.
+constexpr uint32_t kMinfsInodeFlagExtents  = 0x00000002;
+
+// A run of |length| blocks of a file, starting at |file_block| within the
+// file, stored contiguously on disk from data block |start|.
+struct Extent {
+    uint32_t file_block;
+    blk_t start;
+    uint32_t length;
+};
+
+constexpr uint32_t kMinfsInlineExtents = 15;
+
+// For files with kMinfsInodeFlagExtents, the block pointers of the inode
+// (dnum, inum and dinum) are replaced by an InodeExtents.
+struct InodeExtents {
+    uint32_t count;     // Number of extents of the file
+    blk_t next;         // First ExtentBlock, or 0
+    Extent extents[kMinfsInlineExtents];
+    uint32_t rsvd;
+};
+
+static_assert(sizeof(InodeExtents) == sizeof(blk_t) * (kMinfsDirect + kMinfsIndirect +
+                                                       kMinfsDoublyIndirect),
+              "minfs inode extents size is wrong");
+static_assert(offsetof(Inode, dnum) + sizeof(InodeExtents) == sizeof(Inode),
+              "minfs inode extents must end the inode");
+
+inline InodeExtents* GetInodeExtents(Inode* inode) {
+    return reinterpret_cast<InodeExtents*>(inode->dnum);
+}
+
+inline const InodeExtents* GetInodeExtents(const Inode* inode) {
+    return reinterpret_cast<const InodeExtents*>(inode->dnum);
+}
+
+// Extents which do not fit in the inode overflow into a chain of
+// ExtentBlocks, which are data blocks owned by the file.
+struct ExtentBlock {
+    uint32_t magic;
+    uint32_t count;     // Number of extents in this block
+    blk_t next;         // Next ExtentBlock, or 0
+    uint32_t rsvd;
+    Extent extents[];
+};
+
+constexpr uint32_t kMinfsExtentBlockMagic = 0x746e7865;
+constexpr uint32_t kMinfsExtentsPerBlock = (kMinfsBlockSize - sizeof(ExtentBlock)) /
+                                           sizeof(Extent);
+
+// Notes:
+// - extents are sorted by file_block and never overlap; adjacent extents which
+//   are also contiguous on disk are merged
+// - the first kMinfsInlineExtents extents live in the inode, and the rest are
+//   held by the ExtentBlocks in order; blocks of the chain need not be full,
+//   so that a full block is split rather than the extents after it shifted
+//   through the rest of the chain, but are never empty
+// - the block_count of the inode covers both the data blocks and the chain
+// - only regular files are mapped by extents: new files, and files without
+//   any blocks once they are written, start using them; files mapped by
+//   block pointers keep them
+
 struct Dirent {
     ino_t ino;                      // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
@@ -205,6 +317,40 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 //   record starts. If the MAX_DIR_SIZE is increased, this 'last' record will
 //   also increase in size.
 
+// A directory which outgrows its first block is converted into a hashed
+// directory, made of an index block followed by leaf blocks. The index block
+// starts with the '.' and '..' records, followed by a free record covering the
+// rest of the block, in which the DirIndex lives. Each leaf block holds the
+// records whose name hashes (see DirentHash) fall in a range of the index.
+struct DirIndexEntry {
+    uint32_t hash;  // Lowest name hash of the leaf
+    blk_t block;    // Leaf block, relative to the start of the directory
+};
+
+struct DirIndex {
+    uint32_t magic;
+    uint32_t count; // Number of leaves
+    DirIndexEntry entries[];
+};
+
+constexpr uint32_t kMinfsDirIndexMagic   = 0x78646e69;
+// Offset of the DirIndex within the index block.
+constexpr uint32_t kMinfsDirIndexOffset  = DirentSize(1) + DirentSize(2) + MINFS_DIRENT_SIZE;
+constexpr uint32_t kMinfsDirIndexMaxLeaves = (kMinfsBlockSize - kMinfsDirIndexOffset -
+                                              sizeof(DirIndex)) / sizeof(DirIndexEntry);
+constexpr uint32_t kMinfsMaxHashedDirectorySize = (1 + kMinfsDirIndexMaxLeaves) * kMinfsBlockSize;
+
+// Notes:
+// - the entries of a DirIndex are sorted by strictly increasing hash, the
+//   first of which is 0; a leaf holds the hashes up to that of the next entry
+// - leaf blocks are numbered from 1 up to the number of leaves, in the order
+//   in which they were added, and the directory size covers all of them
+// - the records of a hashed directory never cross a block boundary, and none
+//   of them carries kMinfsReclenLast: the directory ends at its size
+// - leaves are split by hash when they fill up, and are never freed
+// - linear directories larger than a block, written before hashed directories
+//   existed, are left linear
+
 // blocksize   8K    16K    32K
 // 16 dir =  128K   256K   512K
 // 32 ind =  512M  1024M  2048M
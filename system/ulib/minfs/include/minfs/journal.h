@@ -0,0 +1,160 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file describes the metadata journal of MinFS (see JournalInfo), which
+// makes the metadata updates of each transaction atomic, and lets the updates
+// of many transactions reach the disk in a few large writes.
+
+#pragma once
+
+#ifdef __Fuchsia__
+#include <fbl/vector.h>
+#include <lib/fzl/owned-vmo-mapper.h>
+#endif
+
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+
+#include <minfs/bcache.h>
+#include <minfs/format.h>
+
+#ifdef __Fuchsia__
+#include <minfs/writeback.h>
+#endif
+
+namespace minfs {
+
+// Returns the number of blocks of the journal described by |info|,
+// including its JournalInfo block.
+blk_t JournalBlocks(const Superblock& info);
+
+// Replays the entries which an unclean shutdown left in the journal of the
+// filesystem backed by |bc|, and marks the journal as empty.
+//
+// |info| holds the superblock as read from disk. Since the superblock is
+// itself journaled, it is read again into |info| if any entry was replayed.
+zx_status_t ReplayJournal(Bcache* bc, Superblock* info);
+
+#ifdef __Fuchsia__
+
+// Writes back metadata through the journal, on behalf of the writeback thread.
+//
+// The file data of a batch of WritebackWorks is written in place first,
+// together with a single journal entry holding the latest copy of every
+// metadata block the batch modifies. Once both are flushed to disk, the
+// metadata is written in place too. Entries stay live (and would be replayed)
+// until the journal runs out of room, at which point all of them are retired
+// at once by updating the JournalInfo block.
+//
+// This class is thread-compatible; it is only used by the writeback thread.
+class Journal {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Journal);
+
+    // Creates the journal of the filesystem backed by |bc| and described by
+    // |info|. The journal must already have been replayed.
+    static zx_status_t Create(Bcache* bc, const Superblock& info, fbl::unique_ptr<Journal>* out);
+    ~Journal();
+
+    // Returns the largest number of metadata blocks a single entry may hold.
+    size_t EntryCapacity() const;
+
+    // Writes out |works|, whose requests point into the writeback buffer
+    // mapped at |buffer| and attached as |buffer_vmoid|, then marks each of
+    // them completed.
+    //
+    // Unless some of them write file data over blocks which others use for
+    // metadata, the whole batch is committed as a single entry.
+    void Write(fbl::Vector<fbl::unique_ptr<WritebackWork>>* works, const void* buffer,
+               vmoid_t buffer_vmoid);
+
+    // Ensures all metadata written so far is in place on disk, and marks the
+    // journal as empty.
+    zx_status_t Retire();
+
+private:
+    // A metadata block to be written: |target| on disk, from |buffer_block|
+    // of the writeback buffer.
+    struct Block {
+        blk_t target;
+        size_t buffer_block;
+    };
+
+    Journal(Bcache* bc, const Superblock& info, fzl::OwnedVmoMapper mapper);
+
+    // Writes out |count| works at |works|, whose latest metadata blocks are
+    // |blocks|, committing the metadata as a single entry.
+    zx_status_t WriteEntry(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                           const fbl::Vector<Block>& blocks, const void* buffer,
+                           vmoid_t buffer_vmoid);
+
+    // Writes out |count| works at |works| in place, without journaling.
+    zx_status_t WriteInPlace(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                             vmoid_t buffer_vmoid);
+
+    // Collects the latest copy of every metadata block of |count| works at
+    // |works| into |out|, sorted by target.
+    static void CollectBlocks(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                              fbl::Vector<Block>* out);
+
+    // Returns true if any file data of |count| works at |works| is written to
+    // one of the sorted |targets|.
+    static bool DataOverlaps(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                             const fbl::Vector<blk_t>& targets);
+
+    // Returns true if any file data of |count| works at |works| is written to
+    // one of the targets of the sorted |blocks|.
+    static bool DataOverlaps(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                             const fbl::Vector<Block>& blocks);
+
+    // Returns block |index| of the log, within |mapper_|.
+    void* LogBlock(size_t index);
+
+    // Copies |blocks| from the writeback buffer at |buffer| into the log, as
+    // an entry starting at the end of the live entries.
+    void PrepareEntry(const fbl::Vector<Block>& blocks, const void* buffer);
+
+    // Appends requests to write the log blocks [|start|, |start| + |length|),
+    // wrapping around the end of the log, to |requests|.
+    void AddLogRequests(size_t start, size_t length, fbl::Vector<block_fifo_request_t>* requests);
+
+    // Appends a request to |requests|, with offsets and length in MinFS blocks.
+    void AddRequest(uint32_t opcode, vmoid_t vmoid, uint64_t vmo_offset, uint64_t dev_offset,
+                    uint64_t length, fbl::Vector<block_fifo_request_t>* requests);
+
+    zx_status_t Transact(const fbl::Vector<block_fifo_request_t>& requests);
+
+    // Waits until everything written so far is durable.
+    zx_status_t Flush();
+
+    // Writes the JournalInfo block describing the live entries, then flushes
+    // it to disk.
+    zx_status_t WriteInfo();
+
+    Bcache* bc_;
+    const blk_t start_block_;
+    // The number of blocks of the log, which follows the JournalInfo block.
+    const size_t capacity_;
+
+    // A copy of the journal, with the JournalInfo block followed by the log.
+    fzl::OwnedVmoMapper mapper_;
+    vmoid_t vmoid_ = VMOID_INVALID;
+
+    // The live entries occupy the |live_| blocks of the log starting at
+    // |start_|, the first of which has sequence number |start_sequence_|.
+    // The next entry is written at |(start_ + live_) % capacity_|.
+    size_t start_ = 0;
+    size_t live_ = 0;
+    uint64_t start_sequence_ = 0;
+    uint64_t next_sequence_ = 0;
+
+    // The sorted targets of the live entries. File data may not be written
+    // to them until the entries are retired, since replaying the entries
+    // would overwrite it.
+    fbl::Vector<blk_t> live_targets_;
+};
+
+#endif // __Fuchsia__
+
+} // namespace minfs
@@ -28,6 +28,8 @@ struct MountOptions {
     bool readonly;
     bool metrics;
     bool verbose;
+    // Write metadata back through the journal, making each transaction atomic.
+    bool journal = false;
 
     // Number of slices to preallocate for data when the filesystem is created.
     uint32_t fvm_data_slices = 1;
@@ -27,7 +27,7 @@ public:
     // section within one transaction. For data vnodes, based on a max write size of 64kb, this is
     // currently expected to be 3 indirect blocks (would be 4 with the introduction of more doubly
     // indirect blocks). For directories, with a max dirent size of 268b, this is expected to be 5
-    // blocks.
+    // blocks. For extent-mapped files, this is kMaxExtentBlocks ExtentBlocks.
     blk_t GetMaximumMetaDataBlocks() const { return max_meta_data_blocks_; }
 
     // Returns the maximum number of data blocks (including indirects) that we expect to be
@@ -67,6 +67,15 @@ public:
     // (In the case of Create, the parent directory and the child inode will be modified.)
     static constexpr blk_t kMaxInodeTableBlocks = 2;
 
+    // Maximum number of runs of blocks which may be mapped into the extents of a file within one
+    // transaction. Flushing the delayed blocks of a file takes as many transactions as needed.
+    static constexpr blk_t kMaxExtentInserts = 2;
+
+    // Maximum number of ExtentBlocks which may be modified within one transaction. Mapping a run
+    // modifies at most two of them: the one it is added to, and the one split off from it if it
+    // was full.
+    static constexpr blk_t kMaxExtentBlocks = 2 * kMaxExtentInserts;
+
     // The largest amount of data that Write() should able to process at once. This is currently
     // constrainted by external factors to (1 << 13), but with the switch to FIDL we expect
     // incoming requests to be NO MORE than (1 << 16). Even so, we should update Write() to handle
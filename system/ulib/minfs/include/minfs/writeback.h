@@ -30,6 +30,7 @@
 
 namespace minfs {
 
+class Journal;
 class VnodeMinfs;
 
 // A wrapper around a WriteTxn, holding references to the underlying Vnodes
@@ -55,6 +56,11 @@ public:
     // consumed.
     size_t Complete(zx_handle_t vmo, vmoid_t vmoid);
 
+    // Drops the enqueued work, which has been transacted by other means,
+    // signals the closure (if any) with |status|, and resets the WritebackWork
+    // to its initial state.
+    void MarkCompleted(zx_status_t status);
+
     // Adds a closure to the WritebackWork, such that it will be signalled
     // when the WritebackWork is flushed to disk.
     // If no closure is set, nothing will get signalled.
@@ -103,6 +109,30 @@ public:
         return block_promise_->Allocate(work_.get());
     }
 
+    // Allocates between 1 and |count| contiguous blocks, starting at |hint| if it is free.
+    size_t AllocateBlockRun(size_t hint, size_t count, size_t* out_count) {
+        ZX_DEBUG_ASSERT(block_promise_ != nullptr);
+        return block_promise_->AllocateRun(work_.get(), hint, count, out_count);
+    }
+
+    // Moves the blocks reserved by this transaction, but not yet allocated, into |promise|.
+    void GiveBlocks(fbl::unique_ptr<AllocatorPromise>* promise) {
+        if (*promise == nullptr) {
+            *promise = std::move(block_promise_);
+        } else if (block_promise_ != nullptr) {
+            (*promise)->Merge(block_promise_.get());
+        }
+    }
+
+    // Adds the blocks reserved by |promise| to those reserved by this transaction.
+    void TakeBlocks(fbl::unique_ptr<AllocatorPromise> promise) {
+        if (block_promise_ == nullptr) {
+            block_promise_ = std::move(promise);
+        } else if (promise != nullptr) {
+            block_promise_->Merge(promise.get());
+        }
+    }
+
     void SetWork(fbl::unique_ptr<WritebackWork> work) {
         work_ = std::move(work);
     }
@@ -144,6 +174,9 @@ public:
     // enqueued, preventing them from closing while the writeback is pending.
     void Enqueue(fbl::unique_ptr<WritebackWork> work) __TA_EXCLUDES(writeback_lock_);
 
+    // Writes back all subsequent work through |journal|.
+    void SetJournal(fbl::unique_ptr<Journal> journal) __TA_EXCLUDES(writeback_lock_);
+
 private:
     WritebackBuffer(Bcache* bc, fzl::OwnedVmoMapper mapper);
 
@@ -164,6 +197,11 @@ private:
     // safely guarantee that space exists within the buffer.
     void CopyToBufferLocked(WriteTxn* txn) __TA_REQUIRES(writeback_lock_);
 
+    // Moves work from the front of |work_queue_| into |batch|, for as long as
+    // its metadata fits in a single journal entry.
+    void DequeueBatchLocked(fbl::Vector<fbl::unique_ptr<WritebackWork>>* batch)
+        __TA_REQUIRES(writeback_lock_);
+
     static int WritebackThread(void* arg);
 
     // The waiter struct may be used as a stack-allocated queue for producers.
@@ -193,6 +231,8 @@ private:
     // writeback buffer and are ready to be sent to disk.
     WorkQueue work_queue_ __TA_GUARDED(writeback_lock_){};
     bool unmounting_ __TA_GUARDED(writeback_lock_){false};
+    // Optional. Once set, work is written back in batches through the journal.
+    fbl::unique_ptr<Journal> journal_ __TA_GUARDED(writeback_lock_);
     fzl::OwnedVmoMapper mapper_;
     vmoid_t buffer_vmoid_ = VMOID_INVALID;
     // The units of all the following are "MinFS blocks".
@@ -0,0 +1,566 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fs/trace.h>
+#include <lib/cksum.h>
+
+#ifdef __Fuchsia__
+#include <fs/block-txn.h>
+#include <lib/fzl/owned-vmo-mapper.h>
+#include <zircon/syscalls.h>
+#endif
+
+#include <minfs/fsck.h>
+#include <minfs/journal.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace minfs {
+namespace {
+
+// Reads block |index| of the log of the journal which starts at |start_block|
+// and holds |log_blocks| blocks of log.
+zx_status_t ReadLogBlock(Bcache* bc, blk_t start_block, blk_t log_blocks, size_t index,
+                         void* data) {
+    return bc->Readblk(static_cast<blk_t>(start_block + 1 + index % log_blocks), data);
+}
+
+// Reads the entry starting at block |start| of the log, and checks that it is
+// complete and carries |sequence|. On success, |header| holds its header block.
+zx_status_t ReadEntry(Bcache* bc, blk_t start_block, blk_t log_blocks, size_t start,
+                      uint64_t sequence, JournalHeaderBlock* header) {
+    zx_status_t status;
+    if ((status = ReadLogBlock(bc, start_block, log_blocks, start, header)) != ZX_OK) {
+        return status;
+    }
+    if (header->magic != kJournalEntryHeaderMagic || header->sequence != sequence ||
+        header->num_blocks == 0 || header->num_blocks > kJournalEntryHeaderMaxBlocks ||
+        header->num_blocks + kJournalEntryMetadataBlocks > log_blocks) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    uint8_t blk[kMinfsBlockSize];
+    uint32_t checksum = crc32(0, reinterpret_cast<const uint8_t*>(header), kMinfsBlockSize);
+    for (size_t i = 0; i < header->num_blocks; i++) {
+        if ((status = ReadLogBlock(bc, start_block, log_blocks, start + 1 + i, blk)) != ZX_OK) {
+            return status;
+        }
+        checksum = crc32(checksum, blk, kMinfsBlockSize);
+    }
+
+    const size_t commit = start + 1 + header->num_blocks;
+    if ((status = ReadLogBlock(bc, start_block, log_blocks, commit, blk)) != ZX_OK) {
+        return status;
+    }
+    const JournalCommitBlock* commit_block = reinterpret_cast<const JournalCommitBlock*>(blk);
+    if (commit_block->magic != kJournalEntryCommitMagic || commit_block->sequence != sequence ||
+        commit_block->checksum != checksum) {
+        // The entry was not completely written before the filesystem went away.
+        return ZX_ERR_NOT_FOUND;
+    }
+    return ZX_OK;
+}
+
+} // namespace
+
+blk_t JournalBlocks(const Superblock& info) {
+    if (info.flags & kMinfsFlagFVM) {
+        return static_cast<blk_t>(info.journal_slices * (info.slice_size / kMinfsBlockSize));
+    }
+    return info.dat_block - info.journal_start_block;
+}
+
+zx_status_t ReplayJournal(Bcache* bc, Superblock* info) {
+    TRACE_DURATION("minfs", "ReplayJournal");
+    zx_status_t status;
+    // The location of the journal comes from the superblock, so it must be sane.
+    if ((status = CheckSuperblock(info, bc)) != ZX_OK) {
+        return status;
+    }
+
+#ifndef __Fuchsia__
+    // Sparse images are only ever produced by host tools, which do not
+    // journal, so there is never anything to replay.
+    if (bc->extent_lengths_.size() > 0) {
+        return ZX_OK;
+    }
+#endif
+
+    const blk_t journal_blocks = JournalBlocks(*info);
+    const blk_t log_blocks = journal_blocks - 1;
+    uint8_t blk[kMinfsBlockSize];
+    if ((status = bc->Readblk(info->journal_start_block, blk)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not read journal info block\n");
+        return status;
+    }
+    JournalInfo journal_info;
+    memcpy(&journal_info, blk, sizeof(journal_info));
+    if (journal_info.magic != kJournalMagic) {
+        FS_TRACE_ERROR("minfs: bad journal magic\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    if (journal_info.start_block == 0) {
+        // The journal was never used.
+        return ZX_OK;
+    }
+    if (journal_info.start_block >= journal_blocks) {
+        FS_TRACE_ERROR("minfs: journal start %" PRIu64 " out of range\n",
+                       journal_info.start_block);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    size_t start = journal_info.start_block - 1;
+    uint64_t sequence = journal_info.sequence;
+    size_t replayed = 0;
+    size_t walked = 0;
+    JournalHeaderBlock header;
+    while (true) {
+        status = ReadEntry(bc, info->journal_start_block, log_blocks, start, sequence, &header);
+        if (status == ZX_ERR_NOT_FOUND) {
+            break;
+        } else if (status != ZX_OK) {
+            FS_TRACE_ERROR("minfs: could not read journal entry: %d\n", status);
+            return status;
+        }
+        const size_t entry_blocks = header.num_blocks + kJournalEntryMetadataBlocks;
+        if (walked + entry_blocks > log_blocks) {
+            // Live entries never overlap, so this one must be stale.
+            break;
+        }
+
+        for (size_t i = 0; i < header.num_blocks; i++) {
+            const blk_t target = header.target_blocks[i];
+            if ((target >= info->journal_start_block &&
+                 target < info->journal_start_block + journal_blocks) ||
+                target >= bc->Maxblk()) {
+                FS_TRACE_ERROR("minfs: journal entry targets invalid block %u\n", target);
+                return ZX_ERR_IO_DATA_INTEGRITY;
+            }
+        }
+        for (size_t i = 0; i < header.num_blocks; i++) {
+            if ((status = ReadLogBlock(bc, info->journal_start_block, log_blocks,
+                                       start + 1 + i, blk)) != ZX_OK ||
+                (status = bc->Writeblk(header.target_blocks[i], blk)) != ZX_OK) {
+                FS_TRACE_ERROR("minfs: could not replay journal entry: %d\n", status);
+                return status;
+            }
+        }
+
+        start = (start + entry_blocks) % log_blocks;
+        walked += entry_blocks;
+        sequence++;
+        replayed++;
+    }
+
+    if (replayed == 0) {
+        return ZX_OK;
+    }
+    FS_TRACE_INFO("minfs: replayed %zu journal entries\n", replayed);
+
+    // The replayed metadata must be durable before the entries are dropped.
+    if (bc->Sync() != 0) {
+        return ZX_ERR_IO;
+    }
+    memset(blk, 0, sizeof(blk));
+    journal_info.start_block = start + 1;
+    journal_info.sequence = sequence;
+    memcpy(blk, &journal_info, sizeof(journal_info));
+    if ((status = bc->Writeblk(info->journal_start_block, blk)) != ZX_OK) {
+        return status;
+    }
+    if (bc->Sync() != 0) {
+        return ZX_ERR_IO;
+    }
+
+    // The superblock may have been replayed as well.
+    if ((status = bc->Readblk(0, blk)) != ZX_OK) {
+        return status;
+    }
+    memcpy(info, blk, sizeof(Superblock));
+    return CheckSuperblock(info, bc);
+}
+
+#ifdef __Fuchsia__
+
+Journal::Journal(Bcache* bc, const Superblock& info, fzl::OwnedVmoMapper mapper)
+    : bc_(bc), start_block_(info.journal_start_block), capacity_(JournalBlocks(info) - 1),
+      mapper_(std::move(mapper)) {}
+
+Journal::~Journal() {
+    if (vmoid_ != VMOID_INVALID) {
+        block_fifo_request_t request;
+        request.group = bc_->BlockGroupID();
+        request.vmoid = vmoid_;
+        request.opcode = BLOCKIO_CLOSE_VMO;
+        bc_->Transaction(&request, 1);
+    }
+}
+
+zx_status_t Journal::Create(Bcache* bc, const Superblock& info, fbl::unique_ptr<Journal>* out) {
+    const blk_t journal_blocks = JournalBlocks(info);
+    if (journal_blocks < kJournalEntryMetadataBlocks + 2) {
+        FS_TRACE_ERROR("minfs: journal too small\n");
+        return ZX_ERR_NO_SPACE;
+    }
+
+    zx_status_t status;
+    fzl::OwnedVmoMapper mapper;
+    if ((status = mapper.CreateAndMap(journal_blocks * kMinfsBlockSize, "minfs-journal")) !=
+        ZX_OK) {
+        return status;
+    }
+
+    fbl::unique_ptr<Journal> journal(new Journal(bc, info, std::move(mapper)));
+    if ((status = bc->AttachVmo(journal->mapper_.vmo(), &journal->vmoid_)) != ZX_OK) {
+        return status;
+    }
+    if ((status = bc->Readblk(journal->start_block_, journal->mapper_.start())) != ZX_OK) {
+        return status;
+    }
+    const JournalInfo* journal_info = static_cast<const JournalInfo*>(journal->mapper_.start());
+    if (journal_info->magic != kJournalMagic || journal_info->start_block >= journal_blocks) {
+        FS_TRACE_ERROR("minfs: bad journal info\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    if (journal_info->start_block == 0) {
+        // Start from an unpredictable sequence number, so that whatever an
+        // earlier filesystem left in the log can never pass for a valid entry.
+        journal->start_sequence_ = static_cast<uint64_t>(zx_ticks_get());
+        journal->next_sequence_ = journal->start_sequence_;
+        if ((status = journal->WriteInfo()) != ZX_OK) {
+            return status;
+        }
+    } else {
+        journal->start_ = journal_info->start_block - 1;
+        journal->start_sequence_ = journal_info->sequence;
+        journal->next_sequence_ = journal_info->sequence;
+    }
+
+    *out = std::move(journal);
+    return ZX_OK;
+}
+
+size_t Journal::EntryCapacity() const {
+    return fbl::min<size_t>(kJournalEntryHeaderMaxBlocks,
+                            capacity_ - kJournalEntryMetadataBlocks);
+}
+
+void Journal::Write(fbl::Vector<fbl::unique_ptr<WritebackWork>>* works, const void* buffer,
+                    vmoid_t buffer_vmoid) {
+    TRACE_DURATION("minfs", "Journal::Write", "works", works->size());
+    const size_t count = works->size();
+    fbl::Vector<Block> blocks;
+    CollectBlocks(works->get(), count, &blocks);
+
+    // A block may be freed as metadata and reused for file data (or the other
+    // way around) within a batch. Committing the batch as one entry could then
+    // order the two writes wrongly, so each work gets an entry of its own.
+    if (count == 1 || !DataOverlaps(works->get(), count, blocks)) {
+        zx_status_t status = WriteEntry(works->get(), count, blocks, buffer, buffer_vmoid);
+        for (size_t i = 0; i < count; i++) {
+            (*works)[i]->MarkCompleted(status);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        blocks.reset();
+        CollectBlocks(&(*works)[i], 1, &blocks);
+        zx_status_t status = WriteEntry(&(*works)[i], 1, blocks, buffer, buffer_vmoid);
+        (*works)[i]->MarkCompleted(status);
+    }
+}
+
+zx_status_t Journal::WriteEntry(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                                const fbl::Vector<Block>& blocks, const void* buffer,
+                                vmoid_t buffer_vmoid) {
+    zx_status_t status;
+    // Replaying a live entry would overwrite file data written over one of
+    // its targets.
+    if (DataOverlaps(works, count, live_targets_) && (status = Retire()) != ZX_OK) {
+        return status;
+    }
+
+    if (blocks.size() == 0) {
+        return WriteInPlace(works, count, buffer_vmoid);
+    }
+
+    if (blocks.size() > EntryCapacity()) {
+        // Batches are sized to fit, and the journal always has room for the
+        // largest transaction, so this only happens if either is misconfigured.
+        FS_TRACE_WARN("minfs: %zu metadata blocks do not fit in the journal\n", blocks.size());
+        if ((status = Retire()) != ZX_OK) {
+            return status;
+        }
+        return WriteInPlace(works, count, buffer_vmoid);
+    }
+
+    const size_t entry_blocks = blocks.size() + kJournalEntryMetadataBlocks;
+    if (live_ + entry_blocks > capacity_ && (status = Retire()) != ZX_OK) {
+        return status;
+    }
+
+    // Write the file data in place and the metadata to the log, and wait for
+    // both to be durable: from then on, the entry may be replayed.
+    const size_t next = (start_ + live_) % capacity_;
+    PrepareEntry(blocks, buffer);
+    fbl::Vector<block_fifo_request_t> requests;
+    for (size_t i = 0; i < count; i++) {
+        const fbl::Vector<WriteRequest>& reqs = works[i]->Requests();
+        for (size_t j = 0; j < reqs.size(); j++) {
+            if (reqs[j].data) {
+                AddRequest(BLOCKIO_WRITE, buffer_vmoid, reqs[j].vmo_offset, reqs[j].dev_offset,
+                           reqs[j].length, &requests);
+            }
+        }
+    }
+    AddLogRequests(next, entry_blocks, &requests);
+    if ((status = Transact(requests)) != ZX_OK || (status = Flush()) != ZX_OK) {
+        return status;
+    }
+
+    live_ += entry_blocks;
+    next_sequence_++;
+    fbl::Vector<blk_t> targets;
+    size_t live_index = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        while (live_index < live_targets_.size() && live_targets_[live_index] < blocks[i].target) {
+            targets.push_back(live_targets_[live_index++]);
+        }
+        if (live_index < live_targets_.size() && live_targets_[live_index] == blocks[i].target) {
+            live_index++;
+        }
+        targets.push_back(blocks[i].target);
+    }
+    while (live_index < live_targets_.size()) {
+        targets.push_back(live_targets_[live_index++]);
+    }
+    live_targets_ = std::move(targets);
+
+    // Write the metadata in place from the log, merging runs of blocks which
+    // are contiguous both on disk and in the log. Should this fail, the entry
+    // is replayed on the next mount.
+    requests.reset();
+    size_t run = 0;
+    for (size_t i = 1; i <= blocks.size(); i++) {
+        if (i < blocks.size() && blocks[i].target == blocks[i - 1].target + 1 &&
+            (next + 1 + i) % capacity_ != 0) {
+            continue;
+        }
+        AddRequest(BLOCKIO_WRITE, vmoid_, 1 + (next + 1 + run) % capacity_, blocks[run].target,
+                   i - run, &requests);
+        run = i;
+    }
+    return Transact(requests);
+}
+
+zx_status_t Journal::WriteInPlace(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                                  vmoid_t buffer_vmoid) {
+    fbl::Vector<block_fifo_request_t> requests;
+    for (size_t i = 0; i < count; i++) {
+        const fbl::Vector<WriteRequest>& reqs = works[i]->Requests();
+        for (size_t j = 0; j < reqs.size(); j++) {
+            AddRequest(BLOCKIO_WRITE, buffer_vmoid, reqs[j].vmo_offset, reqs[j].dev_offset,
+                       reqs[j].length, &requests);
+        }
+    }
+    return Transact(requests);
+}
+
+zx_status_t Journal::Retire() {
+    TRACE_DURATION("minfs", "Journal::Retire", "blocks", live_);
+    if (live_ == 0) {
+        return ZX_OK;
+    }
+
+    // The metadata of the live entries has been written in place, but it must
+    // be durable before the entries are dropped.
+    zx_status_t status;
+    if ((status = Flush()) != ZX_OK) {
+        return status;
+    }
+    const size_t start = start_;
+    const uint64_t start_sequence = start_sequence_;
+    start_ = (start_ + live_) % capacity_;
+    start_sequence_ = next_sequence_;
+    if ((status = WriteInfo()) != ZX_OK) {
+        start_ = start;
+        start_sequence_ = start_sequence;
+        return status;
+    }
+    live_ = 0;
+    live_targets_.reset();
+    return ZX_OK;
+}
+
+void Journal::CollectBlocks(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                            fbl::Vector<Block>* out) {
+    fbl::Vector<Block> blocks;
+    for (size_t i = 0; i < count; i++) {
+        const fbl::Vector<WriteRequest>& reqs = works[i]->Requests();
+        for (size_t j = 0; j < reqs.size(); j++) {
+            if (reqs[j].data) {
+                continue;
+            }
+            for (size_t b = 0; b < reqs[j].length; b++) {
+                blocks.push_back({static_cast<blk_t>(reqs[j].dev_offset + b),
+                                  reqs[j].vmo_offset + b});
+            }
+        }
+    }
+
+    // Later copies of a block were enqueued later, so they are the ones to keep.
+    std::stable_sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) {
+        return a.target < b.target;
+    });
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (i + 1 < blocks.size() && blocks[i + 1].target == blocks[i].target) {
+            continue;
+        }
+        out->push_back(blocks[i]);
+    }
+}
+
+bool Journal::DataOverlaps(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                           const fbl::Vector<blk_t>& targets) {
+    if (targets.is_empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const fbl::Vector<WriteRequest>& reqs = works[i]->Requests();
+        for (size_t j = 0; j < reqs.size(); j++) {
+            if (!reqs[j].data) {
+                continue;
+            }
+            const blk_t* target = std::lower_bound(targets.begin(), targets.end(),
+                                                   reqs[j].dev_offset);
+            if (target != targets.end() && *target < reqs[j].dev_offset + reqs[j].length) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool Journal::DataOverlaps(const fbl::unique_ptr<WritebackWork>* works, size_t count,
+                           const fbl::Vector<Block>& blocks) {
+    if (blocks.is_empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const fbl::Vector<WriteRequest>& reqs = works[i]->Requests();
+        for (size_t j = 0; j < reqs.size(); j++) {
+            if (!reqs[j].data) {
+                continue;
+            }
+            const Block* block = std::lower_bound(blocks.begin(), blocks.end(),
+                                                  reqs[j].dev_offset,
+                                                  [](const Block& b, size_t target) {
+                                                      return b.target < target;
+                                                  });
+            if (block != blocks.end() && block->target < reqs[j].dev_offset + reqs[j].length) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void* Journal::LogBlock(size_t index) {
+    return static_cast<uint8_t*>(mapper_.start()) + (1 + index % capacity_) * kMinfsBlockSize;
+}
+
+void Journal::PrepareEntry(const fbl::Vector<Block>& blocks, const void* buffer) {
+    const size_t next = start_ + live_;
+    JournalHeaderBlock* header = static_cast<JournalHeaderBlock*>(LogBlock(next));
+    memset(header, 0, kMinfsBlockSize);
+    header->magic = kJournalEntryHeaderMagic;
+    header->sequence = next_sequence_;
+    header->num_blocks = blocks.size();
+    for (size_t i = 0; i < blocks.size(); i++) {
+        header->target_blocks[i] = blocks[i].target;
+    }
+    uint32_t checksum = crc32(0, reinterpret_cast<const uint8_t*>(header), kMinfsBlockSize);
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        void* block = LogBlock(next + 1 + i);
+        memcpy(block, static_cast<const uint8_t*>(buffer) + blocks[i].buffer_block *
+               kMinfsBlockSize, kMinfsBlockSize);
+        checksum = crc32(checksum, static_cast<const uint8_t*>(block), kMinfsBlockSize);
+    }
+
+    JournalCommitBlock* commit =
+        static_cast<JournalCommitBlock*>(LogBlock(next + 1 + blocks.size()));
+    memset(commit, 0, kMinfsBlockSize);
+    commit->magic = kJournalEntryCommitMagic;
+    commit->sequence = next_sequence_;
+    commit->checksum = checksum;
+}
+
+void Journal::AddLogRequests(size_t start, size_t length,
+                             fbl::Vector<block_fifo_request_t>* requests) {
+    const size_t first = fbl::min(length, capacity_ - start);
+    AddRequest(BLOCKIO_WRITE, vmoid_, 1 + start, start_block_ + 1 + start, first, requests);
+    if (length > first) {
+        AddRequest(BLOCKIO_WRITE, vmoid_, 1, start_block_ + 1, length - first, requests);
+    }
+}
+
+void Journal::AddRequest(uint32_t opcode, vmoid_t vmoid, uint64_t vmo_offset,
+                         uint64_t dev_offset, uint64_t length,
+                         fbl::Vector<block_fifo_request_t>* requests) {
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->DeviceBlockSize();
+    block_fifo_request_t request;
+    request.group = bc_->BlockGroupID();
+    request.vmoid = vmoid;
+    request.opcode = opcode;
+    request.vmo_offset = vmo_offset * kDiskBlocksPerMinfsBlock;
+    request.dev_offset = dev_offset * kDiskBlocksPerMinfsBlock;
+    length *= kDiskBlocksPerMinfsBlock;
+    ZX_ASSERT_MSG(length < UINT32_MAX, "Too many blocks");
+    request.length = static_cast<uint32_t>(length);
+    requests->push_back(request);
+}
+
+zx_status_t Journal::Transact(const fbl::Vector<block_fifo_request_t>& requests) {
+    if (requests.is_empty()) {
+        return ZX_OK;
+    }
+    return bc_->Transaction(const_cast<block_fifo_request_t*>(requests.get()), requests.size());
+}
+
+zx_status_t Journal::Flush() {
+    block_fifo_request_t request = {};
+    request.group = bc_->BlockGroupID();
+    request.vmoid = vmoid_;
+    request.opcode = BLOCKIO_FLUSH;
+    return bc_->Transaction(&request, 1);
+}
+
+zx_status_t Journal::WriteInfo() {
+    JournalInfo* info = static_cast<JournalInfo*>(mapper_.start());
+    memset(info, 0, kMinfsBlockSize);
+    info->magic = kJournalMagic;
+    info->start_block = start_ + 1;
+    info->sequence = start_sequence_;
+
+    fbl::Vector<block_fifo_request_t> requests;
+    AddRequest(BLOCKIO_WRITE, vmoid_, 0, start_block_, 1, &requests);
+    zx_status_t status;
+    if ((status = Transact(requests)) != ZX_OK) {
+        return status;
+    }
+    return Flush();
+}
+
+#endif // __Fuchsia__
+
+} // namespace minfs
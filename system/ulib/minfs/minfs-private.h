@@ -10,14 +10,17 @@
 #include <inttypes.h>
 
 #ifdef __Fuchsia__
+#include <bitmap/rle-bitmap.h>
 #include <fbl/auto_lock.h>
 #include <fs/managed-vfs.h>
 #include <fs/remote.h>
 #include <fs/watcher.h>
 #include <fuchsia/io/c/fidl.h>
 #include <fuchsia/minfs/c/fidl.h>
+#include <lib/async/cpp/task.h>
 #include <lib/fzl/resizeable-vmo-mapper.h>
 #include <lib/sync/completion.h>
+#include <lib/zx/time.h>
 #include <lib/zx/vmo.h>
 #endif
 
@@ -28,6 +31,7 @@
 #include <fbl/macros.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
 #include <fs/block-txn.h>
 #include <fs/locking.h>
 #include <fs/ticker.h>
@@ -61,6 +65,14 @@ using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
 #endif
 
 #ifdef __Fuchsia__
+// The number of blocks of file data which a vnode may hold in memory before
+// allocating them on disk (see VnodeMinfs::FlushDelayed).
+constexpr blk_t kMinfsMaxDelayedBlocks = 256;
+
+// How long blocks may stay delayed before they are flushed, even if their
+// file is neither synced nor closed.
+constexpr zx::duration kMinfsDelayedFlushInterval = zx::sec(5);
+
 // Validate that |vmo| is large enough to access block |blk|,
 // relative to the start of the vmo.
 inline void ValidateVmoSize(zx_handle_t vmo, blk_t blk) {
@@ -157,12 +169,24 @@ public:
     // Allocate a new data block.
     void BlockNew(Transaction* state, blk_t* out_bno);
 
+    // Allocate between 1 and |count| contiguous data blocks, starting at |hint| if it is free.
+    void BlockNewRun(Transaction* state, blk_t hint, blk_t count, blk_t* out_bno,
+                     blk_t* out_count);
+
     // Free a data block.
     void BlockFree(WriteTxn* txn, blk_t bno);
 
+    // Free |count| contiguous data blocks, starting at |bno|.
+    void BlockFreeRun(WriteTxn* txn, blk_t bno, blk_t count);
+
     // Queries the underlying FVM, if it exists.
     zx_status_t FVMQuery(fvm_info_t* info) const;
 
+#ifdef __Fuchsia__
+    // Starts writing metadata back through the journal, rather than in place.
+    zx_status_t InitJournal();
+#endif
+
     // Free ino in inode bitmap, release all blocks held by inode.
     zx_status_t InoFree(VnodeMinfs* vn, WritebackWork* wb);
 
@@ -175,6 +199,11 @@ public:
     // Free resources of all vnodes marked unlinked.
     zx_status_t PurgeUnlinked();
 
+    // Upgrades the filesystem to |version|, unless it is already at least that
+    // recent, before the feature it introduced is first used, so that drivers
+    // which predate the feature refuse to mount it.
+    void UpgradeVersion(WritebackWork* wb, uint32_t version);
+
     // Writes back an inode into the inode table on persistent storage.
     // Does not modify inode bitmap.
     void InodeUpdate(WriteTxn* txn, ino_t ino, const Inode* inode) {
@@ -204,9 +233,18 @@ public:
     uint64_t GetFsId() const { return fs_id_; }
 
     // Signals the completion object as soon as...
-    // (1) A sync probe has entered and exited the writeback queue, and
-    // (2) The block cache has sync'd with the underlying block device.
+    // (1) The delayed blocks of all files have been flushed,
+    // (2) A sync probe has entered and exited the writeback queue, and
+    // (3) The block cache has sync'd with the underlying block device.
     void Sync(SyncCallback closure);
+
+    // Flushes the delayed blocks of all files which have any. Returns the first error, after
+    // trying all of them.
+    zx_status_t FlushDelayed();
+
+    // Flushes the delayed blocks of all files which have any, in the background, once
+    // kMinfsDelayedFlushInterval has passed. Called when a file first delays blocks.
+    void ScheduleDelayedFlush();
 #endif
 
     // The following methods are used to read one block from the specified extent,
@@ -289,6 +327,10 @@ private:
     // Enqueues an update to the super block.
     void WriteInfo(WriteTxn* txn);
 
+#ifdef __Fuchsia__
+    void HandleDelayedFlush();
+#endif
+
     // Creates an unique identifier for this instance. This is to be called only during
     // "construction".
     static zx_status_t CreateFsId(uint64_t* out);
@@ -315,6 +357,7 @@ private:
     fuchsia_minfs_Metrics metrics_ = {};
     fbl::unique_ptr<WritebackBuffer> writeback_;
     uint64_t fs_id_ = 0;
+    async::TaskClosureMethod<Minfs, &Minfs::HandleDelayedFlush> delayed_flush_task_{this};
 #else
     // Store start block + length for all extents. These may differ from info block for
     // sparse files.
@@ -324,6 +367,9 @@ private:
     TransactionLimits limits_;
 };
 
+// The position of a Readdir, which lives in its fs::vdircookie_t.
+struct DirCookie;
+
 struct DirectoryOffset {
     size_t off = 0;      // Offset in directory of current record
     size_t off_prev = 0; // Offset in directory of previous record
@@ -336,8 +382,16 @@ struct DirArgs {
     uint32_t reclen;
     Transaction* state;
     DirectoryOffset offs;
+    // Set by FindDirentSpace when the directory must be hashed, or the leaf which
+    // |name| hashes to must be split, before the direntry can be appended.
+    bool split;
 };
 
+// Returns the hash which selects the leaf of a hashed directory holding |name|.
+inline uint32_t DirentHash(fbl::StringPiece name) {
+    return fnv1a32(name.data(), name.length());
+}
+
 class VnodeMinfs final : public fs::Vnode,
                          public fbl::SinglyLinkedListable<VnodeMinfs*>,
                          public fbl::Recyclable<VnodeMinfs> {
@@ -359,6 +413,10 @@ public:
     static zx_status_t Recreate(Minfs* fs, ino_t ino, fbl::RefPtr<VnodeMinfs>* out);
 
     bool IsDirectory() const { return inode_.magic == kMinfsMagicDir; }
+    bool IsHashedDirectory() const {
+        return IsDirectory() && (inode_.flags & kMinfsInodeFlagDirIndex);
+    }
+    bool IsExtentMapped() const { return (inode_.flags & kMinfsInodeFlagExtents) != 0; }
     bool IsUnlinked() const { return inode_.link_count == 0; }
     zx_status_t CanUnlink() const;
 
@@ -394,6 +452,9 @@ private:
     friend zx_status_t Minfs::InoFree(VnodeMinfs* vn, WritebackWork* wb);
     friend void Minfs::AddUnlinked(WritebackWork* wb, VnodeMinfs* vn);
     friend void Minfs::RemoveUnlinked(WritebackWork* wb, VnodeMinfs* vn);
+#ifdef __Fuchsia__
+    friend zx_status_t Minfs::FlushDelayed();
+#endif
 
     VnodeMinfs(Minfs* fs);
 
@@ -457,11 +518,90 @@ private:
                                                  DirArgs*);
     static zx_status_t DirentCallbackFindSpace(fbl::RefPtr<VnodeMinfs>, Dirent*, DirArgs*);
 
+    // Finds where a direntry of |args->reclen| bytes named |args->name| may be appended, and
+    // returns in |reserve_blocks| the number of blocks appending it may allocate.
+    zx_status_t FindDirentSpace(DirArgs* args, blk_t* reserve_blocks);
+
     // Appends a new directory at the specified offset within |args|. This requires a prior call to
-    // DirentCallbackFindSpace to find an offset where there is space for the direntry. It takes
-    // the same |args| that were passed into DirentCallbackFindSpace.
+    // FindDirentSpace to find an offset where there is space for the direntry. It takes
+    // the same |args| that were passed into FindDirentSpace.
     zx_status_t AppendDirent(DirArgs* args);
 
+    // Returns the offset at which iterating over the records of the directory stops.
+    size_t DirectoryEnd() const {
+        // A linear directory ends with a record flagged kMinfsReclenLast, which extends to
+        // kMinfsMaxDirectorySize.
+        return IsHashedDirectory() ? inode_.size : kMinfsMaxDirectorySize - MINFS_DIRENT_SIZE;
+    }
+
+    // Returns the offset which the record at |off| may not extend past.
+    size_t DirentLimit(size_t off) const {
+        return IsHashedDirectory() ? fbl::round_up(off + 1, kMinfsBlockSize) :
+                                     kMinfsMaxDirectorySize;
+    }
+
+    // Reads the DirIndex of a hashed directory into |dir_index_|, if it is not there yet.
+    zx_status_t LoadDirIndex();
+
+    // Returns the position within |dir_index_| of the leaf holding the names hashing to |hash|.
+    size_t FindLeaf(uint32_t hash) const;
+
+    // Writes |entries| to the index block.
+    zx_status_t WriteDirIndex(Transaction* state, const fbl::Vector<DirIndexEntry>& entries);
+
+    // Turns a linear directory which fits in a single block into a hashed directory with a
+    // single leaf.
+    zx_status_t ConvertToHashed(Transaction* state);
+
+    // Makes room for a record of |reclen| bytes in the leaf holding the names hashing to |hash|,
+    // by compacting the leaf if that is enough, or else by splitting it in two: the upper half of
+    // its hashes moves to a new leaf at the end of the directory.
+    zx_status_t SplitLeaf(Transaction* state, uint32_t hash, uint32_t reclen);
+
+    // Lists the entries of a hashed directory into |df|, in order of hash, continuing from the
+    // position saved in |cookie|. Since the position is a hash rather than an offset, it stays
+    // valid while the records of the directory are moved by compaction or splitting.
+    zx_status_t ReaddirHashed(DirCookie* cookie, fs::DirentFiller* df);
+
+    // Reads the extents of an extent-mapped file into |extents_|, if they are not there yet.
+    zx_status_t LoadExtents();
+
+    // Returns the disk block holding block |n| of an extent-mapped file, or 0 if it is unmapped.
+    blk_t ExtentLookup(blk_t n) const;
+
+    // Makes room for |inserts| more calls to ExtentAllocate, so that neither they nor the
+    // WriteExtents which follows them can fail.
+    zx_status_t ExtentReserve(size_t inserts);
+
+    // Returns the index in |extent_chain_| of the ExtentBlock holding extent |i|, which must not
+    // be one of the extents held by the inode, and in |out_base| the index of its first extent.
+    size_t ExtentChainFind(size_t i, size_t* out_base) const;
+
+    // Maps the |count| unmapped blocks of the file starting at |n| onto the disk blocks starting
+    // at |bno|, merging them with the neighbouring extents where possible. At most two
+    // ExtentBlocks change: the extents move between blocks only when one splits.
+    void ExtentInsert(Transaction* state, blk_t n, blk_t bno, blk_t count);
+
+    // Allocates between 1 and |count| contiguous blocks for the unmapped blocks of the file
+    // starting at |n|, following the disk block of block |n - 1| if possible, and maps them.
+    // Returns the first disk block and the number of blocks allocated.
+    void ExtentAllocate(Transaction* state, blk_t n, blk_t count, blk_t* out_bno,
+                        blk_t* out_count);
+
+    // Frees and unmaps all blocks of the file from |start| onwards.
+    void ExtentTruncate(Transaction* state, blk_t start);
+
+    // Returns in |reserve_blocks| the number of blocks which a write of |length| bytes at |offset|
+    // to an extent-mapped file may allocate.
+    zx_status_t GetExtentReserveBlocks(size_t offset, size_t length, blk_t* reserve_blocks);
+
+    // Writes back the extents held by the inode, and the ExtentBlocks which changed since they
+    // were last written, allocating the blocks which were split off.
+    zx_status_t WriteExtents(Transaction* state);
+
+    // Starts mapping a regular file which has no blocks through extents.
+    void ConvertToExtents(Transaction* state);
+
     zx_status_t UnlinkChild(Transaction* state, fbl::RefPtr<VnodeMinfs> child,
                             Dirent* de, DirectoryOffset* offs);
     // Remove the link to a vnode (referring to inodes exclusively).
@@ -641,6 +781,15 @@ private:
     zx_status_t InitVmo();
     zx_status_t InitIndirectVmo();
 
+    // Allocates contiguous runs of blocks for all delayed blocks of the file, and writes them
+    // back along with the extents and inode. Everything which may fail happens before the
+    // extents or the block bitmap change, so on failure the blocks which were not flushed yet
+    // stay delayed, along with their reservation.
+    zx_status_t FlushDelayed();
+
+    // Drops the delayed blocks of the file from |start| onwards, and releases their reservation.
+    void CancelDelayed(blk_t start);
+
     // Loads indirect blocks up to and including the doubly indirect block at |index|.
     zx_status_t LoadIndirectWithinDoublyIndirect(uint32_t index);
 
@@ -687,6 +836,7 @@ private:
     // Next kMinfsDoublyIndirect blocks                           - doubly indirect blocks
     // Next kMinfsDoublyIndirect * kMinfsDirectPerIndirect blocks - indirect blocks pointed to
     //                                                              by doubly indirect blocks
+    // Extent-mapped files keep their chain of ExtentBlocks there instead, in order.
     fbl::unique_ptr<fzl::ResizeableVmoMapper> vmo_indirect_;
 
     vmoid_t vmoid_{};
@@ -694,11 +844,39 @@ private:
 
     fs::RemoteContainer remoter_{};
     fs::WatcherContainer watcher_{};
+
+    // Blocks of an extent-mapped file which have been written to vmo_, but
+    // which are not allocated on disk yet, and the blocks reserved for them.
+    bitmap::RleBitmap delayed_;
+    fbl::unique_ptr<AllocatorPromise> delayed_promise_;
+
+    // The size recorded by the inode on disk. While blocks are delayed, it
+    // lags behind inode_.size rather than cover blocks which are not
+    // allocated yet.
+    uint32_t disk_size_ = 0;
 #endif
 
     ino_t ino_{};
     Inode inode_{};
 
+    // The entries of the DirIndex of a hashed directory, once loaded.
+    fbl::Vector<DirIndexEntry> dir_index_;
+
+    // A block of the chain of ExtentBlocks of an extent-mapped file.
+    struct ExtentChainBlock {
+        blk_t bno;          // 0 until the block is allocated
+        uint32_t count;     // Number of extents held by the block
+        bool dirty;         // Changed since it was last written back
+    };
+
+    // The extents of an extent-mapped file, and the blocks of its chain of
+    // ExtentBlocks, once loaded. |extents_dirty_| is set when any of them
+    // changed since they were last written back.
+    fbl::Vector<Extent> extents_;
+    fbl::Vector<ExtentChainBlock> extent_chain_;
+    bool extents_loaded_ = false;
+    bool extents_dirty_ = false;
+
     // This field tracks the current number of file descriptors with
     // an open reference to this Vnode. Notably, this is distinct from the
     // VnodeMinfs's own refcount, since there may still be filesystem
@@ -27,6 +27,7 @@
 #endif
 
 #include <minfs/fsck.h>
+#include <minfs/journal.h>
 #include <minfs/minfs.h>
 
 #include <utility>
@@ -96,7 +97,7 @@ zx_status_t CheckSuperblock(const Superblock* info, Bcache* bc) {
         FS_TRACE_ERROR("minfs: bad magic\n");
         return ZX_ERR_INVALID_ARGS;
     }
-    if (info->version != kMinfsVersion) {
+    if ((info->version > kMinfsVersion) || (info->version < kMinfsVersionLinearDirs)) {
         FS_TRACE_ERROR("minfs: FS Version: %08x. Driver version: %08x\n", info->version,
                        kMinfsVersion);
         return ZX_ERR_INVALID_ARGS;
@@ -306,7 +307,9 @@ zx_status_t Minfs::BeginTransaction(size_t reserve_inodes, size_t reserve_blocks
 void Minfs::CommitTransaction(fbl::unique_ptr<Transaction> state) {
     // On enqueue, unreserve any remaining reserved blocks/inodes tracked by work.
 #ifdef __Fuchsia__
-    ZX_DEBUG_ASSERT(state->GetWork()->BlkCount() <= limits_.GetMaximumEntryDataBlocks());
+    // File data bypasses the journal, and may exceed a journal entry when delayed blocks are
+    // flushed.
+    ZX_DEBUG_ASSERT(state->GetWork()->MetadataBlkCount() <= limits_.GetMaximumEntryDataBlocks());
     writeback_->Enqueue(state->RemoveWork());
 #else
     state->GetWork()->Complete();
@@ -315,11 +318,58 @@ void Minfs::CommitTransaction(fbl::unique_ptr<Transaction> state) {
 
 #ifdef __Fuchsia__
 void Minfs::Sync(SyncCallback closure) {
+    // Files which are not synced themselves may still hold delayed blocks.
+    zx_status_t flush_status = FlushDelayed();
     fbl::unique_ptr<Transaction> state;
     ZX_ASSERT(BeginTransaction(0, 0, &state) == ZX_OK);
-    state->GetWork()->SetClosure(std::move(closure));
+    state->GetWork()->SetClosure([flush_status, cb = std::move(closure)](zx_status_t status) {
+        cb((flush_status != ZX_OK) ? flush_status : status);
+    });
     CommitTransaction(std::move(state));
 }
+
+void Minfs::ScheduleDelayedFlush() {
+    if (!delayed_flush_task_.is_pending()) {
+        delayed_flush_task_.PostDelayed(dispatcher(), kMinfsDelayedFlushInterval);
+    }
+}
+
+zx_status_t Minfs::FlushDelayed() {
+    fbl::Vector<fbl::RefPtr<VnodeMinfs>> vnodes;
+    {
+        // Avoid releasing a reference to any vnode while holding |hash_lock_|.
+        fbl::AutoLock lock(&hash_lock_);
+        for (VnodeMinfs& raw_vn : vnode_hash_) {
+            if (raw_vn.delayed_.num_bits() == 0) {
+                continue;
+            }
+            fbl::RefPtr<VnodeMinfs> vn = fbl::MakeRefPtrUpgradeFromRaw(&raw_vn, hash_lock_);
+            if (vn != nullptr) {
+                vnodes.push_back(std::move(vn));
+            }
+        }
+    }
+
+    zx_status_t result = ZX_OK;
+    for (const auto& vn : vnodes) {
+        zx_status_t status;
+        if ((status = vn->FlushDelayed()) != ZX_OK) {
+            FS_TRACE_ERROR("minfs: ino#%u: Failed to flush delayed blocks: %d\n", vn->ino_,
+                           status);
+            if (result == ZX_OK) {
+                result = status;
+            }
+        }
+    }
+    return result;
+}
+
+void Minfs::HandleDelayedFlush() {
+    // Blocks which could not be flushed stay delayed, and are tried again later.
+    if (FlushDelayed() != ZX_OK) {
+        ScheduleDelayedFlush();
+    }
+}
 #endif
 
 #ifdef __Fuchsia__
@@ -352,12 +402,46 @@ zx_status_t Minfs::FVMQuery(fvm_info_t* info) const {
 #endif
 }
 
+#ifdef __Fuchsia__
+zx_status_t Minfs::InitJournal() {
+    fbl::unique_ptr<Journal> journal;
+    zx_status_t status = Journal::Create(bc_.get(), Info(), &journal);
+    if (status != ZX_OK) {
+        return status;
+    }
+    writeback_->SetJournal(std::move(journal));
+    return ZX_OK;
+}
+#endif
+
 zx_status_t Minfs::InoFree(VnodeMinfs* vn, WritebackWork* wb) {
     TRACE_DURATION("minfs", "Minfs::InoFree", "ino", vn->ino_);
 
     inodes_->Free(wb, vn->ino_);
     uint32_t block_count = vn->inode_.block_count;
 
+    if (vn->IsExtentMapped()) {
+        zx_status_t status;
+        if ((status = vn->LoadExtents()) != ZX_OK) {
+            return status;
+        }
+        // release the extents, and then the blocks which held the extents past the inode
+        for (const Extent& extent : vn->extents_) {
+            ValidateBno(extent.start);
+            block_count -= extent.length;
+            block_allocator_->Free(wb, extent.start, extent.length);
+        }
+        for (const auto& block : vn->extent_chain_) {
+            if (block.bno != 0) {
+                block_count--;
+                block_allocator_->Free(wb, block.bno);
+            }
+        }
+        ZX_DEBUG_ASSERT(block_count == 0);
+        ZX_DEBUG_ASSERT(vn->IsUnlinked());
+        return ZX_OK;
+    }
+
     // release all direct blocks
     for (unsigned n = 0; n < kMinfsDirect; n++) {
         if (vn->inode_.dnum[n] == 0) {
@@ -519,6 +603,14 @@ void Minfs::RemoveUnlinked(WritebackWork* wb, VnodeMinfs* vn) {
     }
 }
 
+void Minfs::UpgradeVersion(WritebackWork* wb, uint32_t version) {
+    if (Info().version >= version) {
+        return;
+    }
+    sb_->MutableInfo()->version = version;
+    sb_->Write(wb);
+}
+
 zx_status_t Minfs::PurgeUnlinked() {
     ino_t last_ino = 0;
     ino_t next_ino = Info().unlinked_head;
@@ -710,10 +802,22 @@ void Minfs::BlockNew(Transaction* state, blk_t* out_bno) {
     *out_bno = static_cast<blk_t>(allocated_bno);
 }
 
+void Minfs::BlockNewRun(Transaction* state, blk_t hint, blk_t count, blk_t* out_bno,
+                        blk_t* out_count) {
+    size_t allocated_count;
+    size_t allocated_bno = state->AllocateBlockRun(hint, count, &allocated_count);
+    *out_bno = static_cast<blk_t>(allocated_bno);
+    *out_count = static_cast<blk_t>(allocated_count);
+}
+
 void Minfs::BlockFree(WriteTxn* txn, blk_t bno) {
     block_allocator_->Free(txn, bno);
 }
 
+void Minfs::BlockFreeRun(WriteTxn* txn, blk_t bno, blk_t count) {
+    block_allocator_->Free(txn, bno, count);
+}
+
 void InitializeDirectory(void* bdata, ino_t ino_self, ino_t ino_parent) {
 #define DE0_SIZE DirentSize(1)
 
@@ -805,9 +909,11 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const Superblock* info,
     // determine the size of the writeback buffer.
     //
     // Currently, we set the writeback buffer size to 2% of physical
-    // memory.
+    // memory, but no less than a few flushes of delayed blocks, each of
+    // which is enqueued as a single unit.
     const size_t write_buffer_size =
-        fbl::round_up((zx_system_get_physmem() * 2) / 100, kMinfsBlockSize);
+        fbl::max(fbl::round_up((zx_system_get_physmem() * 2) / 100, kMinfsBlockSize),
+                 4 * kMinfsMaxDelayedBlocks * static_cast<size_t>(kMinfsBlockSize));
 
     fzl::OwnedVmoMapper mapper;
     zx::vmo vmo;
@@ -853,7 +959,12 @@ zx_status_t Mount(fbl::unique_ptr<minfs::Bcache> bc, fbl::RefPtr<VnodeMinfs>* ro
         FS_TRACE_ERROR("minfs: could not read info block\n");
         return status;
     }
-    const Superblock* info = reinterpret_cast<Superblock*>(blk);
+    Superblock* info = reinterpret_cast<Superblock*>(blk);
+
+    if ((status = ReplayJournal(bc.get(), info)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not replay journal\n");
+        return status;
+    }
 
     fbl::unique_ptr<Minfs> fs;
     if ((status = Minfs::Create(std::move(bc), info, &fs)) != ZX_OK) {
@@ -886,6 +997,10 @@ zx_status_t MountAndServe(const MountOptions* options, async_dispatcher_t* dispa
     }
 
     Minfs* vfs = vn->fs_;
+    if (options->journal && (status = vfs->InitJournal()) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not initialize journal: %d\n", status);
+        return status;
+    }
     vfs->SetReadonly(options->readonly);
     vfs->SetMetrics(options->metrics);
     vfs->SetUnmountCallback(std::move(on_unmount));
@@ -897,6 +1012,9 @@ void Minfs::Shutdown(fs::Vfs::ShutdownCallback cb) {
     ManagedVfs::Shutdown([this, cb = std::move(cb)](zx_status_t status) mutable {
         Sync([this, cb = std::move(cb)](zx_status_t) mutable {
             async::PostTask(dispatcher(), [this, cb = std::move(cb)]() mutable {
+                // Sync flushed all delayed blocks, and no more can be written.
+                delayed_flush_task_.Cancel();
+
                 // Ensure writeback buffer completes before auxiliary structures
                 // are deleted.
                 writeback_ = nullptr;
@@ -927,7 +1045,9 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
     memset(&info, 0x00, sizeof(info));
     info.magic0 = kMinfsMagic0;
     info.magic1 = kMinfsMagic1;
-    info.version = kMinfsVersion;
+    // New filesystems start out at the oldest version, and are only upgraded once they use the
+    // features of a later one.
+    info.version = kMinfsVersionLinearDirs;
     info.flags = kMinfsFlagClean;
     info.block_size = kMinfsBlockSize;
     info.inode_size = kMinfsInodeSize;
@@ -85,7 +85,8 @@ void TransactionLimits::CalculateDataBlocks() {
     blk_t direct_blocks = (fbl::round_up(kMaxWriteBytes, kMinfsBlockSize) / kMinfsBlockSize) + 1;
     blk_t max_indirect_blocks = max_data_blocks_ - direct_blocks;
 
-    max_meta_data_blocks_ = fbl::max(max_directory_blocks, max_indirect_blocks);
+    max_meta_data_blocks_ = fbl::max(fbl::max(max_directory_blocks, max_indirect_blocks),
+                                     kMaxExtentBlocks);
 }
 
 void TransactionLimits::CalculateJournalBlocks(blk_t block_bitmap_blocks) {
@@ -45,13 +45,14 @@ zx_time_t GetTimeUTC() {
     return time;
 }
 
-zx_status_t ValidateDirent(Dirent* de, size_t bytes_read, size_t off) {
+// Validates the record |de| at offset |off|, which may not extend past |limit|.
+zx_status_t ValidateDirent(Dirent* de, size_t bytes_read, size_t off, size_t limit) {
     uint32_t reclen = static_cast<uint32_t>(MinfsReclen(de, off));
     if ((bytes_read < MINFS_DIRENT_SIZE) || (reclen < MINFS_DIRENT_SIZE)) {
         FS_TRACE_ERROR("vn_dir: Could not read dirent at offset: %zd\n", off);
         return ZX_ERR_IO;
-    } else if ((off + reclen > kMinfsMaxDirectorySize) || (reclen & 3)) {
-        FS_TRACE_ERROR("vn_dir: bad reclen %u > %u\n", reclen, kMinfsMaxDirectorySize);
+    } else if ((off + reclen > limit) || (reclen & 3)) {
+        FS_TRACE_ERROR("vn_dir: bad reclen %u > %zu\n", reclen, limit - off);
         return ZX_ERR_IO;
     } else if (de->ino != 0) {
         if ((de->namelen == 0) ||
@@ -70,6 +71,100 @@ zx_status_t NextDirent(Dirent* de, DirectoryOffset* offs) {
     return kDirIteratorNext;
 }
 
+// A live record within a block of a directory.
+struct BlockRecord {
+    uint32_t off;
+    uint32_t size; // DirentSize of the record
+    uint32_t hash;
+};
+
+int CompareRecordHashes(const void* a, const void* b) {
+    const uint32_t hash_a = static_cast<const BlockRecord*>(a)->hash;
+    const uint32_t hash_b = static_cast<const BlockRecord*>(b)->hash;
+    return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+// Sorts |records| of the directory block |block| by hash, and records of equal hash by name, which
+// is the order in which Readdir lists a hashed directory.
+void SortRecords(const uint8_t* block, fbl::Vector<BlockRecord>* records) {
+    qsort(records->get(), records->size(), sizeof(BlockRecord), CompareRecordHashes);
+    for (size_t i = 1; i < records->size(); i++) {
+        const BlockRecord record = (*records)[i];
+        const Dirent* de = reinterpret_cast<const Dirent*>(block + record.off);
+        fbl::StringPiece name(de->name, de->namelen);
+        size_t j = i;
+        for (; (j > 0) && ((*records)[j - 1].hash == record.hash); j--) {
+            const Dirent* prev = reinterpret_cast<const Dirent*>(block + (*records)[j - 1].off);
+            if (fbl::StringPiece(prev->name, prev->namelen).compare(name) <= 0) {
+                break;
+            }
+            (*records)[j] = (*records)[j - 1];
+        }
+        (*records)[j] = record;
+    }
+}
+
+// Collects the live records among the first |size| bytes of the directory block |block|.
+// The records must tile these bytes, unless a record flagged kMinfsReclenLast, which only a
+// linear directory may hold, ends them.
+zx_status_t CollectRecords(const uint8_t* block, size_t size, bool linear,
+                           fbl::Vector<BlockRecord>* out) {
+    size_t off = 0;
+    while (off < size) {
+        const Dirent* de = reinterpret_cast<const Dirent*>(block + off);
+        const bool last = de->reclen & kMinfsReclenLast;
+        const size_t reclen = last ? size - off : de->reclen & kMinfsReclenMask;
+        if ((size - off < MINFS_DIRENT_SIZE) || (last && !linear) ||
+            (reclen < MINFS_DIRENT_SIZE) || (reclen > size - off) || (reclen & 3)) {
+            FS_TRACE_ERROR("vn_dir: bad reclen at offset %zu\n", off);
+            return ZX_ERR_IO;
+        }
+        if (de->ino != 0) {
+            const uint32_t dsize = DirentSize(de->namelen);
+            if ((de->namelen == 0) || (dsize > reclen)) {
+                FS_TRACE_ERROR("vn_dir: bad namelen %u / %zu\n", de->namelen, reclen);
+                return ZX_ERR_IO;
+            }
+            fbl::AllocChecker ac;
+            const BlockRecord record = {static_cast<uint32_t>(off), dsize,
+                                        DirentHash(fbl::StringPiece(de->name, de->namelen))};
+            out->push_back(record, &ac);
+            if (!ac.check()) {
+                return ZX_ERR_NO_MEMORY;
+            }
+        }
+        if (last) {
+            break;
+        }
+        off += reclen;
+    }
+    return ZX_OK;
+}
+
+// Copies the records of |records| from |src| whose hash lies in [|min_hash|, |max_hash|) to
+// the start of the directory block |dst|, and extends the last of them to the end of the block
+// ("." and "..", which belong in the index block, are left out).
+void PackRecords(const uint8_t* src, const fbl::Vector<BlockRecord>& records,
+                 uint64_t min_hash, uint64_t max_hash, uint8_t* dst) {
+    memset(dst, 0, kMinfsBlockSize);
+    Dirent* last = reinterpret_cast<Dirent*>(dst);
+    uint32_t off = 0;
+    for (const BlockRecord& record : records) {
+        const Dirent* de = reinterpret_cast<const Dirent*>(src + record.off);
+        fbl::StringPiece name(de->name, de->namelen);
+        if ((record.hash < min_hash) || (record.hash >= max_hash) ||
+            (name == ".") || (name == "..")) {
+            continue;
+        }
+        last = reinterpret_cast<Dirent*>(dst + off);
+        memcpy(last, de, record.size);
+        last->reclen = record.size;
+        off += record.size;
+    }
+    // With no records, |last| is a free record covering the whole block.
+    last->reclen = static_cast<uint32_t>(dst + kMinfsBlockSize - reinterpret_cast<uint8_t*>(last));
+}
+
 #ifdef __Fuchsia__
 
 // MinfsConnection overrides the base Connection class to allow Minfs to
@@ -130,6 +225,20 @@ void VnodeMinfs::InodeSync(WritebackWork* wb, uint32_t flags) {
         }
     }
 
+#ifdef __Fuchsia__
+    if (delayed_.num_bits() > 0) {
+        // Delayed blocks are not allocated yet, so the size on disk may not grow to cover the
+        // first of them until they are flushed.
+        const size_t allocated_size = delayed_.begin()->bitoff * kMinfsBlockSize;
+        Inode inode = inode_;
+        inode.size = static_cast<uint32_t>(fbl::min<size_t>(
+                inode_.size, fbl::max<size_t>(disk_size_, allocated_size)));
+        disk_size_ = inode.size;
+        fs_->InodeUpdate(wb, ino_, &inode);
+        return;
+    }
+    disk_size_ = inode_.size;
+#endif
     fs_->InodeUpdate(wb, ino_, &inode_);
 }
 
@@ -137,6 +246,18 @@ void VnodeMinfs::InodeSync(WritebackWork* wb, uint32_t flags) {
 // the file. Does not update mtime/atime.
 zx_status_t VnodeMinfs::BlocksShrink(Transaction* state, blk_t start) {
     ZX_DEBUG_ASSERT(state != nullptr);
+    if (IsExtentMapped()) {
+#ifdef __Fuchsia__
+        CancelDelayed(start);
+#endif
+        zx_status_t status;
+        if ((status = LoadExtents()) != ZX_OK) {
+            return status;
+        }
+        ExtentTruncate(state, start);
+        return WriteExtents(state);
+    }
+
     BlockOpArgs op_args(start, static_cast<blk_t>(kMinfsMaxFileBlock - start), nullptr);
     zx_status_t status;
     if ((status = ApplyOperation(state, BlockOp::kDelete, &op_args)) != ZX_OK) {
@@ -226,6 +347,11 @@ zx_status_t VnodeMinfs::InitIndirectVmo() {
         return status;
     }
 
+    // Extent-mapped files have no indirect blocks: LoadExtents reads their ExtentBlocks.
+    if (IsExtentMapped()) {
+        return ZX_OK;
+    }
+
     // Load initial set of indirect blocks
     if ((status = LoadIndirectBlocks(inode_.inum, kMinfsIndirect, 0, 0)) != ZX_OK) {
         vmo_indirect_ = nullptr;
@@ -279,6 +405,22 @@ zx_status_t VnodeMinfs::InitVmo() {
                                ticker.End());
     });
 
+    if (IsExtentMapped()) {
+        if ((status = LoadExtents()) != ZX_OK) {
+            vmo_.reset();
+            return status;
+        }
+        // Each extent is read with a single request.
+        for (const Extent& extent : extents_) {
+            dnum_count += extent.length;
+            txn.Enqueue(vmoid_, extent.file_block, extent.start + fs_->Info().dat_block,
+                        extent.length);
+        }
+        status = txn.Transact();
+        ValidateVmoTail();
+        return status;
+    }
+
     // Initialize all direct blocks
     blk_t bno;
     for (uint32_t d = 0; d < kMinfsDirect; d++) {
@@ -681,6 +823,22 @@ zx_status_t VnodeMinfs::ApplyOperation(Transaction* state, BlockOp op, BlockOpAr
 }
 
 zx_status_t VnodeMinfs::BlockGet(Transaction* state, blk_t n, blk_t* bno) {
+    if (IsExtentMapped()) {
+        zx_status_t status;
+        if ((status = LoadExtents()) != ZX_OK) {
+            return status;
+        }
+        *bno = ExtentLookup(n);
+        if ((*bno == 0) && (state != nullptr)) {
+            if ((status = ExtentReserve(1)) != ZX_OK) {
+                return status;
+            }
+            blk_t count;
+            ExtentAllocate(state, n, 1, bno, &count);
+        }
+        return ZX_OK;
+    }
+
 #ifdef __Fuchsia__
     if (n >= kMinfsDirect) {
         zx_status_t status;
@@ -710,6 +868,491 @@ zx_status_t VnodeMinfs::BlockGet(Transaction* state, blk_t n, blk_t* bno) {
     return ApplyOperation(state, state ? BlockOp::kWrite : BlockOp::kRead, &op_args);
 }
 
+zx_status_t VnodeMinfs::LoadExtents() {
+    ZX_DEBUG_ASSERT(IsExtentMapped());
+    if (extents_loaded_) {
+        return ZX_OK;
+    }
+
+    const InodeExtents* header = GetInodeExtents(&inode_);
+    fbl::AllocChecker ac;
+    fbl::Vector<Extent> extents;
+    fbl::Vector<ExtentChainBlock> chain;
+    extents.reserve(header->count, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < fbl::min(header->count, kMinfsInlineExtents); i++) {
+        extents.push_back(header->extents[i]);
+    }
+
+    blk_t bno = header->next;
+    while (extents.size() < header->count) {
+        if ((bno == 0) || (bno >= fs_->Info().block_count)) {
+            FS_TRACE_ERROR("minfs: ino#%u: bad extent block %u\n", ino_, bno);
+            return ZX_ERR_IO;
+        }
+        const ExtentBlock* block;
+#ifdef __Fuchsia__
+        zx_status_t status;
+        const blk_t offset = static_cast<blk_t>(chain.size());
+        if ((status = InitIndirectVmo()) != ZX_OK) {
+            return status;
+        }
+        if (vmo_indirect_->size() < (offset + 1) * kMinfsBlockSize &&
+            (status = vmo_indirect_->Grow((offset + 1) * kMinfsBlockSize)) != ZX_OK) {
+            return status;
+        }
+        fs::ReadTxn txn(fs_->bc_.get());
+        txn.Enqueue(vmoid_indirect_, offset, bno + fs_->Info().dat_block, 1);
+        if ((status = txn.Transact()) != ZX_OK) {
+            return status;
+        }
+        uint32_t* entry;
+        ReadIndirectVmoBlock(offset, &entry);
+        block = reinterpret_cast<const ExtentBlock*>(entry);
+#else
+        uint32_t data[kMinfsBlockSize / sizeof(uint32_t)];
+        if (fs_->bc_->Readblk(bno + fs_->Info().dat_block, data)) {
+            return ZX_ERR_IO;
+        }
+        block = reinterpret_cast<const ExtentBlock*>(data);
+#endif
+        // Blocks of the chain need not be full, but are never empty.
+        if ((block->magic != kMinfsExtentBlockMagic) || (block->count == 0) ||
+            (block->count > kMinfsExtentsPerBlock) ||
+            (block->count > header->count - extents.size())) {
+            FS_TRACE_ERROR("minfs: ino#%u: bad extent block %u\n", ino_, bno);
+            return ZX_ERR_IO;
+        }
+        for (size_t i = 0; i < block->count; i++) {
+            extents.push_back(block->extents[i]);
+        }
+        chain.push_back(ExtentChainBlock{bno, block->count, false}, &ac);
+        if (!ac.check()) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        bno = block->next;
+    }
+    if (bno != 0) {
+        FS_TRACE_ERROR("minfs: ino#%u: extent chain continues past its last extent\n", ino_);
+        return ZX_ERR_IO;
+    }
+
+    // Extents must map disjoint ranges of the file, in order, onto data blocks.
+    for (size_t i = 0; i < extents.size(); i++) {
+        const Extent& extent = extents[i];
+        if ((extent.length == 0) || (extent.start == 0) ||
+            (extent.start + extent.length < extent.start) ||
+            (extent.start + extent.length > fs_->Info().block_count) ||
+            (extent.file_block + extent.length > kMinfsMaxFileBlock) ||
+            ((i > 0) &&
+             (extent.file_block < extents[i - 1].file_block + extents[i - 1].length))) {
+            FS_TRACE_ERROR("minfs: ino#%u: bad extent %zu\n", ino_, i);
+            return ZX_ERR_IO;
+        }
+    }
+
+    extents_ = std::move(extents);
+    extent_chain_ = std::move(chain);
+    extents_loaded_ = true;
+    extents_dirty_ = false;
+    return ZX_OK;
+}
+
+blk_t VnodeMinfs::ExtentLookup(blk_t n) const {
+    ZX_DEBUG_ASSERT(extents_loaded_);
+    // Find the last extent starting at or before |n|.
+    size_t lo = 0;
+    size_t hi = extents_.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (extents_[mid].file_block <= n) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return 0;
+    }
+    const Extent& extent = extents_[lo - 1];
+    return (n < extent.file_block + extent.length) ? extent.start + (n - extent.file_block) : 0;
+}
+
+zx_status_t VnodeMinfs::ExtentReserve(size_t inserts) {
+    ZX_DEBUG_ASSERT(extents_loaded_);
+    // Each insertion adds at most one extent, and splits at most one ExtentBlock.
+    fbl::AllocChecker ac;
+    extents_.reserve(extents_.size() + inserts, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    extent_chain_.reserve(extent_chain_.size() + inserts, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+#ifdef __Fuchsia__
+    // WriteExtents stages the blocks it writes in the indirect VMO.
+    const size_t blocks = extent_chain_.size() + inserts;
+    if (blocks > 0) {
+        zx_status_t status;
+        if ((status = InitIndirectVmo()) != ZX_OK) {
+            return status;
+        }
+        if (vmo_indirect_->size() < blocks * kMinfsBlockSize &&
+            (status = vmo_indirect_->Grow(blocks * kMinfsBlockSize)) != ZX_OK) {
+            return status;
+        }
+    }
+#endif
+    return ZX_OK;
+}
+
+size_t VnodeMinfs::ExtentChainFind(size_t i, size_t* out_base) const {
+    ZX_DEBUG_ASSERT(i >= kMinfsInlineExtents && !extent_chain_.is_empty());
+    size_t base = kMinfsInlineExtents;
+    size_t b = 0;
+    while ((b + 1 < extent_chain_.size()) && (i >= base + extent_chain_[b].count)) {
+        base += extent_chain_[b].count;
+        b++;
+    }
+    *out_base = base;
+    return b;
+}
+
+void VnodeMinfs::ExtentInsert(Transaction* state, blk_t n, blk_t bno, blk_t count) {
+    ZX_DEBUG_ASSERT(extents_loaded_);
+    // The new extent goes after all extents starting before |n|.
+    size_t i = 0;
+    size_t hi = extents_.size();
+    while (i < hi) {
+        size_t mid = i + (hi - i) / 2;
+        if (extents_[mid].file_block < n) {
+            i = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    ZX_DEBUG_ASSERT(i == 0 || extents_[i - 1].file_block + extents_[i - 1].length <= n);
+    ZX_DEBUG_ASSERT(i == extents_.size() || n + count <= extents_[i].file_block);
+
+    const bool merge_prev = (i > 0) &&
+                            (extents_[i - 1].file_block + extents_[i - 1].length == n) &&
+                            (extents_[i - 1].start + extents_[i - 1].length == bno);
+    const bool merge_next = (i < extents_.size()) &&
+                            (n + count == extents_[i].file_block) &&
+                            (bno + count == extents_[i].start);
+    size_t base;
+    if (merge_prev || merge_next) {
+        if (merge_prev) {
+            i--;
+            extents_[i].length += count;
+        } else {
+            extents_[i].file_block = n;
+            extents_[i].start = bno;
+            extents_[i].length += count;
+        }
+        if (i >= kMinfsInlineExtents) {
+            extent_chain_[ExtentChainFind(i, &base)].dirty = true;
+        }
+        if (merge_prev && merge_next) {
+            // The next extent is absorbed. Its block, or the first block if the inode held it,
+            // holds one extent less, and leaves the chain once it is empty.
+            extents_[i].length += extents_[i + 1].length;
+            if (!extent_chain_.is_empty()) {
+                const size_t b = (i + 1 < kMinfsInlineExtents) ? 0 : ExtentChainFind(i + 1, &base);
+                if (--extent_chain_[b].count > 0) {
+                    extent_chain_[b].dirty = true;
+                } else {
+                    if (extent_chain_[b].bno != 0) {
+                        fs_->BlockFree(state->GetWork(), extent_chain_[b].bno);
+                        inode_.block_count--;
+                    }
+                    extent_chain_.erase(b);
+                    if (b > 0) {
+                        extent_chain_[b - 1].dirty = true;
+                    }
+                }
+            }
+            extents_.erase(i + 1);
+        }
+    } else {
+        ZX_DEBUG_ASSERT(extents_.capacity() > extents_.size());
+        extents_.insert(i, Extent{n, bno, count});
+        if (extents_.size() > kMinfsInlineExtents) {
+            // One more extent is held past the inode: by the block which |i| lands in, or by the
+            // first block if the last extent held by the inode is pushed out of it.
+            size_t b = 0;
+            size_t pos = 0;
+            if (extent_chain_.is_empty()) {
+                ZX_DEBUG_ASSERT(extent_chain_.capacity() > 0);
+                extent_chain_.push_back(ExtentChainBlock{0, 0, true});
+            } else if (i >= kMinfsInlineExtents) {
+                b = ExtentChainFind(i, &base);
+                pos = i - base;
+                // Between two blocks, prefer the end of the first one.
+                if ((pos == 0) && (b > 0) &&
+                    (extent_chain_[b - 1].count < kMinfsExtentsPerBlock)) {
+                    b--;
+                    pos = extent_chain_[b].count;
+                }
+            }
+            if (extent_chain_[b].count < kMinfsExtentsPerBlock) {
+                extent_chain_[b].count++;
+            } else {
+                // Split the full block. Appending to it starts a new block, so that files
+                // written in order keep their blocks full; otherwise each half keeps one half.
+                const uint32_t total = kMinfsExtentsPerBlock + 1;
+                const uint32_t keep = (pos == kMinfsExtentsPerBlock) ? kMinfsExtentsPerBlock
+                                                                     : total / 2;
+                extent_chain_[b].count = keep;
+                ZX_DEBUG_ASSERT(extent_chain_.capacity() > extent_chain_.size());
+                extent_chain_.insert(b + 1, ExtentChainBlock{0, total - keep, true});
+            }
+            extent_chain_[b].dirty = true;
+        }
+    }
+    extents_dirty_ = true;
+}
+
+void VnodeMinfs::ExtentAllocate(Transaction* state, blk_t n, blk_t count, blk_t* out_bno,
+                                blk_t* out_count) {
+    // Continue the extent which maps the previous block, if the blocks after it are free.
+    blk_t hint = (n > 0) ? ExtentLookup(n - 1) : 0;
+    if (hint != 0) {
+        hint++;
+    }
+    fs_->BlockNewRun(state, hint, count, out_bno, out_count);
+    ExtentInsert(state, n, *out_bno, *out_count);
+    inode_.block_count += *out_count;
+}
+
+void VnodeMinfs::ExtentTruncate(Transaction* state, blk_t start) {
+    ZX_DEBUG_ASSERT(extents_loaded_);
+    bool changed = false;
+    while (!extents_.is_empty()) {
+        Extent& extent = extents_[extents_.size() - 1];
+        if (extent.file_block + extent.length <= start) {
+            break;
+        }
+        const blk_t keep = (extent.file_block < start) ? start - extent.file_block : 0;
+        fs_->BlockFreeRun(state->GetWork(), extent.start + keep, extent.length - keep);
+        inode_.block_count -= extent.length - keep;
+        if (keep == 0) {
+            extents_.pop_back();
+        } else {
+            extent.length = keep;
+        }
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+    extents_dirty_ = true;
+
+    // Only the tail of the chain changes: the blocks which no longer hold any extents are freed,
+    // and the last remaining one is rewritten.
+    size_t held = (extents_.size() > kMinfsInlineExtents) ?
+                  extents_.size() - kMinfsInlineExtents : 0;
+    size_t kept = 0;
+    while ((kept < extent_chain_.size()) && (held > 0)) {
+        const uint32_t count = static_cast<uint32_t>(fbl::min<size_t>(extent_chain_[kept].count,
+                                                                      held));
+        extent_chain_[kept].count = count;
+        held -= count;
+        kept++;
+    }
+    if (kept > 0) {
+        extent_chain_[kept - 1].dirty = true;
+    }
+    while (extent_chain_.size() > kept) {
+        const ExtentChainBlock& block = extent_chain_[extent_chain_.size() - 1];
+        if (block.bno != 0) {
+            fs_->BlockFree(state->GetWork(), block.bno);
+            inode_.block_count--;
+        }
+        extent_chain_.pop_back();
+    }
+}
+
+zx_status_t VnodeMinfs::GetExtentReserveBlocks(size_t offset, size_t length,
+                                               blk_t* reserve_blocks) {
+    zx_status_t status;
+#ifdef __Fuchsia__
+    if ((status = InitVmo()) != ZX_OK) {
+        return status;
+    }
+#else
+    if ((status = LoadExtents()) != ZX_OK) {
+        return status;
+    }
+#endif
+    const blk_t start = static_cast<blk_t>(fbl::min<size_t>(offset / kMinfsBlockSize,
+                                                            kMinfsMaxFileBlock));
+    const blk_t end = static_cast<blk_t>(fbl::min<size_t>(
+            fbl::round_up(offset + length, kMinfsBlockSize) / kMinfsBlockSize,
+            kMinfsMaxFileBlock));
+    blk_t count = 0;
+    for (blk_t n = start; n < end; n++) {
+#ifdef __Fuchsia__
+        if (delayed_.Get(n, n + 1)) {
+            continue;
+        }
+#endif
+        if (ExtentLookup(n) == 0) {
+            count++;
+        }
+    }
+#ifdef __Fuchsia__
+    // The ExtentBlocks which delayed blocks may need are reserved when they are flushed.
+    *reserve_blocks = count;
+#else
+    // Each block may be mapped by an extent of its own, which may split an ExtentBlock.
+    *reserve_blocks = (extents_.size() + count > kMinfsInlineExtents) ? 2 * count : count;
+#endif
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::WriteExtents(Transaction* state) {
+    ZX_DEBUG_ASSERT(extents_loaded_);
+    if (!extents_dirty_) {
+        return ZX_OK;
+    }
+
+    // Allocate the blocks which were split off since the chain was last written.
+    for (size_t b = 0; b < extent_chain_.size(); b++) {
+        if (extent_chain_[b].bno == 0) {
+            fs_->BlockNew(state, &extent_chain_[b].bno);
+            inode_.block_count++;
+        }
+    }
+
+    const size_t count = extents_.size();
+    InodeExtents* header = GetInodeExtents(&inode_);
+    memset(header, 0, sizeof(*header));
+    header->count = static_cast<uint32_t>(count);
+    header->next = extent_chain_.is_empty() ? 0 : extent_chain_[0].bno;
+    memcpy(header->extents, extents_.get(),
+           fbl::min<size_t>(count, kMinfsInlineExtents) * sizeof(Extent));
+
+    size_t base = kMinfsInlineExtents;
+#ifdef __Fuchsia__
+    // Changed blocks are staged in the indirect VMO, which ExtentReserve made large enough, until
+    // the transaction copies them out.
+    blk_t staged = 0;
+#endif
+    for (size_t b = 0; b < extent_chain_.size(); base += extent_chain_[b].count, b++) {
+        if (!extent_chain_[b].dirty) {
+            continue;
+        }
+#ifdef __Fuchsia__
+        ZX_DEBUG_ASSERT(vmo_indirect_->size() >= (staged + 1) * kMinfsBlockSize);
+        uint32_t* entry;
+        ReadIndirectVmoBlock(staged, &entry);
+        ExtentBlock* block = reinterpret_cast<ExtentBlock*>(entry);
+#else
+        uint32_t data[kMinfsBlockSize / sizeof(uint32_t)];
+        ExtentBlock* block = reinterpret_cast<ExtentBlock*>(data);
+#endif
+        memset(block, 0, kMinfsBlockSize);
+        block->magic = kMinfsExtentBlockMagic;
+        block->count = extent_chain_[b].count;
+        block->next = (b + 1 < extent_chain_.size()) ? extent_chain_[b + 1].bno : 0;
+        memcpy(block->extents, &extents_[base], block->count * sizeof(Extent));
+#ifdef __Fuchsia__
+        state->GetWork()->Enqueue(vmo_indirect_->vmo().get(), staged++,
+                                  extent_chain_[b].bno + fs_->Info().dat_block, 1);
+#else
+        if (fs_->bc_->Writeblk(extent_chain_[b].bno + fs_->Info().dat_block, data)) {
+            return ZX_ERR_IO;
+        }
+#endif
+        extent_chain_[b].dirty = false;
+    }
+
+    extents_dirty_ = false;
+    return ZX_OK;
+}
+
+void VnodeMinfs::ConvertToExtents(Transaction* state) {
+    ZX_DEBUG_ASSERT(!IsDirectory() && !IsExtentMapped());
+    ZX_DEBUG_ASSERT(inode_.block_count == 0);
+    fs_->UpgradeVersion(state->GetWork(), kMinfsVersionExtents);
+    memset(GetInodeExtents(&inode_), 0, sizeof(InodeExtents));
+    inode_.flags |= kMinfsInodeFlagExtents;
+    extents_.reset();
+    extent_chain_.reset();
+    extents_loaded_ = true;
+    extents_dirty_ = false;
+}
+
+#ifdef __Fuchsia__
+zx_status_t VnodeMinfs::FlushDelayed() {
+    if (delayed_.num_bits() == 0) {
+        return ZX_OK;
+    }
+    TRACE_DURATION("minfs", "VnodeMinfs::FlushDelayed", "ino", ino_,
+                   "blocks", delayed_.num_bits());
+
+    zx_status_t status;
+    if ((status = LoadExtents()) != ZX_OK) {
+        return status;
+    }
+
+    // Each transaction maps at most kMaxExtentInserts runs of delayed blocks, so that it modifies
+    // no more ExtentBlocks than TransactionLimits accounts for.
+    while (delayed_.num_bits() > 0) {
+        if ((status = ExtentReserve(TransactionLimits::kMaxExtentInserts)) != ZX_OK) {
+            return status;
+        }
+        // Besides the delayed blocks themselves, which were reserved as they were written, each
+        // run may split an ExtentBlock.
+        fbl::unique_ptr<Transaction> state;
+        if ((status = fs_->BeginTransaction(0, TransactionLimits::kMaxExtentInserts,
+                                            &state)) != ZX_OK) {
+            return status;
+        }
+        state->TakeBlocks(std::move(delayed_promise_));
+
+        for (blk_t runs = 0; (runs < TransactionLimits::kMaxExtentInserts) &&
+                             (delayed_.num_bits() > 0); runs++) {
+            const blk_t n = static_cast<blk_t>(delayed_.begin()->start());
+            const blk_t end = static_cast<blk_t>(delayed_.begin()->end());
+            blk_t bno;
+            blk_t count;
+            ExtentAllocate(state.get(), n, end - n, &bno, &count);
+            state->GetWork()->EnqueueData(vmo_.get(), n, bno + fs_->Info().dat_block, count);
+            delayed_.Clear(n, n + count);
+        }
+
+        // This cannot fail: ExtentReserve made room for everything it writes.
+        status = WriteExtents(state.get());
+        ZX_DEBUG_ASSERT(status == ZX_OK);
+
+        // The reservation of the delayed blocks which are left goes back to them.
+        state->GiveBlocks(&delayed_promise_);
+        ZX_DEBUG_ASSERT(delayed_promise_->Reserved() >= delayed_.num_bits());
+        delayed_promise_->Cancel(delayed_promise_->Reserved() - delayed_.num_bits());
+
+        InodeSync(state->GetWork(), kMxFsSyncDefault);
+        state->GetWork()->PinVnode(fbl::WrapRefPtr(this));
+        fs_->CommitTransaction(std::move(state));
+    }
+    return ZX_OK;
+}
+
+void VnodeMinfs::CancelDelayed(blk_t start) {
+    const size_t delayed = delayed_.num_bits();
+    if (delayed == 0) {
+        return;
+    }
+    delayed_.Clear(start, kMinfsMaxFileBlock);
+    ZX_DEBUG_ASSERT(delayed_promise_ != nullptr);
+    delayed_promise_->Cancel(delayed - delayed_.num_bits());
+}
+#endif
+
 zx_status_t VnodeMinfs::ReadExactInternal(void* data, size_t len, size_t off) {
     size_t actual;
     zx_status_t status = ReadInternal(data, len, off, &actual);
@@ -776,13 +1419,15 @@ zx_status_t VnodeMinfs::UnlinkChild(Transaction* state,
     // Verify they are free and small enough to merge.
     size_t coalesced_size = MinfsReclen(de, off);
     // Coalesce with "next" first, so the kMinfsReclenLast bit can easily flow
-    // back to "de" and "de_prev".
-    if (!(de->reclen & kMinfsReclenLast)) {
+    // back to "de" and "de_prev". Records of a hashed directory are not
+    // coalesced across blocks.
+    if (!(de->reclen & kMinfsReclenLast) && (off_next < DirentLimit(off))) {
         size_t len = MINFS_DIRENT_SIZE;
         if ((status = ReadExactInternal(&de_next, len, off_next)) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Failed to read next dirent\n");
             return status;
-        } else if ((status = ValidateDirent(&de_next, len, off_next)) != ZX_OK) {
+        } else if ((status = ValidateDirent(&de_next, len, off_next,
+                                            DirentLimit(off_next))) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Read invalid dirent\n");
             return status;
         }
@@ -797,7 +1442,8 @@ zx_status_t VnodeMinfs::UnlinkChild(Transaction* state,
         if ((status = ReadExactInternal(&de_prev, len, off_prev)) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Failed to read previous dirent\n");
             return status;
-        } else if ((status = ValidateDirent(&de_prev, len, off_prev)) != ZX_OK) {
+        } else if ((status = ValidateDirent(&de_prev, len, off_prev,
+                                            DirentLimit(off_prev))) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Read invalid dirent\n");
             return status;
         }
@@ -989,14 +1635,73 @@ zx_status_t VnodeMinfs::DirentCallbackFindSpace(fbl::RefPtr<VnodeMinfs> vndir, D
     }
 }
 
+zx_status_t VnodeMinfs::FindDirentSpace(DirArgs* args, blk_t* reserve_blocks) {
+    args->split = false;
+    zx_status_t status = ForEachDirent(args, DirentCallbackFindSpace);
+    if ((status == ZX_ERR_NOT_FOUND) && IsHashedDirectory()) {
+        // The leaf is full. Splitting it appends a new leaf to the directory.
+        args->split = true;
+        return GetRequiredBlockCount(inode_.size, kMinfsBlockSize, reserve_blocks);
+    } else if (status == ZX_ERR_NOT_FOUND) {
+        return ZX_ERR_NO_SPACE;
+    } else if (status != ZX_OK) {
+        return status;
+    }
+
+    if (!IsHashedDirectory() && (inode_.size <= kMinfsBlockSize)) {
+        char data[kMinfsMaxDirentSize];
+        Dirent* de = reinterpret_cast<Dirent*>(data);
+        size_t r;
+        if ((status = ReadInternal(data, kMinfsMaxDirentSize, args->offs.off, &r)) != ZX_OK) {
+            return status;
+        } else if ((status = ValidateDirent(de, r, args->offs.off,
+                                            DirentLimit(args->offs.off))) != ZX_OK) {
+            return status;
+        }
+        size_t end = args->offs.off + (de->ino ? DirentSize(de->namelen) : 0) + args->reclen;
+        if (end > kMinfsBlockSize) {
+            // Rather than outgrowing its first block, the directory is hashed: the index takes
+            // over the first block, and the first leaf (which may have to be split for the
+            // direntry to fit) is appended.
+            args->split = true;
+            return GetRequiredBlockCount(kMinfsBlockSize, 2 * kMinfsBlockSize, reserve_blocks);
+        }
+    }
+
+    // Calculate maximum blocks to reserve for the directory, based on the size and offset
+    // of the new direntry (Assuming that the offset is the current size of the directory).
+    return GetRequiredBlockCount(inode_.size, args->reclen, reserve_blocks);
+}
+
 zx_status_t VnodeMinfs::AppendDirent(DirArgs* args) {
     char data[kMinfsMaxDirentSize];
     Dirent* de = reinterpret_cast<Dirent*>(data);
     size_t r;
-    zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, args->offs.off, &r);
+    zx_status_t status;
+    if (args->split) {
+        // Make room in the leaf which |args->name| hashes to, then look for it again.
+        if (!IsHashedDirectory() && (status = ConvertToHashed(args->state)) != ZX_OK) {
+            return status;
+        }
+        status = ForEachDirent(args, DirentCallbackFindSpace);
+        if (status == ZX_ERR_NOT_FOUND) {
+            if ((status = SplitLeaf(args->state, DirentHash(args->name), args->reclen)) != ZX_OK) {
+                return status;
+            }
+            status = ForEachDirent(args, DirentCallbackFindSpace);
+        }
+        if (status == ZX_ERR_NOT_FOUND) {
+            return ZX_ERR_NO_SPACE;
+        } else if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    status = ReadInternal(data, kMinfsMaxDirentSize, args->offs.off, &r);
     if (status != ZX_OK) {
         return status;
-    } else if ((status = ValidateDirent(de, r, args->offs.off)) != ZX_OK) {
+    } else if ((status = ValidateDirent(de, r, args->offs.off,
+                                        DirentLimit(args->offs.off))) != ZX_OK) {
         return status;
     }
 
@@ -1064,18 +1769,34 @@ zx_status_t VnodeMinfs::AppendDirent(DirArgs* args) {
 //  'offs': Offset info about where in the directory this direntry is located.
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
+//
+// In a hashed directory, only the block which may hold 'args->name' is visited:
+// the index block for "." and "..", or else the leaf which the name hashes to.
 zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func) {
     char data[kMinfsMaxDirentSize];
     Dirent* de = (Dirent*) data;
-    args->offs.off = 0;
-    args->offs.off_prev = 0;
-    while (args->offs.off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+    size_t start = 0;
+    size_t end = DirectoryEnd();
+    if (IsHashedDirectory()) {
+        if ((args->name != ".") && (args->name != "..")) {
+            zx_status_t status;
+            if ((status = LoadDirIndex()) != ZX_OK) {
+                return status;
+            }
+            start = dir_index_[FindLeaf(DirentHash(args->name))].block * kMinfsBlockSize;
+        }
+        end = start + kMinfsBlockSize;
+    }
+    args->offs.off = start;
+    args->offs.off_prev = start;
+    while (args->offs.off < end) {
         FS_TRACE_DEBUG("Reading dirent at offset %zd\n", args->offs.off);
         size_t r;
         zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, args->offs.off, &r);
         if (status != ZX_OK) {
             return status;
-        } else if ((status = ValidateDirent(de, r, args->offs.off)) != ZX_OK) {
+        } else if ((status = ValidateDirent(de, r, args->offs.off,
+                                            DirentLimit(args->offs.off))) != ZX_OK) {
             return status;
         }
 
@@ -1096,6 +1817,234 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
     return ZX_ERR_NOT_FOUND;
 }
 
+zx_status_t VnodeMinfs::LoadDirIndex() {
+    if (!dir_index_.is_empty()) {
+        return ZX_OK;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> block(new (&ac) uint8_t[kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    zx_status_t status;
+    if ((status = ReadExactInternal(block.get(), kMinfsBlockSize, 0)) != ZX_OK) {
+        return status;
+    }
+
+    const DirIndex* index = reinterpret_cast<const DirIndex*>(&block[kMinfsDirIndexOffset]);
+    if ((index->magic != kMinfsDirIndexMagic) || (index->count == 0) ||
+        (index->count > kMinfsDirIndexMaxLeaves) ||
+        ((1 + index->count) * kMinfsBlockSize != inode_.size)) {
+        FS_TRACE_ERROR("minfs: ino#%u: bad directory index\n", ino_);
+        return ZX_ERR_IO;
+    }
+
+    // Each leaf must appear exactly once, in order of hash.
+    bool seen[kMinfsDirIndexMaxLeaves + 1] = {};
+    fbl::Vector<DirIndexEntry> entries;
+    entries.reserve(index->count, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < index->count; i++) {
+        const DirIndexEntry& entry = index->entries[i];
+        if (((i == 0) ? (entry.hash != 0) : (entry.hash <= index->entries[i - 1].hash)) ||
+            (entry.block == 0) || (entry.block > index->count) || seen[entry.block]) {
+            FS_TRACE_ERROR("minfs: ino#%u: bad directory index entry %u\n", ino_, i);
+            return ZX_ERR_IO;
+        }
+        seen[entry.block] = true;
+        entries.push_back(entry);
+    }
+    dir_index_ = std::move(entries);
+    return ZX_OK;
+}
+
+size_t VnodeMinfs::FindLeaf(uint32_t hash) const {
+    ZX_DEBUG_ASSERT(!dir_index_.is_empty());
+    // Find the last entry whose hash is not above |hash|; the first one covers hash 0.
+    size_t lo = 0;
+    size_t hi = dir_index_.size();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (dir_index_[mid].hash <= hash) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+zx_status_t VnodeMinfs::WriteDirIndex(Transaction* state,
+                                      const fbl::Vector<DirIndexEntry>& entries) {
+    const size_t length = sizeof(DirIndex) + entries.size() * sizeof(DirIndexEntry);
+    uint8_t data[sizeof(DirIndex) + kMinfsDirIndexMaxLeaves * sizeof(DirIndexEntry)];
+    DirIndex* index = reinterpret_cast<DirIndex*>(data);
+    index->magic = kMinfsDirIndexMagic;
+    index->count = static_cast<uint32_t>(entries.size());
+    memcpy(index->entries, entries.get(), entries.size() * sizeof(DirIndexEntry));
+    return WriteExactInternal(state, data, length, kMinfsDirIndexOffset);
+}
+
+zx_status_t VnodeMinfs::ConvertToHashed(Transaction* state) {
+    ZX_DEBUG_ASSERT(!IsHashedDirectory());
+    ZX_DEBUG_ASSERT(inode_.size <= kMinfsBlockSize);
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> blocks(new (&ac) uint8_t[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    uint8_t* index_block = &blocks[0];
+    uint8_t* leaf = &blocks[kMinfsBlockSize];
+
+    // Move every record but "." and ".." to the first leaf.
+    zx_status_t status;
+    fbl::Vector<BlockRecord> records;
+    if ((status = ReadExactInternal(index_block, inode_.size, 0)) != ZX_OK) {
+        return status;
+    } else if ((status = CollectRecords(index_block, inode_.size, true, &records)) != ZX_OK) {
+        return status;
+    }
+    PackRecords(index_block, records, 0, UINT64_MAX, leaf);
+
+    ino_t parent = 0;
+    for (const BlockRecord& record : records) {
+        const Dirent* de = reinterpret_cast<const Dirent*>(&index_block[record.off]);
+        if (fbl::StringPiece(de->name, de->namelen) == "..") {
+            parent = de->ino;
+        }
+    }
+    if (parent == 0) {
+        FS_TRACE_ERROR("minfs: ino#%u: directory missing '..'\n", ino_);
+        return ZX_ERR_IO;
+    }
+
+    // The index block holds "." and "..", then a free record covering the index.
+    memset(index_block, 0, kMinfsBlockSize);
+    InitializeDirectory(index_block, ino_, parent);
+    Dirent* de = reinterpret_cast<Dirent*>(&index_block[DirentSize(1)]);
+    de->reclen = DirentSize(2);
+    de = reinterpret_cast<Dirent*>(&index_block[DirentSize(1) + DirentSize(2)]);
+    de->reclen = kMinfsBlockSize - DirentSize(1) - DirentSize(2);
+
+    const DirIndexEntry entry = {0, 1};
+    fbl::Vector<DirIndexEntry> entries;
+    entries.push_back(entry, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    DirIndex* index = reinterpret_cast<DirIndex*>(&index_block[kMinfsDirIndexOffset]);
+    index->magic = kMinfsDirIndexMagic;
+    index->count = 1;
+    index->entries[0] = entry;
+
+    // The leaf is written first, past the end of the directory, so that the directory is left
+    // as it was if either write fails. It is only marked as hashed once both succeed.
+    const uint32_t size = inode_.size;
+    if ((status = WriteExactInternal(state, leaf, kMinfsBlockSize, kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    } else if ((status = WriteExactInternal(state, index_block, kMinfsBlockSize, 0)) != ZX_OK) {
+        inode_.size = size;
+        return status;
+    }
+
+    fs_->UpgradeVersion(state->GetWork(), kMinfsVersionDirIndex);
+    inode_.flags |= kMinfsInodeFlagDirIndex;
+    dir_index_ = std::move(entries);
+    InodeSync(state->GetWork(), kMxFsSyncMtime);
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::SplitLeaf(Transaction* state, uint32_t hash, uint32_t reclen) {
+    zx_status_t status;
+    if ((status = LoadDirIndex()) != ZX_OK) {
+        return status;
+    }
+    const size_t index = FindLeaf(hash);
+    const size_t leaf_off = dir_index_[index].block * kMinfsBlockSize;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> blocks(new (&ac) uint8_t[3 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    uint8_t* leaf = &blocks[0];
+    uint8_t* lower = &blocks[kMinfsBlockSize];
+    uint8_t* upper = &blocks[2 * kMinfsBlockSize];
+
+    fbl::Vector<BlockRecord> records;
+    if ((status = ReadExactInternal(leaf, kMinfsBlockSize, leaf_off)) != ZX_OK) {
+        return status;
+    } else if ((status = CollectRecords(leaf, kMinfsBlockSize, false, &records)) != ZX_OK) {
+        return status;
+    }
+    size_t total = 0;
+    for (const BlockRecord& record : records) {
+        total += record.size;
+    }
+
+    if (total + reclen <= kMinfsBlockSize) {
+        // The free space of the leaf is merely fragmented.
+        PackRecords(leaf, records, 0, UINT64_MAX, lower);
+        return WriteExactInternal(state, lower, kMinfsBlockSize, leaf_off);
+    } else if (dir_index_.size() == kMinfsDirIndexMaxLeaves) {
+        return ZX_ERR_NO_SPACE;
+    }
+
+    // Split the leaf at the hash which halves its records, keeping records whose names hash
+    // alike together. The lower half may not be left empty.
+    qsort(records.get(), records.size(), sizeof(BlockRecord), CompareRecordHashes);
+    size_t i = 0;
+    for (size_t half = 0; i < records.size(); i++) {
+        half += records[i].size;
+        if (2 * half >= total) {
+            break;
+        }
+    }
+    while ((i < records.size()) && (records[i].hash == records[0].hash)) {
+        i++;
+    }
+    if (i == records.size()) {
+        return ZX_ERR_NO_SPACE;
+    }
+    const uint32_t split = records[i].hash;
+    PackRecords(leaf, records, 0, split, lower);
+    PackRecords(leaf, records, split, UINT64_MAX, upper);
+
+    const DirIndexEntry entry = {split, static_cast<blk_t>(dir_index_.size() + 1)};
+    const size_t upper_off = entry.block * kMinfsBlockSize;
+    ZX_DEBUG_ASSERT(upper_off == inode_.size);
+    fbl::Vector<DirIndexEntry> entries;
+    entries.reserve(dir_index_.size() + 1, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    for (const DirIndexEntry& e : dir_index_) {
+        entries.push_back(e);
+    }
+    entries.insert(index + 1, entry);
+
+    // The new leaf is appended before the index points at it, and the records it takes over are
+    // only dropped from the old leaf once it does, so that the directory is left as it was if any
+    // of the writes fails. |dir_index_| is only updated once all of them succeed.
+    const uint32_t size = inode_.size;
+    if ((status = WriteExactInternal(state, upper, kMinfsBlockSize, upper_off)) != ZX_OK) {
+        return status;
+    } else if ((status = WriteDirIndex(state, entries)) != ZX_OK) {
+        inode_.size = size;
+        return status;
+    } else if ((status = WriteExactInternal(state, lower, kMinfsBlockSize, leaf_off)) != ZX_OK) {
+        WriteDirIndex(state, dir_index_);
+        inode_.size = size;
+        return status;
+    }
+    dir_index_ = std::move(entries);
+    return ZX_OK;
+}
+
 void VnodeMinfs::fbl_recycle() {
     ZX_DEBUG_ASSERT(fd_count_ == 0);
     if (!IsUnlinked()) {
@@ -1177,12 +2126,25 @@ zx_status_t VnodeMinfs::Close() {
     fd_count_--;
 
     if (fd_count_ == 0 && IsUnlinked()) {
+#ifdef __Fuchsia__
+        // The contents of the file will never be read back.
+        CancelDelayed(0);
+#endif
         fbl::unique_ptr<Transaction> state;
         ZX_ASSERT(fs_->BeginTransaction(0, 0, &state) == ZX_OK);
         fs_->RemoveUnlinked(state->GetWork(), this);
         Purge(state->GetWork());
         fs_->CommitTransaction(std::move(state));
     }
+#ifdef __Fuchsia__
+    if (fd_count_ == 0) {
+        zx_status_t status;
+        if ((status = FlushDelayed()) != ZX_OK) {
+            FS_TRACE_ERROR("minfs: ino#%u: Failed to flush delayed blocks: %d\n", ino_, status);
+            return status;
+        }
+    }
+#endif
     return ZX_OK;
 }
 
@@ -1282,7 +2244,12 @@ zx_status_t VnodeMinfs::Write(const void* data, size_t len, size_t offset,
 
     blk_t reserve_blocks;
     // Calculate maximum number of blocks to reserve for this write operation.
-    zx_status_t status = GetRequiredBlockCount(offset, len, &reserve_blocks);
+    zx_status_t status;
+    if (IsExtentMapped()) {
+        status = GetExtentReserveBlocks(offset, len, &reserve_blocks);
+    } else {
+        status = GetRequiredBlockCount(offset, len, &reserve_blocks);
+    }
     if (status != ZX_OK) {
         return status;
     }
@@ -1291,10 +2258,48 @@ zx_status_t VnodeMinfs::Write(const void* data, size_t len, size_t offset,
         return status;
     }
 
+    // Files without any blocks, including all new files, are mapped by extents from their
+    // first write onwards.
+    if ((len > 0) && !IsExtentMapped() && (inode_.block_count == 0)) {
+        ConvertToExtents(state.get());
+    }
+
     status = WriteInternal(state.get(), data, len, offset, out_actual);
     if (status != ZX_OK) {
         return status;
     }
+#ifdef __Fuchsia__
+    if (IsExtentMapped() && (*out_actual != 0)) {
+        // Newly written blocks stay delayed, along with their reservation, until enough of them
+        // have accumulated to be allocated contiguously.
+        state->GiveBlocks(&delayed_promise_);
+        if (delayed_promise_ != nullptr) {
+            ZX_DEBUG_ASSERT(delayed_promise_->Reserved() >= delayed_.num_bits());
+            delayed_promise_->Cancel(delayed_promise_->Reserved() - delayed_.num_bits());
+        }
+        if (state->GetWork()->BlkCount() == 0) {
+            // Nothing was overwritten in place: the inode is written back with the delayed
+            // blocks.
+            inode_.modify_time = GetTimeUTC();
+        } else {
+            InodeSync(state->GetWork(), kMxFsSyncMtime);
+            state->GetWork()->PinVnode(fbl::WrapRefPtr(this));
+            fs_->CommitTransaction(std::move(state));
+        }
+        if (delayed_.num_bits() >= kMinfsMaxDelayedBlocks) {
+            // The data was accepted either way. Blocks which cannot be flushed now stay delayed,
+            // to be flushed again when the file is synced or closed, which report the error.
+            if ((status = FlushDelayed()) != ZX_OK) {
+                FS_TRACE_ERROR("minfs: ino#%u: Failed to flush delayed blocks: %d\n", ino_,
+                               status);
+            }
+        }
+        if (delayed_.num_bits() > 0) {
+            fs_->ScheduleDelayedFlush();
+        }
+        return ZX_OK;
+    }
+#endif
     if (*out_actual != 0) {
         InodeSync(state->GetWork(), kMxFsSyncMtime);  // Successful writes updates mtime
         state->GetWork()->PinVnode(fbl::WrapRefPtr(this));
@@ -1358,11 +2363,27 @@ zx_status_t VnodeMinfs::WriteInternal(Transaction* state, const void* data,
 
         // Update this block on-disk
         blk_t bno;
-        if ((status = BlockGet(state, n, &bno))) {
-            break;
+        if (IsExtentMapped()) {
+            // Blocks which are not allocated yet are delayed, and only allocated once they are
+            // flushed. Allocated blocks are updated in place.
+            if ((bno = ExtentLookup(n)) != 0) {
+                state->GetWork()->EnqueueData(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+            } else if ((status = delayed_.Set(n, n + 1)) != ZX_OK) {
+                break;
+            }
+        } else {
+            if ((status = BlockGet(state, n, &bno))) {
+                break;
+            }
+            ZX_DEBUG_ASSERT(bno != 0);
+            // Directory contents are metadata, and are journaled along with the
+            // rest of the transaction.
+            if (IsDirectory()) {
+                state->GetWork()->Enqueue(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+            } else {
+                state->GetWork()->EnqueueData(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+            }
         }
-        ZX_DEBUG_ASSERT(bno != 0);
-        state->GetWork()->Enqueue(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
 #else
         blk_t bno;
         if ((status = BlockGet(state, n, &bno))) {
@@ -1399,6 +2420,10 @@ zx_status_t VnodeMinfs::WriteInternal(Transaction* state, const void* data,
         return ZX_ERR_NO_SPACE;
     }
 
+    if (IsExtentMapped() && (status = WriteExtents(state)) != ZX_OK) {
+        return status;
+    }
+
     if ((off + len) > inode_.size) {
         inode_.size = static_cast<uint32_t>(off + len);
     }
@@ -1486,6 +2511,12 @@ struct DirCookie {
     uint32_t seqno;    // inode seq no
 };
 
+// In a hashed directory, |off| instead holds kDirCookieHashed along with the hash of the next
+// record to list, or kDirCookieHashedEnd once all of them were listed, and |reserved| holds how
+// many records of that hash were listed already. A zero |off| still starts from ".".
+constexpr size_t kDirCookieHashed = 1ul << 63;
+constexpr size_t kDirCookieHashedEnd = 1ul << 32;
+
 static_assert(sizeof(DirCookie) <= sizeof(fs::vdircookie_t),
               "MinFS DirCookie too large to fit in IO state");
 
@@ -1500,6 +2531,17 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    if (IsHashedDirectory()) {
+        zx_status_t status = ReaddirHashed(dc, &df);
+        if (status != ZX_OK) {
+            dc->off = 0;
+            return status;
+        }
+        *out_actual = df.BytesFilled();
+        ZX_DEBUG_ASSERT(*out_actual <= len); // Otherwise, we're overflowing the input buffer.
+        return ZX_OK;
+    }
+
     size_t off = dc->off;
     size_t r;
     char data[kMinfsMaxDirentSize];
@@ -1512,12 +2554,13 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
 
         size_t off_recovered = 0;
         while (off_recovered < off) {
-            if (off_recovered + MINFS_DIRENT_SIZE >= kMinfsMaxDirectorySize) {
+            if (off_recovered >= DirectoryEnd()) {
                 FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent; dirent reclen too large\n");
                 goto fail;
             }
             zx_status_t status = ReadInternal(de, kMinfsMaxDirentSize, off_recovered, &r);
-            if ((status != ZX_OK) || (ValidateDirent(de, r, off_recovered) != ZX_OK)) {
+            if ((status != ZX_OK) ||
+                (ValidateDirent(de, r, off_recovered, DirentLimit(off_recovered)) != ZX_OK)) {
                 FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent unreadable/failed validation\n");
                 goto fail;
             }
@@ -1526,12 +2569,12 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
         off = off_recovered;
     }
 
-    while (off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+    while (off < DirectoryEnd()) {
         zx_status_t status = ReadInternal(de, kMinfsMaxDirentSize, off, &r);
         if (status != ZX_OK) {
             FS_TRACE_ERROR("minfs: Readdir: Unreadable dirent\n");
             goto fail;
-        } else if (ValidateDirent(de, r, off) != ZX_OK) {
+        } else if (ValidateDirent(de, r, off, DirentLimit(off)) != ZX_OK) {
             FS_TRACE_ERROR("minfs: Readdir: Corrupt dirent failed validation\n");
             goto fail;
         }
@@ -1562,6 +2605,76 @@ fail:
     return ZX_ERR_IO;
 }
 
+zx_status_t VnodeMinfs::ReaddirHashed(DirCookie* dc, fs::DirentFiller* df) {
+    zx_status_t status;
+    if ((status = LoadDirIndex()) != ZX_OK) {
+        return status;
+    }
+
+    if (dc->off == 0) {
+        if (df->Next(".", kMinfsTypeDir, ino_) != ZX_OK) {
+            return ZX_OK;
+        }
+        dc->off = kDirCookieHashed;
+        dc->reserved = 0;
+    } else if (!(dc->off & kDirCookieHashed)) {
+        // The directory was hashed since the listing started, so the records already listed
+        // cannot be told apart; list the others again from the start.
+        dc->off = kDirCookieHashed;
+        dc->reserved = 0;
+    }
+    if ((dc->off & ~kDirCookieHashed) >= kDirCookieHashedEnd) {
+        return ZX_OK;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> leaf(new (&ac) uint8_t[kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    // |hash| and |listed| are the position to resume from: the records hashing below |hash|,
+    // and the first |listed| records hashing to it, have already been listed.
+    uint32_t hash = static_cast<uint32_t>(dc->off & ~kDirCookieHashed);
+    uint32_t listed = dc->reserved;
+    uint32_t skip = listed;
+    for (size_t i = FindLeaf(hash); i < dir_index_.size(); i++) {
+        fbl::Vector<BlockRecord> records;
+        if ((status = ReadExactInternal(leaf.get(), kMinfsBlockSize,
+                                        dir_index_[i].block * kMinfsBlockSize)) != ZX_OK) {
+            return status;
+        } else if ((status = CollectRecords(leaf.get(), kMinfsBlockSize, false,
+                                            &records)) != ZX_OK) {
+            return status;
+        }
+        SortRecords(leaf.get(), &records);
+
+        for (const BlockRecord& record : records) {
+            if (record.hash < hash) {
+                continue;
+            } else if (record.hash > hash) {
+                hash = record.hash;
+                listed = 0;
+                skip = 0;
+            } else if (skip > 0) {
+                skip--;
+                continue;
+            }
+            const Dirent* de = reinterpret_cast<const Dirent*>(&leaf[record.off]);
+            if (df->Next(fbl::StringPiece(de->name, de->namelen), de->type, de->ino) != ZX_OK) {
+                dc->off = kDirCookieHashed | hash;
+                dc->reserved = listed;
+                return ZX_OK;
+            }
+            listed++;
+        }
+    }
+
+    dc->off = kDirCookieHashed | kDirCookieHashedEnd;
+    dc->reserved = 0;
+    return ZX_OK;
+}
+
 VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs) {}
 
 #ifdef __Fuchsia__
@@ -1594,6 +2707,9 @@ zx_status_t VnodeMinfs::Recreate(Minfs* fs, ino_t ino, fbl::RefPtr<VnodeMinfs>*
     }
     fs->InodeLoad(ino, &(*out)->inode_);
     (*out)->ino_ = ino;
+#ifdef __Fuchsia__
+    (*out)->disk_size_ = (*out)->inode_.size;
+#endif
     return ZX_OK;
 }
 
@@ -1629,17 +2745,8 @@ zx_status_t VnodeMinfs::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece nam
     // before updating any other metadata.
     args.type = type;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-    status = ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
-        return status;
-    }
-
-    // Calculate maximum blocks to reserve for the current directory, based on the size and offset
-    // of the new direntry (Assuming that the offset is the current size of the directory).
     blk_t reserve_blocks = 0;
-    if ((status = GetRequiredBlockCount(inode_.size, args.reclen, &reserve_blocks)) != ZX_OK) {
+    if ((status = FindDirentSpace(&args, &reserve_blocks)) != ZX_OK) {
         return status;
     }
 
@@ -1831,7 +2938,13 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* state, size_t len) {
                                rel_bno, r);
                 return ZX_ERR_IO;
             }
-            if (bno != 0) {
+#ifdef __Fuchsia__
+            // Delayed blocks are not allocated yet, but their tail must be cleared all the same.
+            const bool delayed = delayed_.Get(rel_bno, rel_bno + 1);
+#else
+            const bool delayed = false;
+#endif
+            if (bno != 0 || delayed) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
                 if ((r = vmo_.read(bdata, len - adjust, adjust)) != ZX_OK) {
@@ -1844,7 +2957,14 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* state, size_t len) {
                     FS_TRACE_ERROR("minfs: Truncate failed to write last block: %d\n", r);
                     return ZX_ERR_IO;
                 }
-                state->GetWork()->Enqueue(vmo_.get(), rel_bno, bno + fs_->Info().dat_block, 1);
+                if (IsDirectory()) {
+                    state->GetWork()->Enqueue(vmo_.get(), rel_bno,
+                                              bno + fs_->Info().dat_block, 1);
+                } else if (!delayed) {
+                    // Delayed blocks are written back once they are flushed.
+                    state->GetWork()->EnqueueData(vmo_.get(), rel_bno,
+                                                  bno + fs_->Info().dat_block, 1);
+                }
 #else
                 if (fs_->bc_->Readblk(bno + fs_->Info().dat_block, bdata)) {
                     return ZX_ERR_IO;
@@ -1942,23 +3062,16 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
     // before updating any other metadata.
     args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newname.length())));
-
-    status = newdir->ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
-        return status;
-    }
-
-    DirectoryOffset append_offs = args.offs;
+    args.name = newname;
 
     // Reserve potential blocks to add a new direntry to newdir.
     blk_t reserved_blocks;
-    if ((status = GetRequiredBlockCount(newdir->GetInode()->size, args.reclen, &reserved_blocks))
-        != ZX_OK) {
+    if ((status = newdir->FindDirentSpace(&args, &reserved_blocks)) != ZX_OK) {
         return status;
     }
 
+    DirectoryOffset append_offs = args.offs;
+
     fbl::unique_ptr<Transaction> state;
     if ((status = fs_->BeginTransaction(0, reserved_blocks, &state)) != ZX_OK) {
         return status;
@@ -1967,7 +3080,6 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
     // If the entry for 'newname' exists, make sure it can be replaced by
     // the vnode behind 'oldname'.
     args.state = state.get();
-    args.name = newname;
     args.ino = oldvn->ino_;
     status = newdir->ForEachDirent(&args, DirentCallbackAttemptRename);
     if (status == ZX_ERR_NOT_FOUND) {
@@ -2039,17 +3151,10 @@ zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targ
     // before updating any other metadata.
     args.type = kMinfsTypeFile; // We can't hard link directories
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-    status = ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
-        return status;
-    }
 
     // Reserve potential blocks to write a new direntry.
     blk_t reserved_blocks;
-    if ((status = GetRequiredBlockCount(GetInode()->size, args.reclen, &reserved_blocks))
-        != ZX_OK) {
+    if ((status = FindDirentSpace(&args, &reserved_blocks)) != ZX_OK) {
         return status;
     }
 
@@ -2085,6 +3190,11 @@ zx_status_t VnodeMinfs::GetNodeInfo(uint32_t flags, fuchsia_io_NodeInfo* info) {
 
 void VnodeMinfs::Sync(SyncCallback closure) {
     TRACE_DURATION("minfs", "VnodeMinfs::Sync");
+    zx_status_t status;
+    if ((status = FlushDelayed()) != ZX_OK) {
+        closure(status);
+        return;
+    }
     fs_->Sync([this, cb = std::move(closure)](zx_status_t status) {
         if (status != ZX_OK) {
             cb(status);
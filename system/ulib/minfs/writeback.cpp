@@ -22,6 +22,7 @@
 #include <fs/vfs.h>
 
 #include "minfs-private.h"
+#include <minfs/journal.h>
 #include <minfs/writeback.h>
 
 #include <utility>
@@ -32,9 +33,19 @@ namespace minfs {
 
 void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
                        uint64_t nblocks) {
+    EnqueueRequest(vmo, vmo_offset, dev_offset, nblocks, false);
+}
+
+void WriteTxn::EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                           uint64_t nblocks) {
+    EnqueueRequest(vmo, vmo_offset, dev_offset, nblocks, true);
+}
+
+void WriteTxn::EnqueueRequest(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                              uint64_t nblocks, bool data) {
     ValidateVmoSize(vmo, static_cast<blk_t>(vmo_offset));
     for (size_t i = 0; i < requests_.size(); i++) {
-        if (requests_[i].vmo != vmo) {
+        if (requests_[i].vmo != vmo || requests_[i].data != data) {
             continue;
         }
 
@@ -59,6 +70,7 @@ void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset
     request.vmo_offset = vmo_offset;
     request.dev_offset = dev_offset;
     request.length = nblocks;
+    request.data = data;
     requests_.push_back(std::move(request));
 }
 
@@ -97,6 +109,16 @@ size_t WriteTxn::BlkCount() const {
     return blocks_needed;
 }
 
+size_t WriteTxn::MetadataBlkCount() const {
+    size_t blocks_needed = 0;
+    for (size_t i = 0; i < requests_.size(); i++) {
+        if (!requests_[i].data) {
+            blocks_needed += requests_[i].length;
+        }
+    }
+    return blocks_needed;
+}
+
 #endif  // __Fuchsia__
 
 WritebackWork::WritebackWork(Bcache* bc) : WriteTxn(bc),
@@ -120,12 +142,16 @@ void WritebackWork::Reset() {
 // consumed
 size_t WritebackWork::Complete(zx_handle_t vmo, vmoid_t vmoid) {
     size_t blk_count = BlkCount();
-    zx_status_t status = Flush(vmo, vmoid);
+    MarkCompleted(Flush(vmo, vmoid));
+    return blk_count;
+}
+
+void WritebackWork::MarkCompleted(zx_status_t status) {
+    Requests().reset();
     if (closure_) {
         closure_(status);
     }
     Reset();
-    return blk_count;
 }
 
 void WritebackWork::SetClosure(SyncCallback closure) {
@@ -272,6 +298,7 @@ void WritebackBuffer::CopyToBufferLocked(WriteTxn* txn) {
             request.vmo_offset = 0;
             request.dev_offset = dev_offset;
             request.length = wb_len;
+            request.data = reqs[i].data;
             i++;
             reqs.insert(i, request);
         }
@@ -312,11 +339,60 @@ void WritebackBuffer::Enqueue(fbl::unique_ptr<WritebackWork> work) {
     cnd_signal(&consumer_cvar_);
 }
 
+void WritebackBuffer::SetJournal(fbl::unique_ptr<Journal> journal) {
+    fbl::AutoLock lock(&writeback_lock_);
+    ZX_DEBUG_ASSERT(journal_ == nullptr);
+    journal_ = std::move(journal);
+}
+
+void WritebackBuffer::DequeueBatchLocked(fbl::Vector<fbl::unique_ptr<WritebackWork>>* batch) {
+    // Everything queued up while the previous batch was being written is
+    // committed together, which is what makes synchronous workloads cheap:
+    // each of their transactions no longer costs a round trip of its own.
+    const size_t capacity = journal_->EntryCapacity();
+    size_t blocks = 0;
+    while (!work_queue_.is_empty()) {
+        const size_t work_blocks = work_queue_.front().MetadataBlkCount();
+        if (!batch->is_empty() && blocks + work_blocks > capacity) {
+            break;
+        }
+        blocks += work_blocks;
+        batch->push_back(work_queue_.pop());
+    }
+}
+
 int WritebackBuffer::WritebackThread(void* arg) {
     WritebackBuffer* b = reinterpret_cast<WritebackBuffer*>(arg);
 
     b->writeback_lock_.Acquire();
     while (true) {
+        while (b->journal_ != nullptr && !b->work_queue_.is_empty()) {
+            fbl::Vector<fbl::unique_ptr<WritebackWork>> batch;
+            b->DequeueBatchLocked(&batch);
+            TRACE_DURATION("minfs", "WritebackBuffer::WritebackThread", "works", batch.size());
+            Journal* journal = b->journal_.get();
+
+            size_t blks_consumed = 0;
+            for (size_t i = 0; i < batch.size(); i++) {
+                blks_consumed += batch[i]->BlkCount();
+            }
+
+            // Stay unlocked while processing the batch. The journal is only
+            // ever used (and destroyed) by this thread.
+            b->writeback_lock_.Release();
+            journal->Write(&batch, b->mapper_.start(), b->buffer_vmoid_);
+            for (size_t i = 0; i < batch.size(); i++) {
+                TRACE_FLOW_END("minfs", "writeback",
+                               reinterpret_cast<trace_flow_id_t>(batch[i].get()));
+            }
+            batch.reset();
+
+            b->writeback_lock_.Acquire();
+            b->start_ = (b->start_ + blks_consumed) % b->cap_;
+            b->len_ -= blks_consumed;
+            cnd_signal(&b->producer_cvar_);
+        }
+
         while (!b->work_queue_.is_empty()) {
             auto work = b->work_queue_.pop();
             TRACE_DURATION("minfs", "WritebackBuffer::WritebackThread");
@@ -340,6 +416,12 @@ int WritebackBuffer::WritebackThread(void* arg) {
 
         // Before waiting, we should check if we're unmounting.
         if (b->unmounting_) {
+            if (b->journal_ != nullptr) {
+                // Leave an empty journal behind, so nothing is replayed on
+                // the next mount.
+                b->journal_->Retire();
+                b->journal_.reset();
+            }
             b->writeback_lock_.Release();
             return 0;
         }
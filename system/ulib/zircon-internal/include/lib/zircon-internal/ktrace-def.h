@@ -11,6 +11,10 @@
 KTRACE_DEF(0x000,32B,VERSION,META) // version
 KTRACE_DEF(0x001,32B,TICKS_PER_MS,META) // lo32, hi32
 
+// Filler covering the unused bytes at the end of a per-cpu ring buffer before
+// it wraps. The size bits of the tag hold its length; readers skip it.
+KTRACE_DEF(0x002,PAD,PAD,META)
+
 KTRACE_DEF(0x020,NAME,KTHREAD_NAME,META) // ktid, 0, name[]
 KTRACE_DEF(0x021,NAME,THREAD_NAME,META) // tid, pid, name[]
 KTRACE_DEF(0x022,NAME,PROC_NAME,META) // pid, 0, name[]
@@ -24,6 +24,7 @@ __BEGIN_CDECLS
 #define KTRACE_TAG_16B(e,g)       KTRACE_TAG(e,g,16)
 #define KTRACE_TAG_32B(e,g)       KTRACE_TAG(e,g,32)
 #define KTRACE_TAG_NAME(e,g)      KTRACE_TAG(e,g,48)
+#define KTRACE_TAG_PAD(e,g)       KTRACE_TAG(e,g,0)
 
 #define KTRACE_LEN(tag)           (((tag)&0xF)<<3)
 #define KTRACE_GROUP(tag)         (((tag)>>20)&0xFFF)
@@ -46,6 +47,7 @@ __BEGIN_CDECLS
 #define KTRACE_GRP_IRQ            0x020
 #define KTRACE_GRP_PROBE          0x040
 #define KTRACE_GRP_ARCH           0x080
+#define KTRACE_GRP_PROFILE        0x100
 
 #define KTRACE_GRP_TO_MASK(grp)   ((grp) << 20)
 
@@ -75,6 +77,27 @@ typedef struct ktrace_rec_name {
     char name[1];
 } ktrace_rec_name_t;
 
+// Sample taken by the kernel's sampling profiler. |pc[0]| is the interrupted
+// pc and the rest are return addresses found by following frame pointers, in
+// user space if KTRACE_PROFILE_FLAG_USER is set and in the kernel otherwise.
+// Only as many pcs as the size in the tag covers are present; see
+// TAG_PROFILE_SAMPLE.
+#define KTRACE_PROFILE_MAX_FRAMES  12
+#define KTRACE_PROFILE_FLAG_USER   0x1
+#define KTRACE_PROFILE_CPU(flags)  (((flags) >> 8) & 0xFF)
+
+typedef struct ktrace_rec_profile {
+    uint32_t tag;
+    uint32_t tid;
+    uint64_t ts;
+    uint32_t pid;   // koid of the sampled process, 0 for kernel threads
+    uint32_t flags; // KTRACE_PROFILE_FLAG_*, cpu number in bits 8-15
+    uint64_t pc[KTRACE_PROFILE_MAX_FRAMES];
+} ktrace_rec_profile_t;
+
+static_assert(sizeof(ktrace_rec_profile_t) <= KTRACE_LEN(0xF),
+              "ktrace_rec_profile_t does not fit in a ktrace record");
+
 #define KTRACE_DEF(num,type,name,group) TAG_##name = KTRACE_TAG_##type(num,KTRACE_GRP_##group),
 enum {
 #include <lib/zircon-internal/ktrace-def.h>
@@ -83,10 +106,22 @@ enum {
 #define TAG_PROBE_16(n) KTRACE_TAG(((n)|0x800),KTRACE_GRP_PROBE,16)
 #define TAG_PROBE_24(n) KTRACE_TAG(((n)|0x800),KTRACE_GRP_PROBE,24)
 
+// Profiler sample carrying |n| pcs, 1 <= n <= KTRACE_PROFILE_MAX_FRAMES.
+#define TAG_PROFILE_SAMPLE(n) KTRACE_TAG(0x180,KTRACE_GRP_PROFILE,(24+8*(n)))
+
 // Actions for ktrace control
 #define KTRACE_ACTION_START     1 // options = grpmask, 0 = all
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_SET_MODE  5 // options = KTRACE_MODE_*, tracing must be stopped
+#define KTRACE_ACTION_GET_DROPPED 6 // options = entries in ptr, ptr = uint64_t[] per-cpu drops
+                                    // followed by dropped metadata records
+                                    // returns the number of cpus + 1
+
+// Buffer modes for KTRACE_ACTION_SET_MODE
+#define KTRACE_MODE_LINEAR    0 // stop recording on a cpu once its buffer is full
+#define KTRACE_MODE_CIRCULAR  1 // overwrite the oldest records (flight recorder)
+#define KTRACE_MODE_STREAMING 2 // zx_ktrace_read() consumes records as they arrive
 
 __END_CDECLS
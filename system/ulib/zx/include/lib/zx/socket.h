@@ -7,6 +7,7 @@
 
 #include <lib/zx/handle.h>
 #include <lib/zx/object.h>
+#include <lib/zx/vmo.h>
 
 namespace zx {
 
@@ -56,6 +57,15 @@ public:
     zx_status_t shutdown(uint32_t options) const {
         return zx_socket_shutdown(get(), options);
     }
+
+    zx_status_t ring_vmo(uint32_t options, vmo* out_vmo) const {
+        return zx_socket_ring_vmo(get(), options, out_vmo->reset_and_get_address());
+    }
+
+    zx_status_t ring_advance(uint32_t options, size_t count,
+                             zx_socket_ring_state_t* state) const {
+        return zx_socket_ring_advance(get(), options, count, state);
+    }
 };
 
 using unowned_socket = unowned<socket>;
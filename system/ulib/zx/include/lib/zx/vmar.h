@@ -43,6 +43,10 @@ public:
         return zx_vmar_protect(get(), prot, address, len);
     }
 
+    zx_status_t op_range(uint32_t op, uintptr_t address, size_t len) const {
+        return zx_vmar_op_range(get(), op, address, len);
+    }
+
     zx_status_t destroy() const {
         return zx_vmar_destroy(get());
     }
@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <blobfs/format.h>
@@ -21,6 +22,7 @@
 #include <fs-test-utils/perftest.h>
 #include <perftest/perftest.h>
 #include <unittest/unittest.h>
+#include <zircon/limits.h>
 
 #include <utility>
 
@@ -115,9 +117,10 @@ fbl::String GetNameForOrder(ReadOrder order) {
     return "";
 }
 
-// Creates a an in memory blob.
+// Creates a an in memory blob. A |compressible| blob is made of runs of
+// repeated bytes, which blobfs stores compressed.
 bool MakeBlob(fbl::String fs_path, size_t blob_size, unsigned int* seed,
-              fbl::unique_ptr<BlobInfo>* out) {
+              fbl::unique_ptr<BlobInfo>* out, bool compressible = false) {
     BEGIN_HELPER;
     // Generate a Blob of random data
     fbl::AllocChecker ac;
@@ -130,8 +133,18 @@ bool MakeBlob(fbl::String fs_path, size_t blob_size, unsigned int* seed,
     // sequence for each byte. We did hit this issue, which translates into
     // test failures.
     unsigned int initial_seed = rand_r(seed);
-    for (size_t i = 0; i < blob_size; i++) {
-        info->data[i] = static_cast<char>(rand_r(&initial_seed));
+    if (compressible) {
+        size_t i = 0;
+        while (i < blob_size) {
+            const char value = static_cast<char>(rand_r(&initial_seed));
+            const size_t run = fbl::min<size_t>(1 + rand_r(&initial_seed) % 16, blob_size - i);
+            memset(&info->data[i], value, run);
+            i += run;
+        }
+    } else {
+        for (size_t i = 0; i < blob_size; i++) {
+            info->data[i] = static_cast<char>(rand_r(&initial_seed));
+        }
     }
     info->size_data = blob_size;
 
@@ -279,6 +292,110 @@ public:
         END_HELPER;
     }
 
+    // Measures the first accesses to blobs which are not in memory, the way a
+    // program is started from blobfs: the blob is opened and mapped, and only
+    // some of its pages are touched.
+    bool ColdStartTest(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        // Touching one page in every 16 stands in for a program calling into
+        // a few of its functions.
+        constexpr size_t kSparseStride = 16 * ZX_PAGE_SIZE;
+
+        fbl::Vector<fbl::unique_ptr<BlobInfo>> blobs;
+        for (int64_t curr = 0; curr < info_.blob_count; ++curr) {
+            fbl::unique_ptr<BlobInfo> new_blob;
+            ASSERT_TRUE(MakeBlob(fixture->fs_path(), info_.blob_size, fixture->mutable_seed(),
+                                 &new_blob));
+            fbl::unique_fd fd(open(new_blob->path.c_str(), O_CREAT | O_RDWR));
+            ASSERT_TRUE(fd, strerror(errno));
+            ASSERT_EQ(ftruncate(fd.get(), info_.blob_size), 0, strerror(errno));
+            ASSERT_EQ(StreamAll(write, fd.get(), new_blob->data.get(), new_blob->size_data), 0,
+                      strerror(errno));
+            blobs.push_back(std::move(new_blob));
+        }
+
+        state->DeclareStep("open");
+        state->DeclareStep("mmap");
+        state->DeclareStep("first_page");
+        state->DeclareStep("sparse_pages");
+        state->DeclareStep("close");
+
+        // Blobs are evicted from memory once closed and unmapped, so cycling
+        // through them makes every access below go to disk.
+        uint64_t current = 0;
+        while (state->KeepRunning()) {
+            const BlobInfo& blob = *blobs[current % blobs.size()];
+            fbl::unique_fd fd(open(blob.path.c_str(), O_RDONLY));
+            ASSERT_TRUE(fd);
+            state->NextStep();
+
+            void* addr = mmap(nullptr, blob.size_data, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+            ASSERT_NE(addr, MAP_FAILED, strerror(errno));
+            const char* data = static_cast<const char*>(addr);
+            state->NextStep();
+
+            ASSERT_EQ(data[0], blob.data[0]);
+            state->NextStep();
+
+            for (size_t off = kSparseStride; off < blob.size_data; off += kSparseStride) {
+                ASSERT_EQ(data[off], blob.data[off]);
+            }
+            state->NextStep();
+
+            ASSERT_EQ(munmap(addr, blob.size_data), 0);
+            ASSERT_EQ(close(fd.release()), 0);
+            ++current;
+        }
+        END_HELPER;
+    }
+
+    // Measures reading a single page at a random offset of compressible blobs
+    // which are not in memory, which needs the data around the offset to be
+    // read from disk and decompressed.
+    bool RandomReadTest(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        fbl::Vector<fbl::unique_ptr<BlobInfo>> blobs;
+        for (int64_t curr = 0; curr < info_.blob_count; ++curr) {
+            fbl::unique_ptr<BlobInfo> new_blob;
+            ASSERT_TRUE(MakeBlob(fixture->fs_path(), info_.blob_size, fixture->mutable_seed(),
+                                 &new_blob, true));
+            fbl::unique_fd fd(open(new_blob->path.c_str(), O_CREAT | O_RDWR));
+            ASSERT_TRUE(fd, strerror(errno));
+            ASSERT_EQ(ftruncate(fd.get(), info_.blob_size), 0, strerror(errno));
+            ASSERT_EQ(StreamAll(write, fd.get(), new_blob->data.get(), new_blob->size_data), 0,
+                      strerror(errno));
+            blobs.push_back(std::move(new_blob));
+        }
+
+        char buffer[ZX_PAGE_SIZE];
+        const size_t pages = fbl::round_up(info_.blob_size, ZX_PAGE_SIZE) / ZX_PAGE_SIZE;
+
+        state->DeclareStep("open");
+        state->DeclareStep("read");
+        state->DeclareStep("close");
+
+        // As in the cold start test, cycling through the blobs makes every
+        // read go to disk.
+        uint64_t current = 0;
+        while (state->KeepRunning()) {
+            const BlobInfo& blob = *blobs[current % blobs.size()];
+            const size_t offset = (rand_r(fixture->mutable_seed()) % pages) * ZX_PAGE_SIZE;
+            const size_t length = fbl::min<size_t>(ZX_PAGE_SIZE, blob.size_data - offset);
+            fbl::unique_fd fd(open(blob.path.c_str(), O_RDONLY));
+            ASSERT_TRUE(fd);
+            state->NextStep();
+
+            ASSERT_EQ(pread(fd.get(), buffer, length, offset), static_cast<ssize_t>(length),
+                      strerror(errno));
+            ASSERT_EQ(memcmp(buffer, &blob.data[offset], length), 0);
+            state->NextStep();
+
+            ASSERT_EQ(close(fd.release()), 0);
+            ++current;
+        }
+        END_HELPER;
+    }
+
 private:
     void SortPathsByOrder(ReadOrder order, unsigned int* seed) {
         switch (order) {
@@ -326,6 +443,8 @@ bool RunBenchmark(int argc, char** argv) {
         1000,
         10000,
     };
+    // Number of blobs cycled through by the cold start test.
+    constexpr size_t kColdStartBlobCount = 10;
     const ReadOrder orders[] = {
         ReadOrder::kSequentialForward,
         ReadOrder::kSequentialReverse,
@@ -384,6 +503,49 @@ bool RunBenchmark(int argc, char** argv) {
             testcases.push_back(std::move(testcase));
             ++test_index;
         }
+
+        const size_t blob_count = (p_opts.is_unittest) ? 1 : kColdStartBlobCount;
+        BlobfsInfo fs_info;
+        fs_info.blob_count = blob_count;
+        fs_info.blob_size = blob_size;
+        blobfs_tests.push_back(std::move(fs_info));
+        TestCaseInfo testcase;
+        testcase.teardown = false;
+        testcase.sample_count = kSampleCount;
+        const size_t required_disk_space =
+            blob_count * (blob_size + 2 * MerkleTree::kNodeSize + blobfs::kBlobfsInodeSize);
+
+        // Run with --enable_pager to measure demand paging instead of reading
+        // blobs in full when they are opened.
+        TestInfo cold_start_test;
+        cold_start_test.name =
+            fbl::StringPrintf("%s/%s/ColdStart%s", disk_format_string_[f_opts.fs_type],
+                              GetNameForSize(blob_size).c_str(),
+                              f_opts.fs_enable_pager ? "Paged" : "");
+        cold_start_test.required_disk_space = required_disk_space;
+        cold_start_test.test_fn = [test_index, &blobfs_tests](perftest::RepeatState* state,
+                                                              fs_test_utils::Fixture* fixture) {
+            return blobfs_tests[test_index].ColdStartTest(state, fixture);
+        };
+        testcase.tests.push_back(std::move(cold_start_test));
+
+        // Run with --lz4_frame_compression to compare with blobs compressed as
+        // a single LZ4 frame, which are decompressed in full on any read.
+        TestInfo random_read_test;
+        random_read_test.name =
+            fbl::StringPrintf("%s/%s/CompressedRandomRead%s%s",
+                              disk_format_string_[f_opts.fs_type],
+                              GetNameForSize(blob_size).c_str(),
+                              f_opts.fs_lz4_frame_compression ? "LZ4Frame" : "",
+                              f_opts.fs_enable_pager ? "Paged" : "");
+        random_read_test.required_disk_space = required_disk_space;
+        random_read_test.test_fn = [test_index, &blobfs_tests](perftest::RepeatState* state,
+                                                               fs_test_utils::Fixture* fixture) {
+            return blobfs_tests[test_index].RandomReadTest(state, fixture);
+        };
+        testcase.tests.push_back(std::move(random_read_test));
+        testcases.push_back(std::move(testcase));
+        ++test_index;
     }
 
     return fs_test_utils::RunTestCases(f_opts, p_opts, testcases);
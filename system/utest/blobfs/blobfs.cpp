@@ -60,6 +60,9 @@ uint64_t gRamdiskFailureLoops = 0;
 // Indicates whether we should enable the journal for the current test run.
 bool gEnableJournal = true;
 
+// Indicates whether blobs should be paged in as they are accessed for the current test run.
+bool gEnablePager = false;
+
 // Information about the real disk which must be constructed at runtime, but which persists
 // between tests.
 bool gUseRealDisk = false;
@@ -496,6 +499,7 @@ bool BlobfsTest::Mount() {
 
     mount_options_t options = default_mount_options;
     options.enable_journal = gEnableJournal;
+    options.enable_pager = gEnablePager;
 
     if (read_only_) {
         options.readonly = true;
@@ -2372,6 +2376,7 @@ static bool CorruptAtMount(BlobfsTest* blobfsTest) {
     // Attempt to mount the VPart. This should fail since slices are missing.
     mount_options_t options = default_mount_options;
     options.enable_journal = gEnableJournal;
+    options.enable_pager = gEnablePager;
     ASSERT_NE(mount(fd.release(), MOUNT_PATH, DISK_FORMAT_BLOBFS, &options,
                     launch_stdio_async), ZX_OK);
 
@@ -2787,6 +2792,8 @@ static void print_test_help(FILE* f) {
             "      This option is only valid when using a ramdisk.\n"
             "  -j\n"
             "      Disable the journal\n"
+            "  -p\n"
+            "      Enable the pager\n"
             "\n");
 }
 
@@ -2839,6 +2846,9 @@ int main(int argc, char** argv) {
         } else if (!strcmp(argv[i], "-j")) {
             gEnableJournal = false;
             i++;
+        } else if (!strcmp(argv[i], "-p")) {
+            gEnablePager = true;
+            i++;
         } else {
             // Ignore options we don't recognize. See ulib/unittest/README.md.
             break;
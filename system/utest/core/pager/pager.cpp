@@ -959,6 +959,51 @@ bool clone_detach_test() {
     END_TEST;
 }
 
+// Tests that ZX_INFO_VMO_RECLAIM accounts for supplied and written pages.
+bool reclaim_info_test() {
+    BEGIN_TEST;
+
+    UserPager pager;
+
+    ASSERT_TRUE(pager.Init());
+
+    Vmo* vmo;
+    ASSERT_TRUE(pager.CreateVmo(3, &vmo));
+
+    ASSERT_TRUE(pager.SupplyPages(vmo, 0, 3));
+
+    zx_info_vmo_reclaim_t info;
+    ASSERT_EQ(vmo->vmo().get_info(ZX_INFO_VMO_RECLAIM, &info, sizeof(info), nullptr, nullptr),
+              ZX_OK);
+    ASSERT_EQ(info.active_bytes + info.inactive_bytes, 3 * ZX_PAGE_SIZE);
+    ASSERT_EQ(info.modified_bytes, 0u);
+    ASSERT_EQ(info.evicted_bytes, 0u);
+
+    // Written pages can't be evicted, since the pager would supply the old contents.
+    *reinterpret_cast<volatile uint64_t*>(vmo->GetBaseAddr()) = 0;
+
+    ASSERT_EQ(vmo->vmo().get_info(ZX_INFO_VMO_RECLAIM, &info, sizeof(info), nullptr, nullptr),
+              ZX_OK);
+    ASSERT_EQ(info.active_bytes + info.inactive_bytes, 2 * ZX_PAGE_SIZE);
+    ASSERT_EQ(info.modified_bytes, ZX_PAGE_SIZE);
+
+    END_TEST;
+}
+
+// Tests that ZX_INFO_VMO_RECLAIM is only supported on paged vmos.
+bool reclaim_info_not_paged_test() {
+    BEGIN_TEST;
+
+    zx::vmo vmo;
+    ASSERT_EQ(zx::vmo::create(ZX_PAGE_SIZE, 0, &vmo), ZX_OK);
+
+    zx_info_vmo_reclaim_t info;
+    ASSERT_EQ(vmo.get_info(ZX_INFO_VMO_RECLAIM, &info, sizeof(info), nullptr, nullptr),
+              ZX_ERR_NOT_SUPPORTED);
+
+    END_TEST;
+}
+
 // Tests focused on reading a paged vmo.
 
 BEGIN_TEST_CASE(pager_read_tests)
@@ -1006,6 +1051,13 @@ RUN_TEST(clone_write_to_clone_test);
 RUN_TEST(clone_detach_test);
 END_TEST_CASE(clone_tests);
 
+// Tests focused on page reclamation.
+
+BEGIN_TEST_CASE(reclaim_tests)
+RUN_TEST(reclaim_info_test);
+RUN_TEST(reclaim_info_not_paged_test);
+END_TEST_CASE(reclaim_tests)
+
 } // namespace pager_tests
 
 //TODO: Test cases which violate various syscall invalid args
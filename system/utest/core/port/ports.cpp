@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <threads.h>
 
+#include <zircon/process.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/port.h>
 #include <fbl/algorithm.h>
@@ -108,6 +109,122 @@ static bool queue_too_many(void) {
     END_TEST;
 }
 
+static bool wait_many_test(void) {
+    BEGIN_TEST;
+    zx_status_t status;
+
+    zx_handle_t port;
+    status = zx_port_create(0, &port);
+    EXPECT_EQ(status, ZX_OK, "could not create port");
+
+    zx_port_packet_t out[40] = {};
+    size_t actual = 0u;
+
+    status = zx_port_wait_many(port, 0, out, 0u, &actual);
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS);
+
+    status = zx_port_wait_many(port, zx_deadline_after(ZX_USEC(1)), out, 1u, &actual);
+    EXPECT_EQ(status, ZX_ERR_TIMED_OUT);
+
+    // More packets than the kernel copies out at a time.
+    constexpr uint64_t kCount = 36u;
+    for (uint64_t i = 0; i < kCount; ++i) {
+        const zx_port_packet_t in = {i, ZX_PKT_TYPE_USER, 0, { {} }};
+        status = zx_port_queue(port, &in);
+        EXPECT_EQ(status, ZX_OK);
+    }
+
+    // Packets come back in FIFO order, at most |count| at a time.
+    status = zx_port_wait_many(port, ZX_TIME_INFINITE, out, 5u, &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, 5u);
+    for (uint64_t i = 0; i < 5u; ++i) {
+        EXPECT_EQ(out[i].key, i);
+        EXPECT_EQ(out[i].type, ZX_PKT_TYPE_USER);
+    }
+
+    status = zx_port_wait_many(port, ZX_TIME_INFINITE, out, fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, kCount - 5u);
+    for (uint64_t i = 0; i < actual; ++i) {
+        EXPECT_EQ(out[i].key, i + 5u);
+    }
+
+    // |actual| is optional.
+    const zx_port_packet_t in = {99ull, ZX_PKT_TYPE_USER, 0, { {} }};
+    status = zx_port_queue(port, &in);
+    EXPECT_EQ(status, ZX_OK);
+    status = zx_port_wait_many(port, 0, out, fbl::count_of(out), nullptr);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(out[0].key, 99u);
+
+    status = zx_handle_close(port);
+    EXPECT_EQ(status, ZX_OK);
+
+    END_TEST;
+}
+
+static bool wait_many_bad_buffer_test(void) {
+    BEGIN_TEST;
+    zx_status_t status;
+
+    zx_handle_t port;
+    status = zx_port_create(0, &port);
+    EXPECT_EQ(status, ZX_OK, "could not create port");
+
+    constexpr uint64_t kCount = 36u;
+    for (uint64_t i = 0; i < kCount; ++i) {
+        const zx_port_packet_t in = {i, ZX_PKT_TYPE_USER, 0, { {} }};
+        status = zx_port_queue(port, &in);
+        EXPECT_EQ(status, ZX_OK);
+    }
+
+    // Nothing is dequeued if the buffer can't be written at all.
+    size_t actual = 0u;
+    status = zx_port_wait_many(port, 0, nullptr, kCount, &actual);
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS);
+
+    // A buffer with room for only 20 packets before an unmapped page.
+    zx_handle_t vmo;
+    status = zx_vmo_create(2 * ZX_PAGE_SIZE, 0, &vmo);
+    ASSERT_EQ(status, ZX_OK);
+    uintptr_t addr;
+    status = zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ | ZX_VM_PERM_WRITE, 0, vmo, 0,
+                         2 * ZX_PAGE_SIZE, &addr);
+    ASSERT_EQ(status, ZX_OK);
+    status = zx_vmar_unmap(zx_vmar_root_self(), addr + ZX_PAGE_SIZE, ZX_PAGE_SIZE);
+    ASSERT_EQ(status, ZX_OK);
+    auto short_buffer = reinterpret_cast<zx_port_packet_t*>(
+        addr + ZX_PAGE_SIZE - 20 * sizeof(zx_port_packet_t));
+
+    // Only whole batches that fit are taken, and the rest stay queued.
+    status = zx_port_wait_many(port, 0, short_buffer, kCount, &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_GT(actual, 0u);
+    EXPECT_LE(actual, 20u);
+    for (uint64_t i = 0; i < actual; ++i) {
+        EXPECT_EQ(short_buffer[i].key, i);
+    }
+
+    zx_port_packet_t out[kCount] = {};
+    size_t rest = 0u;
+    status = zx_port_wait_many(port, 0, out, kCount, &rest);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual + rest, kCount);
+    for (uint64_t i = 0; i < rest; ++i) {
+        EXPECT_EQ(out[i].key, actual + i);
+    }
+
+    status = zx_vmar_unmap(zx_vmar_root_self(), addr, ZX_PAGE_SIZE);
+    EXPECT_EQ(status, ZX_OK);
+    status = zx_handle_close(vmo);
+    EXPECT_EQ(status, ZX_OK);
+    status = zx_handle_close(port);
+    EXPECT_EQ(status, ZX_OK);
+
+    END_TEST;
+}
+
 static bool async_wait_channel_test(void) {
     BEGIN_TEST;
     zx_status_t status;
@@ -642,6 +759,8 @@ BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
 RUN_TEST(queue_too_many)
+RUN_TEST(wait_many_test)
+RUN_TEST(wait_many_bad_buffer_test)
 RUN_TEST(async_wait_channel_test)
 RUN_TEST(async_wait_event_test_single)
 RUN_TEST(async_wait_event_test_repeat)
@@ -6,6 +6,15 @@
 #include <lib/zx/profile.h>
 #include <lib/zx/thread.h>
 #include <lib/zx/job.h>
+#include <lib/zx/time.h>
+#include <threads.h>
+#include <zircon/syscalls.h>
+#include <zircon/threads.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+#include <fbl/auto_call.h>
+#include <fbl/vector.h>
 
 // Tests in this file rely that the default job is the root job.
 
@@ -66,7 +75,141 @@ static bool profile_priority_test(void) {
     END_TEST;
 }
 
+// Deadline profiles are described by a zx_profile_deadline_info_t, which is
+// passed in place of a zx_profile_info_t.
+static zx_status_t create_deadline_profile(const zx::job& root_job, zx_duration_t capacity,
+                                           zx_duration_t relative_deadline, zx_duration_t period,
+                                           zx::profile* out) {
+    zx_profile_deadline_info_t info = {};
+    info.type = ZX_PROFILE_INFO_DEADLINE;
+    info.deadline = {capacity, relative_deadline, period};
+    return zx::profile::create(root_job, reinterpret_cast<const zx_profile_info_t*>(&info), out);
+}
+
+static bool profile_deadline_test(void) {
+    BEGIN_TEST;
+
+    zx::unowned_job root_job(zx_job_default());
+    if (!root_job->is_valid()) {
+        unittest_printf("no root job. skipping test\n");
+    } else {
+        zx::profile profile;
+
+        // The parameters must satisfy capacity <= deadline <= period.
+        ASSERT_EQ(create_deadline_profile(*root_job, ZX_MSEC(2), ZX_MSEC(1), ZX_MSEC(10), &profile),
+                  ZX_ERR_INVALID_ARGS, "");
+        ASSERT_EQ(create_deadline_profile(*root_job, ZX_MSEC(2), ZX_MSEC(20), ZX_MSEC(10),
+                                          &profile),
+                  ZX_ERR_INVALID_ARGS, "");
+        ASSERT_EQ(create_deadline_profile(*root_job, 0, ZX_MSEC(10), ZX_MSEC(10), &profile),
+                  ZX_ERR_INVALID_ARGS, "");
+        ASSERT_EQ(create_deadline_profile(*root_job, ZX_MSEC(2), ZX_SEC(2), ZX_SEC(2), &profile),
+                  ZX_ERR_INVALID_ARGS, "");
+
+        // A whole cpu is more than the deadline class may reserve.
+        ASSERT_EQ(create_deadline_profile(*root_job, ZX_MSEC(10), ZX_MSEC(10), ZX_MSEC(10),
+                                          &profile),
+                  ZX_OK, "");
+        ASSERT_EQ(zx::thread::self()->set_profile(profile, 0), ZX_ERR_NO_RESOURCES, "");
+
+        zx::profile deadline_profile;
+        ASSERT_EQ(create_deadline_profile(*root_job, ZX_MSEC(1), ZX_MSEC(10), ZX_MSEC(10),
+                                          &deadline_profile),
+                  ZX_OK, "");
+
+        zx::profile default_profile;
+        zx_profile_info_t profile_info = {};
+        profile_info.type = ZX_PROFILE_INFO_SCHEDULER;
+        profile_info.scheduler.priority = ZX_PRIORITY_DEFAULT;
+        ASSERT_EQ(zx::profile::create(*root_job, &profile_info, &default_profile), ZX_OK, "");
+
+        // Moving into the deadline class and back releases the reservation each time.
+        for (int i = 0; i < 100; i++) {
+            ASSERT_EQ(zx::thread::self()->set_profile(deadline_profile, 0), ZX_OK, "");
+            zx_nanosleep(ZX_USEC(100));
+            ASSERT_EQ(zx::thread::self()->set_profile(default_profile, 0), ZX_OK, "");
+        }
+    }
+
+    END_TEST;
+}
+
+static fbl::atomic<bool> busy_threads_stop;
+
+static int busy_thread(void* arg) {
+    while (!busy_threads_stop.load()) {
+    }
+    return 0;
+}
+
+static bool profile_deadline_latency_test(void) {
+    BEGIN_TEST;
+
+    zx::unowned_job root_job(zx_job_default());
+    if (!root_job->is_valid()) {
+        unittest_printf("no root job. skipping test\n");
+    } else {
+        zx::profile deadline_profile;
+        ASSERT_EQ(create_deadline_profile(*root_job, ZX_MSEC(2), ZX_MSEC(10), ZX_MSEC(10),
+                                          &deadline_profile),
+                  ZX_OK, "");
+
+        zx_profile_info_t profile_info = {};
+        profile_info.type = ZX_PROFILE_INFO_SCHEDULER;
+        profile_info.scheduler.priority = ZX_PRIORITY_HIGHEST;
+        zx::profile busy_profile;
+        ASSERT_EQ(zx::profile::create(*root_job, &profile_info, &busy_profile), ZX_OK, "");
+
+        profile_info.scheduler.priority = ZX_PRIORITY_DEFAULT;
+        zx::profile default_profile;
+        ASSERT_EQ(zx::profile::create(*root_job, &profile_info, &default_profile), ZX_OK, "");
+
+        // Become a deadline thread first, so that the busy threads can't starve us.
+        ASSERT_EQ(zx::thread::self()->set_profile(deadline_profile, 0), ZX_OK, "");
+        auto restore_profile = fbl::MakeAutoCall([&default_profile]() {
+            zx::thread::self()->set_profile(default_profile, 0);
+        });
+
+        // Keep every cpu busy with a thread of the highest priority. They are
+        // stopped on every way out of the test, so that a failure doesn't
+        // leave them spinning.
+        busy_threads_stop.store(false);
+        fbl::Vector<thrd_t> threads;
+        auto stop_threads = fbl::MakeAutoCall([&threads]() {
+            busy_threads_stop.store(true);
+            for (thrd_t thread : threads) {
+                thrd_join(thread, nullptr);
+            }
+        });
+        for (uint32_t i = 0; i < zx_system_get_num_cpus(); i++) {
+            thrd_t thread;
+            ASSERT_EQ(thrd_create(&thread, busy_thread, nullptr), thrd_success, "");
+            threads.push_back(thread);
+            zx::unowned_thread handle(thrd_get_zx_handle(thread));
+            ASSERT_EQ(handle->set_profile(busy_profile, 0), ZX_OK, "");
+        }
+
+        // Deadline threads run before all of them, so wakeups are still prompt.
+        zx_duration_t max_latency = 0;
+        for (int i = 0; i < 100; i++) {
+            zx::time target = zx::deadline_after(zx::msec(10));
+            zx::nanosleep(target);
+            max_latency = fbl::max(max_latency, (zx::clock::get_monotonic() - target).get());
+        }
+
+        stop_threads.call();
+        restore_profile.cancel();
+        ASSERT_EQ(zx::thread::self()->set_profile(default_profile, 0), ZX_OK, "");
+
+        EXPECT_LT(max_latency, ZX_MSEC(10), "deadline thread woke up late");
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(profile_cpp_tests)
 RUN_TEST(profile_failures_test)
 RUN_TEST(profile_priority_test)
+RUN_TEST(profile_deadline_test)
+RUN_TEST(profile_deadline_latency_test)
 END_TEST_CASE(profile_cpp_tests)
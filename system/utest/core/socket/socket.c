@@ -8,6 +8,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 static zx_signals_t get_satisfied_signals(zx_handle_t handle) {
@@ -1206,6 +1207,148 @@ bool socket_share_consumes_on_failure(void) {
     END_TEST;
 }
 
+static bool socket_shared_ring_read_write(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h[2];
+    EXPECT_EQ(zx_socket_create(ZX_SOCKET_DATAGRAM | ZX_SOCKET_SHARED_RING, h, h + 1),
+              ZX_ERR_INVALID_ARGS, "");
+    ASSERT_EQ(zx_socket_create(ZX_SOCKET_SHARED_RING, h, h + 1), ZX_OK, "");
+
+    zx_info_socket_t info;
+    ASSERT_EQ(zx_object_get_info(h[0], ZX_INFO_SOCKET, &info, sizeof(info), NULL, NULL),
+              ZX_OK, "");
+    const size_t ring_size = info.rx_buf_max;
+    EXPECT_EQ(info.tx_buf_max, ring_size, "");
+
+    // Unmodified clients can fill the ring and drain it again, wrapping
+    // around its end.
+    uint8_t* buf = malloc(ring_size);
+    ASSERT_NONNULL(buf, "");
+    for (size_t i = 0; i < ring_size; i++) {
+        buf[i] = (uint8_t)(i * 7);
+    }
+    size_t count;
+    ASSERT_EQ(zx_socket_write(h[0], 0u, buf, ring_size / 2 + 1, &count), ZX_OK, "");
+    EXPECT_EQ(count, ring_size / 2 + 1, "");
+    ASSERT_EQ(zx_socket_read(h[1], 0u, buf, ring_size / 2 + 1, &count), ZX_OK, "");
+
+    ASSERT_EQ(zx_socket_write(h[0], 0u, buf, ring_size, &count), ZX_OK, "");
+    EXPECT_EQ(count, ring_size, "");
+    EXPECT_EQ(get_satisfied_signals(h[0]) & ZX_SOCKET_WRITABLE, 0u, "");
+    EXPECT_EQ(zx_socket_write(h[0], 0u, buf, 1, &count), ZX_ERR_SHOULD_WAIT, "");
+
+    uint8_t* out = malloc(ring_size);
+    ASSERT_NONNULL(out, "");
+    ASSERT_EQ(zx_socket_read(h[1], 0u, out, ring_size, &count), ZX_OK, "");
+    EXPECT_EQ(count, ring_size, "");
+    EXPECT_EQ(memcmp(buf, out, ring_size), 0, "");
+    EXPECT_EQ(get_satisfied_signals(h[0]) & ZX_SOCKET_WRITABLE, ZX_SOCKET_WRITABLE, "");
+    EXPECT_EQ(get_satisfied_signals(h[1]) & ZX_SOCKET_READABLE, 0u, "");
+
+    free(out);
+    free(buf);
+    zx_handle_close(h[0]);
+    zx_handle_close(h[1]);
+
+    END_TEST;
+}
+
+static bool socket_shared_ring_mapped(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h[2];
+    ASSERT_EQ(zx_socket_create(ZX_SOCKET_SHARED_RING, h, h + 1), ZX_OK, "");
+
+    zx_handle_t tx_vmo, rx_vmo;
+    EXPECT_EQ(zx_socket_ring_vmo(h[0], 0u, &tx_vmo), ZX_ERR_INVALID_ARGS, "");
+    ASSERT_EQ(zx_socket_ring_vmo(h[0], ZX_SOCKET_RING_TX, &tx_vmo), ZX_OK, "");
+    ASSERT_EQ(zx_socket_ring_vmo(h[1], ZX_SOCKET_RING_RX, &rx_vmo), ZX_OK, "");
+
+    // The reader's view of its ring is read-only.
+    zx_info_handle_basic_t basic;
+    ASSERT_EQ(zx_object_get_info(rx_vmo, ZX_INFO_HANDLE_BASIC, &basic, sizeof(basic),
+                                 NULL, NULL), ZX_OK, "");
+    EXPECT_EQ(basic.rights & ZX_RIGHT_WRITE, 0u, "");
+
+    uint64_t ring_size;
+    ASSERT_EQ(zx_vmo_get_size(tx_vmo, &ring_size), ZX_OK, "");
+
+    uintptr_t tx_addr, rx_addr;
+    ASSERT_EQ(zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ | ZX_VM_PERM_WRITE, 0,
+                          tx_vmo, 0, ring_size, &tx_addr), ZX_OK, "");
+    ASSERT_EQ(zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ, 0,
+                          rx_vmo, 0, ring_size, &rx_addr), ZX_OK, "");
+
+    // Produce through the mapping and read with zx_socket_read().
+    zx_socket_ring_state_t state;
+    ASSERT_EQ(zx_socket_ring_advance(h[0], ZX_SOCKET_RING_TX, 0u, &state), ZX_OK, "");
+    EXPECT_EQ(state.head, 0u, "");
+    EXPECT_EQ(state.tail, 0u, "");
+    EXPECT_EQ(state.size, ring_size, "");
+    EXPECT_EQ(get_satisfied_signals(h[1]) & ZX_SOCKET_READABLE, 0u, "");
+
+    memcpy((void*)tx_addr, "hello", 5);
+    ASSERT_EQ(zx_socket_ring_advance(h[0], ZX_SOCKET_RING_TX, 5u, &state), ZX_OK, "");
+    EXPECT_EQ(state.tail, 5u, "");
+    EXPECT_EQ(get_satisfied_signals(h[1]) & ZX_SOCKET_READABLE, ZX_SOCKET_READABLE, "");
+
+    char data[8];
+    size_t count;
+    ASSERT_EQ(zx_socket_read(h[1], 0u, data, 2, &count), ZX_OK, "");
+    EXPECT_EQ(count, 2u, "");
+    EXPECT_EQ(memcmp(data, "he", 2), 0, "");
+
+    // Write with zx_socket_write() and consume through the mapping.
+    ASSERT_EQ(zx_socket_write(h[0], 0u, "!", 1, &count), ZX_OK, "");
+    ASSERT_EQ(zx_socket_ring_advance(h[1], ZX_SOCKET_RING_RX, 0u, &state), ZX_OK, "");
+    EXPECT_EQ(state.head, 2u, "");
+    EXPECT_EQ(state.tail, 6u, "");
+    EXPECT_EQ(memcmp((const void*)(rx_addr + state.head), "llo!", 4), 0, "");
+
+    EXPECT_EQ(zx_socket_ring_advance(h[1], ZX_SOCKET_RING_RX, 5u, &state),
+              ZX_ERR_OUT_OF_RANGE, "");
+    ASSERT_EQ(zx_socket_ring_advance(h[1], ZX_SOCKET_RING_RX, 4u, &state), ZX_OK, "");
+    EXPECT_EQ(state.head, 6u, "");
+    EXPECT_EQ(get_satisfied_signals(h[1]) & ZX_SOCKET_READABLE, 0u, "");
+
+    // The writer can't publish more than the free space.
+    EXPECT_EQ(zx_socket_ring_advance(h[0], ZX_SOCKET_RING_TX, ring_size + 1, &state),
+              ZX_ERR_OUT_OF_RANGE, "");
+    ASSERT_EQ(zx_socket_ring_advance(h[0], ZX_SOCKET_RING_TX, ring_size, &state), ZX_OK, "");
+    EXPECT_EQ(get_satisfied_signals(h[0]) & ZX_SOCKET_WRITABLE, 0u, "");
+
+    zx_handle_close(h[1]);
+    EXPECT_EQ(zx_socket_ring_advance(h[0], ZX_SOCKET_RING_TX, 0u, &state),
+              ZX_ERR_PEER_CLOSED, "");
+
+    zx_vmar_unmap(zx_vmar_root_self(), tx_addr, ring_size);
+    zx_vmar_unmap(zx_vmar_root_self(), rx_addr, ring_size);
+    zx_handle_close(tx_vmo);
+    zx_handle_close(rx_vmo);
+    zx_handle_close(h[0]);
+
+    END_TEST;
+}
+
+static bool socket_shared_ring_absent(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h[2];
+    ASSERT_EQ(zx_socket_create(0, h, h + 1), ZX_OK, "");
+
+    zx_handle_t vmo;
+    EXPECT_EQ(zx_socket_ring_vmo(h[0], ZX_SOCKET_RING_RX, &vmo), ZX_ERR_BAD_STATE, "");
+    zx_socket_ring_state_t state;
+    EXPECT_EQ(zx_socket_ring_advance(h[0], ZX_SOCKET_RING_TX, 0u, &state),
+              ZX_ERR_BAD_STATE, "");
+
+    zx_handle_close(h[0]);
+    zx_handle_close(h[1]);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -1226,6 +1369,9 @@ RUN_TEST(socket_accept)
 RUN_TEST(socket_share_invalid_handle)
 RUN_TEST(socket_share_consumes_on_failure)
 RUN_TEST(socket_signals2)
+RUN_TEST(socket_shared_ring_read_write)
+RUN_TEST(socket_shared_ring_mapped)
+RUN_TEST(socket_shared_ring_absent)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -1993,6 +1993,132 @@ bool partial_unmap_with_vmar_offset() {
 
 } // namespace
 
+uint64_t vmo_committed_bytes(zx_handle_t vmo) {
+    zx_info_vmo_t info;
+    if (zx_object_get_info(vmo, ZX_INFO_VMO, &info, sizeof(info), nullptr, nullptr) != ZX_OK) {
+        return UINT64_MAX;
+    }
+    return info.committed_bytes;
+}
+
+// Verify that zx_vmar_op_range() commits and decommits the pages backing a
+// range that spans several mappings.
+bool op_range_commit_decommit_test() {
+    BEGIN_TEST;
+
+    zx_handle_t vmo;
+    const size_t size = 8 * PAGE_SIZE;
+    ASSERT_EQ(zx_vmo_create(size, 0, &vmo), ZX_OK);
+
+    // Map the two halves of the VMO next to each other.
+    zx_handle_t region;
+    uintptr_t region_addr;
+    ASSERT_EQ(zx_vmar_allocate(zx_vmar_root_self(),
+                               ZX_VM_CAN_MAP_READ | ZX_VM_CAN_MAP_WRITE | ZX_VM_CAN_MAP_SPECIFIC,
+                               0, size, &region, &region_addr),
+              ZX_OK);
+    uintptr_t mapping_addr;
+    ASSERT_EQ(zx_vmar_map(region, ZX_VM_PERM_READ | ZX_VM_PERM_WRITE | ZX_VM_SPECIFIC,
+                          0, vmo, 0, size / 2, &mapping_addr),
+              ZX_OK);
+    ASSERT_EQ(zx_vmar_map(region, ZX_VM_PERM_READ | ZX_VM_PERM_WRITE | ZX_VM_SPECIFIC,
+                          size / 2, vmo, size / 2, size / 2, &mapping_addr),
+              ZX_OK);
+    EXPECT_EQ(vmo_committed_bytes(vmo), 0u);
+
+    // Prefetching an untouched anonymous range does not commit anything.
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_MAP_RANGE, region_addr, size), ZX_OK);
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_WILLNEED, region_addr, size), ZX_OK);
+    EXPECT_EQ(vmo_committed_bytes(vmo), 0u);
+
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_COMMIT, region_addr + PAGE_SIZE,
+                               size - 2 * PAGE_SIZE),
+              ZX_OK);
+    EXPECT_EQ(vmo_committed_bytes(vmo), size - 2 * PAGE_SIZE);
+
+    // The committed pages are mapped writable and hold zeroes.
+    volatile uint8_t* target = reinterpret_cast<volatile uint8_t*>(region_addr);
+    EXPECT_EQ(target[PAGE_SIZE], 0u);
+    target[PAGE_SIZE] = 5;
+    target[size / 2] = 6;
+    EXPECT_EQ(vmo_committed_bytes(vmo), size - 2 * PAGE_SIZE);
+
+    // Committing again is harmless, and the data is still there.
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_COMMIT, region_addr, size), ZX_OK);
+    EXPECT_EQ(vmo_committed_bytes(vmo), size);
+    EXPECT_EQ(target[PAGE_SIZE], 5u);
+    EXPECT_EQ(target[size / 2], 6u);
+
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_DECOMMIT, region_addr, size), ZX_OK);
+    EXPECT_EQ(vmo_committed_bytes(vmo), 0u);
+    EXPECT_EQ(target[PAGE_SIZE], 0u);
+
+    EXPECT_EQ(zx_vmar_destroy(region), ZX_OK);
+    EXPECT_EQ(zx_handle_close(region), ZX_OK);
+    EXPECT_EQ(zx_handle_close(vmo), ZX_OK);
+
+    END_TEST;
+}
+
+// Verify zx_vmar_op_range()'s argument, rights and permission checks.
+bool op_range_invalid_test() {
+    BEGIN_TEST;
+
+    zx_handle_t vmo;
+    const size_t size = 4 * PAGE_SIZE;
+    ASSERT_EQ(zx_vmo_create(size, 0, &vmo), ZX_OK);
+
+    zx_handle_t region;
+    uintptr_t region_addr;
+    ASSERT_EQ(zx_vmar_allocate(zx_vmar_root_self(),
+                               ZX_VM_CAN_MAP_READ | ZX_VM_CAN_MAP_WRITE | ZX_VM_CAN_MAP_SPECIFIC,
+                               0, 2 * size, &region, &region_addr),
+              ZX_OK);
+    uintptr_t mapping_addr;
+    ASSERT_EQ(zx_vmar_map(region, ZX_VM_PERM_READ | ZX_VM_SPECIFIC, 0, vmo, 0, size,
+                          &mapping_addr),
+              ZX_OK);
+
+    EXPECT_EQ(zx_vmar_op_range(region, 0u, mapping_addr, size), ZX_ERR_INVALID_ARGS);
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_MAP_RANGE, mapping_addr + 1, size),
+              ZX_ERR_INVALID_ARGS);
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_MAP_RANGE, mapping_addr, 0),
+              ZX_ERR_INVALID_ARGS);
+
+    // The second half of the region is not mapped.
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_MAP_RANGE, mapping_addr, 2 * size),
+              ZX_ERR_NOT_FOUND);
+
+    // The mapping is read-only.
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_COMMIT, mapping_addr, size),
+              ZX_ERR_ACCESS_DENIED);
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_DECOMMIT, mapping_addr, size),
+              ZX_ERR_ACCESS_DENIED);
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_WILLNEED, mapping_addr, size), ZX_OK);
+    EXPECT_EQ(vmo_committed_bytes(vmo), 0u);
+
+    // Committing needs the write right on the VMAR handle.
+    EXPECT_EQ(zx_vmar_protect(region, ZX_VM_PERM_READ | ZX_VM_PERM_WRITE, mapping_addr, size),
+              ZX_OK);
+    zx_handle_t read_only;
+    ASSERT_EQ(zx_handle_duplicate(region, ZX_RIGHT_READ, &read_only), ZX_OK);
+    EXPECT_EQ(zx_vmar_op_range(read_only, ZX_VMAR_OP_COMMIT, mapping_addr, size),
+              ZX_ERR_ACCESS_DENIED);
+    EXPECT_EQ(zx_vmar_op_range(read_only, ZX_VMAR_OP_MAP_RANGE, mapping_addr, size), ZX_OK);
+    EXPECT_EQ(zx_handle_close(read_only), ZX_OK);
+
+    EXPECT_EQ(zx_vmar_op_range(vmo, ZX_VMAR_OP_COMMIT, mapping_addr, size),
+              ZX_ERR_WRONG_TYPE);
+
+    EXPECT_EQ(zx_vmar_destroy(region), ZX_OK);
+    EXPECT_EQ(zx_vmar_op_range(region, ZX_VMAR_OP_MAP_RANGE, mapping_addr, size),
+              ZX_ERR_BAD_STATE);
+    EXPECT_EQ(zx_handle_close(region), ZX_OK);
+    EXPECT_EQ(zx_handle_close(vmo), ZX_OK);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmar_tests)
 RUN_TEST(destroy_root_test);
 RUN_TEST(basic_allocate_test);
@@ -2021,6 +2147,8 @@ RUN_TEST(unmap_large_uncommitted_test);
 RUN_TEST(partial_unmap_and_read);
 RUN_TEST(partial_unmap_and_write);
 RUN_TEST(partial_unmap_with_vmar_offset);
+RUN_TEST(op_range_commit_decommit_test);
+RUN_TEST(op_range_invalid_test);
 END_TEST_CASE(vmar_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <fbl/function.h>
 #include <fbl/string.h>
@@ -158,6 +159,74 @@ private:
     fbl::StringBuffer<fs_test_utils::kPathSize> path_;
 };
 
+// Wrapper so state can be shared across calls.
+class DirectoryOp {
+public:
+    DirectoryOp() = default;
+    DirectoryOp(const DirectoryOp&) = delete;
+    DirectoryOp(DirectoryOp&&) = delete;
+    DirectoryOp& operator=(const DirectoryOp&) = delete;
+    DirectoryOp& operator=(DirectoryOp&&) = delete;
+    ~DirectoryOp() = default;
+
+    // Will add entries to a single directory until |state::KeepGoing| returns false. Entries
+    // are hard links to a single file, so that only the directory grows.
+    bool Link(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        ASSERT_EQ(mkdir(GetDirPath(*fixture).c_str(), 0666), 0);
+        fbl::unique_fd fd(open(GetTargetPath(*fixture).c_str(), O_CREAT | O_RDWR, 0644));
+        ASSERT_TRUE(fd);
+
+        count_ = 0;
+        while (state->KeepRunning()) {
+            ASSERT_EQ(link(GetTargetPath(*fixture).c_str(),
+                           GetEntryPath(*fixture, count_).c_str()), 0);
+            count_++;
+        }
+        END_HELPER;
+    }
+
+    // Will stat the entries added by |Link| until |state::KeepGoing| returns false.
+    bool Stat(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        for (int i = 0; state->KeepRunning() && i < count_; i++) {
+            struct stat buff;
+            ASSERT_EQ(stat(GetEntryPath(*fixture, i).c_str(), &buff), 0);
+        }
+        END_HELPER;
+    }
+
+    // Will unlink the entries added by |Link| until |state::KeepGoing| returns false, then
+    // remove the directory once it is empty.
+    bool Unlink(perftest::RepeatState* state, Fixture* fixture) {
+        BEGIN_HELPER;
+        int i = 0;
+        for (; state->KeepRunning() && i < count_; i++) {
+            ASSERT_EQ(unlink(GetEntryPath(*fixture, i).c_str()), 0);
+        }
+        if (i == count_) {
+            ASSERT_EQ(rmdir(GetDirPath(*fixture).c_str()), 0);
+            ASSERT_EQ(unlink(GetTargetPath(*fixture).c_str()), 0);
+        }
+        END_HELPER;
+    }
+
+private:
+    static fbl::String GetDirPath(const Fixture& fixture) {
+        return fbl::StringPrintf("%s/dir", fixture.fs_path().c_str());
+    }
+
+    static fbl::String GetTargetPath(const Fixture& fixture) {
+        return fbl::StringPrintf("%s/target", fixture.fs_path().c_str());
+    }
+
+    static fbl::String GetEntryPath(const Fixture& fixture, int index) {
+        return fbl::StringPrintf("%s/dir/entry-%d", fixture.fs_path().c_str(), index);
+    }
+
+    int count_ = 0;
+};
+
 } // namespace
 
 bool RunBenchmark(int argc, char** argv) {
@@ -240,6 +309,39 @@ bool RunBenchmark(int argc, char** argv) {
         testcases.push_back(std::move(testcase));
     }
 
+    // Directory tests.
+    const int directory_sample_counts[] = {
+        1000,
+        10000,
+        100000,
+    };
+
+    DirectoryOp dir_op;
+    for (int test_sample_count : directory_sample_counts) {
+        TestCaseInfo testcase;
+        testcase.name = fbl::StringPrintf("%s/Directory/%d-Entries",
+                                          disk_format_string_[f_opts.fs_type], test_sample_count);
+        testcase.sample_count = test_sample_count;
+        testcase.teardown = false;
+
+        TestInfo link_test;
+        link_test.name = fbl::StringPrintf("%s/Link", testcase.name.c_str());
+        link_test.test_fn = fbl::BindMember(&dir_op, &DirectoryOp::Link);
+        testcase.tests.push_back(std::move(link_test));
+
+        TestInfo stat_test;
+        stat_test.name = fbl::StringPrintf("%s/Stat", testcase.name.c_str());
+        stat_test.test_fn = fbl::BindMember(&dir_op, &DirectoryOp::Stat);
+        testcase.tests.push_back(std::move(stat_test));
+
+        TestInfo unlink_test;
+        unlink_test.name = fbl::StringPrintf("%s/Unlink", testcase.name.c_str());
+        unlink_test.test_fn = fbl::BindMember(&dir_op, &DirectoryOp::Unlink);
+        testcase.tests.push_back(std::move(unlink_test));
+
+        testcases.push_back(std::move(testcase));
+    }
+
     return fs_test_utils::RunTestCases(f_opts, p_opts, testcases);
 }
 } // namespace fs_bench
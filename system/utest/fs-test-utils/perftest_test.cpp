@@ -133,6 +133,8 @@ bool OptionsAreOverwritten() {
         "--print_statistics",
         "--fs",
         "blobfs",
+        "--enable_pager",
+        "--lz4_frame_compression",
     };
     const char* argv[argvs.size() + 1];
     for (size_t i = 0; i < argvs.size(); ++i) {
@@ -164,6 +166,8 @@ bool OptionsAreOverwritten() {
     ASSERT_TRUE(f_options.use_fvm);
     ASSERT_EQ(f_options.fvm_slice_size, 8192);
     ASSERT_EQ(f_options.fs_type, DISK_FORMAT_BLOBFS);
+    ASSERT_TRUE(f_options.fs_enable_pager);
+    ASSERT_TRUE(f_options.fs_lz4_frame_compression);
 
     ASSERT_FALSE(p_options.is_unittest);
     ASSERT_TRUE(p_options.result_path == "some_path");
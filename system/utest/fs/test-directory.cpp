@@ -17,6 +17,7 @@
 #include <zircon/compiler.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/unique_ptr.h>
 
 #include "filesystems.h"
 #include "misc.h"
@@ -308,6 +309,19 @@ bool TestDirectoryReaddir(void) {
     END_TEST;
 }
 
+// Marks the entry |name| of the directory made by large_dir_setup as seen.
+// Filesystems may list the entries in any order, but only once each.
+bool large_dir_mark_seen(const char* name, bool* seen, size_t num_entries) {
+    BEGIN_HELPER;
+    char* end;
+    size_t i = strtoul(name, &end, 10);
+    ASSERT_EQ(*end, '\0', "Unexpected dirent");
+    ASSERT_LT(i, num_entries, "Unexpected dirent");
+    ASSERT_FALSE(seen[i], "Duplicate dirent");
+    seen[i] = true;
+    END_HELPER;
+}
+
 // Create a directory named "::dir" with entries "00000", "00001" ... up to
 // num_entries.
 bool large_dir_setup(size_t num_entries) {
@@ -328,17 +342,16 @@ bool large_dir_setup(size_t num_entries) {
     // As a sanity check, it should contain all then entries we made
     struct dirent* de;
     size_t num_seen = 0;
-    size_t i = 0;
+    fbl::unique_ptr<bool[]> seen(new bool[num_entries]());
     while ((de = readdir(dir)) != NULL) {
         if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
             // Ignore these entries
             continue;
         }
-        char dirname[100];
-        snprintf(dirname, 100, "%05lu", i++);
-        ASSERT_EQ(strcmp(de->d_name, dirname), 0, "Unexpected dirent");
+        ASSERT_TRUE(large_dir_mark_seen(de->d_name, seen.get(), num_entries));
         num_seen++;
     }
+    ASSERT_EQ(num_seen, num_entries, "Did not see all expected entries");
     ASSERT_EQ(closedir(dir), 0);
 
     return true;
@@ -356,16 +369,14 @@ bool TestDirectoryReaddirRmAll(void) {
     // Unlink all the entries as we read them.
     struct dirent* de;
     size_t num_seen = 0;
-    size_t i = 0;
+    fbl::unique_ptr<bool[]> seen(new bool[num_entries]());
     while ((de = readdir(dir)) != NULL) {
         if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
             // Ignore these entries
             continue;
         }
-        char dirname[100];
-        snprintf(dirname, 100, "%05lu", i++);
-        ASSERT_EQ(strcmp(de->d_name, dirname), 0, "Unexpected dirent");
-        ASSERT_EQ(unlinkat(dirfd(dir), dirname, AT_REMOVEDIR), 0);
+        ASSERT_TRUE(large_dir_mark_seen(de->d_name, seen.get(), num_entries));
+        ASSERT_EQ(unlinkat(dirfd(dir), de->d_name, AT_REMOVEDIR), 0);
         num_seen++;
     }
 
@@ -4,8 +4,10 @@
 
 // Tests for MinFS-specific behavior.
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -13,12 +15,14 @@
 
 #include <fbl/algorithm.h>
 #include <fbl/unique_fd.h>
+#include <fs-management/mount.h>
 #include <fs-management/ramdisk.h>
 #include <fuchsia/io/c/fidl.h>
 #include <fuchsia/minfs/c/fidl.h>
 #include <fvm/fvm.h>
 #include <lib/fdio/vfs.h>
 #include <lib/fzl/fdio.h>
+#include <lib/zircon-internal/fnv1hash.h>
 #include <minfs/format.h>
 #include <unittest/unittest.h>
 #include <zircon/device/vfs.h>
@@ -504,6 +508,586 @@ bool TestUnlinkFail(void) {
 
     END_TEST;
 }
+
+bool MountWithJournal() {
+    BEGIN_HELPER;
+    int fd = open(test_disk_path, O_RDWR);
+    ASSERT_GE(fd, 0);
+    mount_options_t options = default_mount_options;
+    options.enable_journal = true;
+    ASSERT_EQ(mount(fd, kMountPath, DISK_FORMAT_MINFS, &options, launch_stdio_async), ZX_OK);
+    END_HELPER;
+}
+
+// Tests that transactions written back through the journal are either
+// entirely on disk or not at all, wherever the disk goes away.
+bool TestJournalCrash() {
+    BEGIN_TEST;
+
+    if (use_real_disk) {
+        fprintf(stderr, "Ramdisk required; skipping test\n");
+        return true;
+    }
+
+    // The ramdisk fails every request once it has written this many blocks,
+    // which cuts the writeback short at a different point each time.
+    const uint64_t kBlockCounts[] = {0, 1, 2, 3, 5, 8, 13, 64};
+    for (size_t i = 0; i < fbl::count_of(kBlockCounts); i++) {
+        ASSERT_EQ(test_info->unmount(kMountPath), 0);
+        ASSERT_TRUE(MountWithJournal());
+
+        char path[64];
+        snprintf(path, sizeof(path), "::synced-%zu", i);
+        ASSERT_EQ(mkdir(path, 0755), 0);
+        fbl::unique_fd dir(open(path, O_RDONLY | O_DIRECTORY));
+        ASSERT_TRUE(dir);
+        ASSERT_EQ(syncfs(dir.get()), 0);
+
+        ASSERT_EQ(sleep_ramdisk(ramdisk_path, kBlockCounts[i]), 0);
+        for (size_t j = 0; j < 10; j++) {
+            snprintf(path, sizeof(path), "::synced-%zu/file-%zu", i, j);
+            fbl::unique_fd fd(open(path, O_CREAT | O_RDWR | O_EXCL));
+            ASSERT_TRUE(fd);
+        }
+        // Depending on where the disk went away, this may or may not succeed.
+        syncfs(dir.get());
+        dir.reset();
+
+        // Unmount while the disk is still asleep, as if power had been lost.
+        ASSERT_EQ(test_info->unmount(kMountPath), 0);
+        ASSERT_EQ(wake_ramdisk(ramdisk_path), 0);
+        ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+        ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+
+        for (size_t j = 0; j <= i; j++) {
+            struct stat s;
+            snprintf(path, sizeof(path), "::synced-%zu", j);
+            ASSERT_EQ(stat(path, &s), 0);
+            ASSERT_TRUE(S_ISDIR(s.st_mode));
+        }
+    }
+
+    END_TEST;
+}
+
+// Fills |data| with a pattern identifying block |block| of file |file|.
+void FillBlock(char* data, uint32_t file, uint32_t block) {
+    memset(data, static_cast<int>((file * 0x40 + block) & 0xff), minfs::kMinfsBlockSize);
+    memcpy(data, &block, sizeof(block));
+}
+
+// Checks that the |blocks| blocks of |fd| were written by FillBlock(|file|).
+bool VerifyBlocks(int fd, uint32_t file, uint32_t blocks) {
+    BEGIN_HELPER;
+    char expected[minfs::kMinfsBlockSize];
+    char actual[minfs::kMinfsBlockSize];
+    for (uint32_t i = 0; i < blocks; i++) {
+        FillBlock(expected, file, i);
+        ASSERT_EQ(pread(fd, actual, sizeof(actual), i * minfs::kMinfsBlockSize),
+                  sizeof(actual));
+        ASSERT_EQ(memcmp(expected, actual, sizeof(actual)), 0, "Unexpected file contents");
+    }
+    END_HELPER;
+}
+
+// Reads or writes block |bno| of the unmounted test disk.
+bool ReadDiskBlock(uint32_t bno, void* data) {
+    BEGIN_HELPER;
+    fbl::unique_fd disk(open(test_disk_path, O_RDONLY));
+    ASSERT_TRUE(disk);
+    ASSERT_EQ(pread(disk.get(), data, minfs::kMinfsBlockSize, bno * minfs::kMinfsBlockSize),
+              minfs::kMinfsBlockSize);
+    END_HELPER;
+}
+
+bool WriteDiskBlock(uint32_t bno, const void* data) {
+    BEGIN_HELPER;
+    fbl::unique_fd disk(open(test_disk_path, O_RDWR));
+    ASSERT_TRUE(disk);
+    ASSERT_EQ(pwrite(disk.get(), data, minfs::kMinfsBlockSize, bno * minfs::kMinfsBlockSize),
+              minfs::kMinfsBlockSize);
+    END_HELPER;
+}
+
+// Unmounts the filesystem and returns the version recorded in its superblock.
+bool GetVersion(uint32_t* version) {
+    BEGIN_HELPER;
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+    char data[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(0, data));
+    *version = reinterpret_cast<minfs::Superblock*>(data)->version;
+    ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    END_HELPER;
+}
+
+// Tests that blocks which are still waiting to be allocated when a file is
+// truncated or unlinked are never written, and that their reservations are
+// released.
+bool TestDelayedTruncateUnlink() {
+    BEGIN_TEST;
+
+    uint32_t original_blocks;
+    ASSERT_TRUE(GetUsedBlocks(&original_blocks));
+
+    char data[minfs::kMinfsBlockSize];
+    fbl::unique_fd fd(open("::unlinked", O_CREAT | O_RDWR | O_EXCL));
+    ASSERT_TRUE(fd);
+    for (uint32_t i = 0; i < 8; i++) {
+        FillBlock(data, 0, i);
+        ASSERT_EQ(write(fd.get(), data, sizeof(data)), sizeof(data));
+    }
+    ASSERT_EQ(unlink("::unlinked"), 0);
+    ASSERT_EQ(close(fd.release()), 0);
+
+    fd.reset(open("::truncated", O_CREAT | O_RDWR | O_EXCL));
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(syncfs(fd.get()), 0);
+    uint32_t current_blocks;
+    ASSERT_TRUE(GetUsedBlocks(&current_blocks));
+    ASSERT_EQ(current_blocks, original_blocks);
+
+    // Truncate the file to three blocks, then write a sixth block past the hole this leaves.
+    for (uint32_t i = 0; i < 8; i++) {
+        FillBlock(data, 1, i);
+        ASSERT_EQ(write(fd.get(), data, sizeof(data)), sizeof(data));
+    }
+    ASSERT_EQ(ftruncate(fd.get(), 3 * minfs::kMinfsBlockSize), 0);
+    FillBlock(data, 1, 5);
+    ASSERT_EQ(pwrite(fd.get(), data, sizeof(data), 5 * minfs::kMinfsBlockSize), sizeof(data));
+    fd.reset();
+    ASSERT_TRUE(check_remount());
+
+    fd.reset(open("::truncated", O_RDWR));
+    ASSERT_TRUE(fd);
+    struct stat s;
+    ASSERT_EQ(fstat(fd.get(), &s), 0);
+    ASSERT_EQ(s.st_size, 6 * minfs::kMinfsBlockSize);
+    uint64_t blocks;
+    ASSERT_TRUE(GetFileBlocks(fd.get(), &blocks));
+    ASSERT_EQ(blocks, 4);
+    ASSERT_TRUE(VerifyBlocks(fd.get(), 1, 3));
+    char zero[minfs::kMinfsBlockSize];
+    memset(zero, 0, sizeof(zero));
+    for (uint32_t i = 3; i < 5; i++) {
+        ASSERT_EQ(pread(fd.get(), data, sizeof(data), i * minfs::kMinfsBlockSize), sizeof(data));
+        ASSERT_EQ(memcmp(data, zero, sizeof(data)), 0, "Hole was not zero");
+    }
+    char expected[minfs::kMinfsBlockSize];
+    FillBlock(expected, 1, 5);
+    ASSERT_EQ(pread(fd.get(), data, sizeof(data), 5 * minfs::kMinfsBlockSize), sizeof(data));
+    ASSERT_EQ(memcmp(data, expected, sizeof(data)), 0, "Unexpected file contents");
+    fd.reset();
+
+    ASSERT_EQ(unlink("::truncated"), 0);
+    ASSERT_TRUE(check_remount());
+    ASSERT_TRUE(GetUsedBlocks(&current_blocks));
+    ASSERT_EQ(current_blocks, original_blocks);
+    END_TEST;
+}
+
+// Tests files with more extents than fit in the inode, whose extents overflow
+// into a chain of ExtentBlocks.
+bool TestExtentOverflow() {
+    BEGIN_TEST;
+
+    // Allocating the blocks of two files alternately leaves every block of
+    // either file in an extent of its own. This is enough for a chain of at
+    // least two ExtentBlocks.
+    const uint32_t kBlocks = minfs::kMinfsInlineExtents + minfs::kMinfsExtentsPerBlock + 16;
+    fbl::unique_fd fds[2];
+    fds[0].reset(open("::extents-0", O_CREAT | O_RDWR | O_EXCL));
+    ASSERT_TRUE(fds[0]);
+    fds[1].reset(open("::extents-1", O_CREAT | O_RDWR | O_EXCL));
+    ASSERT_TRUE(fds[1]);
+
+    char data[minfs::kMinfsBlockSize];
+    for (uint32_t i = 0; i < kBlocks; i++) {
+        for (uint32_t f = 0; f < 2; f++) {
+            FillBlock(data, f, i);
+            ASSERT_EQ(write(fds[f].get(), data, sizeof(data)), sizeof(data));
+            // Syncing allocates the delayed block before the other file's.
+            ASSERT_EQ(syncfs(fds[f].get()), 0);
+        }
+    }
+
+    // The ExtentBlocks count towards the blocks of the file.
+    uint64_t blocks;
+    ASSERT_TRUE(GetFileBlocks(fds[0].get(), &blocks));
+    ASSERT_GE(blocks, kBlocks + 2);
+    fds[0].reset();
+    fds[1].reset();
+    ASSERT_TRUE(check_remount());
+
+    for (uint32_t f = 0; f < 2; f++) {
+        char path[64];
+        snprintf(path, sizeof(path), "::extents-%u", f);
+        fds[f].reset(open(path, O_RDWR));
+        ASSERT_TRUE(fds[f]);
+        ASSERT_TRUE(VerifyBlocks(fds[f].get(), f, kBlocks));
+    }
+
+    // Truncating the file back into its inode releases the chain.
+    ASSERT_EQ(ftruncate(fds[0].get(), minfs::kMinfsInlineExtents * minfs::kMinfsBlockSize), 0);
+    ASSERT_TRUE(GetFileBlocks(fds[0].get(), &blocks));
+    ASSERT_EQ(blocks, minfs::kMinfsInlineExtents);
+    fds[0].reset();
+    fds[1].reset();
+    ASSERT_TRUE(check_remount());
+
+    fds[0].reset(open("::extents-0", O_RDWR));
+    ASSERT_TRUE(fds[0]);
+    ASSERT_TRUE(VerifyBlocks(fds[0].get(), 0, minfs::kMinfsInlineExtents));
+    fds[0].reset();
+    ASSERT_EQ(unlink("::extents-0"), 0);
+    ASSERT_EQ(unlink("::extents-1"), 0);
+    ASSERT_TRUE(check_remount());
+    END_TEST;
+}
+
+// Tests that files mapped by block pointers, as written before extents were
+// introduced, remain readable and writable, and that a filesystem of a
+// previous version is upgraded only once it holds an extent-mapped file.
+bool TestBlockMappedUpgrade() {
+    BEGIN_TEST;
+
+    if (use_real_disk) {
+        fprintf(stderr, "Ramdisk required; skipping test\n");
+        return true;
+    }
+
+    // Write a file of two contiguous blocks, then rewrite its inode as the
+    // equivalent block-mapped one, on a version 7 filesystem.
+    fbl::unique_fd fd(open("::legacy", O_CREAT | O_RDWR | O_EXCL));
+    ASSERT_TRUE(fd);
+    char data[minfs::kMinfsBlockSize];
+    for (uint32_t i = 0; i < 2; i++) {
+        FillBlock(data, 0, i);
+        ASSERT_EQ(write(fd.get(), data, sizeof(data)), sizeof(data));
+    }
+    struct stat s;
+    ASSERT_EQ(fstat(fd.get(), &s), 0);
+    const uint32_t ino = static_cast<uint32_t>(s.st_ino);
+    fd.reset();
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+
+    char sb_data[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(0, sb_data));
+    minfs::Superblock* sb = reinterpret_cast<minfs::Superblock*>(sb_data);
+    ASSERT_EQ(sb->version, minfs::kMinfsVersionExtents);
+    sb->version = minfs::kMinfsVersionLinearDirs;
+    ASSERT_TRUE(WriteDiskBlock(0, sb_data));
+
+    const uint32_t ino_bno = sb->ino_block + ino / minfs::kMinfsInodesPerBlock;
+    char ino_data[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(ino_bno, ino_data));
+    minfs::Inode* inode = reinterpret_cast<minfs::Inode*>(ino_data) +
+                          ino % minfs::kMinfsInodesPerBlock;
+    ASSERT_TRUE(inode->flags & minfs::kMinfsInodeFlagExtents);
+    const minfs::InodeExtents* extents = minfs::GetInodeExtents(inode);
+    ASSERT_EQ(extents->count, 1);
+    ASSERT_EQ(extents->extents[0].length, 2);
+    const uint32_t start = extents->extents[0].start;
+    inode->flags &= ~minfs::kMinfsInodeFlagExtents;
+    memset(inode->dnum, 0, sizeof(minfs::InodeExtents));
+    inode->dnum[0] = start;
+    inode->dnum[1] = start + 1;
+    ASSERT_TRUE(WriteDiskBlock(ino_bno, ino_data));
+    ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+
+    // Grow the block-mapped file past its direct blocks, which leaves the
+    // version untouched.
+    const uint32_t kBlocks = minfs::kMinfsDirect + 8;
+    fd.reset(open("::legacy", O_RDWR));
+    ASSERT_TRUE(fd);
+    ASSERT_TRUE(VerifyBlocks(fd.get(), 0, 2));
+    for (uint32_t i = 2; i < kBlocks; i++) {
+        FillBlock(data, 0, i);
+        ASSERT_EQ(pwrite(fd.get(), data, sizeof(data), i * minfs::kMinfsBlockSize),
+                  sizeof(data));
+    }
+    fd.reset();
+    uint32_t version;
+    ASSERT_TRUE(GetVersion(&version));
+    ASSERT_EQ(version, minfs::kMinfsVersionLinearDirs);
+
+    fd.reset(open("::legacy", O_RDWR));
+    ASSERT_TRUE(fd);
+    ASSERT_TRUE(VerifyBlocks(fd.get(), 0, kBlocks));
+    fd.reset();
+
+    // The first extent-mapped file upgrades the filesystem.
+    fd.reset(open("::extents", O_CREAT | O_RDWR | O_EXCL));
+    ASSERT_TRUE(fd);
+    FillBlock(data, 1, 0);
+    ASSERT_EQ(write(fd.get(), data, sizeof(data)), sizeof(data));
+    fd.reset();
+    ASSERT_TRUE(GetVersion(&version));
+    ASSERT_EQ(version, minfs::kMinfsVersionExtents);
+
+    fd.reset(open("::legacy", O_RDWR));
+    ASSERT_TRUE(fd);
+    ASSERT_TRUE(VerifyBlocks(fd.get(), 0, kBlocks));
+    fd.reset(open("::extents", O_RDWR));
+    ASSERT_TRUE(fd);
+    ASSERT_TRUE(VerifyBlocks(fd.get(), 1, 1));
+    fd.reset();
+    ASSERT_EQ(unlink("::legacy"), 0);
+    ASSERT_EQ(unlink("::extents"), 0);
+    END_TEST;
+}
+
+// Pads the names of directory entries, so that directories span many blocks.
+const char kLongName[] = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+
+// Tests that listing a hashed directory while entries are added and removed,
+// which moves the records of its leaves around, lists every entry present
+// throughout exactly once.
+bool TestHashedReaddirWhileModified() {
+    BEGIN_TEST;
+
+    const uint32_t kEntries = 1000;
+    ASSERT_EQ(mkdir("::dir", 0755), 0);
+    char path[PATH_MAX];
+    for (uint32_t i = 0; i < kEntries; i++) {
+        snprintf(path, sizeof(path), "::dir/stable-%u-%.*s", i, i % 64, kLongName);
+        fbl::unique_fd fd(open(path, O_CREAT | O_RDWR | O_EXCL));
+        ASSERT_TRUE(fd);
+        snprintf(path, sizeof(path), "::dir/churn-%u", i);
+        fd.reset(open(path, O_CREAT | O_RDWR | O_EXCL));
+        ASSERT_TRUE(fd);
+    }
+
+    DIR* dir = opendir("::dir");
+    ASSERT_NONNULL(dir);
+    bool seen[kEntries] = {};
+    uint32_t listed = 0;
+    uint32_t removed = 0;
+    uint32_t added = 0;
+    struct dirent* de;
+    while ((de = readdir(dir)) != nullptr) {
+        unsigned i;
+        if (sscanf(de->d_name, "stable-%u-", &i) == 1) {
+            ASSERT_LT(i, kEntries);
+            ASSERT_FALSE(seen[i], "Entry listed twice");
+            seen[i] = true;
+        }
+        if (++listed % 50 != 0) {
+            continue;
+        }
+        // Removing entries leaves gaps which inserts compact, and inserts split leaves.
+        for (uint32_t j = 0; j < 20; j++) {
+            if (removed < kEntries) {
+                snprintf(path, sizeof(path), "churn-%u", removed++);
+                ASSERT_EQ(unlinkat(dirfd(dir), path, 0), 0);
+            }
+            snprintf(path, sizeof(path), "added-%u-%.*s", added, added % 64, kLongName);
+            added++;
+            fbl::unique_fd fd(openat(dirfd(dir), path, O_CREAT | O_RDWR | O_EXCL));
+            ASSERT_TRUE(fd);
+        }
+    }
+    ASSERT_EQ(closedir(dir), 0);
+    for (uint32_t i = 0; i < kEntries; i++) {
+        ASSERT_TRUE(seen[i], "Entry not listed");
+    }
+    ASSERT_TRUE(check_remount());
+
+    for (uint32_t i = 0; i < kEntries; i++) {
+        snprintf(path, sizeof(path), "::dir/stable-%u-%.*s", i, i % 64, kLongName);
+        ASSERT_EQ(unlink(path), 0);
+    }
+    for (uint32_t i = removed; i < kEntries; i++) {
+        snprintf(path, sizeof(path), "::dir/churn-%u", i);
+        ASSERT_EQ(unlink(path), 0);
+    }
+    for (uint32_t i = 0; i < added; i++) {
+        snprintf(path, sizeof(path), "::dir/added-%u-%.*s", i, i % 64, kLongName);
+        ASSERT_EQ(unlink(path), 0);
+    }
+    ASSERT_EQ(rmdir("::dir"), 0);
+    END_TEST;
+}
+
+// Creates the files |prefix|-|first| to |prefix|-|first + count - 1| in the directory |dir|,
+// padding their names with up to 63 characters.
+bool CreateEntries(const char* dir, const char* prefix, uint32_t first, uint32_t count) {
+    BEGIN_HELPER;
+    char path[PATH_MAX];
+    for (uint32_t i = first; i < first + count; i++) {
+        snprintf(path, sizeof(path), "%s/%s-%u-%.*s", dir, prefix, i, i % 64, kLongName);
+        fbl::unique_fd fd(open(path, O_CREAT | O_RDWR | O_EXCL));
+        ASSERT_TRUE(fd);
+    }
+    END_HELPER;
+}
+
+// Checks that the files made by CreateEntries exist, or do not, as |present| says. Every
+// |step|th file is checked.
+bool CheckEntries(const char* dir, const char* prefix, uint32_t first, uint32_t count,
+                  uint32_t step, bool present) {
+    BEGIN_HELPER;
+    char path[PATH_MAX];
+    for (uint32_t i = first; i < first + count; i += step) {
+        snprintf(path, sizeof(path), "%s/%s-%u-%.*s", dir, prefix, i, i % 64, kLongName);
+        struct stat s;
+        ASSERT_EQ(stat(path, &s), present ? 0 : -1, path);
+    }
+    END_HELPER;
+}
+
+bool UnlinkEntries(const char* dir, const char* prefix, uint32_t first, uint32_t count,
+                   uint32_t step) {
+    BEGIN_HELPER;
+    char path[PATH_MAX];
+    for (uint32_t i = first; i < first + count; i += step) {
+        snprintf(path, sizeof(path), "%s/%s-%u-%.*s", dir, prefix, i, i % 64, kLongName);
+        ASSERT_EQ(unlink(path), 0, path);
+    }
+    END_HELPER;
+}
+
+bool GetSize(const char* path, off_t* size) {
+    BEGIN_HELPER;
+    struct stat s;
+    ASSERT_EQ(stat(path, &s), 0);
+    *size = s.st_size;
+    END_HELPER;
+}
+
+// Tests that a directory outgrowing its first block is hashed, that full
+// leaves of a hashed directory are compacted or split, and that entries can
+// be renamed into a hashed directory.
+bool TestHashedDirectory() {
+    BEGIN_TEST;
+
+    const uint32_t kEntries = 2000;
+    ASSERT_EQ(mkdir("::hashed", 0755), 0);
+    off_t size;
+    ASSERT_TRUE(GetSize("::hashed", &size));
+    ASSERT_LE(size, minfs::kMinfsBlockSize);
+
+    // The first entry which does not fit in the first block turns it into
+    // the index block, followed by a single leaf.
+    uint32_t created = 0;
+    while (size <= minfs::kMinfsBlockSize) {
+        ASSERT_TRUE(CreateEntries("::hashed", "entry", created++, 1));
+        ASSERT_TRUE(GetSize("::hashed", &size));
+    }
+    ASSERT_EQ(size, 2 * minfs::kMinfsBlockSize);
+
+    // Filling the leaf splits it, appending leaves to the directory.
+    ASSERT_TRUE(CreateEntries("::hashed", "entry", created, kEntries - created));
+    ASSERT_TRUE(GetSize("::hashed", &size));
+    ASSERT_GT(size, 3 * minfs::kMinfsBlockSize);
+    ASSERT_EQ(size % minfs::kMinfsBlockSize, 0);
+    ASSERT_TRUE(check_remount());
+    ASSERT_TRUE(CheckEntries("::hashed", "entry", 0, kEntries, 1, true));
+
+    // Entries recreated in another order than they were created in may not
+    // fit in the gaps left by removing them, but always fit in their leaves
+    // once these are compacted, so no leaf is added.
+    ASSERT_TRUE(UnlinkEntries("::hashed", "entry", 0, kEntries, 2));
+    ASSERT_TRUE(CheckEntries("::hashed", "entry", 0, kEntries, 2, false));
+    for (uint32_t i = kEntries; i >= 2; i -= 2) {
+        ASSERT_TRUE(CreateEntries("::hashed", "entry", i - 2, 1));
+    }
+    off_t compacted_size;
+    ASSERT_TRUE(GetSize("::hashed", &compacted_size));
+    ASSERT_EQ(compacted_size, size);
+    ASSERT_TRUE(check_remount());
+    ASSERT_TRUE(CheckEntries("::hashed", "entry", 0, kEntries, 1, true));
+
+    // Entries renamed into the hashed directory, or within it, move to the
+    // leaf of their new name.
+    ASSERT_EQ(mkdir("::linear", 0755), 0);
+    ASSERT_TRUE(CreateEntries("::linear", "moved", 0, 16));
+    for (uint32_t i = 0; i < 16; i++) {
+        char src[PATH_MAX];
+        char dst[PATH_MAX];
+        snprintf(src, sizeof(src), "::linear/moved-%u-%.*s", i, i % 64, kLongName);
+        snprintf(dst, sizeof(dst), "::hashed/moved-%u-%.*s", i, i % 64, kLongName);
+        ASSERT_EQ(rename(src, dst), 0);
+        snprintf(src, sizeof(src), "::hashed/entry-%u-%.*s", i, i % 64, kLongName);
+        snprintf(dst, sizeof(dst), "::hashed/renamed-%u-%.*s", i, i % 64, kLongName);
+        ASSERT_EQ(rename(src, dst), 0);
+    }
+    ASSERT_TRUE(check_remount());
+    ASSERT_TRUE(CheckEntries("::linear", "moved", 0, 16, 1, false));
+    ASSERT_TRUE(CheckEntries("::hashed", "moved", 0, 16, 1, true));
+    ASSERT_TRUE(CheckEntries("::hashed", "entry", 0, 16, 1, false));
+    ASSERT_TRUE(CheckEntries("::hashed", "renamed", 0, 16, 1, true));
+    ASSERT_TRUE(CheckEntries("::hashed", "entry", 16, kEntries - 16, 1, true));
+
+    ASSERT_TRUE(UnlinkEntries("::hashed", "moved", 0, 16, 1));
+    ASSERT_TRUE(UnlinkEntries("::hashed", "renamed", 0, 16, 1));
+    ASSERT_TRUE(UnlinkEntries("::hashed", "entry", 16, kEntries - 16, 1));
+    ASSERT_EQ(rmdir("::hashed"), 0);
+    ASSERT_EQ(rmdir("::linear"), 0);
+    END_TEST;
+}
+
+// Tests that fsck rejects an entry of a hashed directory which lives in
+// another leaf than the one its name hashes to.
+bool TestHashedDirectoryFsck() {
+    BEGIN_TEST;
+
+    if (use_real_disk) {
+        fprintf(stderr, "Ramdisk required; skipping test\n");
+        return true;
+    }
+
+    ASSERT_EQ(mkdir("::hashed", 0755), 0);
+    ASSERT_TRUE(CreateEntries("::hashed", "entry", 0, 600));
+    struct stat s;
+    ASSERT_EQ(stat("::hashed", &s), 0);
+    ASSERT_LE(s.st_size, minfs::kMinfsDirect * minfs::kMinfsBlockSize);
+    const uint32_t ino = static_cast<uint32_t>(s.st_ino);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+
+    // Find the blocks of the directory: its index block, and the first leaf of the index.
+    char data[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(0, data));
+    const minfs::Superblock* sb = reinterpret_cast<const minfs::Superblock*>(data);
+    const uint32_t dat_block = sb->dat_block;
+    ASSERT_TRUE(ReadDiskBlock(sb->ino_block + ino / minfs::kMinfsInodesPerBlock, data));
+    const minfs::Inode inode = reinterpret_cast<const minfs::Inode*>(data)[
+            ino % minfs::kMinfsInodesPerBlock];
+    ASSERT_TRUE(inode.flags & minfs::kMinfsInodeFlagDirIndex);
+    ASSERT_TRUE(ReadDiskBlock(dat_block + inode.dnum[0], data));
+    const minfs::DirIndex* index = reinterpret_cast<const minfs::DirIndex*>(
+            &data[minfs::kMinfsDirIndexOffset]);
+    ASSERT_EQ(index->magic, minfs::kMinfsDirIndexMagic);
+    ASSERT_GE(index->count, 2);
+    const uint32_t leaf_end = index->entries[1].hash;
+    const uint32_t leaf_bno = dat_block + inode.dnum[index->entries[0].block];
+
+    // Rename the first entry of the leaf, in place, to a name which hashes past the leaf.
+    char leaf[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(leaf_bno, leaf));
+    char original[minfs::kMinfsBlockSize];
+    memcpy(original, leaf, sizeof(leaf));
+    minfs::Dirent* de = reinterpret_cast<minfs::Dirent*>(leaf);
+    while (de->ino == 0) {
+        de = reinterpret_cast<minfs::Dirent*>(reinterpret_cast<char*>(de) +
+                                              (de->reclen & minfs::kMinfsReclenMask));
+        ASSERT_LT(reinterpret_cast<char*>(de) - leaf, minfs::kMinfsBlockSize);
+    }
+    for (char c = 'A'; fnv1a32(de->name, de->namelen) < leaf_end; c++) {
+        ASSERT_LE(c, 'Z');
+        de->name[0] = c;
+    }
+    ASSERT_TRUE(WriteDiskBlock(leaf_bno, leaf));
+    ASSERT_NE(test_info->fsck(test_disk_path), 0);
+
+    ASSERT_TRUE(WriteDiskBlock(leaf_bno, original));
+    ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    ASSERT_TRUE(UnlinkEntries("::hashed", "entry", 0, 600, 1));
+    ASSERT_EQ(rmdir("::hashed"), 0);
+    END_TEST;
+}
 }  // namespace
 
 #define RUN_MINFS_TESTS_NORMAL(name, CASE_TESTS) \
@@ -515,10 +1099,18 @@ bool TestUnlinkFail(void) {
 RUN_MINFS_TESTS_NORMAL(FsMinfsTests,
     RUN_TEST_LARGE(TestFullOperations)
     RUN_TEST_MEDIUM(TestUnlinkFail)
+    RUN_TEST_LARGE(TestJournalCrash)
+    RUN_TEST_MEDIUM(TestDelayedTruncateUnlink)
+    RUN_TEST_LARGE(TestExtentOverflow)
+    RUN_TEST_MEDIUM(TestBlockMappedUpgrade)
+    RUN_TEST_LARGE(TestHashedReaddirWhileModified)
+    RUN_TEST_LARGE(TestHashedDirectory)
+    RUN_TEST_MEDIUM(TestHashedDirectoryFsck)
 )
 
 RUN_MINFS_TESTS_FVM(FsMinfsFvmTests,
     RUN_TEST_MEDIUM(TestQueryInfo)
     RUN_TEST_MEDIUM(TestMetrics)
     RUN_TEST_MEDIUM(TestUnlinkFail)
+    RUN_TEST_LARGE(TestJournalCrash)
 )
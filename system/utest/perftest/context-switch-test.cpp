@@ -0,0 +1,135 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+
+#include <fbl/algorithm.h>
+#include <launchpad/launchpad.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/process.h>
+#include <zircon/processargs.h>
+#include <zircon/syscalls.h>
+
+#include "context-switch-test.h"
+
+namespace {
+
+// Passing this as the only argument makes perf-test run as the echo side of
+// the cross-process test instead of running tests.
+constexpr char kEchoArg[] = "--context-switch-echo";
+
+// Path of this executable, used to launch the echo process.
+const char* g_self_path = nullptr;
+
+// Echoes each message read from |channel| back until the peer goes away.
+void EchoLoop(zx_handle_t channel) {
+    for (;;) {
+        zx_signals_t observed;
+        ZX_ASSERT(zx_object_wait_one(channel, ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED,
+                                     ZX_TIME_INFINITE, &observed) == ZX_OK);
+        if (!(observed & ZX_CHANNEL_READABLE)) {
+            break;
+        }
+        uint32_t msg;
+        uint32_t actual_bytes;
+        ZX_ASSERT(zx_channel_read(channel, 0, &msg, nullptr, sizeof(msg), 0, &actual_bytes,
+                                  nullptr) == ZX_OK);
+        ZX_ASSERT(zx_channel_write(channel, 0, &msg, sizeof(msg), nullptr, 0) == ZX_OK);
+    }
+    zx_handle_close(channel);
+}
+
+int EchoThread(void* arg) {
+    EchoLoop(static_cast<zx_handle_t>(reinterpret_cast<uintptr_t>(arg)));
+    return 0;
+}
+
+// Sends one message to the echo side and waits for it to come back.
+void RoundTrip(zx_handle_t channel) {
+    uint32_t msg = 0;
+    ZX_ASSERT(zx_channel_write(channel, 0, &msg, sizeof(msg), nullptr, 0) == ZX_OK);
+    ZX_ASSERT(zx_object_wait_one(channel, ZX_CHANNEL_READABLE, ZX_TIME_INFINITE,
+                                 nullptr) == ZX_OK);
+    uint32_t actual_bytes;
+    ZX_ASSERT(zx_channel_read(channel, 0, &msg, nullptr, sizeof(msg), 0, &actual_bytes,
+                              nullptr) == ZX_OK);
+}
+
+// Measures a channel round trip to a thread in the same process.  Blocking
+// and waking threads costs the same here as in the cross-process test, but
+// no address space switch is needed.
+bool SameProcessTest(perftest::RepeatState* state) {
+    zx_handle_t channel;
+    zx_handle_t peer;
+    ZX_ASSERT(zx_channel_create(0, &channel, &peer) == ZX_OK);
+
+    thrd_t thread;
+    ZX_ASSERT(thrd_create(&thread, EchoThread,
+                          reinterpret_cast<void*>(static_cast<uintptr_t>(peer))) ==
+              thrd_success);
+
+    while (state->KeepRunning()) {
+        RoundTrip(channel);
+    }
+
+    zx_handle_close(channel);
+    ZX_ASSERT(thrd_join(thread, nullptr) == thrd_success);
+    return true;
+}
+
+// Measures a channel round trip to another process.  Each round trip
+// switches address spaces twice when both sides share a CPU, which is what
+// PCIDs (x86) and ASIDs (arm64) make cheaper by not flushing the TLB.
+bool CrossProcessTest(perftest::RepeatState* state) {
+    ZX_ASSERT(g_self_path != nullptr);
+
+    zx_handle_t channel;
+    zx_handle_t peer;
+    ZX_ASSERT(zx_channel_create(0, &channel, &peer) == ZX_OK);
+
+    launchpad_t* lp;
+    ZX_ASSERT(launchpad_create(ZX_HANDLE_INVALID, "context-switch-echo", &lp) == ZX_OK);
+    ZX_ASSERT(launchpad_load_from_file(lp, g_self_path) == ZX_OK);
+    const char* args[] = {g_self_path, kEchoArg};
+    ZX_ASSERT(launchpad_set_args(lp, static_cast<int>(fbl::count_of(args)), args) == ZX_OK);
+    ZX_ASSERT(launchpad_clone(lp, LP_CLONE_ALL) == ZX_OK);
+    ZX_ASSERT(launchpad_add_handle(lp, peer, PA_HND(PA_USER0, 0)) == ZX_OK);
+    zx_handle_t process;
+    const char* errmsg;
+    ZX_ASSERT_MSG(launchpad_go(lp, &process, &errmsg) == ZX_OK, "%s", errmsg);
+
+    while (state->KeepRunning()) {
+        RoundTrip(channel);
+    }
+
+    zx_handle_close(channel);
+    ZX_ASSERT(zx_object_wait_one(process, ZX_TASK_TERMINATED, ZX_TIME_INFINITE,
+                                 nullptr) == ZX_OK);
+    zx_handle_close(process);
+    return true;
+}
+
+void RegisterTests() {
+    perftest::RegisterTest("ContextSwitch/SameProcess", SameProcessTest);
+    perftest::RegisterTest("ContextSwitch/CrossProcess", CrossProcessTest);
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
+
+bool MaybeRunContextSwitchEcho(int argc, char** argv, int* exit_code) {
+    g_self_path = argv[0];
+    if (argc != 2 || strcmp(argv[1], kEchoArg) != 0) {
+        return false;
+    }
+
+    zx_handle_t channel = zx_take_startup_handle(PA_HND(PA_USER0, 0));
+    ZX_ASSERT(channel != ZX_HANDLE_INVALID);
+    EchoLoop(channel);
+    *exit_code = 0;
+    return true;
+}
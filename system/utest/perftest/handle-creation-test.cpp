@@ -2,6 +2,12 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <launchpad/launchpad.h>
 #include <lib/zx/channel.h>
 #include <lib/zx/event.h>
 #include <lib/zx/eventpair.h>
@@ -12,9 +18,22 @@
 #include <lib/zx/thread.h>
 #include <lib/zx/vmar.h>
 #include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/process.h>
+#include <zircon/processargs.h>
+#include <zircon/syscalls.h>
+
+#include "handle-creation-test.h"
 
 namespace {
 
+// Passing this as the only argument makes perf-test run as a background
+// process of the HandleDuplicate tests instead of running tests.
+constexpr char kChurnArg[] = "--handle-churn";
+
+// Path of this executable, used to launch the background processes.
+const char* g_self_path = nullptr;
+
 // These tests measure the times taken to create and close various types of
 // Zircon handle.  Strictly speaking, they test creating Zircon objects as
 // well as creating handles.
@@ -126,6 +145,68 @@ bool VmoCreateTest(perftest::RepeatState* state) {
     return true;
 }
 
+// Duplicates and closes a handle until |channel|'s peer goes away.
+void ChurnLoop(zx_handle_t channel) {
+    for (;;) {
+        for (int i = 0; i < 100; ++i) {
+            zx_handle_t dup;
+            ZX_ASSERT(zx_handle_duplicate(channel, ZX_RIGHT_SAME_RIGHTS, &dup) == ZX_OK);
+            ZX_ASSERT(zx_handle_close(dup) == ZX_OK);
+        }
+        zx_signals_t observed = 0;
+        zx_object_wait_one(channel, ZX_CHANNEL_PEER_CLOSED, 0, &observed);
+        if (observed & ZX_CHANNEL_PEER_CLOSED) {
+            break;
+        }
+    }
+    zx_handle_close(channel);
+}
+
+// Measures duplicating and closing a handle while |process_count| other
+// processes do the same.  The processes have separate handle tables, so
+// this only slows down as |process_count| grows if handle allocation
+// contends on something shared by every process.
+bool HandleDuplicateTest(perftest::RepeatState* state, uint32_t process_count) {
+    ZX_ASSERT(g_self_path != nullptr);
+    state->DeclareStep("duplicate");
+    state->DeclareStep("close");
+
+    fbl::unique_ptr<zx_handle_t[]> channels(new zx_handle_t[process_count]);
+    fbl::unique_ptr<zx_handle_t[]> processes(new zx_handle_t[process_count]);
+    for (uint32_t i = 0; i < process_count; ++i) {
+        zx_handle_t peer;
+        ZX_ASSERT(zx_channel_create(0, &channels[i], &peer) == ZX_OK);
+
+        launchpad_t* lp;
+        ZX_ASSERT(launchpad_create(ZX_HANDLE_INVALID, "handle-churn", &lp) == ZX_OK);
+        ZX_ASSERT(launchpad_load_from_file(lp, g_self_path) == ZX_OK);
+        const char* args[] = {g_self_path, kChurnArg};
+        ZX_ASSERT(launchpad_set_args(lp, static_cast<int>(fbl::count_of(args)), args) == ZX_OK);
+        ZX_ASSERT(launchpad_clone(lp, LP_CLONE_ALL) == ZX_OK);
+        ZX_ASSERT(launchpad_add_handle(lp, peer, PA_HND(PA_USER0, 0)) == ZX_OK);
+        const char* errmsg;
+        ZX_ASSERT_MSG(launchpad_go(lp, &processes[i], &errmsg) == ZX_OK, "%s", errmsg);
+    }
+
+    zx::event event;
+    ZX_ASSERT(zx::event::create(0, &event) == ZX_OK);
+    while (state->KeepRunning()) {
+        zx::event dup;
+        ZX_ASSERT(event.duplicate(ZX_RIGHT_SAME_RIGHTS, &dup) == ZX_OK);
+        state->NextStep();
+    }
+
+    for (uint32_t i = 0; i < process_count; ++i) {
+        zx_handle_close(channels[i]);
+    }
+    for (uint32_t i = 0; i < process_count; ++i) {
+        ZX_ASSERT(zx_object_wait_one(processes[i], ZX_TASK_TERMINATED, ZX_TIME_INFINITE,
+                                     nullptr) == ZX_OK);
+        zx_handle_close(processes[i]);
+    }
+    return true;
+}
+
 void RegisterTests() {
     perftest::RegisterTest("HandleCreate_Channel", ChannelCreateTest);
     perftest::RegisterTest("HandleCreate_Event", EventCreateTest);
@@ -135,7 +216,26 @@ void RegisterTests() {
     perftest::RegisterTest("HandleCreate_Process", ProcessCreateTest);
     perftest::RegisterTest("HandleCreate_Thread", ThreadCreateTest);
     perftest::RegisterTest("HandleCreate_Vmo", VmoCreateTest);
+
+    static const uint32_t kProcessCounts[] = {0, 1, 3, 7, 15};
+    for (auto process_count : kProcessCounts) {
+        auto name = fbl::StringPrintf("HandleDuplicate/%uprocesses", process_count);
+        perftest::RegisterTest(name.c_str(), HandleDuplicateTest, process_count);
+    }
 }
 PERFTEST_CTOR(RegisterTests);
 
 }  // namespace
+
+bool MaybeRunHandleChurn(int argc, char** argv, int* exit_code) {
+    g_self_path = argv[0];
+    if (argc != 2 || strcmp(argv[1], kChurnArg) != 0) {
+        return false;
+    }
+
+    zx_handle_t channel = zx_take_startup_handle(PA_HND(PA_USER0, 0));
+    ZX_ASSERT(channel != ZX_HANDLE_INVALID);
+    ChurnLoop(channel);
+    *exit_code = 0;
+    return true;
+}
@@ -0,0 +1,10 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+// If |argv| asks for the background process used by the HandleDuplicate
+// tests, runs it, sets |exit_code| and returns true.  Otherwise returns false
+// so that main() can run the tests.
+bool MaybeRunHandleChurn(int argc, char** argv, int* exit_code);
@@ -4,7 +4,11 @@
 
 #include <threads.h>
 
+#include <fbl/atomic.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
 #include <perftest/perftest.h>
+#include <zircon/syscalls.h>
 
 namespace {
 
@@ -24,8 +28,73 @@ bool MutexLockUnlockTest(perftest::RepeatState* state) {
     return true;
 }
 
+// Futexes used by the contention tests, each on its own cache line so that
+// threads using different futexes do not contend in the memory system.
+struct alignas(64) PaddedFutex {
+    zx_futex_t value;
+};
+
+struct FutexHammerArgs {
+    zx_futex_t* futex;
+    fbl::atomic<bool>* stop;
+};
+
+// Issues futex syscalls that each take the kernel's lock for |futex| but
+// never block: a wake with no waiters and a wait whose value check fails.
+void FutexOps(zx_futex_t* futex) {
+    ZX_ASSERT(zx_futex_wake(futex, 1) == ZX_OK);
+    ZX_ASSERT(zx_futex_wait(futex, *futex + 1, ZX_HANDLE_INVALID, ZX_TIME_INFINITE) ==
+              ZX_ERR_BAD_STATE);
+}
+
+int FutexHammerThread(void* arg) {
+    auto* args = static_cast<FutexHammerArgs*>(arg);
+    while (!args->stop->load()) {
+        FutexOps(args->futex);
+    }
+    return 0;
+}
+
+// Measure the time taken by futex operations on one futex while
+// |thread_count| other threads of the same process run futex operations
+// concurrently.  If |shared| is false, every thread uses its own futex, so
+// the time should not grow with |thread_count| unless unrelated futexes
+// contend on a kernel lock.  If |shared| is true, all threads use the same
+// futex, which gives the fully contended time for comparison.
+bool FutexContentionTest(perftest::RepeatState* state, uint32_t thread_count, bool shared) {
+    fbl::unique_ptr<PaddedFutex[]> futexes(new PaddedFutex[thread_count + 1]());
+    fbl::unique_ptr<FutexHammerArgs[]> args(new FutexHammerArgs[thread_count]);
+    fbl::unique_ptr<thrd_t[]> threads(new thrd_t[thread_count]);
+    fbl::atomic<bool> stop(false);
+
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        args[i].futex = &futexes[shared ? 0 : i + 1].value;
+        args[i].stop = &stop;
+        ZX_ASSERT(thrd_create(&threads[i], FutexHammerThread, &args[i]) == thrd_success);
+    }
+
+    while (state->KeepRunning()) {
+        FutexOps(&futexes[0].value);
+    }
+
+    stop.store(true);
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        ZX_ASSERT(thrd_join(threads[i], nullptr) == thrd_success);
+    }
+    return true;
+}
+
 void RegisterTests() {
     perftest::RegisterTest("MutexLockUnlock", MutexLockUnlockTest);
+
+    static const uint32_t kThreadCounts[] = {0, 1, 3, 7, 15};
+    for (auto thread_count : kThreadCounts) {
+        auto name = fbl::StringPrintf("FutexContention/SeparateFutexes/%uthreads",
+                                      thread_count);
+        perftest::RegisterTest(name.c_str(), FutexContentionTest, thread_count, false);
+        name = fbl::StringPrintf("FutexContention/SharedFutex/%uthreads", thread_count);
+        perftest::RegisterTest(name.c_str(), FutexContentionTest, thread_count, true);
+    }
 }
 PERFTEST_CTOR(RegisterTests);
 
@@ -0,0 +1,80 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <lib/zx/port.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+namespace {
+
+// Queues |packet_count| user packets on a port, then dequeues them all with
+// one zx_port_wait() call per packet.  The "dequeue" step is the cost of
+// delivering |packet_count| events to an event loop one at a time.
+bool PortWaitTest(perftest::RepeatState* state, uint32_t packet_count) {
+    state->DeclareStep("queue");
+    state->DeclareStep("dequeue");
+
+    zx::port port;
+    ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+
+    zx_port_packet_t packet = {};
+    packet.type = ZX_PKT_TYPE_USER;
+
+    while (state->KeepRunning()) {
+        for (uint32_t i = 0; i < packet_count; ++i) {
+            ZX_ASSERT(port.queue(&packet) == ZX_OK);
+        }
+        state->NextStep();
+        for (uint32_t i = 0; i < packet_count; ++i) {
+            ZX_ASSERT(port.wait(zx::time(), &packet) == ZX_OK);
+        }
+    }
+    return true;
+}
+
+// Same as PortWaitTest, but dequeues the packets with zx_port_wait_many()
+// in batches of up to |batch_size|.
+bool PortWaitManyTest(perftest::RepeatState* state, uint32_t packet_count,
+                      uint32_t batch_size) {
+    state->DeclareStep("queue");
+    state->DeclareStep("dequeue");
+
+    zx::port port;
+    ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+
+    zx_port_packet_t packet = {};
+    packet.type = ZX_PKT_TYPE_USER;
+    fbl::unique_ptr<zx_port_packet_t[]> packets(new zx_port_packet_t[batch_size]);
+
+    while (state->KeepRunning()) {
+        for (uint32_t i = 0; i < packet_count; ++i) {
+            ZX_ASSERT(port.queue(&packet) == ZX_OK);
+        }
+        state->NextStep();
+        for (uint32_t received = 0; received < packet_count;) {
+            size_t actual;
+            ZX_ASSERT(port.wait_many(zx::time(), packets.get(), batch_size, &actual) == ZX_OK);
+            received += static_cast<uint32_t>(actual);
+        }
+    }
+    return true;
+}
+
+void RegisterTests() {
+    for (uint32_t packet_count : {1, 16, 256}) {
+        auto name = fbl::StringPrintf("Port/Wait/%uPackets", packet_count);
+        perftest::RegisterTest(name.c_str(), PortWaitTest, packet_count);
+
+        for (uint32_t batch_size : {16, 64}) {
+            auto name = fbl::StringPrintf("Port/WaitMany/%uPackets/Batch%u", packet_count,
+                                          batch_size);
+            perftest::RegisterTest(name.c_str(), PortWaitManyTest, packet_count, batch_size);
+        }
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+} // namespace
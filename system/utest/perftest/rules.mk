@@ -10,17 +10,22 @@ MODULE_TYPE := usertest
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/clock-test.cpp \
+    $(LOCAL_DIR)/context-switch-test.cpp \
     $(LOCAL_DIR)/handle-creation-test.cpp \
     $(LOCAL_DIR)/malloc-test.cpp \
     $(LOCAL_DIR)/memcpy-test.cpp \
     $(LOCAL_DIR)/mutex-test.cpp \
     $(LOCAL_DIR)/null-test.cpp \
+    $(LOCAL_DIR)/port-test.cpp \
     $(LOCAL_DIR)/process-test.cpp \
     $(LOCAL_DIR)/results-test.cpp \
     $(LOCAL_DIR)/runner-test.cpp \
     $(LOCAL_DIR)/sleep-test.cpp \
+    $(LOCAL_DIR)/socket-test.cpp \
     $(LOCAL_DIR)/syscalls-test.cpp \
     $(LOCAL_DIR)/timer-test.cpp \
+    $(LOCAL_DIR)/vmar-test.cpp \
+    $(LOCAL_DIR)/wakeup-test.cpp \
 
 MODULE_NAME := perf-test
 
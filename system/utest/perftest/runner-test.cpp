@@ -11,6 +11,9 @@
 
 #include <utility>
 
+#include "context-switch-test.h"
+#include "handle-creation-test.h"
+
 // This is a helper for creating a FILE* that we can redirect output to, in
 // order to make the tests below less noisy.  We don't look at the output
 // that is sent to the stream.
@@ -336,5 +339,12 @@ RUN_TEST(TestParsingCommandArgs)
 END_TEST_CASE(perftest_runner_test)
 
 int main(int argc, char** argv) {
+    int exit_code;
+    if (MaybeRunContextSwitchEcho(argc, argv, &exit_code)) {
+        return exit_code;
+    }
+    if (MaybeRunHandleChurn(argc, argv, &exit_code)) {
+        return exit_code;
+    }
     return perftest::PerfTestMain(argc, argv, "fuchsia.zircon.perf_test");
 }
@@ -0,0 +1,148 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <lib/zx/socket.h>
+#include <lib/zx/vmar.h>
+#include <lib/zx/vmo.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+namespace {
+
+// Measures moving |chunk_size| bytes through a stream socket with
+// zx_socket_write() and zx_socket_read().  Chunks larger than the socket's
+// buffer are moved in pieces, alternating writes and reads on one thread, so
+// the result is the copying and syscall cost without any context switches.
+bool ReadWriteTest(perftest::RepeatState* state, size_t chunk_size, uint32_t options) {
+    state->SetBytesProcessedPerRun(chunk_size);
+
+    zx::socket sockets[2];
+    ZX_ASSERT(zx::socket::create(options, &sockets[0], &sockets[1]) == ZX_OK);
+
+    fbl::unique_ptr<char[]> src(new char[chunk_size]);
+    fbl::unique_ptr<char[]> dest(new char[chunk_size]);
+    memset(src.get(), 0, chunk_size);
+
+    while (state->KeepRunning()) {
+        size_t written = 0;
+        size_t read = 0;
+        while (read < chunk_size) {
+            if (written < chunk_size) {
+                size_t actual;
+                ZX_ASSERT(sockets[0].write(0, src.get() + written, chunk_size - written,
+                                           &actual) == ZX_OK);
+                written += actual;
+            }
+            size_t actual;
+            ZX_ASSERT(sockets[1].read(0, dest.get() + read, chunk_size - read,
+                                      &actual) == ZX_OK);
+            read += actual;
+        }
+    }
+    return true;
+}
+
+// Maps one of the rings of |socket| and returns its address.
+uintptr_t MapRing(const zx::socket& socket, uint32_t options, zx_vm_option_t perms) {
+    zx::vmo vmo;
+    ZX_ASSERT(socket.ring_vmo(options, &vmo) == ZX_OK);
+    uint64_t size;
+    ZX_ASSERT(vmo.get_size(&size) == ZX_OK);
+    uintptr_t addr;
+    ZX_ASSERT(zx::vmar::root_self()->map(0, vmo, 0, size, perms, &addr) == ZX_OK);
+    return addr;
+}
+
+// Copies |len| bytes between a linear buffer and the ring at |ring_addr|,
+// starting at stream offset |offset|.
+void CopyToRing(uintptr_t ring_addr, uint64_t ring_size, uint64_t offset,
+                const char* src, size_t len) {
+    while (len > 0) {
+        const size_t ring_offset = offset & (ring_size - 1);
+        const size_t copy_len = fbl::min(len, static_cast<size_t>(ring_size - ring_offset));
+        memcpy(reinterpret_cast<char*>(ring_addr + ring_offset), src, copy_len);
+        offset += copy_len;
+        src += copy_len;
+        len -= copy_len;
+    }
+}
+
+void CopyFromRing(uintptr_t ring_addr, uint64_t ring_size, uint64_t offset,
+                  char* dest, size_t len) {
+    while (len > 0) {
+        const size_t ring_offset = offset & (ring_size - 1);
+        const size_t copy_len = fbl::min(len, static_cast<size_t>(ring_size - ring_offset));
+        memcpy(dest, reinterpret_cast<const char*>(ring_addr + ring_offset), copy_len);
+        offset += copy_len;
+        dest += copy_len;
+        len -= copy_len;
+    }
+}
+
+// Same as ReadWriteTest(), but both ends copy through their own mappings of
+// the rings of a ZX_SOCKET_SHARED_RING socket and only tell the kernel how
+// far they got with zx_socket_ring_advance().
+bool MappedRingTest(perftest::RepeatState* state, size_t chunk_size) {
+    state->SetBytesProcessedPerRun(chunk_size);
+
+    zx::socket sockets[2];
+    ZX_ASSERT(zx::socket::create(ZX_SOCKET_SHARED_RING, &sockets[0], &sockets[1]) == ZX_OK);
+    const uintptr_t tx_addr = MapRing(sockets[0], ZX_SOCKET_RING_TX,
+                                      ZX_VM_PERM_READ | ZX_VM_PERM_WRITE);
+    const uintptr_t rx_addr = MapRing(sockets[1], ZX_SOCKET_RING_RX, ZX_VM_PERM_READ);
+
+    zx_socket_ring_state_t ring;
+    ZX_ASSERT(sockets[0].ring_advance(ZX_SOCKET_RING_TX, 0, &ring) == ZX_OK);
+
+    fbl::unique_ptr<char[]> src(new char[chunk_size]);
+    fbl::unique_ptr<char[]> dest(new char[chunk_size]);
+    memset(src.get(), 0, chunk_size);
+
+    while (state->KeepRunning()) {
+        size_t written = 0;
+        size_t read = 0;
+        while (read < chunk_size) {
+            const size_t space = static_cast<size_t>(ring.size - (ring.tail - ring.head));
+            const size_t write_len = fbl::min(chunk_size - written, space);
+            CopyToRing(tx_addr, ring.size, ring.tail, src.get() + written, write_len);
+            ZX_ASSERT(sockets[0].ring_advance(ZX_SOCKET_RING_TX, write_len, &ring) == ZX_OK);
+            written += write_len;
+
+            const size_t read_len = static_cast<size_t>(ring.tail - ring.head);
+            CopyFromRing(rx_addr, ring.size, ring.head, dest.get() + read, read_len);
+            ZX_ASSERT(sockets[1].ring_advance(ZX_SOCKET_RING_RX, read_len, &ring) == ZX_OK);
+            read += read_len;
+        }
+    }
+
+    ZX_ASSERT(zx::vmar::root_self()->unmap(tx_addr, ring.size) == ZX_OK);
+    ZX_ASSERT(zx::vmar::root_self()->unmap(rx_addr, ring.size) == ZX_OK);
+    return true;
+}
+
+void RegisterTests() {
+    static const size_t kChunkSizes[] = {
+        1024,
+        16 * 1024,
+        128 * 1024,
+        1024 * 1024,
+    };
+    for (auto chunk_size : kChunkSizes) {
+        auto name = fbl::StringPrintf("Socket/Stream/%zubytes", chunk_size);
+        perftest::RegisterTest(name.c_str(), ReadWriteTest, chunk_size, 0u);
+        name = fbl::StringPrintf("Socket/SharedRing/%zubytes", chunk_size);
+        perftest::RegisterTest(name.c_str(), ReadWriteTest, chunk_size,
+                               static_cast<uint32_t>(ZX_SOCKET_SHARED_RING));
+        name = fbl::StringPrintf("Socket/MappedRing/%zubytes", chunk_size);
+        perftest::RegisterTest(name.c_str(), MappedRingTest, chunk_size);
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+} // namespace
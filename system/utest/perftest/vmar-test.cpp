@@ -0,0 +1,67 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <limits.h>
+
+#include <fbl/string_printf.h>
+#include <lib/zx/vmar.h>
+#include <lib/zx/vmo.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+namespace {
+
+// Writes one byte to every page of [addr, addr + size).
+void TouchPages(uintptr_t addr, size_t size) {
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        *reinterpret_cast<volatile uint8_t*>(addr + offset) = 1;
+    }
+}
+
+// Measures writing to every page of a fresh mapping, with or without first
+// committing it with zx_vmar_op_range().  Without the commit each page takes
+// a fault; the "touch" step shows the cost a request path avoids by
+// populating its working set ahead of time.
+bool TouchTest(perftest::RepeatState* state, size_t page_count, bool commit) {
+    const size_t size = page_count * PAGE_SIZE;
+    state->DeclareStep("map");
+    if (commit) {
+        state->DeclareStep("commit");
+    }
+    state->DeclareStep("touch");
+    state->DeclareStep("unmap");
+
+    while (state->KeepRunning()) {
+        zx::vmo vmo;
+        ZX_ASSERT(zx::vmo::create(size, 0, &vmo) == ZX_OK);
+        uintptr_t addr;
+        ZX_ASSERT(zx::vmar::root_self()->map(0, vmo, 0, size,
+                                             ZX_VM_PERM_READ | ZX_VM_PERM_WRITE,
+                                             &addr) == ZX_OK);
+        state->NextStep();
+
+        if (commit) {
+            ZX_ASSERT(zx::vmar::root_self()->op_range(ZX_VMAR_OP_COMMIT, addr, size) == ZX_OK);
+            state->NextStep();
+        }
+
+        TouchPages(addr, size);
+        state->NextStep();
+
+        ZX_ASSERT(zx::vmar::root_self()->unmap(addr, size) == ZX_OK);
+    }
+    return true;
+}
+
+void RegisterTests() {
+    for (size_t page_count : {1, 64, 1024}) {
+        auto name = fbl::StringPrintf("Vmar/Touch/%zupages", page_count);
+        perftest::RegisterTest(name.c_str(), TouchTest, page_count, false);
+        name = fbl::StringPrintf("Vmar/CommitAndTouch/%zupages", page_count);
+        perftest::RegisterTest(name.c_str(), TouchTest, page_count, true);
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+} // namespace
@@ -0,0 +1,90 @@
+// Copyright 2019 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <fbl/atomic.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/syscalls.h>
+
+namespace {
+
+struct WakeupStormState {
+    // Incremented to wake every waiting thread for another round.
+    fbl::atomic<zx_futex_t> generation{0};
+    // Number of threads yet to finish the current round.
+    fbl::atomic<zx_futex_t> remaining{0};
+    fbl::atomic<bool> stop{false};
+};
+
+int WakeupStormThread(void* arg) {
+    auto* state = static_cast<WakeupStormState*>(arg);
+    zx_futex_t seen = 0;
+    for (;;) {
+        while (state->generation.load() == seen) {
+            zx_status_t status = zx_futex_wait(
+                reinterpret_cast<zx_futex_t*>(&state->generation), seen,
+                ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+            ZX_ASSERT(status == ZX_OK || status == ZX_ERR_BAD_STATE);
+        }
+        seen = state->generation.load();
+        if (state->stop.load()) {
+            return 0;
+        }
+        if (state->remaining.fetch_sub(1) == 1) {
+            ZX_ASSERT(zx_futex_wake(reinterpret_cast<zx_futex_t*>(&state->remaining), 1) ==
+                      ZX_OK);
+        }
+    }
+}
+
+// Measure the time taken to wake |thread_count| threads blocked on one futex
+// and for all of them to run.  Every round wakes all the threads at once, so
+// this mostly measures how well the scheduler spreads a burst of wakeups over
+// the cpus and how much the cpus contend while doing so.
+bool WakeupStormTest(perftest::RepeatState* state, uint32_t thread_count) {
+    WakeupStormState storm;
+    fbl::unique_ptr<thrd_t[]> threads(new thrd_t[thread_count]);
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        ZX_ASSERT(thrd_create(&threads[i], WakeupStormThread, &storm) == thrd_success);
+    }
+
+    while (state->KeepRunning()) {
+        storm.remaining.store(thread_count);
+        storm.generation.fetch_add(1);
+        ZX_ASSERT(zx_futex_wake(reinterpret_cast<zx_futex_t*>(&storm.generation),
+                                UINT32_MAX) == ZX_OK);
+
+        zx_futex_t remaining;
+        while ((remaining = storm.remaining.load()) != 0) {
+            zx_status_t status = zx_futex_wait(
+                reinterpret_cast<zx_futex_t*>(&storm.remaining), remaining,
+                ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+            ZX_ASSERT(status == ZX_OK || status == ZX_ERR_BAD_STATE);
+        }
+    }
+
+    storm.stop.store(true);
+    storm.generation.fetch_add(1);
+    ZX_ASSERT(zx_futex_wake(reinterpret_cast<zx_futex_t*>(&storm.generation), UINT32_MAX) ==
+              ZX_OK);
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        ZX_ASSERT(thrd_join(threads[i], nullptr) == thrd_success);
+    }
+    return true;
+}
+
+void RegisterTests() {
+    static const uint32_t kThreadCounts[] = {1, 4, 16, 64};
+    for (auto thread_count : kThreadCounts) {
+        auto name = fbl::StringPrintf("WakeupStorm/%uthreads", thread_count);
+        perftest::RegisterTest(name.c_str(), WakeupStormTest, thread_count);
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace